@@ -0,0 +1,194 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+/*
+ * Aardvark I2C HAL with multiplexer support for the collector
+ *
+ * Every SPS30 has the same I2C address, so multiple sensors are attached through
+ * TCA9548A/PCA9548A 8-channel multiplexers at consecutive addresses starting at
+ * I2C_MUX_BASE_ADDRESS. Bus index N selects channel (N % 8) of multiplexer (N / 8).
+ * Set I2C_MUX_COUNT to 0 when a single sensor is wired directly to the adapter.
+ *
+ * Unlike the data collection HAL, transfers are not printed: the collector issues
+ * thousands of transfers per second.
+ */
+
+#include "sensirion_arch_config.h"
+#include "sensirion_common.h"
+#include "sensirion_i2c.h"
+#include <aardvark.h>
+#include <assert.h>
+#include <unistd.h>
+
+#ifndef I2C_MUX_COUNT
+	#define I2C_MUX_COUNT 8
+#endif
+#define I2C_MUX_BASE_ADDRESS 0x70
+#define I2C_MUX_CHANNELS 8
+
+static Aardvark handle_ = 0;
+static AardvarkConfig mode_ = AA_CONFIG_SPI_I2C;
+static int selected_mux_ = -1;
+static int selected_channel_ = -1;
+
+static void aardvark_initialize()
+{
+	uint16_t devices;
+	int devices_found;
+	// Find the port instead of using the hard-wired one
+	devices_found = aa_find_devices(1, &devices);
+	assert(devices_found);
+	assert(false == (AA_PORT_NOT_FREE & devices)); // Otherwise port is in uses
+	handle_ = aa_open(devices);
+	assert(handle_ > 0); // could not find aardvark device
+
+	// Configure for I2C support
+	aa_configure(handle_, mode_);
+
+	// Enable target power
+	aa_target_power(handle_, AA_TARGET_POWER_BOTH);
+}
+
+static void aardvark_shutdown()
+{
+	aa_close(handle_);
+	handle_ = 0;
+}
+
+static int16_t mux_write(int mux, uint8_t channel_mask)
+{
+	uint16_t num_written;
+	int r = aa_i2c_write_ext(handle_, (uint16_t)(I2C_MUX_BASE_ADDRESS + mux), AA_I2C_NO_FLAGS, 1,
+							 &channel_mask, &num_written);
+	return (r == AA_I2C_STATUS_OK && num_written == 1) ? NO_ERROR : (int16_t)-1;
+}
+
+/**
+ * Select the current i2c bus by index.
+ * All following i2c operations will be directed at that bus.
+ *
+ * @param bus_idx   Bus index to select
+ * @returns         0 on success, an error code otherwise
+ */
+int16_t sensirion_i2c_select_bus(uint8_t bus_idx)
+{
+#if I2C_MUX_COUNT == 0
+	return bus_idx == 0 ? NO_ERROR : (int16_t)-1;
+#else
+	const int mux = bus_idx / I2C_MUX_CHANNELS;
+	const int channel = bus_idx % I2C_MUX_CHANNELS;
+
+	if(mux >= I2C_MUX_COUNT)
+	{
+		return -1;
+	}
+
+	if(mux == selected_mux_ && channel == selected_channel_)
+	{
+		return NO_ERROR;
+	}
+
+	// Disconnect the previous multiplexer, otherwise two sensors answer at the same address
+	if(selected_mux_ >= 0 && selected_mux_ != mux)
+	{
+		(void)mux_write(selected_mux_, 0);
+	}
+
+	selected_mux_ = -1;
+	if(mux_write(mux, (uint8_t)(1u << channel)) != NO_ERROR)
+	{
+		return -1;
+	}
+
+	selected_mux_ = mux;
+	selected_channel_ = channel;
+	return NO_ERROR;
+#endif
+}
+
+/**
+ * Initialize all hard- and software components that are needed for the I2C
+ * communication.
+ */
+void sensirion_i2c_init(void)
+{
+	aardvark_initialize();
+	selected_mux_ = -1;
+	selected_channel_ = -1;
+}
+
+/**
+ * Release all resources initialized by sensirion_i2c_init().
+ */
+void sensirion_i2c_release(void)
+{
+	aardvark_shutdown();
+}
+
+/**
+ * Execute one read transaction on the I2C bus, reading a given number of bytes.
+ * If the device does not acknowledge the read command, an error shall be
+ * returned.
+ *
+ * @param address 7-bit I2C address to read from
+ * @param data    pointer to the buffer where the data is to be stored
+ * @param count   number of bytes to read from I2C and store in the buffer
+ * @returns 0 on success, error code otherwise
+ */
+int8_t sensirion_i2c_read(uint8_t address, uint8_t* data, uint16_t count)
+{
+	uint16_t num_read;
+
+	int r = aa_i2c_read_ext(handle_, address, AA_I2C_NO_FLAGS, count, data, &num_read);
+	if(r == AA_I2C_STATUS_OK && num_read != count)
+	{
+		return -1;
+	}
+
+	return (int8_t)r;
+}
+
+/**
+ * Execute one write transaction on the I2C bus, sending a given number of
+ * bytes. The bytes in the supplied buffer must be sent to the given address. If
+ * the slave device does not acknowledge any of the bytes, an error shall be
+ * returned.
+ *
+ * @param address 7-bit I2C address to write to
+ * @param data    pointer to the buffer containing the data to write
+ * @param count   number of bytes to read from the buffer and send over I2C
+ * @returns 0 on success, error code otherwise
+ */
+int8_t sensirion_i2c_write(uint8_t address, const uint8_t* data, uint16_t count)
+{
+	uint16_t num_written;
+
+	int r = aa_i2c_write_ext(handle_, address, AA_I2C_NO_FLAGS, count, data, &num_written);
+	if(r == AA_I2C_STATUS_OK && num_written != count)
+	{
+		return -1;
+	}
+
+	return (int8_t)r;
+}
+
+/**
+ * Sleep for a given number of microseconds. The function should delay the
+ * execution for at least the given time, but may also sleep longer.
+ *
+ * Despite the unit, a <10 millisecond precision is sufficient.
+ *
+ * @param useconds the sleep time in microseconds
+ */
+void sensirion_sleep_usec(uint32_t useconds)
+{
+	usleep(useconds);
+}
+
+/* The Aardvark API issues one transfer per call, so messages are not chained */
+int16_t sensirion_i2c_transfer(const struct sensirion_i2c_msg* msgs, uint16_t count)
+{
+	return sensirion_i2c_transfer_sequential(msgs, count);
+}
@@ -0,0 +1,417 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+/*
+ * Simulated I2C HAL for the collector
+ *
+ * Every bus index hosts a simulated SPS30 that answers from data recorded on real devices.
+ * Each sensor cycles through the recorded measurements, starting at a different offset.
+ * By default, devices respond immediately, and sensirion_sleep_usec() does not sleep, so
+ * the collector's own cost can be measured with hundreds of sensors.
+ *
+ * Sensors start idle, unless SPS30_SIMULATED_MEASURING is set in the environment, which
+ * simulates sensors left measuring by a previous collector run.
+ *
+ * If SPS30_SIMULATED_I2C_HZ is set, e.g., to 100000, each transfer (and each change of
+ * multiplexer channel) takes as long as it would on a bus at that clock rate, and
+ * sensirion_sleep_usec() sleeps, so bring-up times can be measured. Sensors are then also
+ * busy after commands with a datasheet delay, and do not acknowledge until they are ready.
+ * They are ready well within the datasheet delays, a little later on every fourth bus,
+ * like a fleet of healthy units.
+ *
+ * The selected bus is kept per thread, so different threads can address different sensors
+ * concurrently, as with one thread per physical bus.
+ *
+ * Like real units, sensors do not acknowledge arguments whose CRC does not match, and read
+ * back the auto cleaning interval they were last written.
+ *
+ * Sensors report firmware 2.2, unless a test sets another version with
+ * sps30_simulated_i2c_set_firmware(). Tests can make individual sensors misbehave with
+ * sps30_simulated_i2c_set_fault(), and check how the bus was used with
+ * sps30_simulated_i2c_get_counters().
+ */
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime, nanosleep
+
+#include "sensirion_arch_config.h"
+#include "sensirion_common.h"
+#include "sensirion_i2c.h"
+#include "sps30.h"
+#include "sps30_commands.h"
+#include "sps30_recorded_data.h"
+#include "sps30_simulated_i2c.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIMULATED_SENSOR_COUNT 256
+
+/* Returned when the simulated device does not acknowledge a transfer */
+#define SIMULATED_I2C_NACK (-1)
+
+/* How long a sensor is busy after commands, before the per-bus spread */
+#define SIMULATED_COMMAND_BUSY_USEC 1200
+#define SIMULATED_START_STOP_BUSY_USEC 5000
+#define SIMULATED_WRITE_FLASH_BUSY_USEC 8000
+#define SIMULATED_RESET_BUSY_USEC 30000
+
+struct simulated_sensor
+{
+	uint16_t command;
+	bool measuring;
+	uint8_t next_measurement;
+	uint64_t busy_until_us;
+	uint8_t autoclean_interval[SENSIRION_FRAME_BYTES(2)];
+	uint8_t firmware_version[SENSIRION_FRAME_BYTES(1)];
+	struct sps30_simulated_fault fault;
+};
+
+static const uint8_t* const measurement_responses_[] = {
+	sps30_measurement_low_particle_response_1, sps30_measurement_low_particle_response_2,
+	sps30_measurement_low_particle_response_3, sps30_measurement_mid_particle_response_1,
+	sps30_measurement_mid_particle_response_2, sps30_measurement_zero_particle_response,
+};
+
+#define MEASUREMENT_RESPONSE_COUNT \
+	(sizeof(measurement_responses_) / sizeof(measurement_responses_[0]))
+
+static struct simulated_sensor sensors_[SIMULATED_SENSOR_COUNT];
+static _Thread_local uint8_t bus_ = 0;
+static _Thread_local struct sps30_simulated_i2c_counters counters_;
+static uint32_t i2c_hz_ = 0;
+
+static void sleep_ns(uint64_t ns)
+{
+	struct timespec duration = {
+		.tv_sec = (time_t)(ns / 1000000000u),
+		.tv_nsec = (long)(ns % 1000000000u),
+	};
+	while(nanosleep(&duration, &duration) != 0)
+	{
+	}
+}
+
+/* The bus time of a transfer: the address and data bytes, each with an acknowledge bit */
+static uint64_t transfer_ns(uint16_t count)
+{
+	return i2c_hz_ ? (uint64_t)(count + 1u) * 9u * 1000000000u / i2c_hz_ : 0;
+}
+
+static void simulate_transfer(uint16_t count)
+{
+	if(i2c_hz_)
+	{
+		sleep_ns(transfer_ns(count));
+	}
+}
+
+static uint64_t monotonic_us(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}
+
+static bool busy(const struct simulated_sensor* sensor)
+{
+	return i2c_hz_ && monotonic_us() < sensor->busy_until_us;
+}
+
+/* Make the sensor busy after a command, if the command has a datasheet delay */
+static void start_command(struct simulated_sensor* sensor, uint16_t count)
+{
+	uint32_t busy_us;
+
+	switch(sensor->command)
+	{
+		case SPS30_OPCODE_START_MEASUREMENT:
+		case SPS30_OPCODE_STOP_MEASUREMENT:
+			busy_us = SIMULATED_START_STOP_BUSY_USEC;
+			break;
+		case SPS30_OPCODE_AUTOCLEAN_INTERVAL:
+			// With arguments, the interval is written to flash
+			busy_us = count > SENSIRION_COMMAND_SIZE ? SIMULATED_WRITE_FLASH_BUSY_USEC
+													 : SIMULATED_COMMAND_BUSY_USEC;
+			break;
+		case SPS30_OPCODE_RESET:
+			busy_us = SIMULATED_RESET_BUSY_USEC;
+			break;
+		case SPS30_OPCODE_READ_DEVICE_STATUS_REG:
+		case SPS30_OPCODE_SLEEP:
+		case SPS30_OPCODE_WAKE_UP:
+		case SPS30_OPCODE_START_MANUAL_FAN_CLEANING:
+			busy_us = SIMULATED_COMMAND_BUSY_USEC;
+			break;
+		default:
+			return;
+	}
+
+	if(sensor->fault.slow_opcode && sensor->command == sensor->fault.slow_opcode)
+	{
+		sensor->busy_until_us = monotonic_us() + sensor->fault.slow_busy_usec;
+		return;
+	}
+
+	const unsigned bus = (unsigned)(sensor - sensors_);
+	sensor->busy_until_us = monotonic_us() + busy_us + busy_us * (bus % 4) / 4;
+}
+
+int16_t sensirion_i2c_select_bus(uint8_t bus_idx)
+{
+	if(bus_idx != bus_)
+	{
+		simulate_transfer(1);
+	}
+	bus_ = bus_idx;
+	return 0;
+}
+
+void sensirion_i2c_init(void)
+{
+	const bool measuring = getenv("SPS30_SIMULATED_MEASURING") != NULL;
+	const char* i2c_hz = getenv("SPS30_SIMULATED_I2C_HZ");
+
+	i2c_hz_ = i2c_hz ? (uint32_t)strtoul(i2c_hz, NULL, 0) : 0;
+
+	memset(sensors_, 0, sizeof(sensors_));
+	memset(&counters_, 0, sizeof(counters_));
+	for(unsigned i = 0; i < SIMULATED_SENSOR_COUNT; i++)
+	{
+		sensors_[i].measuring = measuring;
+		sensors_[i].next_measurement = (uint8_t)(i % MEASUREMENT_RESPONSE_COUNT);
+		memcpy(sensors_[i].autoclean_interval, sps30_fan_auto_cleaning_interval_response_1,
+			   sizeof(sensors_[i].autoclean_interval));
+		memcpy(sensors_[i].firmware_version, sps30_fw_ver_response,
+			   sizeof(sensors_[i].firmware_version));
+	}
+}
+
+void sps30_simulated_i2c_set_fault(uint8_t bus, const struct sps30_simulated_fault* fault)
+{
+	sensors_[bus].fault = *fault;
+}
+
+void sps30_simulated_i2c_set_firmware(uint8_t bus, uint8_t major, uint8_t minor)
+{
+	uint8_t* const version = sensors_[bus].firmware_version;
+
+	version[0] = major;
+	version[1] = minor;
+	version[2] = sensirion_common_generate_crc(version, SENSIRION_WORD_SIZE);
+}
+
+struct sps30_simulated_i2c_counters sps30_simulated_i2c_get_counters(void)
+{
+	return counters_;
+}
+
+void sensirion_i2c_release(void)
+{
+	// Nothing to release
+}
+
+/* A read, once its bus time has passed */
+static int8_t read_message(uint8_t address, uint8_t* data, uint16_t count)
+{
+	struct simulated_sensor* sensor = &sensors_[bus_];
+	const uint8_t* response;
+	uint16_t response_size;
+
+	if(address != SPS30_I2C_ADDRESS || sensor->fault.absent || sensor->fault.asleep ||
+	   busy(sensor))
+	{
+		return SIMULATED_I2C_NACK;
+	}
+
+	switch(sensor->command)
+	{
+		case SPS30_OPCODE_GET_SERIAL:
+			response = sps30_serial_number_response;
+			response_size = sizeof(sps30_serial_number_response);
+			break;
+		case SPS30_OPCODE_GET_DATA_READY:
+			response =
+				sensor->measuring ? sps30_data_ready_response_2 : sps30_data_ready_response_1;
+			response_size = sizeof(sps30_data_ready_response_1);
+			break;
+		case SPS30_OPCODE_READ_DEVICE_STATUS_REG:
+			response = sps30_device_status_response_1;
+			response_size = sizeof(sps30_device_status_response_1);
+			break;
+		case SPS30_OPCODE_GET_FIRMWARE_VERSION:
+			response = sensor->firmware_version;
+			response_size = sizeof(sensor->firmware_version);
+			break;
+		case SPS30_OPCODE_AUTOCLEAN_INTERVAL:
+			response = sensor->autoclean_interval;
+			response_size = sizeof(sensor->autoclean_interval);
+			break;
+		case SPS30_OPCODE_READ_MEASUREMENT:
+			if(!sensor->measuring)
+			{
+				return SIMULATED_I2C_NACK;
+			}
+			response = measurement_responses_[sensor->next_measurement];
+			response_size = sizeof(sps30_measurement_zero_particle_response);
+			sensor->next_measurement =
+				(uint8_t)((sensor->next_measurement + 1) % MEASUREMENT_RESPONSE_COUNT);
+			break;
+		default:
+			return SIMULATED_I2C_NACK;
+	}
+
+	if(count > response_size)
+	{
+		return SIMULATED_I2C_NACK;
+	}
+
+	memcpy(data, response, count);
+	if(sensor->fault.corrupt_opcode && sensor->command == sensor->fault.corrupt_opcode)
+	{
+		data[count - 1] ^= 0xff;
+	}
+	return NO_ERROR;
+}
+
+/* Whether every argument word of a write is followed by its CRC */
+static bool arguments_valid(const uint8_t* data, uint16_t count)
+{
+	const uint16_t frame_bytes = count - SENSIRION_COMMAND_SIZE;
+
+	if(frame_bytes % SENSIRION_FRAME_BYTES(1))
+	{
+		return false;
+	}
+
+	for(uint16_t i = SENSIRION_COMMAND_SIZE; i < count; i += SENSIRION_FRAME_BYTES(1))
+	{
+		if(sensirion_common_check_crc(&data[i], SENSIRION_WORD_SIZE,
+									  data[i + SENSIRION_WORD_SIZE]) != NO_ERROR)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* A write, once its bus time has passed */
+static int8_t write_message(uint8_t address, const uint8_t* data, uint16_t count)
+{
+	struct simulated_sensor* sensor = &sensors_[bus_];
+
+	if(address != SPS30_I2C_ADDRESS || count < SENSIRION_COMMAND_SIZE || sensor->fault.absent)
+	{
+		return SIMULATED_I2C_NACK;
+	}
+
+	const uint16_t command = (uint16_t)((data[0] << 8) | data[1]);
+	if(sensor->fault.asleep)
+	{
+		// The first wake-up command only wakes up the interface
+		sensor->fault.asleep = command != SPS30_OPCODE_WAKE_UP;
+		return SIMULATED_I2C_NACK;
+	}
+	if((busy(sensor) && command != SPS30_OPCODE_WAKE_UP) ||
+	   (sensor->fault.nack_opcode && command == sensor->fault.nack_opcode) ||
+	   !arguments_valid(data, count))
+	{
+		return SIMULATED_I2C_NACK;
+	}
+
+	sensor->command = command;
+	if(command == SPS30_OPCODE_AUTOCLEAN_INTERVAL &&
+	   count == SENSIRION_COMMAND_SIZE + sizeof(sensor->autoclean_interval))
+	{
+		memcpy(sensor->autoclean_interval, &data[SENSIRION_COMMAND_SIZE],
+			   sizeof(sensor->autoclean_interval));
+	}
+	if(command == SPS30_OPCODE_START_MEASUREMENT)
+	{
+		sensor->measuring = true;
+	}
+	else if(command == SPS30_OPCODE_STOP_MEASUREMENT || command == SPS30_OPCODE_RESET)
+	{
+		sensor->measuring = false;
+	}
+	start_command(sensor, count);
+
+	return NO_ERROR;
+}
+
+/* Count a message, as part of the transfer being counted */
+static void count_message(const uint8_t* rx)
+{
+	counters_.messages++;
+	if(rx && (uintptr_t)rx % SENSIRION_CACHE_LINE_SIZE)
+	{
+		counters_.unaligned_reads++;
+	}
+}
+
+int8_t sensirion_i2c_read(uint8_t address, uint8_t* data, uint16_t count)
+{
+	counters_.transfers++;
+	count_message(data);
+	simulate_transfer(count);
+	return read_message(address, data, count);
+}
+
+int8_t sensirion_i2c_write(uint8_t address, const uint8_t* data, uint16_t count)
+{
+	counters_.transfers++;
+	count_message(NULL);
+	simulate_transfer(count);
+	return write_message(address, data, count);
+}
+
+/*
+ * Messages up to a delay are chained, as one I2C_RDWR ioctl would submit them: their bus
+ * time is slept once, together with the delay, instead of once per message.
+ */
+int16_t sensirion_i2c_transfer(const struct sensirion_i2c_msg* msgs, uint16_t count)
+{
+	uint64_t pending_ns = 0;
+
+	counters_.transfers++;
+	for(uint16_t i = 0; i < count; i++)
+	{
+		const struct sensirion_i2c_msg* msg = &msgs[i];
+
+		count_message((msg->flags & SENSIRION_I2C_MSG_READ) ? msg->rx : NULL);
+		counters_.delay_usec += msg->delay_usec;
+		pending_ns += transfer_ns(msg->count);
+		const int8_t r = (msg->flags & SENSIRION_I2C_MSG_READ)
+							 ? read_message(msg->address, msg->rx, msg->count)
+							 : write_message(msg->address, msg->tx, msg->count);
+		if(r != NO_ERROR && !(msg->flags & SENSIRION_I2C_MSG_IGNORE_NACK))
+		{
+			sleep_ns(pending_ns);
+			return r;
+		}
+
+		if(msg->delay_usec && i2c_hz_)
+		{
+			sleep_ns(pending_ns + (uint64_t)msg->delay_usec * 1000u);
+			pending_ns = 0;
+		}
+	}
+
+	if(pending_ns)
+	{
+		sleep_ns(pending_ns);
+	}
+	return NO_ERROR;
+}
+
+void sensirion_sleep_usec(uint32_t useconds)
+{
+	counters_.delay_usec += useconds;
+	if(i2c_hz_)
+	{
+		sleep_ns((uint64_t)useconds * 1000u);
+	}
+}
@@ -0,0 +1,877 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+/*
+ * Long-running measurement collector
+ *
+ * Probes every configured sensor, starts measurement on each one that responds, and then
+ * samples all of them every period, appending one framed binary record per sample to a
+ * rotating log (see sps30_record_log.h). Each frame's payload is a stored struct
+ * sps30_record (see sps30_record.h). Records are group-committed: one write() and
+ * fdatasync() covers many samples. By default, commits are handed to an asynchronous
+ * writer (io_uring, or a writer thread), so sampling never waits for storage. A sparse
+ * time index is kept next to the log (see sps30_log_index.h), for the sps30_query tool.
+ * Each period's samples are also aggregated across the fleet (see sps30_tick_stats.h) for
+ * the report, with optional per-field alert thresholds. Every sample also updates a quantile
+ * sketch per sensor and field (see sps30_sketch.h); the report merges them into fleet-wide
+ * long-term percentiles.
+ *
+ * Sensor metadata is kept next to the log (see sps30_sensor_table.h). When the collector
+ * restarts, sensors that a previous run left measuring (with -m, or after a crash) are
+ * checked through their status and data-ready registers, and read again without a
+ * stop/start cycle, so there is no settling time and data resumes within one measurement
+ * period.
+ *
+ * The table also caches each sensor's serial number, firmware version, and auto-cleaning
+ * interval by bus. A cached sensor is verified with a single serial number read before it
+ * is started, and its metadata is only read again if the serial number differs (or the
+ * sensor does not answer, e.g., because it is asleep). The other sensors are brought up
+ * together (see sps30_fleet.h): each command's delay is waited out once per group of bus
+ * indices rather than once per sensor, and with -g, groups (e.g., physical I2C buses) are
+ * brought up concurrently. With -C, each new sensor's actual command delays are measured
+ * and kept in the table, so known sensors are reset (-r) and started without waiting out
+ * the datasheet's worst cases.
+ *
+ * Each configured sensor is addressed as an I2C bus index (sensirion_i2c_select_bus()),
+ * since every SPS30 uses the same I2C address. The HAL maps bus indices to hardware,
+ * e.g. channels of an I2C multiplexer.
+ *
+ * Signals:
+ *  - SIGHUP rotates the log
+ *  - SIGUSR1 prints the cost report
+ *  - SIGINT/SIGTERM commit pending records, stop the sensors, print the report, and exit
+ *
+ * All memory is statically allocated, so the footprint does not grow with run time.
+ */
+
+#define _POSIX_C_SOURCE 200809L // clock_nanosleep, sigaction, getopt
+
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sensirion_i2c.h"
+#include "sps30.h"
+#include "sps30_fleet.h"
+#include "sps30_log_index.h"
+#include "sps30_record.h"
+#include "sps30_record_log.h"
+#include "sps30_sensor_table.h"
+#include "sps30_sketch.h"
+#include "sps30_tick_stats.h"
+
+/* One sensor per I2C bus index */
+#define MAX_SENSORS 256
+
+#define LOG_BUFFER_SIZE (256 * 1024)
+
+/* Time from starting measurement to stable readings: 8 s for every concentration range */
+#define SETTLING_TIME_MS 8000
+/* A measuring sensor has data ready once per period, within the datasheet's ±4% */
+#define DATA_READY_WAIT_USEC \
+	(SPS30_MEASUREMENT_DURATION_USEC + SPS30_MEASUREMENT_DURATION_USEC / 25)
+/* Reading the device status costs a 5 ms command delay, so records carry the latest reading */
+#define STATUS_REFRESH_MS 10000
+
+struct collector_config
+{
+	const char* log_path;
+	unsigned sensor_count;
+	unsigned period_ms;
+	unsigned duration_s;
+	uint32_t commit_records;
+	uint32_t commit_interval_ms;
+	uint64_t max_file_bytes;
+	uint8_t keep_files;
+	enum sps30_log_writer_backend writer;
+	uint32_t index_records;
+	float thresholds[SPS30_RECORD_FIELD_COUNT];
+	bool cold_start;
+	bool keep_measuring;
+	unsigned bus_groups;
+	bool calibrate;
+	bool set_autoclean;
+	uint32_t autoclean_interval_s;
+	bool reset;
+};
+
+struct collector_counters
+{
+	uint64_t samples;
+	uint64_t read_errors;
+	uint64_t log_errors;
+	uint64_t overruns;
+	uint64_t ticks;
+	uint64_t tick_ns;
+	uint64_t exceedances[SPS30_RECORD_FIELD_COUNT];
+	struct timespec start;
+};
+
+static volatile sig_atomic_t stop_requested_ = 0;
+static volatile sig_atomic_t rotate_requested_ = 0;
+static volatile sig_atomic_t report_requested_ = 0;
+
+static uint8_t sensors_[MAX_SENSORS];
+static uint64_t sensor_ids_[MAX_SENSORS];
+static uint32_t device_status_[MAX_SENSORS];
+static uint64_t status_read_ms_[MAX_SENSORS];
+static unsigned active_sensor_count_ = 0;
+static uint8_t log_buffer_[LOG_BUFFER_SIZE];
+static struct sps30_record_log log_;
+static struct sps30_log_index_writer index_;
+static bool index_open_ = false;
+
+/* The latest period's samples, one column per field, and their fleet statistics */
+static float tick_columns_[SPS30_RECORD_FIELD_COUNT][MAX_SENSORS];
+static float* const tick_column_pointers_[SPS30_RECORD_FIELD_COUNT] = {
+	tick_columns_[0], tick_columns_[1], tick_columns_[2], tick_columns_[3], tick_columns_[4],
+	tick_columns_[5], tick_columns_[6], tick_columns_[7], tick_columns_[8], tick_columns_[9],
+};
+static uint8_t tick_sensors_[MAX_SENSORS];
+static unsigned tick_count_ = 0;
+static struct sps30_tick_field_stats tick_stats_[SPS30_RECORD_FIELD_COUNT];
+static uint64_t tick_masks_[SPS30_RECORD_FIELD_COUNT * SPS30_TICK_MASK_WORDS(MAX_SENSORS)];
+
+/* Long-term distribution of each active sensor's fields, and their fleet-wide merge */
+static struct sps30_sketch sketches_[MAX_SENSORS][SPS30_RECORD_FIELD_COUNT];
+static struct sps30_sketch fleet_sketch_;
+
+/* Sensor metadata that outlives the process, and when each active sensor has settled */
+static struct sps30_sensor_table table_;
+static uint64_t settled_ms_[MAX_SENSORS];
+static unsigned resumed_sensor_count_ = 0;
+static uint64_t launch_ms_ = 0;
+static uint64_t first_settled_ms_ = 0;
+
+static struct sps30_fleet_report bring_up_;
+
+static void handle_signal(int signal)
+{
+	switch(signal)
+	{
+		case SIGHUP:
+			rotate_requested_ = 1;
+			break;
+		case SIGUSR1:
+			report_requested_ = 1;
+			break;
+		default:
+			stop_requested_ = 1;
+			break;
+	}
+}
+
+static void install_signal_handlers(void)
+{
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = handle_signal;
+	sigemptyset(&action.sa_mask);
+	// No SA_RESTART: the sleep between samples is interrupted so signals are handled promptly
+
+	sigaction(SIGHUP, &action, NULL);
+	sigaction(SIGUSR1, &action, NULL);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+}
+
+static uint64_t realtime_ms(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u;
+}
+
+static double elapsed_s(const struct timespec* since)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - since->tv_sec) + (double)(now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+static void timespec_add_ms(struct timespec* t, unsigned ms)
+{
+	t->tv_sec += ms / 1000;
+	t->tv_nsec += (long)(ms % 1000) * 1000000L;
+	if(t->tv_nsec >= 1000000000L)
+	{
+		t->tv_sec++;
+		t->tv_nsec -= 1000000000L;
+	}
+}
+
+static int timespec_before(const struct timespec* a, const struct timespec* b)
+{
+	return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static void activate_sensor(uint8_t bus, const struct sps30_sensor_table_entry* entry)
+{
+	const unsigned i = active_sensor_count_++;
+
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		sps30_sketch_init(&sketches_[i][f]);
+	}
+	sensor_ids_[i] = entry->sensor_id;
+	sensors_[i] = bus;
+	settled_ms_[i] = entry->started_ms + SETTLING_TIME_MS;
+	device_status_[i] = SPS30_RECORD_STATUS_UNKNOWN;
+	status_read_ms_[i] = 0;
+}
+
+/*
+ * Re-read the device status register of the active sensor i, on the selected bus, once it is
+ * STATUS_REFRESH_MS old. Firmware older than 2.2 has no status register, and is not sent the
+ * command (see sps30_fleet_read_status()), so its records keep SPS30_RECORD_STATUS_UNKNOWN.
+ */
+static void refresh_device_status(unsigned i, uint64_t now_ms)
+{
+	uint32_t status = 0;
+
+	if(status_read_ms_[i] && now_ms - status_read_ms_[i] < STATUS_REFRESH_MS)
+	{
+		return;
+	}
+
+	status_read_ms_[i] = now_ms;
+	device_status_[i] = sps30_fleet_read_status(&table_.entries[sensors_[i]], &status) == 0 ?
+							status & ~SPS30_RECORD_STATUS_UNKNOWN :
+							SPS30_RECORD_STATUS_UNKNOWN;
+}
+
+/*
+ * Whether the sensor on a bus is measuring: 1 if it is, 0 if it has no data ready yet, or
+ * -1 if it does not respond (e.g., asleep or powered off) or reports a fan or laser error
+ */
+static int sensor_measuring(uint8_t bus)
+{
+	const uint32_t errors =
+		SPS30_DEVICE_STATUS_FAN_ERROR_MASK | SPS30_DEVICE_STATUS_LASER_ERROR_MASK;
+	uint32_t status = 0;
+	uint16_t data_ready = 0;
+
+	if(sensirion_i2c_select_bus(bus) != 0 || sps30_read_device_status_register(&status) != 0 ||
+	   (status & errors) || sps30_read_data_ready(&data_ready) != 0)
+	{
+		return -1;
+	}
+
+	return data_ready ? 1 : 0;
+}
+
+/* Resume reading the sensors the table says were left measuring, without restarting them */
+static void resume_sensors(const struct collector_config* config, bool* resumed)
+{
+	uint8_t pending[MAX_SENSORS];
+	unsigned pending_count = 0;
+
+	for(unsigned bus = 0; bus < config->sensor_count; bus++)
+	{
+		if(!(table_.entries[bus].flags & SPS30_SENSOR_TABLE_MEASURING))
+		{
+			continue;
+		}
+
+		const int measuring = sensor_measuring((uint8_t)bus);
+		if(measuring > 0)
+		{
+			activate_sensor((uint8_t)bus, &table_.entries[bus]);
+			resumed[bus] = true;
+		}
+		else if(measuring == 0)
+		{
+			pending[pending_count++] = (uint8_t)bus;
+		}
+	}
+
+	// Sensors that were just read have no data ready; one wait covers all of them
+	if(pending_count)
+	{
+		sensirion_sleep_usec(DATA_READY_WAIT_USEC);
+		for(unsigned i = 0; i < pending_count; i++)
+		{
+			if(sensor_measuring(pending[i]) > 0)
+			{
+				activate_sensor(pending[i], &table_.entries[pending[i]]);
+				resumed[pending[i]] = true;
+			}
+		}
+	}
+
+	resumed_sensor_count_ = active_sensor_count_;
+}
+
+static void probe_sensors(const struct collector_config* config)
+{
+	bool resumed[MAX_SENSORS] = {false};
+
+	const int16_t r = sps30_sensor_table_load(&table_, config->log_path);
+	if(r != 0 && !(r == SPS30_SENSOR_TABLE_ERROR_IO && errno == ENOENT))
+	{
+		printf("ignoring the sensor table of %s (error %d)\n", config->log_path, r);
+	}
+	if(!config->cold_start)
+	{
+		resume_sensors(config, resumed);
+	}
+
+	const struct sps30_fleet_config fleet = {
+		.sensor_count = config->sensor_count,
+		.buses = config->bus_groups,
+		.skip = resumed,
+		.calibrate = config->calibrate,
+		.set_autoclean = config->set_autoclean,
+		.autoclean_interval_s = config->autoclean_interval_s,
+		.reset = config->reset,
+		.start = true,
+	};
+	sps30_fleet_bring_up(&fleet, &table_, &bring_up_);
+
+	for(unsigned bus = 0; bus < config->sensor_count; bus++)
+	{
+		if(bring_up_.started[bus])
+		{
+			activate_sensor((uint8_t)bus, &table_.entries[bus]);
+		}
+		else if(bring_up_.results[bus] == SPS30_FLEET_ABSENT)
+		{
+			printf("sensor %u: probing failed, skipping\n", bus);
+		}
+		else if(bring_up_.results[bus] != SPS30_FLEET_SKIPPED)
+		{
+			printf("sensor %u: error starting measurement, skipping\n", bus);
+		}
+	}
+
+	if(sps30_sensor_table_save(&table_, config->log_path) != 0)
+	{
+		printf("error saving the sensor table of %s: %s\n", config->log_path, strerror(errno));
+	}
+
+	printf("%u of %u sensors measuring, %u resumed without a restart\n", active_sensor_count_,
+		   config->sensor_count, resumed_sensor_count_);
+	printf("brought up %u sensors on %u threads in %.1f ms; %u calibrated, %u fell back to "
+		   "datasheet delays\n",
+		   config->sensor_count - resumed_sensor_count_, bring_up_.threads,
+		   (double)bring_up_.elapsed_ns / 1e6, bring_up_.calibrated, bring_up_.fallbacks);
+}
+
+/* Stop the sensors, unless they are to be resumed by the next run */
+static void stop_sensors(const struct collector_config* config)
+{
+	if(config->keep_measuring)
+	{
+		return;
+	}
+
+	for(unsigned i = 0; i < active_sensor_count_; i++)
+	{
+		if(sensirion_i2c_select_bus(sensors_[i]) == 0)
+		{
+			(void)sps30_stop_measurement();
+		}
+		table_.entries[sensors_[i]].flags &= ~SPS30_SENSOR_TABLE_MEASURING;
+	}
+
+	if(sps30_sensor_table_save(&table_, config->log_path) != 0)
+	{
+		printf("error saving the sensor table of %s: %s\n", config->log_path, strerror(errno));
+	}
+}
+
+/* Read every sensor that has data ready, and append a record for each sample */
+static void sample_sensors(struct collector_counters* counters)
+{
+	uint8_t payload[SPS30_RECORD_SIZE];
+	struct sps30_measurement m;
+	struct sps30_record record;
+
+	tick_count_ = 0;
+
+	for(unsigned i = 0; i < active_sensor_count_; i++)
+	{
+		uint16_t data_ready = 0;
+
+		if(sensirion_i2c_select_bus(sensors_[i]) != 0 || sps30_read_data_ready(&data_ready) != 0)
+		{
+			counters->read_errors++;
+			continue;
+		}
+
+		if(!data_ready)
+		{
+			continue;
+		}
+
+		if(sps30_read_measurement(&m) != 0)
+		{
+			counters->read_errors++;
+			continue;
+		}
+
+		const uint64_t now = realtime_ms();
+		refresh_device_status(i, now);
+		sps30_record_init(&record, sensor_ids_[i], sensors_[i], device_status_[i], now, &m);
+		sps30_record_encode(&record, payload);
+		if(sps30_record_log_append(&log_, payload, sizeof(payload), now) != 0)
+		{
+			counters->log_errors++;
+		}
+		counters->samples++;
+		sps30_sketch_add_fields(sketches_[i], record.values);
+		if(!first_settled_ms_ && now >= settled_ms_[i])
+		{
+			first_settled_ms_ = now;
+		}
+
+		for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+		{
+			tick_columns_[f][tick_count_] = record.values[f];
+		}
+		tick_sensors_[tick_count_++] = sensors_[i];
+	}
+}
+
+/* Fleet statistics and threshold exceedances over this period's samples */
+static void aggregate_tick(const struct collector_config* config,
+						   struct collector_counters* counters)
+{
+	struct timespec start;
+	struct timespec end;
+
+	if(tick_count_ == 0)
+	{
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	sps30_tick_stats((const float* const*)tick_column_pointers_, NULL, tick_count_,
+					 config->thresholds, tick_masks_, tick_stats_);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	counters->ticks++;
+	counters->tick_ns += (uint64_t)((end.tv_sec - start.tv_sec) * 1000000000L +
+									(end.tv_nsec - start.tv_nsec));
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		counters->exceedances[f] += tick_stats_[f].exceedances;
+	}
+}
+
+static void print_tick(const struct collector_config* config,
+					   const struct collector_counters* counters)
+{
+	printf("\tlatest period: %u samples, aggregated in %.2f us on average\n", tick_count_,
+		   counters->ticks ? (double)counters->tick_ns / 1e3 / (double)counters->ticks : 0.0);
+	printf("\t\t%-22s %9s %9s %9s %9s %10s\n", "field", "min", "mean", "max", "stddev",
+		   "exceeded");
+
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		const struct sps30_tick_field_stats* stats = &tick_stats_[f];
+		const uint64_t* mask = &tick_masks_[f * SPS30_TICK_MASK_WORDS(tick_count_)];
+		printf("\t\t%-22s %9.2f %9.2f %9.2f %9.2f %10llu", sps30_record_field_name(f),
+			   (double)stats->min, stats->mean, (double)stats->max, sqrt(stats->variance),
+			   (unsigned long long)counters->exceedances[f]);
+		if(isinf(config->thresholds[f]) || stats->exceedances == 0)
+		{
+			printf("\n");
+			continue;
+		}
+
+		printf("  above %.2f now on buses:", (double)config->thresholds[f]);
+		for(unsigned i = 0; i < tick_count_; i++)
+		{
+			if(mask[i / 64] & (1ull << (i % 64)))
+			{
+				printf(" %u", tick_sensors_[i]);
+			}
+		}
+		printf("\n");
+	}
+}
+
+/* Fleet-wide percentiles since startup, merged from the per-sensor sketches */
+static void print_quantiles(void)
+{
+	struct timespec start;
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	printf("\t\t%-22s %9s %9s %9s\n", "field", "p50", "p95", "p99");
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		sps30_sketch_init(&fleet_sketch_);
+		for(unsigned i = 0; i < active_sensor_count_; i++)
+		{
+			sps30_sketch_merge(&fleet_sketch_, &sketches_[i][f]);
+		}
+
+		printf("\t\t%-22s %9.2f %9.2f %9.2f\n", sps30_record_field_name(f),
+			   (double)sps30_sketch_quantile(&fleet_sketch_, 0.5),
+			   (double)sps30_sketch_quantile(&fleet_sketch_, 0.95),
+			   (double)sps30_sketch_quantile(&fleet_sketch_, 0.99));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("\t\tmerged %u sketches per field (%.0f%% relative error) in %.1f us\n",
+		   active_sensor_count_, SPS30_SKETCH_RELATIVE_ACCURACY * 100,
+		   (double)((end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec)) /
+			   1e3);
+}
+
+static void print_report(const struct collector_config* config,
+						 const struct collector_counters* counters)
+{
+	const struct sps30_record_log_stats* stats = sps30_record_log_get_stats(&log_);
+	const double samples = counters->samples ? (double)counters->samples : 1.0;
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	const double user_us = (double)usage.ru_utime.tv_sec * 1e6 + (double)usage.ru_utime.tv_usec;
+	const double system_us =
+		(double)usage.ru_stime.tv_sec * 1e6 + (double)usage.ru_stime.tv_usec;
+
+	printf("Collector report after %.1f s:\n", elapsed_s(&counters->start));
+	printf("\tsensors: %u, samples: %llu, read errors: %llu, log errors: %llu, overruns: %llu\n",
+		   active_sensor_count_, (unsigned long long)counters->samples,
+		   (unsigned long long)counters->read_errors, (unsigned long long)counters->log_errors,
+		   (unsigned long long)counters->overruns);
+	if(first_settled_ms_)
+	{
+		printf("\tstartup: %u resumed, %u started; first settled sample %.3f s after launch\n",
+			   resumed_sensor_count_, active_sensor_count_ - resumed_sensor_count_,
+			   (double)(first_settled_ms_ - launch_ms_) / 1e3);
+	}
+	else
+	{
+		printf("\tstartup: %u resumed, %u started; no settled sample yet\n",
+			   resumed_sensor_count_, active_sensor_count_ - resumed_sensor_count_);
+	}
+	const unsigned lookups = bring_up_.hits + bring_up_.misses + bring_up_.uncached;
+	printf("\tprobe cache: %u hits, %u misses, %u uncached (%.1f%% hit rate); bring-up took "
+		   "%.1f ms on %u threads\n",
+		   bring_up_.hits, bring_up_.misses, bring_up_.uncached,
+		   lookups ? 100.0 * bring_up_.hits / lookups : 0.0, (double)bring_up_.elapsed_ns / 1e6,
+		   bring_up_.threads);
+	printf("\tCPU per sample: %.2f us user, %.2f us system\n", user_us / samples,
+		   system_us / samples);
+	printf("\tI/O per sample: %.1f bytes, %.3f commits, %.2f us write, %.2f us sync\n",
+		   (double)stats->bytes / samples, (double)stats->commits / samples,
+		   (double)stats->write_ns / 1e3 / samples, (double)stats->sync_ns / 1e3 / samples);
+	printf("\tdropped records: %llu, write errors: %llu\n", (unsigned long long)stats->dropped,
+		   (unsigned long long)stats->write_errors);
+	printf("\tcommits: %llu (%.0f us write + sync each), rotations: %llu, max RSS: %ld KiB\n",
+		   (unsigned long long)stats->commits,
+		   stats->commits ? (double)(stats->write_ns + stats->sync_ns) / 1e3 /
+								(double)stats->commits
+						  : 0.0,
+		   (unsigned long long)stats->rotations, usage.ru_maxrss);
+	if(index_open_)
+	{
+		printf("\tindex blocks: %llu, entries: %llu, skipped frames: %llu, errors: %llu\n",
+			   (unsigned long long)index_.stats.blocks, (unsigned long long)index_.stats.entries,
+			   (unsigned long long)index_.stats.skipped, (unsigned long long)index_.stats.errors);
+	}
+	if(counters->ticks)
+	{
+		print_tick(config, counters);
+		printf("\tlong-term percentiles across all sensors:\n");
+		print_quantiles();
+	}
+}
+
+/* Service signals that arrived since the last call */
+static void handle_requests(const struct collector_config* config,
+							const struct collector_counters* counters)
+{
+	if(rotate_requested_)
+	{
+		rotate_requested_ = 0;
+		if(sps30_record_log_rotate(&log_) != 0)
+		{
+			printf("error rotating log: %s\n", strerror(errno));
+		}
+	}
+
+	if(report_requested_)
+	{
+		report_requested_ = 0;
+		print_report(config, counters);
+	}
+}
+
+static void usage(const char* name)
+{
+	printf("Usage: %s [options]\n"
+		   "\t-n <count>   Sensors to probe, on I2C bus indices 0..count-1 (default: 1)\n"
+		   "\t-o <path>    Log file (default: sps30_collector.log)\n"
+		   "\t-p <ms>      Sampling period (default: 1000)\n"
+		   "\t-d <s>       Run duration, 0 to run until signalled (default: 0)\n"
+		   "\t-b <count>   Commit after this many records (default: 4096)\n"
+		   "\t-i <ms>      Commit records older than this (default: 5000)\n"
+		   "\t-s <MiB>     Rotate the log at this size, 0 to disable (default: 64)\n"
+		   "\t-k <count>   Rotated log files to keep (default: 8)\n"
+		   "\t-w <writer>  sync, thread, io_uring, or async (default: async)\n"
+		   "\t-x <count>   Records per sensor in each index block, 0 to disable (default: 1024)\n"
+		   "\t-e <f>=<v>   Count samples of field f above v, e.g. mc_2p5=35 (repeatable)\n"
+		   "\t-c           Cold start: restart every sensor, even if it was left measuring\n"
+		   "\t-m           Leave the sensors measuring at exit, for the next run to resume\n"
+		   "\t-g <count>   Bring up sensors in this many groups of consecutive bus indices\n"
+		   "\t             concurrently, e.g., one per I2C bus (default: 1)\n"
+		   "\t-C           Calibrate the command delays of sensors without calibrated delays\n"
+		   "\t-a <s>       Set the fan auto-cleaning interval of every sensor brought up\n"
+		   "\t-r           Reset every sensor before starting it\n",
+		   name);
+}
+
+static int parse_writer(const char* name, enum sps30_log_writer_backend* writer)
+{
+	static const struct
+	{
+		const char* name;
+		enum sps30_log_writer_backend backend;
+	} writers[] = {
+		{"sync", SPS30_LOG_WRITER_SYNC},
+		{"thread", SPS30_LOG_WRITER_THREAD},
+		{"io_uring", SPS30_LOG_WRITER_IO_URING},
+		{"async", SPS30_LOG_WRITER_ASYNC},
+	};
+
+	for(size_t i = 0; i < sizeof(writers) / sizeof(writers[0]); i++)
+	{
+		if(strcmp(name, writers[i].name) == 0)
+		{
+			*writer = writers[i].backend;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/* <field>=<threshold> */
+static int parse_threshold(const char* text, float* thresholds)
+{
+	const char* equals = strchr(text, '=');
+	char* end;
+
+	const int field = equals ? sps30_record_field_index(text, (size_t)(equals - text)) : -1;
+	if(field < 0)
+	{
+		return -1;
+	}
+	thresholds[field] = strtof(equals + 1, &end);
+	return *end == '\0' ? 0 : -1;
+}
+
+static int parse_arguments(int argc, char* argv[], struct collector_config* config)
+{
+	int option;
+
+	while((option = getopt(argc, argv, "n:o:p:d:b:i:s:k:w:x:e:cmg:Ca:rh")) != -1)
+	{
+		switch(option)
+		{
+			case 'n':
+				config->sensor_count = (unsigned)strtoul(optarg, NULL, 0);
+				break;
+			case 'o':
+				config->log_path = optarg;
+				break;
+			case 'p':
+				config->period_ms = (unsigned)strtoul(optarg, NULL, 0);
+				break;
+			case 'd':
+				config->duration_s = (unsigned)strtoul(optarg, NULL, 0);
+				break;
+			case 'b':
+				config->commit_records = (uint32_t)strtoul(optarg, NULL, 0);
+				break;
+			case 'i':
+				config->commit_interval_ms = (uint32_t)strtoul(optarg, NULL, 0);
+				break;
+			case 's':
+				config->max_file_bytes = (uint64_t)strtoull(optarg, NULL, 0) << 20;
+				break;
+			case 'k':
+				config->keep_files = (uint8_t)strtoul(optarg, NULL, 0);
+				break;
+			case 'w':
+				if(parse_writer(optarg, &config->writer) != 0)
+				{
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'x':
+				config->index_records = (uint32_t)strtoul(optarg, NULL, 0);
+				break;
+			case 'e':
+				if(parse_threshold(optarg, config->thresholds) != 0)
+				{
+					printf("invalid threshold: %s\n", optarg);
+					return -1;
+				}
+				break;
+			case 'c':
+				config->cold_start = true;
+				break;
+			case 'm':
+				config->keep_measuring = true;
+				break;
+			case 'g':
+				config->bus_groups = (unsigned)strtoul(optarg, NULL, 0);
+				break;
+			case 'C':
+				config->calibrate = true;
+				break;
+			case 'a':
+				config->set_autoclean = true;
+				config->autoclean_interval_s = (uint32_t)strtoul(optarg, NULL, 0);
+				break;
+			case 'r':
+				config->reset = true;
+				break;
+			default:
+				usage(argv[0]);
+				return -1;
+		}
+	}
+
+	if(config->sensor_count == 0 || config->sensor_count > MAX_SENSORS ||
+	   config->period_ms == 0)
+	{
+		printf("Between 1 and %d sensors, and a non-zero period, are required\n", MAX_SENSORS);
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	struct collector_config config = {
+		.log_path = "sps30_collector.log",
+		.sensor_count = 1,
+		.period_ms = 1000,
+		.duration_s = 0,
+		.commit_records = 4096,
+		.commit_interval_ms = 5000,
+		.max_file_bytes = 64u << 20,
+		.keep_files = 8,
+		.writer = SPS30_LOG_WRITER_ASYNC,
+		.index_records = 1024,
+		.bus_groups = 1,
+	};
+	struct collector_counters counters = {0};
+	struct timespec next;
+
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		config.thresholds[f] = INFINITY;
+	}
+
+	if(parse_arguments(argc, argv, &config) != 0)
+	{
+		return EXIT_FAILURE;
+	}
+	launch_ms_ = realtime_ms();
+
+	const struct sps30_record_log_config log_config = {
+		.path = config.log_path,
+		.buffer = log_buffer_,
+		.capacity = sizeof(log_buffer_),
+		.commit_records = config.commit_records,
+		.commit_interval_ms = config.commit_interval_ms,
+		.max_file_bytes = config.max_file_bytes,
+		.keep_files = config.keep_files,
+		.writer = config.writer,
+	};
+
+	if(sps30_record_log_open(&log_, &log_config) != 0)
+	{
+		printf("error opening %s: %s\n", config.log_path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	install_signal_handlers();
+	sensirion_i2c_init();
+	probe_sensors(&config);
+
+	// Blocks hold about index_records samples from each sensor, whatever the sensor count
+	if(config.index_records && active_sensor_count_)
+	{
+		if(sps30_log_index_writer_open(&index_, config.log_path,
+									   config.index_records * active_sensor_count_,
+									   config.keep_files) == 0)
+		{
+			sps30_record_log_set_commit_hook(&log_, sps30_log_index_writer_add, &index_);
+			index_open_ = true;
+		}
+		else
+		{
+			printf("error opening the index of %s, continuing without it: %s\n",
+				   config.log_path, strerror(errno));
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &counters.start);
+	next = counters.start;
+
+	while(!stop_requested_)
+	{
+		sample_sensors(&counters);
+		aggregate_tick(&config, &counters);
+		if(sps30_record_log_poll(&log_, realtime_ms()) != 0)
+		{
+			counters.log_errors++;
+		}
+
+		if(config.duration_s && elapsed_s(&counters.start) >= config.duration_s)
+		{
+			break;
+		}
+
+		// If sampling overran the period, skip ahead rather than issuing a burst of late reads
+		struct timespec now;
+		timespec_add_ms(&next, config.period_ms);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if(timespec_before(&next, &now))
+		{
+			counters.overruns++;
+			next = now;
+		}
+
+		do
+		{
+			handle_requests(&config, &counters);
+		} while(!stop_requested_ &&
+				clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+	}
+
+	if(sps30_record_log_close(&log_) != 0)
+	{
+		printf("error committing log: %s\n", strerror(errno));
+		counters.log_errors++;
+	}
+	if(index_open_ && sps30_log_index_writer_close(&index_) != 0)
+	{
+		printf("error writing the index of %s: %s\n", config.log_path, strerror(errno));
+	}
+
+	stop_sensors(&config);
+	sensirion_i2c_release();
+	print_report(&config, &counters);
+
+	return counters.log_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,640 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include "sps30_fleet.h"
+#include "sensirion_common.h"
+#include "sensirion_i2c.h"
+#include "sps30.h"
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+/* Calibration polls this often, and adds half the measured delay plus this margin */
+#define CALIBRATION_POLL_USEC 100
+#define CALIBRATION_MARGIN_USEC 500
+
+static const uint32_t datasheet_delays_us_[SPS30_DELAY_COUNT] = {
+	[SPS30_DELAY_COMMAND] = SPS30_FLEET_DATASHEET_COMMAND_DELAY_USEC,
+	[SPS30_DELAY_START_STOP] = SPS30_FLEET_DATASHEET_START_STOP_DELAY_USEC,
+	[SPS30_DELAY_WRITE_FLASH] = SPS30_FLEET_DATASHEET_WRITE_FLASH_DELAY_USEC,
+	[SPS30_DELAY_RESET] = SPS30_FLEET_DATASHEET_RESET_DELAY_USEC,
+};
+
+/* The channels of one bus, and what bring-up found on them */
+struct bus_worker
+{
+	const struct sps30_fleet_config* config;
+	struct sps30_sensor_table* table;
+	struct sps30_fleet_report* report;
+	unsigned first;
+	unsigned end;
+	unsigned hits;
+	unsigned misses;
+	unsigned uncached;
+	unsigned absent;
+	unsigned started;
+	unsigned calibrated;
+	unsigned fallbacks;
+	pthread_t thread;
+};
+
+/* Checks whether the selected sensor answers, and stores what it answered in its entry */
+typedef int16_t (*answer_check)(struct sps30_sensor_table_entry* entry);
+
+static uint64_t realtime_ms(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u;
+}
+
+static uint64_t monotonic_us(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}
+
+uint32_t sps30_fleet_delay_us(const struct sps30_sensor_table_entry* entry, unsigned delay)
+{
+	assert(entry && delay < SPS30_DELAY_COUNT);
+
+	return (entry->flags & SPS30_SENSOR_TABLE_CALIBRATED) ? entry->delays_us[delay]
+														  : datasheet_delays_us_[delay];
+}
+
+/* The longest delay needed by any of the channels */
+static uint32_t longest_delay_us(const struct bus_worker* worker, const uint8_t* channels,
+								 unsigned count, unsigned delay)
+{
+	uint32_t longest = 0;
+
+	for(unsigned i = 0; i < count; i++)
+	{
+		const uint32_t d = sps30_fleet_delay_us(&worker->table->entries[channels[i]], delay);
+		longest = d > longest ? d : longest;
+	}
+	return longest;
+}
+
+/*
+ * Wait out the longest delay of the channels, then check that each one answers. Channels
+ * that do not are given the rest of the datasheet delay, and lose their calibration if
+ * they answer then. Returns the channels that answered, in place.
+ */
+static unsigned wait_for_channels(struct bus_worker* worker, uint8_t* channels, unsigned count,
+								  unsigned delay, answer_check check)
+{
+	uint8_t late[SPS30_SENSOR_TABLE_CHANNELS];
+	unsigned late_count = 0;
+	unsigned answered = 0;
+
+	const uint32_t waited_us = longest_delay_us(worker, channels, count, delay);
+	sensirion_sleep_usec(waited_us);
+
+	for(unsigned i = 0; i < count; i++)
+	{
+		if(sensirion_i2c_select_bus(channels[i]) == 0 &&
+		   check(&worker->table->entries[channels[i]]) == NO_ERROR)
+		{
+			channels[answered++] = channels[i];
+		}
+		else
+		{
+			late[late_count++] = channels[i];
+		}
+	}
+
+	if(late_count == 0 || waited_us >= datasheet_delays_us_[delay])
+	{
+		return answered;
+	}
+
+	sensirion_sleep_usec(datasheet_delays_us_[delay] - waited_us);
+	for(unsigned i = 0; i < late_count; i++)
+	{
+		struct sps30_sensor_table_entry* entry = &worker->table->entries[late[i]];
+		if(sensirion_i2c_select_bus(late[i]) == 0 && check(entry) == NO_ERROR)
+		{
+			if(entry->flags & SPS30_SENSOR_TABLE_CALIBRATED)
+			{
+				entry->flags &= ~SPS30_SENSOR_TABLE_CALIBRATED;
+				worker->fallbacks++;
+			}
+			channels[answered++] = late[i];
+		}
+	}
+	return answered;
+}
+
+static int16_t serial_answers(struct sps30_sensor_table_entry* entry)
+{
+	char serial[SPS30_MAX_SERIAL_LEN];
+	(void)entry;
+	return sps30_get_serial(serial);
+}
+
+static int16_t data_ready_answers(struct sps30_sensor_table_entry* entry)
+{
+	uint16_t data_ready;
+	(void)entry;
+	return sps30_read_data_ready(&data_ready);
+}
+
+/* Reads the auto-cleaning interval requested from the sensor */
+static int16_t interval_answers(struct sps30_sensor_table_entry* entry)
+{
+	uint8_t data[4];
+
+	const int16_t r =
+		sensirion_i2c_read_words_as_bytes(SPS30_I2C_ADDRESS, data, SENSIRION_NUM_WORDS(data));
+	if(r == NO_ERROR)
+	{
+		entry->autoclean_interval_s = sensirion_bytes_to_uint32_t(data);
+	}
+	return r;
+}
+
+/* Sends one of sps30.c's constant frames, which need no building per sensor */
+static int16_t write_frame(const uint8_t* frame, uint16_t size)
+{
+	return sensirion_i2c_write(SPS30_I2C_ADDRESS, frame, size);
+}
+
+static int16_t acknowledges(uint16_t command)
+{
+	return sensirion_i2c_write_cmd(SPS30_I2C_ADDRESS, command);
+}
+
+/* Whether the sensor acknowledges a command it accepts whether idle or measuring */
+static int16_t acknowledges_any_mode(struct sps30_sensor_table_entry* entry)
+{
+	(void)entry;
+	return acknowledges(SPS30_OPCODE_GET_SERIAL);
+}
+
+/*
+ * Time from now until the selected sensor answers, polling it, or SPS30_FLEET_ERROR_NACK
+ * if it does not answer within the datasheet delay
+ */
+static int16_t time_answer(uint64_t since_us, unsigned delay, uint16_t probe_command,
+						   uint8_t* data, uint16_t words, uint32_t* elapsed_us)
+{
+	for(;;)
+	{
+		const int16_t r = data ? sensirion_i2c_read_words_as_bytes(SPS30_I2C_ADDRESS, data, words)
+							   : acknowledges(probe_command);
+		const uint64_t elapsed = monotonic_us() - since_us;
+		if(r == NO_ERROR)
+		{
+			*elapsed_us = (uint32_t)elapsed;
+			return 0;
+		}
+		if(elapsed >= datasheet_delays_us_[delay])
+		{
+			return SPS30_FLEET_ERROR_NACK;
+		}
+		sensirion_sleep_usec(CALIBRATION_POLL_USEC);
+	}
+}
+
+int16_t sps30_fleet_read_status(const struct sps30_sensor_table_entry* entry, uint32_t* status)
+{
+	assert(entry && status);
+
+	const unsigned firmware = ((unsigned)entry->firmware_major << 8) | entry->firmware_minor;
+	if(firmware < SPS30_MIN_FIRMWARE_READ_DEVICE_STATUS_REG)
+	{
+		return SPS30_FLEET_ERROR_UNSUPPORTED;
+	}
+
+	return sps30_read_device_status_register(status);
+}
+
+int16_t sps30_fleet_calibrate(uint8_t channel, struct sps30_sensor_table_entry* entry)
+{
+	uint32_t measured[SPS30_DELAY_COUNT];
+	uint32_t stop_us = 0;
+	uint8_t interval[4];
+	bool measuring = false;
+	uint64_t since;
+	int16_t r;
+
+	assert(entry);
+
+	entry->flags &= ~SPS30_SENSOR_TABLE_CALIBRATED;
+	if(sensirion_i2c_select_bus(channel) != 0)
+	{
+		return SPS30_FLEET_ERROR_NACK;
+	}
+
+	// Command delay: an auto-cleaning interval read, which is also needed for the rewrite
+	since = monotonic_us();
+	r = acknowledges(SPS30_OPCODE_AUTOCLEAN_INTERVAL);
+	if(r == NO_ERROR)
+	{
+		r = time_answer(since, SPS30_DELAY_COMMAND, 0, interval, SENSIRION_NUM_WORDS(interval),
+						&measured[SPS30_DELAY_COMMAND]);
+	}
+
+	// Flash write delay: rewrite the same interval, then poll for an acknowledge. The sensor
+	// is idle, where data-ready reads are not accepted.
+	if(r == NO_ERROR)
+	{
+		const uint16_t words[] = {(uint16_t)((interval[0] << 8) | interval[1]),
+								  (uint16_t)((interval[2] << 8) | interval[3])};
+		since = monotonic_us();
+		r = sensirion_i2c_write_cmd_with_args(SPS30_I2C_ADDRESS, SPS30_OPCODE_AUTOCLEAN_INTERVAL,
+											  words, SENSIRION_NUM_WORDS(words));
+	}
+	if(r == NO_ERROR)
+	{
+		r = time_answer(since, SPS30_DELAY_WRITE_FLASH, SPS30_OPCODE_GET_SERIAL, NULL, 0,
+						&measured[SPS30_DELAY_WRITE_FLASH]);
+	}
+
+	// Start/stop delay: the longer of starting and stopping measurement
+	if(r == NO_ERROR)
+	{
+		since = monotonic_us();
+		r = write_frame(sps30_frame_start_measurement, sizeof(sps30_frame_start_measurement));
+		measuring = r == NO_ERROR;
+	}
+	if(r == NO_ERROR)
+	{
+		r = time_answer(since, SPS30_DELAY_START_STOP, SPS30_OPCODE_GET_DATA_READY, NULL, 0,
+						&measured[SPS30_DELAY_START_STOP]);
+	}
+	if(r == NO_ERROR)
+	{
+		since = monotonic_us();
+		r = acknowledges(SPS30_OPCODE_STOP_MEASUREMENT);
+	}
+	if(r == NO_ERROR)
+	{
+		r = time_answer(since, SPS30_DELAY_START_STOP, SPS30_OPCODE_GET_SERIAL, NULL, 0,
+						&stop_us);
+		measuring = r != NO_ERROR;
+	}
+
+	// Reset delay: the sensor restarts idle
+	if(r == NO_ERROR)
+	{
+		since = monotonic_us();
+		r = acknowledges(SPS30_OPCODE_RESET);
+	}
+	if(r == NO_ERROR)
+	{
+		r = time_answer(since, SPS30_DELAY_RESET, SPS30_OPCODE_GET_SERIAL, NULL, 0,
+						&measured[SPS30_DELAY_RESET]);
+	}
+
+	if(r != NO_ERROR)
+	{
+		// A sensor that may still be measuring is sent stop measurement until it acknowledges,
+		// or for a datasheet delay, so that it is left idle
+		if(measuring && time_answer(monotonic_us(), SPS30_DELAY_START_STOP,
+									SPS30_OPCODE_STOP_MEASUREMENT, NULL, 0, &stop_us) == 0)
+		{
+			sensirion_sleep_usec(datasheet_delays_us_[SPS30_DELAY_START_STOP]);
+		}
+		return SPS30_FLEET_ERROR_NACK;
+	}
+
+	if(stop_us > measured[SPS30_DELAY_START_STOP])
+	{
+		measured[SPS30_DELAY_START_STOP] = stop_us;
+	}
+	for(unsigned d = 0; d < SPS30_DELAY_COUNT; d++)
+	{
+		const uint32_t margin = measured[d] + measured[d] / 2 + CALIBRATION_MARGIN_USEC;
+		entry->delays_us[d] = margin < datasheet_delays_us_[d] ? margin : datasheet_delays_us_[d];
+	}
+	entry->flags |= SPS30_SENSOR_TABLE_CALIBRATED;
+	return 0;
+}
+
+/* Verify the table entries of a bus; returns the channels that need probing in pending */
+static unsigned verify_channels(struct bus_worker* worker, uint8_t* found, unsigned* found_count,
+								uint8_t* pending)
+{
+	char serial[SPS30_MAX_SERIAL_LEN];
+	unsigned pending_count = 0;
+
+	for(unsigned c = worker->first; c < worker->end; c++)
+	{
+		if(worker->config->skip && worker->config->skip[c])
+		{
+			continue;
+		}
+
+		struct sps30_sensor_table_entry* entry = &worker->table->entries[c];
+		entry->flags &= ~SPS30_SENSOR_TABLE_MEASURING;
+		if(!(entry->flags & SPS30_SENSOR_TABLE_PRESENT))
+		{
+			worker->uncached++;
+			pending[pending_count++] = (uint8_t)c;
+		}
+		else if(sensirion_i2c_select_bus((uint8_t)c) == 0 && sps30_get_serial(serial) == 0 &&
+				strcmp(serial, entry->serial) == 0)
+		{
+			worker->hits++;
+			worker->report->results[c] = SPS30_FLEET_VERIFIED;
+			found[(*found_count)++] = (uint8_t)c;
+		}
+		else
+		{
+			worker->misses++;
+			pending[pending_count++] = (uint8_t)c;
+		}
+	}
+
+	return pending_count;
+}
+
+/* Wake the pending sensors and read their metadata into the table */
+static void probe_channels(struct bus_worker* worker, const uint8_t* pending,
+						   unsigned pending_count, uint8_t* found, unsigned* found_count)
+{
+	uint8_t requested[SPS30_SENSOR_TABLE_CHANNELS];
+	unsigned requested_count = 0;
+	char serial[SPS30_MAX_SERIAL_LEN];
+
+	// The wake-up command is sent twice, and fails on sensors that are not asleep. The
+	// sensors are new or replaced, so the datasheet delays apply.
+	for(unsigned i = 0; i < pending_count; i++)
+	{
+		if(sensirion_i2c_select_bus(pending[i]) == 0)
+		{
+			(void)write_frame(sps30_frame_wake_up, sizeof(sps30_frame_wake_up));
+			(void)write_frame(sps30_frame_wake_up, sizeof(sps30_frame_wake_up));
+		}
+	}
+	sensirion_sleep_usec(datasheet_delays_us_[SPS30_DELAY_COMMAND]);
+
+	for(unsigned i = 0; i < pending_count; i++)
+	{
+		const uint8_t c = pending[i];
+		SENSIRION_RX_BUFFER(serial_frame, SPS30_RESPONSE_WORDS_GET_SERIAL);
+		SENSIRION_RX_BUFFER(version_frame, SPS30_RESPONSE_WORDS_GET_FIRMWARE_VERSION) = {0};
+
+		// The serial number decides whether the sensor is present. The firmware version
+		// and the interval request are optional, so they do not stop the transfer.
+		const struct sensirion_i2c_msg msgs[] = {
+			SPS30_I2C_MSG_WRITE(sps30_frame_get_serial, 0, 0),
+			SPS30_I2C_MSG_READ(serial_frame, SPS30_RESPONSE_WORDS_GET_SERIAL, 0),
+			SPS30_I2C_MSG_WRITE(sps30_frame_get_firmware_version, SENSIRION_I2C_MSG_IGNORE_NACK,
+								0),
+			SPS30_I2C_MSG_READ(version_frame, SPS30_RESPONSE_WORDS_GET_FIRMWARE_VERSION,
+							   SENSIRION_I2C_MSG_IGNORE_NACK),
+			SPS30_I2C_MSG_WRITE(sps30_frame_autoclean_interval, SENSIRION_I2C_MSG_IGNORE_NACK,
+								0),
+		};
+
+		if(sensirion_i2c_select_bus(c) != 0 ||
+		   sensirion_i2c_transfer(msgs, ARRAY_SIZE(msgs)) != NO_ERROR ||
+		   sensirion_common_unpack_words(serial_frame, (uint8_t*)serial,
+										 SPS30_RESPONSE_WORDS_GET_SERIAL) != NO_ERROR)
+		{
+			worker->absent++;
+			worker->report->results[c] = SPS30_FLEET_ABSENT;
+			continue;
+		}
+		serial[SPS30_MAX_SERIAL_LEN - 1] = '\0';
+
+		// A sensor that was in the table, but did not answer its verification (e.g., it was
+		// asleep), keeps its calibration
+		struct sps30_sensor_table_entry* entry = &worker->table->entries[c];
+		const uint32_t calibrated = entry->flags & SPS30_SENSOR_TABLE_CALIBRATED;
+		uint32_t delays_us[SPS30_DELAY_COUNT];
+		const bool same_sensor = calibrated && strcmp(entry->serial, serial) == 0;
+		memcpy(delays_us, entry->delays_us, sizeof(delays_us));
+
+		// A version that was not read fails its CRC check, and stays 0.0. The bytes are
+		// taken from the frame where they were received.
+		entry = sps30_sensor_table_set(worker->table, c, serial, same_sensor ? calibrated : 0);
+		if(same_sensor)
+		{
+			memcpy(entry->delays_us, delays_us, sizeof(delays_us));
+		}
+		if(sensirion_common_check_frame(version_frame,
+										SPS30_RESPONSE_WORDS_GET_FIRMWARE_VERSION) == NO_ERROR)
+		{
+			entry->firmware_major = version_frame[0];
+			entry->firmware_minor = version_frame[1];
+		}
+		worker->report->results[c] = SPS30_FLEET_PROBED;
+		found[(*found_count)++] = c;
+		requested[requested_count++] = c;
+	}
+
+	if(requested_count)
+	{
+		(void)wait_for_channels(worker, requested, requested_count, SPS30_DELAY_COMMAND,
+								interval_answers);
+	}
+}
+
+/* Calibrate the sensors found without calibrated delays */
+static void calibrate_channels(struct bus_worker* worker, const uint8_t* found,
+							   unsigned found_count)
+{
+	for(unsigned i = 0; i < found_count; i++)
+	{
+		struct sps30_sensor_table_entry* entry = &worker->table->entries[found[i]];
+		if(!(entry->flags & SPS30_SENSOR_TABLE_CALIBRATED) &&
+		   sps30_fleet_calibrate(found[i], entry) == 0)
+		{
+			worker->calibrated++;
+		}
+	}
+}
+
+/* Write the configured auto-cleaning interval to the sensors found with another interval */
+static void set_autoclean_channels(struct bus_worker* worker, const uint8_t* found,
+								   unsigned found_count)
+{
+	const uint32_t interval_s = worker->config->autoclean_interval_s;
+	const uint16_t words[] = {(uint16_t)(interval_s >> 16), (uint16_t)interval_s};
+	uint8_t written[SPS30_SENSOR_TABLE_CHANNELS];
+	unsigned written_count = 0;
+
+	for(unsigned i = 0; i < found_count; i++)
+	{
+		if(worker->table->entries[found[i]].autoclean_interval_s != interval_s &&
+		   sensirion_i2c_select_bus(found[i]) == 0 &&
+		   sensirion_i2c_write_cmd_with_args(SPS30_I2C_ADDRESS, SPS30_OPCODE_AUTOCLEAN_INTERVAL,
+											 words, SENSIRION_NUM_WORDS(words)) == NO_ERROR)
+		{
+			written[written_count++] = found[i];
+		}
+	}
+	if(written_count == 0)
+	{
+		return;
+	}
+
+	const unsigned answered = wait_for_channels(worker, written, written_count,
+												SPS30_DELAY_WRITE_FLASH, acknowledges_any_mode);
+	for(unsigned i = 0; i < answered; i++)
+	{
+		worker->table->entries[written[i]].autoclean_interval_s = interval_s;
+	}
+}
+
+/* Reset the sensors found, and wait until they answer again; returns those that do */
+static unsigned reset_channels(struct bus_worker* worker, uint8_t* found, unsigned found_count)
+{
+	uint8_t reset[SPS30_SENSOR_TABLE_CHANNELS];
+	unsigned reset_count = 0;
+
+	for(unsigned i = 0; i < found_count; i++)
+	{
+		if(sensirion_i2c_select_bus(found[i]) == 0 && acknowledges(SPS30_OPCODE_RESET) == NO_ERROR)
+		{
+			reset[reset_count++] = found[i];
+		}
+	}
+	if(reset_count == 0)
+	{
+		return 0;
+	}
+
+	const unsigned answered =
+		wait_for_channels(worker, reset, reset_count, SPS30_DELAY_RESET, serial_answers);
+	memcpy(found, reset, answered);
+	return answered;
+}
+
+/* Start measurement on the sensors found, then wait out the start delay once */
+static void start_channels(struct bus_worker* worker, const uint8_t* found, unsigned found_count)
+{
+	uint8_t started[SPS30_SENSOR_TABLE_CHANNELS];
+
+	for(unsigned i = 0; i < found_count; i++)
+	{
+		const uint8_t c = found[i];
+
+		if(sensirion_i2c_select_bus(c) == 0 &&
+		   write_frame(sps30_frame_start_measurement, sizeof(sps30_frame_start_measurement)) ==
+			   NO_ERROR)
+		{
+			struct sps30_sensor_table_entry* entry = &worker->table->entries[c];
+			entry->flags |= SPS30_SENSOR_TABLE_MEASURING;
+			entry->started_ms = realtime_ms();
+			worker->report->started[c] = true;
+			started[worker->started++] = c;
+		}
+	}
+
+	if(worker->started)
+	{
+		(void)wait_for_channels(worker, started, worker->started, SPS30_DELAY_START_STOP,
+								data_ready_answers);
+	}
+}
+
+static void* bring_up_bus(void* arg)
+{
+	struct bus_worker* worker = arg;
+	uint8_t found[SPS30_SENSOR_TABLE_CHANNELS];
+	uint8_t pending[SPS30_SENSOR_TABLE_CHANNELS];
+	unsigned found_count = 0;
+
+	const unsigned pending_count = verify_channels(worker, found, &found_count, pending);
+	if(pending_count)
+	{
+		probe_channels(worker, pending, pending_count, found, &found_count);
+	}
+	if(worker->config->calibrate)
+	{
+		calibrate_channels(worker, found, found_count);
+	}
+	if(worker->config->set_autoclean)
+	{
+		set_autoclean_channels(worker, found, found_count);
+	}
+	if(worker->config->reset)
+	{
+		found_count = reset_channels(worker, found, found_count);
+	}
+	if(worker->config->start)
+	{
+		start_channels(worker, found, found_count);
+	}
+
+	return NULL;
+}
+
+void sps30_fleet_bring_up(const struct sps30_fleet_config* config,
+						  struct sps30_sensor_table* table, struct sps30_fleet_report* report)
+{
+	struct bus_worker workers[SPS30_FLEET_MAX_BUSES];
+	bool threaded[SPS30_FLEET_MAX_BUSES] = {false};
+	struct timespec start;
+	struct timespec end;
+
+	assert(config && table && report);
+	assert(config->sensor_count <= SPS30_SENSOR_TABLE_CHANNELS);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	memset(report, 0, sizeof(*report));
+
+	unsigned buses = config->buses ? config->buses : 1;
+	if(buses > SPS30_FLEET_MAX_BUSES)
+	{
+		buses = SPS30_FLEET_MAX_BUSES;
+	}
+	if(buses > config->sensor_count)
+	{
+		buses = config->sensor_count ? config->sensor_count : 1;
+	}
+
+	// Bus 0 is brought up by the calling thread, as is any bus whose thread does not start
+	memset(workers, 0, sizeof(workers));
+	report->threads = 1;
+	for(unsigned b = 0; b < buses; b++)
+	{
+		struct bus_worker* worker = &workers[b];
+		worker->config = config;
+		worker->table = table;
+		worker->report = report;
+		worker->first = config->sensor_count * b / buses;
+		worker->end = config->sensor_count * (b + 1) / buses;
+		if(b > 0 && pthread_create(&worker->thread, NULL, bring_up_bus, worker) == 0)
+		{
+			threaded[b] = true;
+			report->threads++;
+		}
+	}
+	for(unsigned b = 0; b < buses; b++)
+	{
+		if(!threaded[b])
+		{
+			(void)bring_up_bus(&workers[b]);
+		}
+	}
+	for(unsigned b = 0; b < buses; b++)
+	{
+		if(threaded[b])
+		{
+			pthread_join(workers[b].thread, NULL);
+		}
+		report->hits += workers[b].hits;
+		report->misses += workers[b].misses;
+		report->uncached += workers[b].uncached;
+		report->absent += workers[b].absent;
+		report->started_count += workers[b].started;
+		report->calibrated += workers[b].calibrated;
+		report->fallbacks += workers[b].fallbacks;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	report->elapsed_ns = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000u +
+						 (uint64_t)(end.tv_nsec - start.tv_nsec);
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS30_FLEET_H
+#define SPS30_FLEET_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sps30_commands.h"
+#include "sps30_sensor_table.h"
+
+/** Most buses that are brought up concurrently */
+#define SPS30_FLEET_MAX_BUSES 16
+
+/** The sensor did not answer within the datasheet delay while being calibrated */
+#define SPS30_FLEET_ERROR_NACK (-1)
+/** The sensor's firmware does not support the command, which was not sent */
+#define SPS30_FLEET_ERROR_UNSUPPORTED (-2)
+
+/** The datasheet's SPS30_DELAY_* delays, which every sensor is guaranteed to meet */
+#define SPS30_FLEET_DATASHEET_COMMAND_DELAY_USEC SPS30_DELAY_USEC_AUTOCLEAN_INTERVAL
+#define SPS30_FLEET_DATASHEET_START_STOP_DELAY_USEC SPS30_DELAY_USEC_START_MEASUREMENT
+#define SPS30_FLEET_DATASHEET_WRITE_FLASH_DELAY_USEC SPS30_WRITE_FLASH_DELAY_USEC
+#define SPS30_FLEET_DATASHEET_RESET_DELAY_USEC SPS30_DELAY_USEC_RESET
+
+	/**
+	 * enum sps30_fleet_result - what bring-up found on a channel
+	 *
+	 * @SPS30_FLEET_SKIPPED:   The channel was not brought up (see sps30_fleet_config.skip)
+	 * @SPS30_FLEET_ABSENT:   No sensor answered
+	 * @SPS30_FLEET_VERIFIED: The table entry was verified with one serial number read
+	 * @SPS30_FLEET_PROBED:   The sensor was woken up and its metadata read
+	 */
+	enum sps30_fleet_result
+	{
+		SPS30_FLEET_SKIPPED = 0,
+		SPS30_FLEET_ABSENT,
+		SPS30_FLEET_VERIFIED,
+		SPS30_FLEET_PROBED,
+	};
+
+	/**
+	 * struct sps30_fleet_config - which channels to bring up, and how
+	 *
+	 * @sensor_count:          Channels 0 to sensor_count - 1 are brought up
+	 * @buses:                 The channels are split into this many contiguous groups, e.g.,
+	 *                         one per physical I2C bus, and each group is brought up by its
+	 *                         own thread. With more than one bus, the HAL must accept
+	 *                         concurrent transfers from different threads to channels of
+	 *                         different groups, and keep the sensirion_i2c_select_bus()
+	 *                         selection per thread.
+	 * @skip:                  Channels to leave alone (e.g., sensors already measuring), or
+	 *                         NULL
+	 * @calibrate:             Calibrate the delays of every sensor found without calibrated
+	 *                         delays (see sps30_fleet_calibrate())
+	 * @set_autoclean:         Write autoclean_interval_s to every sensor found with another
+	 *                         auto-cleaning interval
+	 * @autoclean_interval_s:  The fan auto-cleaning interval to write, in seconds
+	 * @reset:                 Reset every sensor that is found, before starting it
+	 * @start:                 Start measurement on every sensor that is found
+	 */
+	struct sps30_fleet_config
+	{
+		unsigned sensor_count;
+		unsigned buses;
+		const bool* skip;
+		bool calibrate;
+		bool set_autoclean;
+		uint32_t autoclean_interval_s;
+		bool reset;
+		bool start;
+	};
+
+	/**
+	 * struct sps30_fleet_report - the outcome of sps30_fleet_bring_up()
+	 *
+	 * @results:        A SPS30_FLEET_* result per channel
+	 * @started:        Whether measurement was started, per channel
+	 * @hits:           Channels whose table entry was verified
+	 * @misses:         Channels whose table entry described another sensor, or no sensor
+	 * @uncached:       Channels without a table entry
+	 * @absent:         Channels where no sensor answered
+	 * @started_count:  Sensors on which measurement was started
+	 * @calibrated:     Sensors whose delays were calibrated
+	 * @fallbacks:      Sensors that did not answer after their calibrated delay, but did
+	 *                  after the datasheet delay, and lost their calibration
+	 * @threads:        Threads that brought up buses, including the calling thread
+	 * @elapsed_ns:     Wall time of the whole bring-up
+	 */
+	struct sps30_fleet_report
+	{
+		uint8_t results[SPS30_SENSOR_TABLE_CHANNELS];
+		bool started[SPS30_SENSOR_TABLE_CHANNELS];
+		unsigned hits;
+		unsigned misses;
+		unsigned uncached;
+		unsigned absent;
+		unsigned started_count;
+		unsigned calibrated;
+		unsigned fallbacks;
+		unsigned threads;
+		uint64_t elapsed_ns;
+	};
+
+	/**
+	 * sps30_fleet_bring_up() - discover, and optionally start, the sensors on many channels
+	 *
+	 * @config:  The channels, and how to bring them up
+	 * @table:   Cached metadata, e.g., loaded with sps30_sensor_table_load(). On return, it
+	 *           is the discovery table: every sensor found has an entry with its serial
+	 *           number, firmware version, and auto-cleaning interval, flagged
+	 *           SPS30_SENSOR_TABLE_MEASURING (with started_ms) if it was started.
+	 * @report:  Filled in with the per-channel results and counts
+	 *
+	 * Each bus's channels are brought up in phases instead of one sensor at a time: a
+	 * command is sent to every channel that needs it, the command's delay is waited out
+	 * once, and then every channel is read. A bus of N sensors therefore waits for the
+	 * wake-up, auto-cleaning interval, and start measurement delays once rather than N
+	 * times. A channel with a table entry is only read for its serial number, and is only
+	 * woken and probed if the serial number does not match. The phases run in this order:
+	 * verify, probe, calibrate, auto-cleaning interval write, reset, and start.
+	 *
+	 * Each wait is the longest delay needed by the channels it covers: the calibrated delay
+	 * for sensors with one, and the datasheet delay otherwise. A probed sensor keeps its
+	 * calibration if its serial number is the one in its table entry. A sensor that does
+	 * not answer after its calibrated delay is given the rest of the datasheet delay, and
+	 * its calibration is dropped.
+	 *
+	 * The entries of skipped channels are not changed.
+	 */
+	void sps30_fleet_bring_up(const struct sps30_fleet_config* config,
+							  struct sps30_sensor_table* table, struct sps30_fleet_report* report);
+
+	/**
+	 * sps30_fleet_delay_us() - how long to wait for a sensor after a command
+	 *
+	 * @entry:  The sensor's table entry
+	 * @delay:  A SPS30_DELAY_* index
+	 *
+	 * Return:  The calibrated delay if the entry has one, or the datasheet delay
+	 */
+	uint32_t sps30_fleet_delay_us(const struct sps30_sensor_table_entry* entry, unsigned delay);
+
+	/**
+	 * sps30_fleet_calibrate() - measure the delays the sensor on a channel needs
+	 *
+	 * @channel:  The channel, which is selected
+	 * @entry:    The sensor's table entry, which receives the delays
+	 *
+	 * The datasheet delays are worst cases; most units are ready much sooner. Each delay
+	 * is measured by issuing a command and polling until the sensor acknowledges (or
+	 * answers) again: an auto-cleaning interval read for the command delay, a write of the
+	 * same interval for the flash write delay, start and stop measurement, and a reset.
+	 * The measured time is stored with a safety margin, capped at the datasheet delay.
+	 *
+	 * The sensor must be idle and awake, and is left idle, with its auto-cleaning interval
+	 * unchanged. If it stops answering after measurement was started, it is sent stop
+	 * measurement until it acknowledges, and the datasheet start/stop delay is waited out.
+	 *
+	 * Only the fleet's own commands wait calibrated delays. The vendor driver and the C++
+	 * driver wait the datasheet delays of the command registry: they keep no per-sensor
+	 * state across runs to hold a calibration in, and no fallback for a sensor that stops
+	 * answering after a delay that turned out too short.
+	 *
+	 * Return:  0 on success, with SPS30_SENSOR_TABLE_CALIBRATED set, or
+	 *          SPS30_FLEET_ERROR_NACK if the sensor did not answer within a datasheet delay,
+	 *          in which case the entry is left uncalibrated
+	 */
+	int16_t sps30_fleet_calibrate(uint8_t channel, struct sps30_sensor_table_entry* entry);
+
+	/**
+	 * sps30_fleet_read_status() - read a sensor's device status register, if it has one
+	 *
+	 * @entry:   The table entry of the sensor on the selected bus, for its firmware version
+	 * @status:  Receives the register (see SPS30_DEVICE_STATUS_* masks)
+	 *
+	 * Firmware older than 2.2 has no status register, and is not sent the command.
+	 *
+	 * Return:  0 on success, SPS30_FLEET_ERROR_UNSUPPORTED on older firmware, or the
+	 *          vendor driver's error if the read failed
+	 */
+	int16_t sps30_fleet_read_status(const struct sps30_sensor_table_entry* entry,
+									uint32_t* status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_FLEET_H */
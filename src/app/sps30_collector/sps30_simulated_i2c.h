@@ -0,0 +1,95 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS30_SIMULATED_I2C_H
+#define SPS30_SIMULATED_I2C_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+	/**
+	 * struct sps30_simulated_fault - how a simulated sensor misbehaves
+	 *
+	 * @absent:          Nothing acknowledges on the bus, as if no sensor were connected
+	 * @asleep:          The sensor is in sleep mode: it acknowledges nothing until it is
+	 *                   woken up, with a first wake-up command that is not acknowledged,
+	 *                   and a second one that is
+	 * @nack_opcode:     A command the sensor never acknowledges, or 0
+	 * @slow_opcode:     A command after which the sensor is busy for slow_busy_usec
+	 *                   instead of its usual time, or 0
+	 * @slow_busy_usec:  How long the sensor is busy after slow_opcode
+	 * @corrupt_opcode:  A command whose responses are read with a wrong CRC, or 0
+	 *
+	 * Busy times only apply when SPS30_SIMULATED_I2C_HZ is set.
+	 */
+	struct sps30_simulated_fault
+	{
+		bool absent;
+		bool asleep;
+		uint16_t nack_opcode;
+		uint16_t slow_opcode;
+		uint32_t slow_busy_usec;
+		uint16_t corrupt_opcode;
+	};
+
+	/**
+	 * sps30_simulated_i2c_set_fault() - make the sensor on a bus misbehave
+	 *
+	 * @bus:    The bus index
+	 * @fault:  The fault, which a zeroed struct clears
+	 *
+	 * sensirion_i2c_init() clears the faults of every sensor.
+	 */
+	void sps30_simulated_i2c_set_fault(uint8_t bus, const struct sps30_simulated_fault* fault);
+
+	/**
+	 * sps30_simulated_i2c_set_firmware() - set the firmware version a sensor reports
+	 *
+	 * @bus:    The bus index
+	 * @major:  The major version
+	 * @minor:  The minor version
+	 *
+	 * Only the reported version changes: the sensor still accepts every command.
+	 * sensirion_i2c_init() sets every sensor back to firmware 2.2.
+	 */
+	void sps30_simulated_i2c_set_firmware(uint8_t bus, uint8_t major, uint8_t minor);
+
+	/**
+	 * struct sps30_simulated_i2c_counters - how the bus was used
+	 *
+	 * @transfers:        Bus transactions: sensirion_i2c_transfer() calls, and reads and
+	 *                    writes made on their own
+	 * @messages:         Reads and writes, including those of transfers
+	 * @unaligned_reads:  Reads into a buffer that does not start on a cache line
+	 * @delay_usec:       The waits asked for, after messages and with sensirion_sleep_usec(),
+	 *                    in microseconds, whether or not they were slept
+	 */
+	struct sps30_simulated_i2c_counters
+	{
+		uint32_t transfers;
+		uint32_t messages;
+		uint32_t unaligned_reads;
+		uint32_t delay_usec;
+	};
+
+	/**
+	 * sps30_simulated_i2c_get_counters() - how the calling thread has used the bus
+	 *
+	 * sensirion_i2c_init() clears the calling thread's counters.
+	 *
+	 * Return: The counts since sensirion_i2c_init()
+	 */
+	struct sps30_simulated_i2c_counters sps30_simulated_i2c_get_counters(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_SIMULATED_I2C_H */
@@ -0,0 +1,452 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+/*
+ * Offline queries over collector logs
+ *
+ * Answers range and point queries from the sparse time index kept next to each log file
+ * (see sps30_log_index.h). Range aggregates are computed from the index's per-block
+ * summaries; only blocks at the edges of the range are read from the log. Several files
+ * (e.g., a log and its rotated predecessors) can be queried at once.
+ *
+ * The report command does not use the index: it scans whole files in parallel (see
+ * sps30_log_aggregate.h) for per-sensor and fleet percentiles and exceedance counts.
+ */
+
+#define _POSIX_C_SOURCE 200809L // gmtime_r, clock_gettime, getopt
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sps30_log_aggregate.h"
+#include "sps30_log_index.h"
+#include "sps30_record.h"
+
+struct query_config
+{
+	const char* command;
+	uint64_t sensor_id;
+	int32_t channel;
+	uint64_t start_ms;
+	uint64_t end_ms;
+	uint32_t block_records;
+	unsigned threads;
+	unsigned field;
+	float thresholds[SPS30_RECORD_FIELD_COUNT];
+};
+
+static double monotonic_us(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec * 1e6 + (double)now.tv_nsec / 1e3;
+}
+
+/* Days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant's days_from_civil) */
+static int64_t days_from_civil(int64_t year, unsigned month, unsigned day)
+{
+	year -= month <= 2;
+	const int64_t era = (year >= 0 ? year : year - 399) / 400;
+	const unsigned year_of_era = (unsigned)(year - era * 400);
+	const unsigned day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	const unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 +
+								day_of_year;
+	return era * 146097 + (int64_t)day_of_era - 719468;
+}
+
+/* Milliseconds since the epoch, or a UTC time as YYYY-MM-DDTHH:MM:SS */
+static int parse_time(const char* text, uint64_t* ms)
+{
+	int year;
+	unsigned month, day, hour = 0, minute = 0, second = 0;
+	char* end;
+
+	if(sscanf(text, "%4d-%2u-%2uT%2u:%2u:%2u", &year, &month, &day, &hour, &minute,
+			  &second) >= 3)
+	{
+		if(year < 1970 || month < 1 || month > 12 || day < 1 || day > 31)
+		{
+			return -1;
+		}
+		const int64_t days = days_from_civil(year, month, day);
+		*ms = ((uint64_t)days * 86400u + hour * 3600u + minute * 60u + second) * 1000u;
+		return 0;
+	}
+
+	*ms = strtoull(text, &end, 0);
+	return *end == '\0' ? 0 : -1;
+}
+
+static const char* format_time(uint64_t ms, char* text, size_t size)
+{
+	const time_t seconds = (time_t)(ms / 1000);
+	struct tm utc;
+
+	gmtime_r(&seconds, &utc);
+	const size_t n = strftime(text, size, "%Y-%m-%dT%H:%M:%S", &utc);
+	snprintf(text + n, size - n, ".%03uZ", (unsigned)(ms % 1000));
+	return text;
+}
+
+static int build(const struct query_config* config, const char* path)
+{
+	const double start = monotonic_us();
+
+	if(sps30_log_index_build(path, config->block_records) != 0)
+	{
+		printf("%s: error building index\n", path);
+		return -1;
+	}
+
+	printf("%s: indexed in %.1f ms\n", path, (monotonic_us() - start) / 1e3);
+	return 0;
+}
+
+static void print_blocks(const struct sps30_log_index* index, const char* path)
+{
+	char first[32];
+	char last[32];
+
+	printf("%s: %zu entries\n", path, index->count);
+	for(size_t i = 0; i < index->count; i++)
+	{
+		const struct sps30_log_index_entry* e = &index->entries[i];
+		printf("  @%-12" PRIu64 " %8" PRIu32 " bytes  sensor %016" PRIx64 " ch %3u  %6" PRIu32
+			   " records  %s .. %s  mc_2p5 %.2f/%.2f/%.2f\n",
+			   e->offset, e->length, e->sensor_id, e->channel, e->count,
+			   format_time(e->first_timestamp_ms, first, sizeof(first)),
+			   format_time(e->last_timestamp_ms, last, sizeof(last)), (double)e->min[1],
+			   e->sum[1] / e->count, (double)e->max[1]);
+	}
+}
+
+static void print_record(const struct sps30_record* record)
+{
+	char time[32];
+
+	printf("%s  sensor %016" PRIx64 " ch %u  status 0x%08" PRIx32 "\n",
+		   format_time(record->timestamp_ms, time, sizeof(time)), record->sensor_id,
+		   record->channel, record->status);
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		printf("  %-22s %10.3f\n", sps30_record_field_name(f), (double)record->values[f]);
+	}
+}
+
+static void print_summary(const struct sps30_log_index_summary* summary, double elapsed_us)
+{
+	char first[32];
+	char last[32];
+
+	printf("%" PRIu64 " records", summary->count);
+	if(summary->count)
+	{
+		printf(", %s .. %s", format_time(summary->first_timestamp_ms, first, sizeof(first)),
+			   format_time(summary->last_timestamp_ms, last, sizeof(last)));
+	}
+	printf("\n%u blocks from the index, %u read from the log, %.1f us\n",
+		   summary->blocks_summarized, summary->blocks_scanned, elapsed_us);
+
+	if(!summary->count)
+	{
+		return;
+	}
+
+	printf("  %-22s %10s %10s %10s\n", "field", "min", "mean", "max");
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		printf("  %-22s %10.3f %10.3f %10.3f\n", sps30_record_field_name(f),
+			   (double)summary->min[f], summary->sum[f] / (double)summary->count,
+			   (double)summary->max[f]);
+	}
+}
+
+/* <field>=<threshold> */
+static int parse_threshold(const char* text, float* thresholds)
+{
+	const char* equals = strchr(text, '=');
+	char* end;
+
+	const int field = equals ? sps30_record_field_index(text, (size_t)(equals - text)) : -1;
+	if(field < 0)
+	{
+		return -1;
+	}
+	thresholds[field] = strtof(equals + 1, &end);
+	return *end == '\0' ? 0 : -1;
+}
+
+static void print_stats_line(const char* label, const struct sps30_log_aggregate_stats* stats,
+							 unsigned field)
+{
+	printf("%-22s %10" PRIu64 " %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %10" PRIu64 "\n", label,
+		   stats->count, (double)stats->min[field], sps30_log_aggregate_mean(stats, field),
+		   (double)sps30_log_aggregate_percentile(stats, field, 0.5),
+		   (double)sps30_log_aggregate_percentile(stats, field, 0.95),
+		   (double)sps30_log_aggregate_percentile(stats, field, 0.99), (double)stats->max[field],
+		   stats->exceedances[field]);
+}
+
+static void print_stats_header(const char* label)
+{
+	printf("%-22s %10s %9s %9s %9s %9s %9s %9s %10s\n", label, "records", "min", "mean", "p50",
+		   "p95", "p99", "max", "exceeded");
+}
+
+static int report(const struct query_config* config, const char* const* paths, size_t count)
+{
+	struct sps30_log_aggregate_config aggregate;
+	struct sps30_log_aggregate_result result;
+	char label[32];
+
+	sps30_log_aggregate_config_init(&aggregate, paths, count);
+	aggregate.threads = config->threads;
+	aggregate.start_ms = config->start_ms;
+	aggregate.end_ms = config->end_ms;
+	memcpy(aggregate.thresholds, config->thresholds, sizeof(aggregate.thresholds));
+
+	const double start = monotonic_us();
+	const int16_t r = sps30_log_aggregate_run(&aggregate, &result);
+	const double elapsed_s = (monotonic_us() - start) / 1e6;
+	if(r != 0)
+	{
+		printf("the logs could not be read\n");
+		sps30_log_aggregate_free(&result);
+		return -1;
+	}
+
+	printf("%" PRIu64 " records from %zu sensors, %.1f MB in %.2f s on %u threads (%.0f MB/s)\n",
+		   result.fleet.count, result.sensor_count, (double)result.bytes / 1e6, elapsed_s,
+		   result.threads, (double)result.bytes / 1e6 / elapsed_s);
+	if(result.skipped)
+	{
+		printf("%" PRIu64 " damaged regions skipped\n", result.skipped);
+	}
+
+	printf("\n%s by sensor:\n", sps30_record_field_name(config->field));
+	print_stats_header("sensor/channel");
+	for(size_t i = 0; i < result.sensor_count; i++)
+	{
+		if(config->sensor_id != SPS30_LOG_INDEX_ANY_SENSOR &&
+		   result.sensors[i].sensor_id != config->sensor_id)
+		{
+			continue;
+		}
+		snprintf(label, sizeof(label), "%016" PRIx64 "/%u", result.sensors[i].sensor_id,
+				 result.sensors[i].channel);
+		print_stats_line(label, &result.sensors[i], config->field);
+	}
+
+	printf("\nFleet:\n");
+	print_stats_header("field");
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		print_stats_line(sps30_record_field_name(f), &result.fleet, f);
+	}
+
+	sps30_log_aggregate_free(&result);
+	return 0;
+}
+
+static void usage(const char* name)
+{
+	printf("Usage: %s [options] <command> <log file>...\n"
+		   "Commands:\n"
+		   "\tsummary      Aggregate the records in a time range\n"
+		   "\tat           Show the latest record at or before the -t time\n"
+		   "\tblocks       List the index entries\n"
+		   "\tbuild        Create or replace the index of each log file\n"
+		   "\treport       Per-sensor and fleet statistics, scanning the files in parallel\n"
+		   "Options:\n"
+		   "\t-s <id>      Sensor ID, in hex (default: any)\n"
+		   "\t-c <number>  Channel (default: any)\n"
+		   "\t-f <time>    Start of the range (default: the first record)\n"
+		   "\t-t <time>    End of the range (default: the last record)\n"
+		   "\t-b <count>   Records per index block, for build (default: %u)\n"
+		   "\t-j <count>   Threads, for report (default: one per CPU)\n"
+		   "\t-F <field>   The field report shows by sensor (default: mc_2p5)\n"
+		   "\t-e <f>=<v>   Count values of field f above v, for report (repeatable)\n"
+		   "Times are milliseconds since the Unix epoch, or UTC as YYYY-MM-DDTHH:MM:SS.\n",
+		   name, SPS30_LOG_INDEX_BLOCK_RECORDS);
+}
+
+static int parse_arguments(int argc, char* argv[], struct query_config* config)
+{
+	int option;
+
+	while((option = getopt(argc, argv, "s:c:f:t:b:j:F:e:h")) != -1)
+	{
+		switch(option)
+		{
+			case 's':
+				config->sensor_id = strtoull(optarg, NULL, 16);
+				break;
+			case 'c':
+				config->channel = (int32_t)strtol(optarg, NULL, 0);
+				break;
+			case 'f':
+				if(parse_time(optarg, &config->start_ms) != 0)
+				{
+					printf("invalid time: %s\n", optarg);
+					return -1;
+				}
+				break;
+			case 't':
+				if(parse_time(optarg, &config->end_ms) != 0)
+				{
+					printf("invalid time: %s\n", optarg);
+					return -1;
+				}
+				break;
+			case 'b':
+				config->block_records = (uint32_t)strtoul(optarg, NULL, 0);
+				break;
+			case 'j':
+				config->threads = (unsigned)strtoul(optarg, NULL, 0);
+				break;
+			case 'F':
+			{
+				const int field = sps30_record_field_index(optarg, strlen(optarg));
+				if(field < 0)
+				{
+					printf("unknown field: %s\n", optarg);
+					return -1;
+				}
+				config->field = (unsigned)field;
+				break;
+			}
+			case 'e':
+				if(parse_threshold(optarg, config->thresholds) != 0)
+				{
+					printf("invalid threshold: %s\n", optarg);
+					return -1;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return -1;
+		}
+	}
+
+	if(argc - optind < 2)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	config->command = argv[optind++];
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	struct query_config config = {
+		.sensor_id = SPS30_LOG_INDEX_ANY_SENSOR,
+		.channel = SPS30_LOG_INDEX_ANY_CHANNEL,
+		.start_ms = 0,
+		.end_ms = UINT64_MAX,
+		.block_records = 0,
+		.threads = 0,
+		.field = 1, // mc_2p5
+	};
+	struct sps30_log_index_summary summary;
+	struct sps30_record latest;
+	bool found = false;
+	double elapsed_us = 0;
+	int result = EXIT_SUCCESS;
+
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		config.thresholds[f] = INFINITY;
+	}
+
+	if(parse_arguments(argc, argv, &config) != 0)
+	{
+		return EXIT_FAILURE;
+	}
+
+	if(strcmp(config.command, "report") == 0)
+	{
+		return report(&config, (const char* const*)&argv[optind], (size_t)(argc - optind)) == 0
+				   ? EXIT_SUCCESS
+				   : EXIT_FAILURE;
+	}
+
+	const bool summarize = strcmp(config.command, "summary") == 0;
+	const bool at = strcmp(config.command, "at") == 0;
+	const bool blocks = strcmp(config.command, "blocks") == 0;
+	if(strcmp(config.command, "build") != 0 && !summarize && !at && !blocks)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	sps30_log_index_summary_init(&summary);
+
+	for(int i = optind; i < argc; i++)
+	{
+		struct sps30_log_index index;
+		struct sps30_record record;
+
+		if(!summarize && !at && !blocks)
+		{
+			result |= build(&config, argv[i]) != 0;
+			continue;
+		}
+
+		if(sps30_log_index_load(&index, argv[i]) != 0)
+		{
+			printf("%s: cannot be read, or its index is damaged (rebuild it with build)\n",
+				   argv[i]);
+			result = EXIT_FAILURE;
+			continue;
+		}
+
+		const double start = monotonic_us();
+		if(summarize)
+		{
+			sps30_log_index_aggregate(&index, config.sensor_id, config.channel, config.start_ms,
+									  config.end_ms, &summary);
+		}
+		else if(at && sps30_log_index_find(&index, config.sensor_id, config.channel,
+										   config.end_ms, &record) == 0 &&
+				(!found || record.timestamp_ms > latest.timestamp_ms))
+		{
+			latest = record;
+			found = true;
+		}
+		elapsed_us += monotonic_us() - start;
+
+		if(blocks)
+		{
+			print_blocks(&index, argv[i]);
+		}
+		sps30_log_index_unload(&index);
+	}
+
+	if(summarize)
+	{
+		print_summary(&summary, elapsed_us);
+	}
+	else if(at)
+	{
+		if(found)
+		{
+			print_record(&latest);
+		}
+		else
+		{
+			printf("no matching record\n");
+		}
+		printf("%.1f us\n", elapsed_us);
+	}
+
+	return result;
+}
@@ -173,3 +173,9 @@ void sensirion_sleep_usec(uint32_t useconds)
 {
 	usleep(useconds);
 }
+
+/* The Aardvark API issues one transfer per call, so messages are not chained */
+int16_t sensirion_i2c_transfer(const struct sensirion_i2c_msg* msgs, uint16_t count)
+{
+	return sensirion_i2c_transfer_sequential(msgs, count);
+}
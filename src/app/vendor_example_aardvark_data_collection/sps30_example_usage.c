@@ -29,9 +29,48 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
 #include <stdio.h> // printf
+#include <time.h>
 
 #include "sps30.h"
+#include "sps30_gorilla.h"
+
+/* Compressed measurements are written here when collection completes */
+#define MEASUREMENT_LOG_PATH "sps30_measurements.gorilla"
+#define MEASUREMENT_LOG_CAPACITY 4096
+
+static uint64_t timestamp_ms(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u;
+}
+
+/* The log is a sample count and stream size (host byte order), followed by the stream */
+static void write_measurement_log(const struct sps30_gorilla_encoder* encoder,
+								  const uint8_t* buffer)
+{
+	const uint32_t count = sps30_gorilla_encoder_count(encoder);
+	const uint32_t size = (uint32_t)sps30_gorilla_encoder_size(encoder);
+
+	FILE* file = fopen(MEASUREMENT_LOG_PATH, "wb");
+	if(!file)
+	{
+		printf("error opening %s\n", MEASUREMENT_LOG_PATH);
+		return;
+	}
+
+	fwrite(&count, sizeof(count), 1, file);
+	fwrite(&size, sizeof(size), 1, file);
+	fwrite(buffer, 1, size, file);
+	fclose(file);
+
+	const size_t raw_size = (size_t)count * (sizeof(uint64_t) + sizeof(struct sps30_measurement));
+	printf("Logged %u measurements to %s: %u bytes (%zu bytes uncompressed)\n", count,
+		   MEASUREMENT_LOG_PATH, size, raw_size);
+}
 
 /**
  * TO USE CONSOLE OUTPUT (printf) PLEASE ADAPT TO YOUR PLATFORM:
@@ -42,6 +81,10 @@ int main(void)
 {
 	struct sps30_measurement m;
 	int16_t ret;
+	static uint8_t log_buffer[MEASUREMENT_LOG_CAPACITY];
+	struct sps30_gorilla_encoder log_encoder;
+
+	sps30_gorilla_encoder_init(&log_encoder, log_buffer, sizeof(log_buffer));
 
 	/* Initialize I2C bus */
 	sensirion_i2c_init();
@@ -167,6 +210,11 @@ int main(void)
 		}
 		else
 		{
+			if(sps30_gorilla_encode(&log_encoder, timestamp_ms(), &m) != 0)
+			{
+				printf("measurement log is full\n");
+			}
+
 #ifdef LOW_PRECISION_PRINTING
 			printf("measured values:\n"
 				   "\t%0.2f pm1.0\n"
@@ -201,6 +249,8 @@ int main(void)
 		}
 	}
 
+	write_measurement_log(&log_encoder, log_buffer);
+
 	printf("Issuing sleep command, expected to fail\n");
 	ret = sps30_sleep();
 	printf("sleep returned: %d\n", ret);
@@ -119,3 +119,19 @@ void sensirion_sleep_usec(uint32_t useconds)
 {
 	// IMPLEMENT
 }
+
+/**
+ * Execute a sequence of messages back-to-back. Reads store the raw bytes, CRCs
+ * included, in the caller's buffers. The transfer stops at the first message that
+ * fails, unless it is flagged SENSIRION_I2C_MSG_IGNORE_NACK.
+ *
+ * @param msgs  the messages, in order
+ * @param count number of messages
+ * @returns 0 on success, the error code of the failed message otherwise
+ */
+int16_t sensirion_i2c_transfer(const struct sensirion_i2c_msg* msgs, uint16_t count)
+{
+	// IMPLEMENT by submitting each run of messages between delays at once, or keep the
+	// sequential implementation if the platform cannot chain transfers
+	return sensirion_i2c_transfer_sequential(msgs, count);
+}
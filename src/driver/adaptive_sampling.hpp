@@ -0,0 +1,339 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_ADAPTIVE_SAMPLING_HPP_
+#define SPS_30_ADAPTIVE_SAMPLING_HPP_
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <driver.hpp>
+#include <energy.hpp>
+
+namespace sps30
+{
+/** Chooses when to read the sensor from the dynamics of the measured signal
+ *
+ * One field (PM2.5 by default) is tracked with an exponentially weighted mean and
+ * variance, updated in constant time per sample. The sampler is in one of three modes:
+ *
+ * - event: the value reached event_enter, and has not yet fallen below event_exit.
+ *   Every sample is read.
+ * - active: the smoothed standard deviation reached active_deviation, and has not yet
+ *   fallen below quiet_deviation. Every sample is read.
+ * - quiet: otherwise. The read interval doubles after each quiet read, up to max_interval.
+ *
+ * Each pair of thresholds forms a hysteresis band, so a signal hovering near a threshold
+ * does not flap between modes. Leaving quiet mode returns to min_interval immediately.
+ *
+ * After power_down_after of quiet air, power_down() reports that the sensor may be stopped
+ * and put to sleep until shortly before the next read, if the read interval leaves time for
+ * the sensor to settle after it is restarted. While powered down, a rise in concentration is
+ * only seen at the next read, up to max_interval later.
+ */
+class adaptive_sampler
+{
+  public:
+	using clock = std::chrono::steady_clock;
+
+	/// The sampling modes, in increasing order of urgency
+	enum class mode_t : uint8_t
+	{
+		quiet,
+		active,
+		event,
+	};
+
+	struct config_t
+	{
+		/// The field that drives the sampling rate
+		float sensor::measurement_t::*field = &sensor::measurement_t::mc_2p5;
+		/// Values at or above this start an event (the PM2.5 AQI "unhealthy for sensitive
+		/// groups" breakpoint)
+		float event_enter = 35.5f;
+		/// An event ends when values fall below this
+		float event_exit = 25.0f;
+		/// Air becomes active when the smoothed standard deviation reaches this
+		float active_deviation = 2.0f;
+		/// Active air becomes quiet when the smoothed standard deviation falls below this
+		float quiet_deviation = 0.5f;
+		/// Weight of each sample in the smoothed mean and variance, in (0, 1]
+		float smoothing = 0.2f;
+		/// The shortest read interval: the sensor's measurement period
+		clock::duration min_interval = MINIMUM_MEASUREMENT_DURATION_USEC;
+		/// The longest read interval in quiet air
+		clock::duration max_interval = std::chrono::seconds(60);
+		/// Quiet time after which the sensor may be powered down between reads.
+		/// Zero keeps the sensor measuring.
+		clock::duration power_down_after = std::chrono::minutes(5);
+		/// Time the sensor needs after starting before its readings are valid
+		clock::duration settling_time = NUM_CONCENTRATION_3000_200_SETTLING_TIME_USEC;
+	};
+
+	adaptive_sampler() = default;
+
+	explicit adaptive_sampler(const config_t& config) : config_(config)
+	{
+		assert(config.smoothing > 0 && config.smoothing <= 1);
+		assert(config.event_exit <= config.event_enter);
+		assert(config.quiet_deviation <= config.active_deviation);
+		assert(config.min_interval <= config.max_interval);
+	}
+
+	/** Account for a sample
+	 *
+	 * @param [in] m The measurement read
+	 * @param [in] time When it was read
+	 *
+	 * @returns The time of the next read
+	 */
+	clock::time_point observe(const sensor::measurement_t& m, clock::time_point time)
+	{
+		const float value = m.*config_.field;
+
+		if(samples_ == 0)
+		{
+			mean_ = value;
+			variance_ = 0;
+		}
+		else
+		{
+			const float delta = value - mean_;
+			mean_ += config_.smoothing * delta;
+			variance_ = (1 - config_.smoothing) * (variance_ + config_.smoothing * delta * delta);
+		}
+		samples_++;
+
+		const mode_t previous = mode_;
+		const float deviation = std::sqrt(variance_);
+		if(value >= config_.event_enter || (mode_ == mode_t::event && value >= config_.event_exit))
+		{
+			mode_ = mode_t::event;
+		}
+		else if(deviation >= config_.active_deviation ||
+				(mode_ != mode_t::quiet && deviation >= config_.quiet_deviation))
+		{
+			mode_ = mode_t::active;
+		}
+		else
+		{
+			mode_ = mode_t::quiet;
+		}
+
+		if(mode_ != previous)
+		{
+			transitions_++;
+		}
+
+		if(mode_ != mode_t::quiet || previous != mode_t::quiet || samples_ == 1)
+		{
+			interval_ = config_.min_interval;
+			quiet_since_ = time;
+		}
+		else
+		{
+			interval_ = std::min(interval_ * 2, config_.max_interval);
+		}
+
+		last_ = time;
+		return time + interval_;
+	}
+
+	/// True if the sensor can be stopped and put to sleep until the next read
+	bool power_down() const
+	{
+		return config_.power_down_after > clock::duration::zero() && mode_ == mode_t::quiet &&
+			   last_ - quiet_since_ >= config_.power_down_after &&
+			   interval_ >= config_.settling_time + config_.min_interval;
+	}
+
+	mode_t mode() const
+	{
+		return mode_;
+	}
+
+	/// The interval before the next read
+	clock::duration interval() const
+	{
+		return interval_;
+	}
+
+	/// Smoothed value of the tracked field
+	float mean() const
+	{
+		return mean_;
+	}
+
+	/// Smoothed standard deviation of the tracked field
+	float deviation() const
+	{
+		return std::sqrt(variance_);
+	}
+
+	/// The number of mode changes
+	uint32_t transitions() const
+	{
+		return transitions_;
+	}
+
+	const config_t& config() const
+	{
+		return config_;
+	}
+
+  private:
+	config_t config_;
+	mode_t mode_ = mode_t::quiet;
+	float mean_ = 0;
+	float variance_ = 0;
+	uint32_t samples_ = 0;
+	uint32_t transitions_ = 0;
+	clock::duration interval_ = clock::duration::zero();
+	clock::time_point quiet_since_;
+	clock::time_point last_;
+};
+
+/** Reads a measuring sensor at the rate an adaptive_sampler chooses
+ *
+ * The caller waits until next_wakeup() and calls poll(), which reads the sensor when a read
+ * is due. When the sampler allows it, the sensor is stopped and put to sleep after a read,
+ * and is woken and restarted one settling time before the next read, so that read is valid.
+ * Power states and transactions are recorded in an energy_meter.
+ *
+ * @tparam Sensor The sensor type. It provides read(), start(), stop(), sleep(), and wake()
+ *  with the semantics of sensor.
+ */
+template<typename Sensor = sensor>
+class adaptive_reader
+{
+  public:
+	using clock = std::chrono::steady_clock;
+
+	/** Create a reader
+	 *
+	 * @pre The sensor is measuring.
+	 *
+	 * @param [in] s The sensor
+	 * @param [in] config The sampling policy
+	 * @param [in] now The current time. The first poll() at or after it reads the sensor.
+	 */
+	adaptive_reader(Sensor& s, const adaptive_sampler::config_t& config, clock::time_point now)
+		: sensor_(s), sampler_(config), next_read_(now)
+	{
+		energy_.start(power_state_t::measuring, now);
+	}
+
+	/** Perform any work due at now
+	 *
+	 * @param [in] now The current time
+	 * @param [out] m Set to the measurement, if one was read and m is not nullptr
+	 *
+	 * @returns true if the sensor was read
+	 */
+	bool poll(clock::time_point now, sensor::measurement_t* m = nullptr)
+	{
+		if(powered_down_)
+		{
+			if(now < wake_at_)
+			{
+				return false;
+			}
+
+			if(asleep_)
+			{
+				sensor_.wake();
+				energy_.add_transactions();
+				asleep_ = false;
+			}
+			sensor_.start();
+			energy_.add_transactions();
+			energy_.transition(power_state_t::measuring, now);
+			powered_down_ = false;
+		}
+
+		if(now < next_read_)
+		{
+			return false;
+		}
+
+		const sensor::measurement_t measurement = sensor_.read();
+		energy_.add_transactions();
+		reads_++;
+		next_read_ = sampler_.observe(measurement, now);
+
+		if(sampler_.power_down())
+		{
+			sensor_.stop();
+			energy_.add_transactions();
+			// Firmware without sleep mode rejects sleep() without a transaction, and stays idle
+			asleep_ = sensor_.sleep() == transport::status_t::OK;
+			if(asleep_)
+			{
+				energy_.add_transactions();
+			}
+			energy_.transition(asleep_ ? power_state_t::sleeping : power_state_t::idle, now);
+			powered_down_ = true;
+			power_cycles_++;
+			wake_at_ = next_read_ - sampler_.config().settling_time;
+		}
+
+		if(m)
+		{
+			*m = measurement;
+		}
+		return true;
+	}
+
+	/// When poll() next has work to do
+	clock::time_point next_wakeup() const
+	{
+		return powered_down_ ? wake_at_ : next_read_;
+	}
+
+	/// True while the sensor is stopped, and asleep if its firmware supports sleep mode
+	bool powered_down() const
+	{
+		return powered_down_;
+	}
+
+	/// The number of measurements read
+	uint32_t reads() const
+	{
+		return reads_;
+	}
+
+	/// The number of times the sensor was put to sleep
+	uint32_t power_cycles() const
+	{
+		return power_cycles_;
+	}
+
+	const adaptive_sampler& sampler() const
+	{
+		return sampler_;
+	}
+
+	const energy_meter& energy() const
+	{
+		return energy_;
+	}
+
+  private:
+	Sensor& sensor_;
+	adaptive_sampler sampler_;
+	energy_meter energy_;
+	clock::time_point next_read_;
+	clock::time_point wake_at_;
+	bool powered_down_ = false;
+	bool asleep_ = false;
+	uint32_t reads_ = 0;
+	uint32_t power_cycles_ = 0;
+};
+
+}; // end namespace sps30
+
+#endif // SPS_30_ADAPTIVE_SAMPLING_HPP_
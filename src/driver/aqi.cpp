@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <aqi.hpp>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+using namespace sps30;
+
+namespace
+{
+constexpr double NOT_A_NUMBER = std::numeric_limits<double>::quiet_NaN();
+
+/// Index slope of each segment, computed exactly as aqi::index() does
+struct segments_t
+{
+	double c_low[aqi::BREAKPOINT_COUNT];
+	double i_low[aqi::BREAKPOINT_COUNT];
+	double slope[aqi::BREAKPOINT_COUNT];
+};
+
+constexpr segments_t make_segments(aqi::pollutant_t pollutant)
+{
+	segments_t s{};
+	const auto& table = aqi::breakpoints(pollutant);
+	for(size_t j = 0; j < table.size(); j++)
+	{
+		s.c_low[j] = table[j].c_low;
+		s.i_low[j] = table[j].i_low;
+		s.slope[j] = (table[j].i_high - table[j].i_low) / (table[j].c_high - table[j].c_low);
+	}
+	return s;
+}
+
+constexpr segments_t SEGMENTS[2] = {
+	make_segments(aqi::pollutant_t::pm2_5),
+	make_segments(aqi::pollutant_t::pm10),
+};
+
+void nowcast_scalar(const float* const* hourly, size_t first, size_t count,
+					aqi::pollutant_t pollutant, float* nowcasts, int16_t* indices)
+{
+	for(size_t s = first; s < count; s++)
+	{
+		float hours[aqi::NOWCAST_HOURS];
+		for(size_t h = 0; h < aqi::NOWCAST_HOURS; h++)
+		{
+			hours[h] = hourly[h][s];
+		}
+
+		const double c = aqi::nowcast(hours, pollutant);
+		nowcasts[s] = static_cast<float>(c);
+		indices[s] = std::isnan(c) ? aqi::NO_INDEX : aqi::index(c, pollutant);
+	}
+}
+
+#if defined(__SSE2__)
+
+/// Lanes where a is true, b elsewhere
+inline __m128d select(__m128d mask, __m128d a, __m128d b)
+{
+	return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+/// Two sensors per iteration. Returns the number of sensors processed.
+size_t nowcast_vector(const float* const* hourly, size_t count, aqi::pollutant_t pollutant,
+					  float* nowcasts, int16_t* indices)
+{
+	const segments_t& segments = SEGMENTS[static_cast<size_t>(pollutant)];
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d one = _mm_set1_pd(1);
+	size_t s = 0;
+
+	for(; s + 2 <= count; s += 2)
+	{
+		__m128d v[aqi::NOWCAST_HOURS];
+		__m128d valid[aqi::NOWCAST_HOURS];
+		__m128d lo = _mm_set1_pd(INFINITY);
+		__m128d hi = _mm_set1_pd(-INFINITY);
+
+		for(size_t h = 0; h < aqi::NOWCAST_HOURS; h++)
+		{
+			const __m128i pair = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&hourly[h][s]));
+			v[h] = _mm_cvtps_pd(_mm_castsi128_ps(pair));
+			valid[h] = _mm_cmpord_pd(v[h], v[h]);
+			// minpd and maxpd return their second operand if either is NaN, so missing
+			// hours leave lo and hi unchanged
+			lo = _mm_min_pd(v[h], lo);
+			hi = _mm_max_pd(v[h], hi);
+		}
+
+		const __m128d recent =
+			_mm_or_pd(_mm_and_pd(valid[0], _mm_or_pd(valid[1], valid[2])),
+					  _mm_and_pd(valid[1], valid[2]));
+		const __m128d w = select(_mm_cmpgt_pd(hi, zero),
+								 _mm_max_pd(_mm_div_pd(lo, hi), _mm_set1_pd(0.5)), one);
+
+		__m128d factor = one;
+		__m128d sum = zero;
+		__m128d weights = zero;
+		for(size_t h = 0; h < aqi::NOWCAST_HOURS; h++)
+		{
+			sum = _mm_add_pd(sum, _mm_and_pd(valid[h], _mm_mul_pd(factor, v[h])));
+			weights = _mm_add_pd(weights, _mm_and_pd(valid[h], factor));
+			factor = _mm_mul_pd(factor, w);
+		}
+
+		// Non-positive averages truncate to 0, as in aqi::truncate()
+		const __m128d c = _mm_max_pd(_mm_div_pd(sum, weights), zero);
+		__m128d truncated;
+		if(pollutant == aqi::pollutant_t::pm2_5)
+		{
+			const __m128i tenths = _mm_cvttpd_epi32(_mm_mul_pd(c, _mm_set1_pd(10)));
+			truncated = _mm_div_pd(_mm_cvtepi32_pd(tenths), _mm_set1_pd(10));
+		}
+		else
+		{
+			truncated = _mm_cvtepi32_pd(_mm_cvttpd_epi32(c));
+		}
+
+		__m128d c_low = _mm_set1_pd(segments.c_low[0]);
+		__m128d i_low = _mm_set1_pd(segments.i_low[0]);
+		__m128d slope = _mm_set1_pd(segments.slope[0]);
+		for(size_t j = 1; j < aqi::BREAKPOINT_COUNT; j++)
+		{
+			const __m128d in = _mm_cmpge_pd(truncated, _mm_set1_pd(segments.c_low[j]));
+			c_low = select(in, _mm_set1_pd(segments.c_low[j]), c_low);
+			i_low = select(in, _mm_set1_pd(segments.i_low[j]), i_low);
+			slope = select(in, _mm_set1_pd(segments.slope[j]), slope);
+		}
+		const __m128d value =
+			_mm_add_pd(_mm_mul_pd(slope, _mm_sub_pd(truncated, c_low)), i_low);
+		const __m128i index = _mm_cvttpd_epi32(_mm_add_pd(value, _mm_set1_pd(0.5)));
+
+		const __m128d nowcast = select(recent, truncated, _mm_set1_pd(NOT_A_NUMBER));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(&nowcasts[s]),
+						 _mm_castps_si128(_mm_cvtpd_ps(nowcast)));
+
+		int32_t lanes[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), index);
+		const int mask = _mm_movemask_pd(recent);
+		indices[s] = (mask & 1) ? static_cast<int16_t>(lanes[0]) : aqi::NO_INDEX;
+		indices[s + 1] = (mask & 2) ? static_cast<int16_t>(lanes[1]) : aqi::NO_INDEX;
+	}
+
+	return s;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+size_t nowcast_vector(const float* const* hourly, size_t count, aqi::pollutant_t pollutant,
+					  float* nowcasts, int16_t* indices)
+{
+	const segments_t& segments = SEGMENTS[static_cast<size_t>(pollutant)];
+	const float64x2_t zero = vdupq_n_f64(0);
+	const float64x2_t one = vdupq_n_f64(1);
+	size_t s = 0;
+
+	for(; s + 2 <= count; s += 2)
+	{
+		float64x2_t v[aqi::NOWCAST_HOURS];
+		uint64x2_t valid[aqi::NOWCAST_HOURS];
+		float64x2_t lo = vdupq_n_f64(INFINITY);
+		float64x2_t hi = vdupq_n_f64(-INFINITY);
+
+		for(size_t h = 0; h < aqi::NOWCAST_HOURS; h++)
+		{
+			v[h] = vcvt_f64_f32(vld1_f32(&hourly[h][s]));
+			valid[h] = vceqq_f64(v[h], v[h]);
+			// fmin and fmax propagate NaN, so missing hours are excluded explicitly
+			lo = vbslq_f64(valid[h], vminq_f64(v[h], lo), lo);
+			hi = vbslq_f64(valid[h], vmaxq_f64(v[h], hi), hi);
+		}
+
+		const uint64x2_t recent = vorrq_u64(vandq_u64(valid[0], vorrq_u64(valid[1], valid[2])),
+											vandq_u64(valid[1], valid[2]));
+		const float64x2_t w = vbslq_f64(vcgtq_f64(hi, zero),
+										vmaxq_f64(vdivq_f64(lo, hi), vdupq_n_f64(0.5)), one);
+
+		float64x2_t factor = one;
+		float64x2_t sum = zero;
+		float64x2_t weights = zero;
+		for(size_t h = 0; h < aqi::NOWCAST_HOURS; h++)
+		{
+			// Separate multiply and add: a fused vfmaq would round differently from nowcast()
+			sum = vaddq_f64(sum, vbslq_f64(valid[h], vmulq_f64(factor, v[h]), zero));
+			weights = vaddq_f64(weights, vbslq_f64(valid[h], factor, zero));
+			factor = vmulq_f64(factor, w);
+		}
+
+		const float64x2_t c = vmaxq_f64(vdivq_f64(sum, weights), zero);
+		float64x2_t truncated;
+		if(pollutant == aqi::pollutant_t::pm2_5)
+		{
+			truncated = vdivq_f64(vrndq_f64(vmulq_f64(c, vdupq_n_f64(10))), vdupq_n_f64(10));
+		}
+		else
+		{
+			truncated = vrndq_f64(c);
+		}
+
+		float64x2_t c_low = vdupq_n_f64(segments.c_low[0]);
+		float64x2_t i_low = vdupq_n_f64(segments.i_low[0]);
+		float64x2_t slope = vdupq_n_f64(segments.slope[0]);
+		for(size_t j = 1; j < aqi::BREAKPOINT_COUNT; j++)
+		{
+			const uint64x2_t in = vcgeq_f64(truncated, vdupq_n_f64(segments.c_low[j]));
+			c_low = vbslq_f64(in, vdupq_n_f64(segments.c_low[j]), c_low);
+			i_low = vbslq_f64(in, vdupq_n_f64(segments.i_low[j]), i_low);
+			slope = vbslq_f64(in, vdupq_n_f64(segments.slope[j]), slope);
+		}
+		const float64x2_t value =
+			vaddq_f64(vmulq_f64(slope, vsubq_f64(truncated, c_low)), i_low);
+		const int64x2_t index = vbslq_s64(recent, vcvtq_s64_f64(vaddq_f64(value, vdupq_n_f64(0.5))),
+										  vdupq_n_s64(aqi::NO_INDEX));
+
+		const float64x2_t nowcast = vbslq_f64(recent, truncated, vdupq_n_f64(NOT_A_NUMBER));
+		vst1_f32(&nowcasts[s], vcvt_f32_f64(nowcast));
+		indices[s] = static_cast<int16_t>(vgetq_lane_s64(index, 0));
+		indices[s + 1] = static_cast<int16_t>(vgetq_lane_s64(index, 1));
+	}
+
+	return s;
+}
+
+#endif
+} // namespace
+
+double aqi::nowcast(const float* hourly, pollutant_t pollutant)
+{
+	assert(hourly);
+
+	const int missing_recent = std::isnan(hourly[0]) + std::isnan(hourly[1]) +
+							   std::isnan(hourly[2]);
+	if(missing_recent > 1)
+	{
+		return NOT_A_NUMBER;
+	}
+
+	double lo = INFINITY;
+	double hi = -INFINITY;
+	for(size_t h = 0; h < NOWCAST_HOURS; h++)
+	{
+		if(!std::isnan(hourly[h]))
+		{
+			lo = std::min<double>(lo, hourly[h]);
+			hi = std::max<double>(hi, hourly[h]);
+		}
+	}
+
+	// All-zero hours give a NowCast of 0 whatever the weight
+	const double w = hi > 0 ? std::max(lo / hi, 0.5) : 1;
+	double factor = 1;
+	double sum = 0;
+	double weights = 0;
+	for(size_t h = 0; h < NOWCAST_HOURS; h++)
+	{
+		if(!std::isnan(hourly[h]))
+		{
+			sum += factor * hourly[h];
+			weights += factor;
+		}
+		factor *= w;
+	}
+
+	return truncate(sum / weights, pollutant);
+}
+
+void aqi::nowcast_batch(const float* const* hourly, size_t count, pollutant_t pollutant,
+						float* nowcasts, int16_t* indices)
+{
+	assert((hourly && nowcasts && indices) || count == 0);
+
+	size_t processed = 0;
+#if defined(__SSE2__) || (defined(__aarch64__) && defined(__ARM_NEON))
+	processed = nowcast_vector(hourly, count, pollutant, nowcasts, indices);
+#endif
+	nowcast_scalar(hourly, processed, count, pollutant, nowcasts, indices);
+}
+
+aqi::engine::engine(uint32_t min_hour_samples) : min_hour_samples_(min_hour_samples)
+{
+	clear();
+}
+
+void aqi::engine::push(std::chrono::steady_clock::time_point time, float pm2_5, float pm10)
+{
+	const int64_t hour =
+		std::chrono::duration_cast<std::chrono::hours>(time.time_since_epoch()).count();
+
+	if(!started_)
+	{
+		hour_ = hour;
+		started_ = true;
+	}
+	else if(hour > hour_)
+	{
+		close_hour();
+
+		// Hours in which no sample arrived are missing; 12 of them clear the ring
+		const int64_t skipped = std::min<int64_t>(hour - hour_ - 1, NOWCAST_HOURS);
+		for(int64_t i = 0; i < skipped; i++)
+		{
+			newest_ = (newest_ + 1) % NOWCAST_HOURS;
+			hours_[0][newest_] = static_cast<float>(NOT_A_NUMBER);
+			hours_[1][newest_] = static_cast<float>(NOT_A_NUMBER);
+		}
+
+		hour_ = hour;
+		update_result();
+	}
+
+	sum_pm2_5_ += pm2_5;
+	sum_pm10_ += pm10;
+	count_++;
+}
+
+float aqi::engine::hourly(pollutant_t pollutant, size_t age) const
+{
+	assert(age < NOWCAST_HOURS);
+
+	return hours_[static_cast<size_t>(pollutant)][(newest_ + NOWCAST_HOURS - age) % NOWCAST_HOURS];
+}
+
+void aqi::engine::clear()
+{
+	started_ = false;
+	sum_pm2_5_ = 0;
+	sum_pm10_ = 0;
+	count_ = 0;
+	newest_ = 0;
+	for(auto& ring : hours_)
+	{
+		ring.fill(static_cast<float>(NOT_A_NUMBER));
+	}
+	result_ = {static_cast<float>(NOT_A_NUMBER),
+			   static_cast<float>(NOT_A_NUMBER),
+			   NO_INDEX,
+			   NO_INDEX,
+			   NO_INDEX,
+			   pollutant_t::pm2_5};
+}
+
+void aqi::engine::close_hour()
+{
+	const bool complete = count_ > 0 && count_ >= min_hour_samples_;
+
+	newest_ = (newest_ + 1) % NOWCAST_HOURS;
+	hours_[0][newest_] = complete ? static_cast<float>(sum_pm2_5_ / count_)
+								  : static_cast<float>(NOT_A_NUMBER);
+	hours_[1][newest_] = complete ? static_cast<float>(sum_pm10_ / count_)
+								  : static_cast<float>(NOT_A_NUMBER);
+
+	sum_pm2_5_ = 0;
+	sum_pm10_ = 0;
+	count_ = 0;
+}
+
+void aqi::engine::update_result()
+{
+	float latest[2][NOWCAST_HOURS];
+	double c[2];
+	int16_t indices[2];
+
+	for(size_t p = 0; p < 2; p++)
+	{
+		const auto pollutant = static_cast<pollutant_t>(p);
+		for(size_t age = 0; age < NOWCAST_HOURS; age++)
+		{
+			latest[p][age] = hourly(pollutant, age);
+		}
+		c[p] = nowcast(latest[p], pollutant);
+		indices[p] = std::isnan(c[p]) ? NO_INDEX : index(c[p], pollutant);
+	}
+
+	const bool pm10_dominates = indices[1] > indices[0];
+	result_ = {static_cast<float>(c[0]),
+			   static_cast<float>(c[1]),
+			   indices[0],
+			   indices[1],
+			   pm10_dominates ? indices[1] : indices[0],
+			   pm10_dominates ? pollutant_t::pm10 : pollutant_t::pm2_5};
+}
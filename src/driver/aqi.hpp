@@ -0,0 +1,242 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_AQI_HPP_
+#define SPS_30_AQI_HPP_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <driver.hpp>
+
+namespace sps30
+{
+/** US EPA Air Quality Index and NowCast for particulate matter
+ *
+ * The AQI of a pollutant is a piecewise-linear function of its concentration, defined by
+ * a table of breakpoints. Hourly reporting uses the NowCast concentration, a weighted
+ * average of the last 12 hourly averages that follows rapid changes:
+ *
+ * 1. c1 is the most recent complete hour, c12 the oldest. Missing hours are skipped.
+ * 2. The weight factor is w = max(cmin / cmax, 0.5) over the available hours.
+ * 3. NowCast = sum(w^(i-1) * ci) / sum(w^(i-1)).
+ * 4. At least two of the three most recent hours must be available.
+ *
+ * NowCast concentrations are truncated (PM2.5 to 0.1 μg/m^3, PM10 to 1 μg/m^3) before the
+ * index is computed, and the index is rounded to the nearest integer. Everything is computed
+ * in double precision, in the order written above, so results are reproducible.
+ *
+ * The breakpoints are those of the EPA's 2024 PM2.5 revision, and the PM10 table, which it
+ * did not change. Concentrations above the top breakpoint extend its last segment, as
+ * AirNow does for "beyond the AQI" values.
+ */
+namespace aqi
+{
+/// The pollutants the SPS-30 measures that have an AQI
+enum class pollutant_t : uint8_t
+{
+	pm2_5,
+	pm10,
+};
+
+/// One linear segment of the index
+struct breakpoint_t
+{
+	/// Lowest (truncated) concentration in the segment, in μg/m^3
+	double c_low;
+	/// Highest (truncated) concentration in the segment, in μg/m^3
+	double c_high;
+	/// Index at c_low
+	int16_t i_low;
+	/// Index at c_high
+	int16_t i_high;
+};
+
+static constexpr size_t BREAKPOINT_COUNT = 6;
+
+static constexpr std::array<breakpoint_t, BREAKPOINT_COUNT> PM2_5_BREAKPOINTS = {{
+	{0.0, 9.0, 0, 50},
+	{9.1, 35.4, 51, 100},
+	{35.5, 55.4, 101, 150},
+	{55.5, 125.4, 151, 200},
+	{125.5, 225.4, 201, 300},
+	{225.5, 325.4, 301, 500},
+}};
+
+static constexpr std::array<breakpoint_t, BREAKPOINT_COUNT> PM10_BREAKPOINTS = {{
+	{0, 54, 0, 50},
+	{55, 154, 51, 100},
+	{155, 254, 101, 150},
+	{255, 354, 151, 200},
+	{355, 424, 201, 300},
+	{425, 604, 301, 500},
+}};
+
+/// Hourly averages in a NowCast
+static constexpr size_t NOWCAST_HOURS = 12;
+
+/// Marks an unavailable index
+static constexpr int16_t NO_INDEX = -1;
+
+constexpr const std::array<breakpoint_t, BREAKPOINT_COUNT>& breakpoints(pollutant_t pollutant)
+{
+	return pollutant == pollutant_t::pm2_5 ? PM2_5_BREAKPOINTS : PM10_BREAKPOINTS;
+}
+
+/** Truncate a concentration to the precision the index is defined for
+ *
+ * @param [in] concentration A non-negative concentration in μg/m^3. Negative values are
+ *  treated as 0.
+ *
+ * @returns PM2.5 truncated to 0.1 μg/m^3, or PM10 truncated to 1 μg/m^3
+ */
+constexpr double truncate(double concentration, pollutant_t pollutant)
+{
+	if(concentration <= 0)
+	{
+		return 0;
+	}
+
+	// Converting a positive value to an integer rounds toward zero
+	return pollutant == pollutant_t::pm2_5
+			   ? static_cast<double>(static_cast<int64_t>(concentration * 10)) / 10
+			   : static_cast<double>(static_cast<int64_t>(concentration));
+}
+
+/** Compute the index of a truncated concentration
+ *
+ * @param [in] truncated A concentration returned by truncate()
+ *
+ * @returns The index, rounded to the nearest integer
+ */
+constexpr int16_t index(double truncated, pollutant_t pollutant)
+{
+	const auto& table = breakpoints(pollutant);
+	size_t segment = 0;
+	while(segment + 1 < table.size() && truncated >= table[segment + 1].c_low)
+	{
+		segment++;
+	}
+
+	const breakpoint_t& b = table[segment];
+	const double value = (b.i_high - b.i_low) / (b.c_high - b.c_low) * (truncated - b.c_low) +
+						 b.i_low;
+	return static_cast<int16_t>(value + 0.5);
+}
+
+/** Compute the NowCast concentration
+ *
+ * @param [in] hourly NOWCAST_HOURS hourly averages, most recent first. NaN marks a
+ *  missing hour.
+ *
+ * @returns The truncated NowCast concentration, or NaN if fewer than two of the three most
+ *  recent hours are available
+ */
+double nowcast(const float* hourly, pollutant_t pollutant);
+
+/** Compute NowCast concentrations and indices for many sensors
+ *
+ * Lanes of SSE2 (x86) or NEON (AArch64) double-precision vectors each evaluate one sensor,
+ * and the results are identical to nowcast() and index().
+ *
+ * @param [in] hourly NOWCAST_HOURS columns of count hourly averages: hourly[0][s] is
+ *  the most recent hour of sensor s. NaN marks a missing hour.
+ * @param [in] count The number of sensors
+ * @param [in] pollutant Selects the breakpoint table and truncation
+ * @param [out] nowcasts count truncated NowCast concentrations, NaN where unavailable
+ * @param [out] indices count indices, NO_INDEX where unavailable
+ */
+void nowcast_batch(const float* const* hourly, size_t count, pollutant_t pollutant,
+				   float* nowcasts, int16_t* indices);
+
+/** Incremental NowCast and AQI for one sensor
+ *
+ * Feed every sample from sensor::read() (e.g., via sensor::latest()) to push(). Samples
+ * are averaged into hourly buckets as they arrive; when a sample starts a new hour, the
+ * finished hour is added to a ring of the last NOWCAST_HOURS hourly averages, and the
+ * NowCast and AQI are updated. push() is constant time, and result() just returns the
+ * stored result, so a dashboard can read it every second without recomputation.
+ *
+ * Hours are aligned to the epoch of the samples' clock. Hours without enough samples count
+ * as missing, as do hours in which no sample arrived at all.
+ */
+class engine
+{
+  public:
+	/// The latest NowCast and AQI
+	struct result_t
+	{
+		/// Truncated PM2.5 NowCast in μg/m^3, or NaN
+		float nowcast_pm2_5;
+		/// Truncated PM10 NowCast in μg/m^3, or NaN
+		float nowcast_pm10;
+		/// PM2.5 index, or NO_INDEX
+		int16_t aqi_pm2_5;
+		/// PM10 index, or NO_INDEX
+		int16_t aqi_pm10;
+		/// The larger index, or NO_INDEX if neither is available
+		int16_t aqi;
+		/// The pollutant that determines aqi
+		pollutant_t dominant;
+	};
+
+	/** Create an engine with no history
+	 *
+	 * @param [in] min_hour_samples Hours with fewer samples count as missing. For example,
+	 *  EPA practice of requiring 45 minutes of data in an hour is 2700 at 1 Hz.
+	 */
+	explicit engine(uint32_t min_hour_samples = 1);
+
+	/// Add a sample
+	void push(const sensor::sample_t& sample)
+	{
+		push(sample.timestamp, sample.measurement.mc_2p5, sample.measurement.mc_10p0);
+	}
+
+	/** Add a sample
+	 *
+	 * Samples from before the current hour are counted in the current hour.
+	 */
+	void push(std::chrono::steady_clock::time_point time, float pm2_5, float pm10);
+
+	/// The result as of the last complete hour. Unavailable until two hours are complete.
+	const result_t& result() const
+	{
+		return result_;
+	}
+
+	/** Retrieve a completed hourly average
+	 *
+	 * @param [in] age 0 for the most recent complete hour. Must be less than NOWCAST_HOURS.
+	 *
+	 * @returns The average, or NaN if the hour is missing
+	 */
+	float hourly(pollutant_t pollutant, size_t age) const;
+
+	/// Discard all samples and hours
+	void clear();
+
+  private:
+	void close_hour();
+	void update_result();
+
+	uint32_t min_hour_samples_;
+	/// The hour being accumulated, counted from the clock's epoch
+	int64_t hour_ = 0;
+	bool started_ = false;
+	double sum_pm2_5_ = 0;
+	double sum_pm10_ = 0;
+	uint32_t count_ = 0;
+	/// Ring of hourly averages for each pollutant; newest_ is the latest entry
+	std::array<std::array<float, NOWCAST_HOURS>, 2> hours_;
+	size_t newest_ = 0;
+	result_t result_;
+};
+
+} // namespace aqi
+}; // end namespace sps30
+
+#endif // SPS_30_AQI_HPP_
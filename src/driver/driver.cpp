@@ -1,4 +1,6 @@
+#include <cstring>
 #include <driver.hpp>
+#include <sps30_commands.hpp>
 
 using namespace sps30;
 
@@ -34,6 +36,36 @@ enum device_status_mask_t
 	FAN_SPEED_WARNING = (1 << 21)
 };
 
+// The buffers exchanged with the transport must hold exactly what the commands send and return
+static_assert(sensor::SPS30_SERIAL_NUM_BUFFER_LEN ==
+			  describe(transport::command_t::SPS30_CMD_GET_SERIAL).response_bytes());
+static_assert(sizeof(uint16_t) ==
+			  describe(transport::command_t::SPS30_CMD_GET_FIRMWARE_VERSION).response_bytes());
+static_assert(sizeof(uint32_t) ==
+			  describe(transport::command_t::SPS30_CMD_AUTOCLEAN_INTERVAL).response_bytes());
+static_assert(sizeof(uint32_t) ==
+			  describe(transport::command_t::SPS30_CMD_AUTOCLEAN_INTERVAL).argument_bytes());
+static_assert(sizeof(uint32_t) ==
+			  describe(transport::command_t::SPS30_CMD_READ_DEVICE_STATUS_REG).response_bytes());
+static_assert(sizeof(uint16_t) ==
+			  describe(transport::command_t::SPS30_CMD_GET_DATA_READY).response_bytes());
+static_assert(sizeof(sensor::measurement_t) ==
+			  describe(transport::command_t::SPS30_CMD_READ_MEASUREMENT).response_bytes());
+
+/// Firmware older than this reports the auto-cleaning interval as of its last reset
+constexpr sensor::version_t CURRENT_AUTOCLEAN_INTERVAL_FIRMWARE = {2, 2};
+
+bool versionAtLeast_(const sensor::version_t v, const sensor::version_t min)
+{
+	return v.major > min.major || (v.major == min.major && v.minor >= min.minor);
+}
+
+bool versionSupports_(const sensor::version_t v, const transport::command_t command)
+{
+	const auto& c = describe(command);
+	return versionAtLeast_(v, {c.firmware_major, c.firmware_minor});
+}
+
 void readSerial_(const transport& t, char* const serial_buffer, size_t max_len)
 {
 	auto status = t.read(transport::command_t::SPS30_CMD_GET_SERIAL,
@@ -42,29 +74,43 @@ void readSerial_(const transport& t, char* const serial_buffer, size_t max_len)
 	assert(status == transport::status_t::OK);
 }
 
-void readFirmwareVersion_(const transport& t, sensor::version_t& v)
+bool readDataReady_(const transport& t)
 {
-	uint16_t reported_value;
-	auto status = t.read(transport::command_t::SPS30_CMD_GET_FIRMWARE_VERSION,
-						 reinterpret_cast<uint8_t*>(&reported_value), sizeof(uint16_t));
+	uint16_t flag;
+	auto status = t.read(transport::command_t::SPS30_CMD_GET_DATA_READY,
+						 reinterpret_cast<uint8_t*>(&flag), sizeof(flag));
 	assert(status == transport::status_t::OK);
 
+	return flag != 0;
+}
+
+/// The responses read when probing, stored by a script until it has run
+struct probe_responses_t
+{
+	uint16_t version;
+	uint32_t autoclean_interval;
+};
+
+/// Append the firmware version and auto-cleaning interval reads to a script
+template<size_t Capacity>
+void readVersionAndInterval_(transport::script<Capacity>& s, probe_responses_t& responses)
+{
+	s.read(transport::command_t::SPS30_CMD_GET_FIRMWARE_VERSION,
+		   reinterpret_cast<uint8_t*>(&responses.version), sizeof(responses.version));
+	s.read(transport::command_t::SPS30_CMD_AUTOCLEAN_INTERVAL,
+		   reinterpret_cast<uint8_t*>(&responses.autoclean_interval),
+		   sizeof(responses.autoclean_interval));
+}
+
+void decodeFirmwareVersion_(const uint16_t reported_value, sensor::version_t& v)
+{
 	v.major = (reported_value & 0xff00) >> 8;
 	v.minor = (reported_value & 0x00ff);
 }
 
-void readFanAutoCleanInterval_(const transport& t, std::chrono::duration<uint32_t>& d)
+/// The transport stores the interval in host byte order
+void decodeFanAutoCleanInterval_(const uint32_t value, std::chrono::duration<uint32_t>& d)
 {
-	uint32_t value;
-	auto status = t.read(transport::command_t::SPS30_CMD_AUTOCLEAN_INTERVAL,
-						 reinterpret_cast<uint8_t*>(&value), sizeof(uint32_t));
-	assert(status == transport::status_t::OK);
-	// TODO: endianness swap? handle in transport?
-#if 0
-uint32_t sensirion_bytes_to_uint32_t(const uint8_t* bytes) {
-    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
-           (uint32_t)bytes[2] << 8 | (uint32_t)bytes[3];
-#endif
 	d = std::chrono::duration<uint32_t>(value);
 }
 
@@ -116,16 +162,126 @@ bool sensor::probe()
 
 	// TODO: how to detect if the device isn't present? add a transport-check API?
 
-	// As part of probing, we read and cache the following information
-	readSerial_(transport_, serial_, SPS30_SERIAL_NUM_BUFFER_LEN);
-	readFirmwareVersion_(transport_, version_);
-	readFanAutoCleanInterval_(transport_, fan_auto_clean_interval_seconds_);
+	awaitReady();
+
+	// As part of probing, we read and cache the following information, in one script
+	probe_responses_t responses;
+	transport::script<3> s;
+	s.read(transport::command_t::SPS30_CMD_GET_SERIAL, reinterpret_cast<uint8_t*>(serial_),
+		   SPS30_SERIAL_NUM_BUFFER_LEN);
+	readVersionAndInterval_(s, responses);
+	auto status = transport_.run(s);
+	assert(status == transport::status_t::OK);
+
+	decodeFirmwareVersion_(responses.version, version_);
+	decodeFanAutoCleanInterval_(responses.autoclean_interval, fan_auto_clean_interval_seconds_);
 
 	probed_ = true;
 
 	return probed_;
 }
 
+/** Probe the SPS-30 sensor using previously cached values
+ *
+ * The serial number is read to verify that the cached values describe the sensor on
+ * the bus. If it matches, the cached firmware version and auto-cleaning interval are
+ * used without being read. Otherwise, they are read as in probe().
+ *
+ * @param [in] cached Values previously returned by probeInfo()
+ *
+ * @postcondition The firmware version, serial number, and auto-clean interval will be
+ * cached and available to the user.
+ *
+ * @returns true if the cached values were verified, false if they were read again
+ */
+bool sensor::probe(const probe_info_t& cached)
+{
+	awaitReady();
+	readSerial_(transport_, serial_, SPS30_SERIAL_NUM_BUFFER_LEN);
+
+	const bool verified = strncmp(serial_, cached.serial, SPS30_SERIAL_NUM_BUFFER_LEN) == 0;
+	if(verified)
+	{
+		version_ = cached.version;
+		fan_auto_clean_interval_seconds_ = cached.autoclean_interval;
+	}
+	else
+	{
+		probe_responses_t responses;
+		transport::script<2> s;
+		readVersionAndInterval_(s, responses);
+		auto status = transport_.run(s);
+		assert(status == transport::status_t::OK);
+
+		decodeFirmwareVersion_(responses.version, version_);
+		decodeFanAutoCleanInterval_(responses.autoclean_interval,
+									fan_auto_clean_interval_seconds_);
+	}
+
+	probed_ = true;
+
+	return verified;
+}
+
+/** Retrieve the values read by probe(), for caching
+ *
+ * @pre Sensor has been probed.
+ *
+ * @returns The serial number, firmware version, and auto-cleaning interval
+ */
+sensor::probe_info_t sensor::probeInfo() const
+{
+	assert(probed_);
+
+	probe_info_t info = {};
+	memcpy(info.serial, serial_, sizeof(info.serial));
+	info.version = version_;
+	info.autoclean_interval = fan_auto_clean_interval_seconds_;
+	return info;
+}
+
+/** Adopt a sensor that a previous run left measuring
+ *
+ * The sensor is probed with the cached values, as in probe(const probe_info_t&). If its
+ * data-ready flag is then set, and the device status register (on firmware that has it)
+ * reports no fan or laser error, the sensor is measuring: the driver is started without
+ * sending start measurement, so the sensor keeps measuring without a new settling time.
+ *
+ * A sensor whose latest measurement was already read has its flag clear until the next
+ * one, within MINIMUM_MEASUREMENT_DURATION_USEC. Call resume() again after that time, or
+ * start() to restart measuring.
+ *
+ * @param [in] cached Values previously returned by probeInfo()
+ *
+ * @post The sensor is probed, and started if it was measuring.
+ *
+ * @returns true if the sensor was measuring, and the driver is started
+ */
+bool sensor::resume(const probe_info_t& cached)
+{
+	assert(!started_ && !sleeping_);
+	probe(cached);
+
+	if(!readDataReady_(transport_))
+	{
+		return false;
+	}
+
+	// A sensor with a fan or laser error is left to be restarted
+	uint32_t flags = 0;
+	if(capabilities().device_status)
+	{
+		deviceStatus(flags);
+	}
+	if(flags & (FAN_ERROR | LASER_ERROR))
+	{
+		return false;
+	}
+
+	started_ = true;
+	return true;
+}
+
 // TODO: make match the embvm expectations
 /** Initialize the SPS-30 senso
  *
@@ -141,7 +297,21 @@ bool sensor::probe()
  */
 void sensor::start()
 {
-	assert(0);
+	assert(probed_ && !sleeping_);
+	awaitReady();
+
+	// Big-endian IEEE754 float output format, followed by the dummy byte, as one word
+	static constexpr uint16_t output_format =
+		describe(transport::command_t::SPS30_CMD_START_MEASUREMENT_ARG).opcode;
+	static_assert(sizeof(output_format) ==
+				  describe(transport::command_t::SPS30_CMD_START_MEASUREMENT).argument_bytes());
+	auto status = transport_.write(transport::command_t::SPS30_CMD_START_MEASUREMENT,
+								   reinterpret_cast<const uint8_t*>(&output_format),
+								   sizeof(output_format));
+	assert(status == transport::status_t::OK);
+	markBusy(transport::command_t::SPS30_CMD_START_MEASUREMENT);
+
+	started_ = true;
 }
 
 // TODO: make match the embvm expectations
@@ -155,7 +325,14 @@ void sensor::start()
  */
 void sensor::stop()
 {
-	assert(0);
+	assert(started_);
+	awaitReady();
+
+	auto status = transport_.write(transport::command_t::SPS30_CMD_STOP_MEASUREMENT, nullptr, 0);
+	assert(status == transport::status_t::OK);
+	markBusy(transport::command_t::SPS30_CMD_STOP_MEASUREMENT);
+
+	started_ = false;
 }
 
 /** Send a stopped sensor to sleep
@@ -169,9 +346,24 @@ void sensor::stop()
  *
  * @note This command only works on firmware 2.0 or newer
  */
-void sensor::sleep()
+transport::status_t sensor::sleep()
 {
-	assert(0);
+	assert(probed_ && !started_ && !sleeping_);
+
+	if(!supports(transport::command_t::SPS30_CMD_SLEEP))
+	{
+		gating_.rejected++;
+		return transport::status_t::SENSOR_FIRWMARE_DOES_NOT_SUPPORT_COMMAND;
+	}
+
+	awaitReady();
+	auto status = transport_.write(transport::command_t::SPS30_CMD_SLEEP, nullptr, 0);
+	assert(status == transport::status_t::OK);
+	markBusy(transport::command_t::SPS30_CMD_SLEEP);
+
+	sleeping_ = true;
+
+	return status;
 }
 
 /** Wake up the sensor from sleep mode
@@ -185,28 +377,49 @@ void sensor::sleep()
  *
  * @note This command only works on firmware 2.0 or newer
  */
-void sensor::wake()
+transport::status_t sensor::wake()
 {
-	assert(0);
+	assert(!started_ && sleeping_);
+
+	if(!supports(transport::command_t::SPS30_CMD_WAKE_UP))
+	{
+		gating_.rejected++;
+		return transport::status_t::SENSOR_FIRWMARE_DOES_NOT_SUPPORT_COMMAND;
+	}
+
+	awaitReady();
+	auto status = transport_.write(transport::command_t::SPS30_CMD_WAKE_UP, nullptr, 0);
+	assert(status == transport::status_t::OK);
+	markBusy(transport::command_t::SPS30_CMD_WAKE_UP);
+
+	sleeping_ = false;
+
+	return status;
 }
 
 /** Reset the sensor
  *
- * Resets the sensor, placing it back into the state it was in before the
- * reset instruction was issued. The caller should
+ * Resets the sensor, which restarts as after a power-up: in idle mode, not measuring.
  *
- * @post The sensor has been issued a restart command.
- * @sideeffect The sensor reboots to the same state as before the reset but takes a few
- * seconds to resume measurements. A delay of SPS30_RESET_DELAY_USEC microseconds will
- * occur before sensor interactions and data can resume. Interactions with the sensor before
- * this duration has elapsed are likely to fail.
+ * @post The sensor has been issued a restart command, and is stopped.
+ * @sideeffect The sensor takes RESET_DELAY_USEC to restart. The next transfer waits out
+ * what is left of that time. start() must be called again to resume measurements.
  *
  * @note During reset, the interface-select configuration is reinterpreted, thus Pin 4
  *  must remain in the selected state during the reset period.
  */
 void sensor::reset()
 {
-	assert(0);
+	assert(!sleeping_);
+	awaitReady();
+
+	auto status = transport_.write(transport::command_t::SPS30_CMD_RESET, nullptr, 0);
+	assert(status == transport::status_t::OK);
+
+	// The sensor restarts idle, and reports the interval last set
+	started_ = false;
+	autoclean_interval_stale_ = false;
+	markBusy(transport::command_t::SPS30_CMD_RESET);
 }
 
 /** Read the sensor firmware version
@@ -226,6 +439,83 @@ sensor::version_t sensor::firmwareVersion() const
 	return version_;
 }
 
+/** The capabilities of a firmware version
+ *
+ * @param [in] version The firmware version
+ *
+ * @returns Which optional commands and behaviors the firmware supports
+ */
+sensor::capabilities_t sensor::capabilities(const version_t version)
+{
+	capabilities_t c = {};
+	c.sleep = versionSupports_(version, transport::command_t::SPS30_CMD_SLEEP);
+	c.device_status =
+		versionSupports_(version, transport::command_t::SPS30_CMD_READ_DEVICE_STATUS_REG);
+	c.current_autoclean_interval = versionAtLeast_(version, CURRENT_AUTOCLEAN_INTERVAL_FIRMWARE);
+	return c;
+}
+
+/** The capabilities of the probed firmware
+ *
+ * @pre Sensor has been probed.
+ */
+sensor::capabilities_t sensor::capabilities() const
+{
+	assert(probed_);
+
+	return capabilities(version_);
+}
+
+/** Check whether the probed firmware supports a command
+ *
+ * @pre Sensor has been probed.
+ *
+ * @param [in] command The command
+ *
+ * @returns true if the firmware is at least the command's minimum version
+ */
+bool sensor::supports(const transport::command_t command) const
+{
+	assert(probed_);
+
+	return versionSupports_(version_, command);
+}
+
+/** Read the device status register
+ *
+ * @pre Device is probed and not in sleep mode
+ *
+ * @param [out] flags The status register's fan and laser flags, set on success
+ *
+ * @returns OK, or SENSOR_FIRWMARE_DOES_NOT_SUPPORT_COMMAND on firmware older than 2.2,
+ *  in which case nothing is sent.
+ */
+transport::status_t sensor::deviceStatus(uint32_t& flags)
+{
+	assert(!sleeping_);
+
+	if(!supports(transport::command_t::SPS30_CMD_READ_DEVICE_STATUS_REG))
+	{
+		gating_.rejected++;
+		return transport::status_t::SENSOR_FIRWMARE_DOES_NOT_SUPPORT_COMMAND;
+	}
+
+	awaitReady();
+	uint32_t value;
+	auto status = transport_.read(transport::command_t::SPS30_CMD_READ_DEVICE_STATUS_REG,
+								  reinterpret_cast<uint8_t*>(&value), sizeof(value));
+	assert(status == transport::status_t::OK);
+
+	flags = value & (FAN_ERROR | LASER_ERROR | FAN_SPEED_WARNING);
+	return status;
+}
+
+/// Bus transactions avoided since the sensor was created
+const sensor::gating_stats_t& sensor::gatingStats() const
+{
+	return gating_;
+}
+
 /** Retrieve the sensor's serial number
  *
  * @pre Sensor has been probed.
@@ -250,8 +540,9 @@ const char* sensor::serial() const
 bool sensor::dataReady()
 {
 	assert(started_);
-	assert(0);
-	return false;
+	awaitReady();
+
+	return readDataReady_(transport_);
 }
 
 /** Read a measurement
@@ -261,13 +552,41 @@ bool sensor::dataReady()
  * @pre The device has been started
  * @post Measurements have been successfully read from the device
  *
+ * @post The measurement is published and available via latest()
+ *
  * @returns A struct that contains the measured values
  */
 sensor::measurement_t sensor::read()
 {
 	assert(started_);
-	assert(0);
-	return {};
+	awaitReady();
+
+	sample_t sample;
+	auto status = transport_.read(transport::command_t::SPS30_CMD_READ_MEASUREMENT,
+								  reinterpret_cast<uint8_t*>(&sample.measurement),
+								  sizeof(measurement_t));
+	assert(status == transport::status_t::OK);
+
+	sample.timestamp = std::chrono::steady_clock::now();
+	latest_.store(sample);
+
+	return sample.measurement;
+}
+
+/** Retrieve the most recent measurement without touching the bus
+ *
+ * Returns the last measurement published by read(), along with the time it was
+ * read. This call never issues a transport transaction, never takes a lock, and
+ * never blocks the thread calling read(), so any number of threads can poll it.
+ *
+ * @note read() must only be called from a single acquisition thread.
+ *
+ * @returns A consistent copy of the latest sample. If read() has not yet
+ *  succeeded, the sample's timestamp is default-constructed.
+ */
+sensor::sample_t sensor::latest() const
+{
+	return latest_.load();
 }
 
 /** Read the current auto-cleaning interval
@@ -304,16 +623,12 @@ std::chrono::duration<uint32_t> sensor::autoCleanInterval() const
 std::chrono::duration<uint32_t>
 	sensor::autoCleanInterval(const std::chrono::seconds interval_seconds)
 {
-	// TODO: byteswap?
-#if 0
-        const uint16_t data[] = {(uint16_t)((interval_seconds & 0xFFFF0000) >> 16),
-                             (uint16_t)(interval_seconds & 0x0000FFFF)};
-#endif
 	// We know we're shortening (potentially) from 64-bits to 32-bits - the sensor only handles
 	// 32-bits, however.
 	assert(interval_seconds.count() <= UINT32_MAX); // > 32-bits won't be handled correctly
 	uint32_t count = static_cast<uint32_t>(interval_seconds.count());
 
+	awaitReady();
 	auto status = transport_.write(transport::command_t::SPS30_CMD_AUTOCLEAN_INTERVAL,
 								   reinterpret_cast<uint8_t*>(&count), sizeof(count));
 	assert(status == transport::status_t::OK);
@@ -321,13 +636,92 @@ std::chrono::duration<uint32_t>
 	// Update cached value
 	// TODO: when async, this needs to happen once the call has been confirmed to succeed
 	fan_auto_clean_interval_seconds_ = std::chrono::duration<uint32_t>(count);
+	autoclean_interval_stale_ = !capabilities().current_autoclean_interval;
 
-	// TODO: delay write flash
-	// sensirion_sleep_usec(SPS_CMD_DELAY_WRITE_FLASH_USEC);4
+	// The interval is written to flash, and the next transfer waits until it has been
+	markBusy(transport::command_t::SPS30_CMD_AUTOCLEAN_INTERVAL);
 
 	return fan_auto_clean_interval_seconds_;
 }
 
+/** Read the auto-cleaning interval from the sensor again
+ *
+ * Firmware older than 2.2 reports the interval as of its last reset. If the interval was
+ * set since then, the sensor is reset first, and the reset delay waited out, so the
+ * value read is the one set. The reset stops measurement, so start() must be called again.
+ * Otherwise, the interval is read without a reset.
+ *
+ * @pre Device is probed and not in sleep mode
+ *
+ * @returns The interval reported by the sensor, in seconds, which is also cached
+ */
+std::chrono::duration<uint32_t> sensor::refreshAutoCleanInterval()
+{
+	assert(probed_ && !sleeping_);
+	awaitReady();
+
+	// The reset, its delay, and the read are submitted together
+	transport::script<3> s;
+	if(autoclean_interval_stale_)
+	{
+		s.write(transport::command_t::SPS30_CMD_RESET);
+		s.delay(RESET_DELAY_USEC);
+	}
+	else
+	{
+		gating_.resets_skipped++;
+	}
+
+	uint32_t value;
+	s.read(transport::command_t::SPS30_CMD_AUTOCLEAN_INTERVAL, reinterpret_cast<uint8_t*>(&value),
+		   sizeof(value));
+	auto status = transport_.run(s);
+	assert(status == transport::status_t::OK);
+
+	// After a reset, the sensor is idle, and reports the interval last set
+	if(autoclean_interval_stale_)
+	{
+		started_ = false;
+		autoclean_interval_stale_ = false;
+	}
+	decodeFanAutoCleanInterval_(value, fan_auto_clean_interval_seconds_);
+	return fan_auto_clean_interval_seconds_;
+}
+
+/** Wait until the sensor accepts commands again
+ *
+ * Commands keep the sensor busy after they are acknowledged, which markBusy() records.
+ * Every transfer first waits out what is left of that time, with a transport delay step.
+ * This is the only wait after a write: the transport does not add one.
+ */
+void sensor::awaitReady()
+{
+	if(not_before_ == std::chrono::steady_clock::time_point{})
+	{
+		return;
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	if(now < not_before_)
+	{
+		transport::script<1> s;
+		s.delay(std::chrono::ceil<std::chrono::microseconds>(not_before_ - now));
+		auto status = transport_.run(s);
+		assert(status == transport::status_t::OK);
+	}
+	not_before_ = {};
+}
+
+/** Record that the sensor is busy after a command was written
+ *
+ * The sensor accepts commands again after the command's write delay: the time to
+ * write flash, for a command that does, or to restart, for a reset.
+ */
+void sensor::markBusy(const transport::command_t command)
+{
+	not_before_ = std::chrono::steady_clock::now() + describe(command).write_delay();
+}
+
 /** Immediately trigger the fan cleaning routine
  *
  * @pre The device has been started
@@ -10,6 +10,8 @@
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <seqlock.hpp>
+#include <sps30_commands.hpp>
 #include <sps30_transport.hpp>
 
 // TODO: refactor into a .cpp file??
@@ -18,7 +20,7 @@ namespace sps30
 {
 /// The delay between issuing a SPS30Sensor::reset() call and attempting to resume measurements
 static constexpr std::chrono::duration<uint32_t, std::micro> RESET_DELAY_USEC =
-	std::chrono::microseconds(100000);
+	describe(transport::command_t::SPS30_CMD_RESET).delay;
 /// The interval between measurements must be at least this duration
 /// Datasheet specifies 1±0.04s
 static constexpr std::chrono::duration<uint32_t, std::micro> MINIMUM_MEASUREMENT_DURATION_USEC =
@@ -74,7 +76,15 @@ static constexpr std::chrono::duration<uint32_t, std::micro>
  * sps30_reset() first if you need the latest value.
  *
  * We work around this by reading the value on probe(), and then we cache
- * any values that are set manually.
+ * any values that are set manually. refreshAutoCleanInterval() resets the sensor before
+ * reading the value again, but only if the firmware needs it and the interval was set
+ * since the last reset.
+ *
+ * ## Firmware Capabilities
+ *
+ * Commands that the probed firmware does not support (see capabilities()) fail with
+ * SENSOR_FIRWMARE_DOES_NOT_SUPPORT_COMMAND without a bus transaction, rather than being
+ * sent and answered with a NAK or garbage.
  */
 class sensor
 {
@@ -89,6 +99,38 @@ class sensor
 	/// The minimum length of a buffer required to hold the serial number string
 	static constexpr size_t SPS30_SERIAL_NUM_BUFFER_LEN = 32;
 
+	/// What the probed firmware supports, from the minimum versions in SPS30_COMMANDS()
+	struct capabilities_t
+	{
+		/// sleep() and wake() (firmware 2.0)
+		bool sleep;
+		/// deviceStatus() (firmware 2.2)
+		bool device_status;
+		/// The auto-cleaning interval reads back the value last set, rather than the value
+		/// at the last reset (firmware 2.2)
+		bool current_autoclean_interval;
+	};
+
+	/// Bus transactions avoided by knowing the firmware's capabilities
+	struct gating_stats_t
+	{
+		/// Commands the firmware does not support, which were rejected without being sent
+		uint32_t rejected;
+		/// Resets that refreshAutoCleanInterval() did not need
+		uint32_t resets_skipped;
+	};
+
+	/// The sensor metadata read by probe(), which can be cached between boots
+	struct probe_info_t
+	{
+		/// The sensor serial number, NUL-terminated
+		char serial[SPS30_SERIAL_NUM_BUFFER_LEN];
+		/// The firmware version
+		version_t version;
+		/// The fan auto-cleaning interval
+		std::chrono::duration<uint32_t> autoclean_interval;
+	};
+
 	// TODO: support fixed point / uint16_t values and floating point
 	// TODO: is this another secret we can hide?
 	// Perhaps with a template parameter that controsl whether values are float or uint16_t?
@@ -152,6 +194,16 @@ class sensor
 		float typical_particle_size;
 	};
 
+	/// A measurement paired with the time at which it was read from the sensor
+	struct sample_t
+	{
+		/// The measured values
+		measurement_t measurement;
+		/// The time read() retrieved the measurement.
+		/// A default-constructed time point indicates that no sample is available yet.
+		std::chrono::steady_clock::time_point timestamp;
+	};
+
   public:
 	sensor(transport& t) : transport_(t)
 	{
@@ -176,6 +228,48 @@ class sensor
 	 */
 	bool probe();
 
+	/** Probe the SPS-30 sensor using previously cached values
+	 *
+	 * The serial number is read to verify that the cached values describe the sensor on
+	 * the bus. If it matches, the cached firmware version and auto-cleaning interval are
+	 * used without being read. Otherwise, they are read as in probe().
+	 *
+	 * @param [in] cached Values previously returned by probeInfo()
+	 *
+	 * @postcondition The firmware version, serial number, and auto-clean interval will be
+	 * cached and available to the user.
+	 *
+	 * @returns true if the cached values were verified, false if they were read again
+	 */
+	bool probe(const probe_info_t& cached);
+
+	/** Retrieve the values read by probe(), for caching
+	 *
+	 * @pre Sensor has been probed.
+	 *
+	 * @returns The serial number, firmware version, and auto-cleaning interval
+	 */
+	probe_info_t probeInfo() const;
+
+	/** Adopt a sensor that a previous run left measuring
+	 *
+	 * The sensor is probed with the cached values, as in probe(const probe_info_t&). If its
+	 * data-ready flag is then set, and the device status register (on firmware that has it)
+	 * reports no fan or laser error, the sensor is measuring: the driver is started without
+	 * sending start measurement, so the sensor keeps measuring without a new settling time.
+	 *
+	 * A sensor whose latest measurement was already read has its flag clear until the next
+	 * one, within MINIMUM_MEASUREMENT_DURATION_USEC. Call resume() again after that time, or
+	 * start() to restart measuring.
+	 *
+	 * @param [in] cached Values previously returned by probeInfo()
+	 *
+	 * @post The sensor is probed, and started if it was measuring.
+	 *
+	 * @returns true if the sensor was measuring, and the driver is started
+	 */
+	bool resume(const probe_info_t& cached);
+
 	// TODO: make match the embvm expectations
 	/** Initialize the SPS-30 senso
 	 *
@@ -207,13 +301,16 @@ class sensor
 	 * The sensor will reduce its power consumption to a minimum, but must be woken
 	 * up again with wake() prior to resuming operations.
 	 *
-	 * @pre Device is stopped
+	 * @pre Device is probed and stopped
 	 * @post Device has successfully been issued a command to enter sleep mode
 	 * @sideeffect Device is placed into sleep mode
 	 *
 	 * @note This command only works on firmware 2.0 or newer
+	 *
+	 * @returns OK, or SENSOR_FIRWMARE_DOES_NOT_SUPPORT_COMMAND on older firmware, in which
+	 *  case nothing is sent and the sensor stays idle.
 	 */
-	void sleep();
+	transport::status_t sleep();
 
 	/** Wake up the sensor from sleep mode
 	 *
@@ -225,22 +322,24 @@ class sensor
 	 * @post Device is in idle mode and can be started.
 	 *
 	 * @note This command only works on firmware 2.0 or newer
+	 *
+	 * @returns OK, or SENSOR_FIRWMARE_DOES_NOT_SUPPORT_COMMAND on older firmware, in which
+	 *  case nothing is sent.
 	 */
-	void wake();
+	transport::status_t wake();
 
 	/** Reset the sensor
 	 *
-	 * Resets the sensor, placing it back into the state it was in before the
-	 * reset instruction was issued. The caller should
+	 * Resets the sensor, which restarts as after a power-up: in idle mode, not measuring.
 	 *
-	 * @post The sensor has been issued a restart command.
-	 * @sideeffect The sensor reboots to the same state as before the reset but takes a few
-	 * seconds to resume measurements. A delay of SPS30_RESET_DELAY_USEC microseconds will
-	 * occur before sensor interactions and data can resume. Interactions with the sensor before
-	 * this duration has elapsed are likely to fail.
+	 * @post The sensor has been issued a restart command, and is stopped.
+	 * @sideeffect The sensor takes RESET_DELAY_USEC to restart. The next transfer waits out
+	 * what is left of that time. start() must be called again to resume measurements.
 	 *
 	 * @note During reset, the interface-select configuration is reinterpreted, thus Pin 4
 	 *  must remain in the selected state during the reset period.
+	 *
+	 * @pre Device is not in sleep mode
 	 */
 	void reset();
 
@@ -256,6 +355,44 @@ class sensor
 	 */
 	version_t firmwareVersion() const;
 
+	/** The capabilities of a firmware version
+	 *
+	 * @param [in] version The firmware version
+	 *
+	 * @returns Which optional commands and behaviors the firmware supports
+	 */
+	static capabilities_t capabilities(const version_t version);
+
+	/** The capabilities of the probed firmware
+	 *
+	 * @pre Sensor has been probed.
+	 */
+	capabilities_t capabilities() const;
+
+	/** Check whether the probed firmware supports a command
+	 *
+	 * @pre Sensor has been probed.
+	 *
+	 * @param [in] command The command
+	 *
+	 * @returns true if the firmware is at least the command's minimum version
+	 */
+	bool supports(const transport::command_t command) const;
+
+	/** Read the device status register
+	 *
+	 * @pre Device is probed and not in sleep mode
+	 *
+	 * @param [out] flags The status register's fan and laser flags, set on success
+	 *
+	 * @returns OK, or SENSOR_FIRWMARE_DOES_NOT_SUPPORT_COMMAND on firmware older than 2.2,
+	 *  in which case nothing is sent.
+	 */
+	transport::status_t deviceStatus(uint32_t& flags);
+
+	/// Bus transactions avoided since the sensor was created
+	const gating_stats_t& gatingStats() const;
+
 	/** Retrieve the sensor's serial number
 	 *
 	 * @pre Sensor has been probed.
@@ -281,10 +418,25 @@ class sensor
 	 * @pre The device has been started
 	 * @post Measurements have been successfully read from the device
 	 *
+	 * @post The measurement is published and available via latest()
+	 *
 	 * @returns A struct that contains the measured values
 	 */
 	measurement_t read();
 
+	/** Retrieve the most recent measurement without touching the bus
+	 *
+	 * Returns the last measurement published by read(), along with the time it was
+	 * read. This call never issues a transport transaction, never takes a lock, and
+	 * never blocks the thread calling read(), so any number of threads can poll it.
+	 *
+	 * @note read() must only be called from a single acquisition thread.
+	 *
+	 * @returns A consistent copy of the latest sample. If read() has not yet
+	 *  succeeded, the sample's timestamp is default-constructed.
+	 */
+	sample_t latest() const;
+
 	/** Read the current auto-cleaning interval
 	 *
 	 * Reads the currently configured fan auto-cleaning interval. The reported value
@@ -314,6 +466,19 @@ class sensor
 	 */
 	std::chrono::duration<uint32_t> autoCleanInterval(const std::chrono::seconds interval_seconds);
 
+	/** Read the auto-cleaning interval from the sensor again
+	 *
+	 * Firmware older than 2.2 reports the interval as of its last reset. If the interval was
+	 * set since then, the sensor is reset first, and the reset delay waited out, so the
+	 * value read is the one set. The reset stops measurement, so start() must be called
+	 * again. Otherwise, the interval is read without a reset.
+	 *
+	 * @pre Device is probed and not in sleep mode
+	 *
+	 * @returns The interval reported by the sensor, in seconds, which is also cached
+	 */
+	std::chrono::duration<uint32_t> refreshAutoCleanInterval();
+
 	/** Immediately trigger the fan cleaning routine
 	 *
 	 * @pre The device has been started
@@ -321,13 +486,37 @@ class sensor
 	 */
 	void cleanFan();
 
+  private:
+	/** Wait until the sensor accepts commands again
+	 *
+	 * Commands keep the sensor busy after they are acknowledged, which markBusy() records.
+	 * Every transfer first waits out what is left of that time, with a transport delay step.
+	 * This is the only wait after a write: the transport does not add one.
+	 */
+	void awaitReady();
+
+	/** Record that the sensor is busy after a command was written
+	 *
+	 * The sensor accepts commands again after the command's write delay: the time to
+	 * write flash, for a command that does, or to restart, for a reset.
+	 */
+	void markBusy(const transport::command_t command);
+
   private:
 	bool started_ = false;
 	bool probed_ = false;
+	bool sleeping_ = false;
+	/// The interval was set on firmware that reports the old value until it is reset
+	bool autoclean_interval_stale_ = false;
+	gating_stats_t gating_ = {};
 	/// Fan auto-clean interval
 	std::chrono::duration<uint32_t> fan_auto_clean_interval_seconds_{0};
 	version_t version_ = {};
 	char serial_[SPS30_SERIAL_NUM_BUFFER_LEN] = {};
+	/// Latest sample published by read()
+	seqlock<sample_t> latest_;
+	/// The sensor does not accept commands before this time, if it is set
+	std::chrono::steady_clock::time_point not_before_{};
 	const transport& transport_;
 };
 
@@ -0,0 +1,132 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_ENERGY_HPP_
+#define SPS_30_ENERGY_HPP_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace sps30
+{
+/// The SPS-30 operating modes, which differ in supply current
+enum class power_state_t : uint8_t
+{
+	/// Measurement mode: the fan and laser are on
+	measuring,
+	/// Idle mode: powered and responsive, but not measuring
+	idle,
+	/// Sleep mode (firmware 2.0 or newer): the interface is off until woken
+	sleeping,
+};
+
+static constexpr size_t POWER_STATE_COUNT = 3;
+
+/// Supply voltage the datasheet currents are specified at
+static constexpr double SUPPLY_VOLTAGE_V = 5.0;
+/// Typical supply current in each power_state_t, in mA, from the datasheet
+static constexpr std::array<double, POWER_STATE_COUNT> SUPPLY_CURRENT_MA = {
+	// Measurement mode, averaged over the fan's operation
+	55.0,
+	// Idle mode
+	0.33,
+	// Sleep mode
+	0.038,
+};
+
+/** Energy accounting from time spent in each power state
+ *
+ * The owner of the sensor reports every power state change, and the meter integrates the
+ * datasheet supply current over time. Bus transactions are counted alongside, since they
+ * are what the host spends on a sensor; their energy is negligible next to the fan.
+ */
+class energy_meter
+{
+  public:
+	using clock = std::chrono::steady_clock;
+
+	/** Start accounting
+	 *
+	 * @param [in] state The sensor's power state at time
+	 */
+	void start(power_state_t state, clock::time_point time)
+	{
+		state_ = state;
+		since_ = time;
+		durations_.fill(clock::duration::zero());
+		transactions_ = 0;
+	}
+
+	/// Record a power state change at time
+	void transition(power_state_t state, clock::time_point time)
+	{
+		durations_[static_cast<size_t>(state_)] += time - since_;
+		state_ = state;
+		since_ = time;
+	}
+
+	/// Count transport transactions
+	void add_transactions(uint32_t count = 1)
+	{
+		transactions_ += count;
+	}
+
+	/// The current power state
+	power_state_t state() const
+	{
+		return state_;
+	}
+
+	/// Time spent in a state up to now
+	clock::duration duration(power_state_t state, clock::time_point now) const
+	{
+		auto d = durations_[static_cast<size_t>(state)];
+		if(state == state_)
+		{
+			d += now - since_;
+		}
+		return d;
+	}
+
+	/// Energy used up to now, in millijoules
+	double energy_mj(clock::time_point now) const
+	{
+		double mj = 0;
+		for(size_t s = 0; s < POWER_STATE_COUNT; s++)
+		{
+			const auto seconds =
+				std::chrono::duration<double>(duration(static_cast<power_state_t>(s), now));
+			mj += SUPPLY_VOLTAGE_V * SUPPLY_CURRENT_MA[s] * seconds.count();
+		}
+		return mj;
+	}
+
+	/// Average supply current from start() to now, in mA
+	double average_current_ma(clock::time_point now) const
+	{
+		const auto total = std::chrono::duration<double>(
+			duration(power_state_t::measuring, now) + duration(power_state_t::idle, now) +
+			duration(power_state_t::sleeping, now));
+		return total.count() > 0 ? energy_mj(now) / SUPPLY_VOLTAGE_V / total.count() : 0;
+	}
+
+	/// Transactions counted since start()
+	uint32_t transactions() const
+	{
+		return transactions_;
+	}
+
+  private:
+	power_state_t state_ = power_state_t::idle;
+	clock::time_point since_;
+	std::array<clock::duration, POWER_STATE_COUNT> durations_{};
+	uint32_t transactions_ = 0;
+};
+
+}; // end namespace sps30
+
+#endif // SPS_30_ENERGY_HPP_
@@ -0,0 +1,263 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_HISTORY_HPP_
+#define SPS_30_HISTORY_HPP_
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <driver.hpp>
+#include <measurement_fields.hpp>
+
+namespace sps30
+{
+/** Fixed-footprint measurement history with rolling window statistics
+ *
+ * Stores the last Capacity measurements in a ring, and maintains the mean, minimum, and
+ * maximum of every measurement field over WindowCount trailing windows. Each window covers
+ * the most recent N samples, where N is chosen at construction and must not exceed Capacity.
+ *
+ * Every push() updates all windows in constant (amortized) time:
+ * - Means are kept as running sums: the new sample is added, and the sample leaving the
+ *   window is subtracted.
+ * - Minimum and maximum use monotonic deques of sample indices, so the current extreme is
+ *   always at the front of the deque.
+ *
+ * No heap allocation is performed. All storage is part of the object, so a history is
+ * normally declared statically. Its footprint is roughly:
+ *
+ *     Capacity * (40 + WindowCount * 80) bytes
+ *
+ * since each window keeps a min and max deque of 32-bit indices for all ten fields.
+ * For long windows (e.g., 24 hours), feed a second history with the per-minute means of the
+ * first rather than sizing one history for 86,400 samples.
+ *
+ * @tparam Capacity The number of samples retained.
+ * @tparam WindowCount The number of rolling windows maintained.
+ */
+template<size_t Capacity, size_t WindowCount = 1>
+class history
+{
+	static_assert(Capacity > 0, "History capacity must be non-zero");
+	static_assert(WindowCount > 0, "At least one window is required");
+
+  public:
+	/// Statistics for a single window
+	struct statistics_t
+	{
+		/// Per-field mean of the samples in the window
+		sensor::measurement_t mean;
+		/// Per-field minimum of the samples in the window
+		sensor::measurement_t min;
+		/// Per-field maximum of the samples in the window
+		sensor::measurement_t max;
+		/// The number of samples in the window. Less than the window length until enough
+		/// samples have been pushed.
+		size_t count;
+	};
+
+	/** Create an empty history
+	 *
+	 * @param [in] window_lengths The length, in samples, of each rolling window.
+	 *  Each length must be in the range [1, Capacity].
+	 */
+	explicit history(const std::array<size_t, WindowCount>& window_lengths)
+	{
+		for(size_t w = 0; w < WindowCount; w++)
+		{
+			assert(window_lengths[w] > 0 && window_lengths[w] <= Capacity);
+			windows_[w].length = window_lengths[w];
+		}
+	}
+
+	/** Add a sample
+	 *
+	 * The oldest sample is overwritten once Capacity samples are stored.
+	 *
+	 * @param [in] m The measurement to add
+	 */
+	void push(const sensor::measurement_t& m)
+	{
+		const uint32_t index = next_index_;
+
+		for(auto& window : windows_)
+		{
+			const bool full = index >= window.length;
+			// The ring still holds the sample leaving the window, since length <= Capacity
+			const auto& leaving = samples_[(index - window.length) % Capacity];
+
+			for(size_t f = 0; f < MEASUREMENT_FIELD_COUNT; f++)
+			{
+				const float value = m.*measurement_fields[f];
+
+				window.sum[f] += value;
+				if(full)
+				{
+					window.sum[f] -= leaving.*measurement_fields[f];
+				}
+
+				window.min[f].push(index, window.length, [&](uint32_t i) {
+					return at_index(i).*measurement_fields[f] >= value;
+				});
+				window.max[f].push(index, window.length, [&](uint32_t i) {
+					return at_index(i).*measurement_fields[f] <= value;
+				});
+			}
+		}
+
+		// The deques evaluate the new value directly, so the ring is updated last.
+		// This allows the slot of the sample leaving a full-capacity window to be reused.
+		samples_[index % Capacity] = m;
+		next_index_++;
+	}
+
+	/// The number of samples currently stored
+	size_t size() const
+	{
+		return next_index_ < Capacity ? next_index_ : Capacity;
+	}
+
+	/// The total number of samples pushed since construction or the last clear()
+	uint32_t pushed() const
+	{
+		return next_index_;
+	}
+
+	/** Retrieve a stored sample
+	 *
+	 * @param [in] age 0 for the newest sample, 1 for the one before it, and so on.
+	 *  Must be less than size().
+	 */
+	const sensor::measurement_t& at(size_t age) const
+	{
+		assert(age < size());
+		return at_index(next_index_ - 1 - static_cast<uint32_t>(age));
+	}
+
+	/** Compute the statistics for a window
+	 *
+	 * This is constant time; nothing is recomputed over the stored samples.
+	 *
+	 * @param [in] window The window index, in the order given at construction.
+	 *
+	 * @returns The window statistics. All values are 0 if no samples have been pushed.
+	 */
+	statistics_t statistics(size_t window) const
+	{
+		assert(window < WindowCount);
+		const auto& w = windows_[window];
+
+		statistics_t stats = {};
+		stats.count = next_index_ < w.length ? next_index_ : w.length;
+		if(stats.count == 0)
+		{
+			return stats;
+		}
+
+		for(size_t f = 0; f < MEASUREMENT_FIELD_COUNT; f++)
+		{
+			auto field = measurement_fields[f];
+			stats.mean.*field = static_cast<float>(w.sum[f] / static_cast<double>(stats.count));
+			stats.min.*field = at_index(w.min[f].front()).*field;
+			stats.max.*field = at_index(w.max[f].front()).*field;
+		}
+
+		return stats;
+	}
+
+	/// Discard all samples and reset every window
+	void clear()
+	{
+		for(auto& window : windows_)
+		{
+			window.sum = {};
+			for(size_t f = 0; f < MEASUREMENT_FIELD_COUNT; f++)
+			{
+				window.min[f].clear();
+				window.max[f].clear();
+			}
+		}
+		next_index_ = 0;
+	}
+
+  private:
+	/** Bounded deque of sample indices with monotonic values
+	 *
+	 * The front index always refers to the extreme value in the window.
+	 */
+	class monotonic_deque
+	{
+	  public:
+		/** Add a new sample index
+		 *
+		 * @param [in] index The new sample's index
+		 * @param [in] length The window length
+		 * @param [in] dominated Returns true if the sample at an index can never again be
+		 *  the window's extreme, because the new sample is at least as extreme.
+		 */
+		template<typename Dominated>
+		void push(uint32_t index, size_t length, Dominated dominated)
+		{
+			while(count_ && dominated(back()))
+			{
+				count_--;
+			}
+
+			// Expire the front if it has left the window
+			if(count_ && index - front() >= length)
+			{
+				head_ = (head_ + 1) % Capacity;
+				count_--;
+			}
+
+			indices_[(head_ + count_) % Capacity] = index;
+			count_++;
+		}
+
+		uint32_t front() const
+		{
+			return indices_[head_];
+		}
+
+		void clear()
+		{
+			head_ = 0;
+			count_ = 0;
+		}
+
+	  private:
+		uint32_t back() const
+		{
+			return indices_[(head_ + count_ - 1) % Capacity];
+		}
+
+		std::array<uint32_t, Capacity> indices_;
+		size_t head_ = 0;
+		size_t count_ = 0;
+	};
+
+	struct window_t
+	{
+		size_t length = 0;
+		std::array<double, MEASUREMENT_FIELD_COUNT> sum = {};
+		std::array<monotonic_deque, MEASUREMENT_FIELD_COUNT> min;
+		std::array<monotonic_deque, MEASUREMENT_FIELD_COUNT> max;
+	};
+
+	const sensor::measurement_t& at_index(uint32_t index) const
+	{
+		return samples_[index % Capacity];
+	}
+
+	std::array<sensor::measurement_t, Capacity> samples_;
+	std::array<window_t, WindowCount> windows_;
+	uint32_t next_index_ = 0;
+};
+
+}; // end namespace sps30
+
+#endif // SPS_30_HISTORY_HPP_
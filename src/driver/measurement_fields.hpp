@@ -0,0 +1,32 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_MEASUREMENT_FIELDS_HPP_
+#define SPS_30_MEASUREMENT_FIELDS_HPP_
+
+#include <cstddef>
+#include <driver.hpp>
+
+namespace sps30
+{
+/// The number of values reported in a single sensor::measurement_t
+static constexpr size_t MEASUREMENT_FIELD_COUNT = 10;
+
+static_assert(sizeof(sensor::measurement_t) == MEASUREMENT_FIELD_COUNT * sizeof(float),
+			  "measurement_t is expected to contain only the reported float values");
+
+/// Member pointers for every measurement_t field, in the order the sensor reports them.
+/// Use this to process fields generically without relying on the struct's layout.
+static constexpr float sensor::measurement_t::*measurement_fields[MEASUREMENT_FIELD_COUNT] = {
+	&sensor::measurement_t::mc_1p0,	 &sensor::measurement_t::mc_2p5,
+	&sensor::measurement_t::mc_4p0,	 &sensor::measurement_t::mc_10p0,
+	&sensor::measurement_t::nc_0p5,	 &sensor::measurement_t::nc_1p0,
+	&sensor::measurement_t::nc_2p5,	 &sensor::measurement_t::nc_4p0,
+	&sensor::measurement_t::nc_10p0, &sensor::measurement_t::typical_particle_size,
+};
+
+}; // end namespace sps30
+
+#endif // SPS_30_MEASUREMENT_FIELDS_HPP_
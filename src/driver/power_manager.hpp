@@ -0,0 +1,314 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_POWER_MANAGER_HPP_
+#define SPS_30_POWER_MANAGER_HPP_
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <driver.hpp>
+#include <energy.hpp>
+
+namespace sps30
+{
+/** Duty-cycles a sensor so that it only runs long enough for valid readings
+ *
+ * Each cycle, the sensor is woken and started, left to settle, read `samples` times at
+ * the measurement period, then stopped and put back to sleep:
+ *
+ *     wake, start | settling_time | K reads, sample_interval apart | stop, sleep | ...
+ *
+ * The fan is on for settling_time + (K - 1) * sample_interval per cycle, which is the
+ * least that yields K valid samples, and the sensor sleeps (or idles, without sleep
+ * support) for the rest of the period. The first valid read of each cycle lands on a
+ * multiple of the period after the manager was created. When the period is too short to
+ * switch the sensor off at all, it keeps measuring and only the reads are scheduled,
+ * since restarting would cost another settling time.
+ *
+ * Every read is returned tagged with whether the sensor had settled. Reads during settling
+ * are only taken if settling_reads is set (e.g., for diagnostics).
+ *
+ * An energy_meter records the power states, and a report is produced per cycle.
+ *
+ * @tparam Sensor The sensor type. It provides read(), start(), stop(), sleep(), and wake()
+ *  with the semantics of sensor.
+ */
+template<typename Sensor = sensor>
+class power_manager
+{
+  public:
+	using clock = std::chrono::steady_clock;
+
+	struct config_t
+	{
+		/// Time from the start of one cycle to the next
+		clock::duration period = std::chrono::minutes(10);
+		/// Valid samples read per cycle
+		uint32_t samples = 3;
+		/// Time between reads: the sensor's measurement period
+		clock::duration sample_interval = MINIMUM_MEASUREMENT_DURATION_USEC;
+		/// Time the sensor needs after starting before its readings are valid
+		clock::duration settling_time = NUM_CONCENTRATION_3000_200_SETTLING_TIME_USEC;
+		/// Put the sensor to sleep between cycles (firmware 2.0 or newer), instead of idling
+		bool sleep = true;
+		/// Also read (invalid) samples while the sensor settles
+		bool settling_reads = false;
+	};
+
+	/// A read, tagged with its validity
+	struct sample_t
+	{
+		sensor::measurement_t measurement;
+		clock::time_point timestamp;
+		/// False if the sensor had not settled since it was started
+		bool valid;
+	};
+
+	/// Power use over one cycle
+	struct cycle_report_t
+	{
+		/// Time spent in each power_state_t
+		clock::duration durations[POWER_STATE_COUNT];
+		uint32_t valid_samples;
+		uint32_t invalid_samples;
+		uint32_t transactions;
+		/// Energy used, from the datasheet supply currents, in millijoules
+		double energy_mj;
+		/// Average supply current, in mA
+		double average_current_ma;
+	};
+
+	/** Create a power manager and start the first cycle
+	 *
+	 * @pre The sensor is probed, awake, and stopped.
+	 *
+	 * @param [in] s The sensor
+	 * @param [in] config The duty cycle
+	 * @param [in] now The current time
+	 */
+	power_manager(Sensor& s, const config_t& config, clock::time_point now)
+		: sensor_(s), config_(config), boundary_(now + config.settling_time),
+		  window_start_(now), continuous_(on_time(config) >= config.period)
+	{
+		assert(config.samples > 0 && config.period > clock::duration::zero());
+		energy_.start(power_state_t::idle, now);
+		open_cycle(now);
+	}
+
+	/** Perform any work due at now
+	 *
+	 * @param [in] now The current time
+	 * @param [out] sample Set to the read, if one was taken and sample is not nullptr
+	 *
+	 * @returns true if the sensor was read
+	 */
+	bool poll(clock::time_point now, sample_t* sample = nullptr)
+	{
+		if(!on_)
+		{
+			if(now < window_start_)
+			{
+				return false;
+			}
+			power_on(now);
+		}
+
+		if(now < next_read_)
+		{
+			return false;
+		}
+
+		const sample_t s = {sensor_.read(), now, now - started_at_ >= config_.settling_time};
+		energy_.add_transactions();
+		if(sample)
+		{
+			*sample = s;
+		}
+
+		if(!s.valid)
+		{
+			invalid_++;
+			next_read_ = std::min(now + config_.sample_interval, boundary_);
+			return true;
+		}
+
+		valid_++;
+		if(++taken_ < config_.samples)
+		{
+			next_read_ = std::max(boundary_ + taken_ * config_.sample_interval,
+								  now + config_.sample_interval);
+			return true;
+		}
+
+		// The window is complete
+		taken_ = 0;
+		boundary_ += config_.period;
+		window_start_ = boundary_ - config_.settling_time;
+		if(continuous_)
+		{
+			next_read_ = boundary_;
+		}
+		else
+		{
+			power_off(now);
+		}
+		close_cycle(now);
+		return true;
+	}
+
+	/// When poll() next has work to do
+	clock::time_point next_wakeup() const
+	{
+		return on_ ? next_read_ : window_start_;
+	}
+
+	/// True while the sensor is measuring
+	bool measuring() const
+	{
+		return on_;
+	}
+
+	/// True if the period is too short to switch the sensor off between cycles
+	bool continuous() const
+	{
+		return continuous_;
+	}
+
+	/// The number of completed cycles
+	uint32_t cycles() const
+	{
+		return cycles_;
+	}
+
+	/// The report for the last completed cycle
+	const cycle_report_t& last_cycle() const
+	{
+		return last_cycle_;
+	}
+
+	const energy_meter& energy() const
+	{
+		return energy_;
+	}
+
+	const config_t& config() const
+	{
+		return config_;
+	}
+
+	/// Time the fan is on per cycle: the least that yields config.samples valid reads
+	static clock::duration on_time(const config_t& config)
+	{
+		return config.settling_time + (config.samples - 1) * config.sample_interval;
+	}
+
+	/// Average supply current over a cycle, in mA, from the datasheet currents
+	static double expected_average_current_ma(const config_t& config)
+	{
+		const double on = std::chrono::duration<double>(on_time(config)).count();
+		const double period = std::chrono::duration<double>(config.period).count();
+		const auto off = config.sleep ? power_state_t::sleeping : power_state_t::idle;
+		if(on >= period)
+		{
+			return SUPPLY_CURRENT_MA[static_cast<size_t>(power_state_t::measuring)];
+		}
+		return (SUPPLY_CURRENT_MA[static_cast<size_t>(power_state_t::measuring)] * on +
+				SUPPLY_CURRENT_MA[static_cast<size_t>(off)] * (period - on)) /
+			   period;
+	}
+
+  private:
+	void power_on(clock::time_point now)
+	{
+		if(asleep_)
+		{
+			sensor_.wake();
+			energy_.add_transactions();
+			asleep_ = false;
+		}
+		sensor_.start();
+		energy_.add_transactions();
+		energy_.transition(power_state_t::measuring, now);
+		on_ = true;
+		started_at_ = now;
+		// A late start moves this cycle's reads, rather than reading before settling
+		boundary_ = std::max(boundary_, now + config_.settling_time);
+		next_read_ = config_.settling_reads ? now : boundary_;
+	}
+
+	void power_off(clock::time_point now)
+	{
+		sensor_.stop();
+		energy_.add_transactions();
+		// Firmware without sleep mode rejects sleep() without a transaction, and stays idle
+		if(config_.sleep && sensor_.sleep() == transport::status_t::OK)
+		{
+			energy_.add_transactions();
+			asleep_ = true;
+		}
+		energy_.transition(asleep_ ? power_state_t::sleeping : power_state_t::idle, now);
+		on_ = false;
+	}
+
+	void open_cycle(clock::time_point now)
+	{
+		for(size_t s = 0; s < POWER_STATE_COUNT; s++)
+		{
+			cycle_start_durations_[s] = energy_.duration(static_cast<power_state_t>(s), now);
+		}
+		cycle_start_energy_mj_ = energy_.energy_mj(now);
+		cycle_start_transactions_ = energy_.transactions();
+		valid_ = 0;
+		invalid_ = 0;
+	}
+
+	void close_cycle(clock::time_point now)
+	{
+		clock::duration total = clock::duration::zero();
+		for(size_t s = 0; s < POWER_STATE_COUNT; s++)
+		{
+			last_cycle_.durations[s] =
+				energy_.duration(static_cast<power_state_t>(s), now) - cycle_start_durations_[s];
+			total += last_cycle_.durations[s];
+		}
+		last_cycle_.valid_samples = valid_;
+		last_cycle_.invalid_samples = invalid_;
+		last_cycle_.transactions = energy_.transactions() - cycle_start_transactions_;
+		last_cycle_.energy_mj = energy_.energy_mj(now) - cycle_start_energy_mj_;
+		const double seconds = std::chrono::duration<double>(total).count();
+		last_cycle_.average_current_ma =
+			seconds > 0 ? last_cycle_.energy_mj / SUPPLY_VOLTAGE_V / seconds : 0;
+		cycles_++;
+		open_cycle(now);
+	}
+
+	Sensor& sensor_;
+	config_t config_;
+	energy_meter energy_;
+	/// The time of the first valid read in the current window
+	clock::time_point boundary_;
+	/// When the sensor is next started
+	clock::time_point window_start_;
+	clock::time_point started_at_;
+	clock::time_point next_read_;
+	const bool continuous_;
+	bool on_ = false;
+	bool asleep_ = false;
+	/// Valid reads taken in the current window
+	uint32_t taken_ = 0;
+	uint32_t valid_ = 0;
+	uint32_t invalid_ = 0;
+	uint32_t cycles_ = 0;
+	cycle_report_t last_cycle_ = {};
+	clock::duration cycle_start_durations_[POWER_STATE_COUNT] = {};
+	double cycle_start_energy_mj_ = 0;
+	uint32_t cycle_start_transactions_ = 0;
+};
+
+}; // end namespace sps30
+
+#endif // SPS_30_POWER_MANAGER_HPP_
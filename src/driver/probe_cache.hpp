@@ -0,0 +1,199 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_PROBE_CACHE_HPP_
+#define SPS_30_PROBE_CACHE_HPP_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <driver.hpp>
+#include <type_traits>
+
+namespace sps30
+{
+/** Caches the values read by probing sensors, keyed by bus position
+ *
+ * Probing reads a sensor's serial number, firmware version, and auto-cleaning interval.
+ * With a cache entry for the position (e.g., an I2C bus or multiplexer channel), only
+ * the serial number is read to verify the entry, and the rest is only read again if the
+ * sensor was replaced.
+ *
+ * The cache is kept in an image_t, a plain struct with a magic number and checksum, so it
+ * can be stored as-is in a file or non-volatile memory and restored with load() on the
+ * next boot.
+ *
+ * @tparam Positions The number of bus positions
+ * @tparam Sensor The sensor type. It provides probe(), probe(const probe_info_t&), and
+ *  probeInfo() with the semantics of sensor.
+ */
+template<size_t Positions, typename Sensor = sensor>
+class probe_cache
+{
+  public:
+	/// Identifies a cache image ("S30P" when read as little-endian bytes)
+	static constexpr uint32_t MAGIC = 0x50303353;
+
+	/// The stored form of the cache
+	struct image_t
+	{
+		/// MAGIC
+		uint32_t magic;
+		/// checksum() of the entries
+		uint32_t checksum;
+		/// Whether each position has an entry
+		bool valid[Positions];
+		/// The probed values of each position
+		sensor::probe_info_t entries[Positions];
+	};
+
+	static_assert(std::is_trivially_copyable<image_t>::value,
+				  "The image must be storable as bytes");
+
+	/// Lookup counts since the cache was created or reset_stats() was called
+	struct stats_t
+	{
+		/// Entries that were verified
+		uint32_t hits;
+		/// Entries that described a different sensor
+		uint32_t misses;
+		/// Positions without an entry
+		uint32_t uncached;
+	};
+
+  public:
+	probe_cache()
+	{
+		image_.magic = MAGIC;
+		image_.checksum = checksum(image_);
+	}
+
+	/** Probe the sensor at a position, verifying the cached values if there are any
+	 *
+	 * @param [in] position The sensor's bus position
+	 * @param [in] s The sensor
+	 *
+	 * @post The sensor is probed, and the cache entry describes it.
+	 *
+	 * @returns true if the cached values were verified
+	 */
+	bool probe(size_t position, Sensor& s)
+	{
+		assert(position < Positions);
+
+		bool hit = false;
+		if(image_.valid[position])
+		{
+			hit = s.probe(image_.entries[position]);
+			(hit ? stats_.hits : stats_.misses)++;
+		}
+		else
+		{
+			s.probe();
+			stats_.uncached++;
+		}
+
+		if(!hit)
+		{
+			image_.entries[position] = s.probeInfo();
+			image_.valid[position] = true;
+			image_.checksum = checksum(image_);
+		}
+
+		return hit;
+	}
+
+	/// Forget the entry for a position, e.g., when its sensor is removed
+	void invalidate(size_t position)
+	{
+		assert(position < Positions);
+
+		image_.valid[position] = false;
+		image_.entries[position] = {};
+		image_.checksum = checksum(image_);
+	}
+
+	/** Restore a stored image
+	 *
+	 * @param [in] image An image previously returned by image()
+	 *
+	 * @returns true if the image was restored, or false if its magic number or checksum
+	 *  do not match, in which case the cache is left unchanged.
+	 */
+	bool load(const image_t& image)
+	{
+		if(image.magic != MAGIC || image.checksum != checksum(image))
+		{
+			return false;
+		}
+
+		image_ = image;
+		return true;
+	}
+
+	/// The cache in its stored form
+	const image_t& image() const
+	{
+		return image_;
+	}
+
+	/// Whether a position has an entry
+	bool cached(size_t position) const
+	{
+		assert(position < Positions);
+		return image_.valid[position];
+	}
+
+	const stats_t& stats() const
+	{
+		return stats_;
+	}
+
+	void reset_stats()
+	{
+		stats_ = {};
+	}
+
+	/// The fraction of lookups that were verified, or 0 if there were none
+	double hit_rate() const
+	{
+		const auto lookups = stats_.hits + stats_.misses + stats_.uncached;
+		return lookups ? static_cast<double>(stats_.hits) / lookups : 0.0;
+	}
+
+  private:
+	/// FNV-1a over the entries' fields, which leaves out any padding
+	static uint32_t checksum(const image_t& image)
+	{
+		uint32_t hash = 2166136261u;
+		const auto add = [&hash](const void* data, size_t length) {
+			const auto* p = static_cast<const uint8_t*>(data);
+			for(size_t i = 0; i < length; i++)
+			{
+				hash = (hash ^ p[i]) * 16777619u;
+			}
+		};
+
+		for(size_t i = 0; i < Positions; i++)
+		{
+			const auto& entry = image.entries[i];
+			const uint32_t interval = entry.autoclean_interval.count();
+			add(&image.valid[i], sizeof(image.valid[i]));
+			add(entry.serial, sizeof(entry.serial));
+			add(&entry.version.major, sizeof(entry.version.major));
+			add(&entry.version.minor, sizeof(entry.version.minor));
+			add(&interval, sizeof(interval));
+		}
+		return hash;
+	}
+
+  private:
+	image_t image_ = {};
+	stats_t stats_ = {};
+};
+
+}; // end namespace sps30
+
+#endif // SPS_30_PROBE_CACHE_HPP_
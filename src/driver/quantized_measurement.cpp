@@ -0,0 +1,156 @@
+#include <cstring>
+#include <quantized_measurement.hpp>
+
+#if defined(__F16C__)
+	#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+using namespace sps30;
+
+uint16_t sps30::float_to_half(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+	const uint32_t abs = bits & 0x7fffffff;
+	const uint32_t exponent = abs >> 23;
+
+	if(abs >= 0x7f800000)
+	{
+		// Infinity stays infinity, NaN is quieted and keeps the upper payload bits
+		return sign | (abs > 0x7f800000 ? (0x7e00 | ((abs >> 13) & 0x3ff)) : 0x7c00);
+	}
+
+	if(abs >= 0x477ff000)
+	{
+		// Rounds past the largest half value (65504)
+		return sign | 0x7c00;
+	}
+
+	if(abs >= 0x38800000)
+	{
+		// Normal half: rebias the exponent and round off the low 13 significand bits
+		uint32_t half = (abs >> 13) - ((127 - 15) << 10);
+		const uint32_t remainder = abs & 0x1fff;
+		if(remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+		{
+			half++;
+		}
+		return sign | static_cast<uint16_t>(half);
+	}
+
+	if(exponent < 102)
+	{
+		// Below half of the smallest half subnormal (2^-25)
+		return sign;
+	}
+
+	// Subnormal half: value / 2^-24, rounded
+	const uint32_t significand = (abs & 0x7fffff) | 0x800000;
+	const uint32_t shift = 126 - exponent;
+	uint32_t half = significand >> shift;
+	const uint32_t remainder = significand & ((1u << shift) - 1);
+	const uint32_t halfway = 1u << (shift - 1);
+	if(remainder > halfway || (remainder == halfway && (half & 1)))
+	{
+		half++;
+	}
+	return sign | static_cast<uint16_t>(half);
+}
+
+float sps30::half_to_float(uint16_t value)
+{
+	const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1f;
+	uint32_t significand = value & 0x3ff;
+	uint32_t bits;
+
+	if(exponent == 0x1f)
+	{
+		bits = sign | 0x7f800000 | (significand ? (0x400000 | (significand << 13)) : 0);
+	}
+	else if(exponent != 0)
+	{
+		bits = sign | ((exponent + (127 - 15)) << 23) | (significand << 13);
+	}
+	else if(significand == 0)
+	{
+		bits = sign;
+	}
+	else
+	{
+		// Subnormal half: normalize into a float
+		exponent = 127 - 14;
+		while((significand & 0x400) == 0)
+		{
+			significand <<= 1;
+			exponent--;
+		}
+		bits = sign | (exponent << 23) | ((significand & 0x3ff) << 13);
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+void sps30::quantize(const sensor::measurement_t* in, quantized_measurement_t* out, size_t count)
+{
+	assert((in && out) || count == 0);
+
+	// Both types are dense arrays of fields, so a batch is converted as one flat run
+	const auto src = reinterpret_cast<const float*>(in);
+	const auto dst = reinterpret_cast<uint16_t*>(out);
+	const size_t n = count * MEASUREMENT_FIELD_COUNT;
+	size_t i = 0;
+
+#if defined(__F16C__)
+	for(; i + 8 <= n; i += 8)
+	{
+		const __m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(&src[i]), _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i]), half);
+	}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	for(; i + 4 <= n; i += 4)
+	{
+		vst1_u16(&dst[i], vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(&src[i]))));
+	}
+#endif
+
+	for(; i < n; i++)
+	{
+		dst[i] = float_to_half(src[i]);
+	}
+}
+
+void sps30::dequantize(const quantized_measurement_t* in, sensor::measurement_t* out,
+					   size_t count)
+{
+	assert((in && out) || count == 0);
+
+	const auto src = reinterpret_cast<const uint16_t*>(in);
+	const auto dst = reinterpret_cast<float*>(out);
+	const size_t n = count * MEASUREMENT_FIELD_COUNT;
+	size_t i = 0;
+
+#if defined(__F16C__)
+	for(; i + 8 <= n; i += 8)
+	{
+		const __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
+		_mm256_storeu_ps(&dst[i], _mm256_cvtph_ps(half));
+	}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	for(; i + 4 <= n; i += 4)
+	{
+		vst1q_f32(&dst[i], vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(&src[i]))));
+	}
+#endif
+
+	for(; i < n; i++)
+	{
+		dst[i] = half_to_float(src[i]);
+	}
+}
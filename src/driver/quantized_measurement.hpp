@@ -0,0 +1,164 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_QUANTIZED_MEASUREMENT_HPP_
+#define SPS_30_QUANTIZED_MEASUREMENT_HPP_
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <driver.hpp>
+#include <measurement_fields.hpp>
+
+namespace sps30
+{
+/** Compact (20 byte) storage encoding of a sensor::measurement_t
+ *
+ * Every field is stored as an IEEE 754 binary16 ("half") value, using round-to-nearest-even.
+ * This halves the storage required for measurement history.
+ *
+ * ## Error Bounds
+ *
+ * Half values carry an 11-bit significand, so for values in the normal half range
+ * [6.1e-5, 65504] the relative error is at most 2^-11 (0.049%). Smaller values are
+ * stored as subnormals with an absolute error of at most 2^-25 (3e-8). At the top of the
+ * sensor's specified ranges this gives:
+ *
+ * | Field                 | Range        | Max encoding error | Datasheet precision     |
+ * |-----------------------|--------------|--------------------|-------------------------|
+ * | Mass conc. PM1, PM2.5 | 0-100 μg/m^3 | ±0.031 μg/m^3      | ±10 μg/m^3              |
+ * |                       | 100-1000     | ±0.25 μg/m^3       | ±10% m.v. (≥ ±10)       |
+ * | Mass conc. PM4, PM10  | 0-100 μg/m^3 | ±0.031 μg/m^3      | ±25 μg/m^3              |
+ * |                       | 100-1000     | ±0.25 μg/m^3       | ±25% m.v. (≥ ±25)       |
+ * | Number conc. (all)    | 0-1000 #/cm^3| ±0.25 #/cm^3       | ±100 #/cm^3 (±250 PM4+) |
+ * |                       | 1000-3000    | ±1.0 #/cm^3        | ±10% m.v. (≥ ±100)      |
+ * | Typical particle size | 0-10 μm      | ±0.0039 μm         | n/a                     |
+ *
+ * The encoding error is at least 100x smaller than the datasheet precision everywhere,
+ * and smaller than the yearly long-term drift limits (±1.25 μg/m^3, ±12.5 #/cm^3).
+ *
+ * Values above 65504 (far outside the sensor's range) saturate to infinity, and NaN is
+ * preserved.
+ */
+struct quantized_measurement_t
+{
+	std::array<uint16_t, MEASUREMENT_FIELD_COUNT> values;
+};
+
+static_assert(sizeof(quantized_measurement_t) * 2 == sizeof(sensor::measurement_t),
+			  "Quantized measurements are expected to be half the size of a measurement");
+
+/// Convert a float to an IEEE binary16 value (round to nearest, ties to even)
+uint16_t float_to_half(float value);
+
+/// Convert an IEEE binary16 value to a float. This conversion is exact.
+float half_to_float(uint16_t value);
+
+/** Encode a batch of measurements
+ *
+ * Uses F16C (x86) or NEON (AArch64) conversion instructions when the compiler targets
+ * them, and a portable scalar implementation otherwise. All implementations produce
+ * identical output.
+ *
+ * @param [in] in The measurements to encode
+ * @param [out] out Storage for count encoded measurements
+ * @param [in] count The number of measurements
+ */
+void quantize(const sensor::measurement_t* in, quantized_measurement_t* out, size_t count);
+
+/** Decode a batch of measurements
+ *
+ * @param [in] in The encoded measurements
+ * @param [out] out Storage for count decoded measurements
+ * @param [in] count The number of measurements
+ */
+void dequantize(const quantized_measurement_t* in, sensor::measurement_t* out, size_t count);
+
+/// Encode a single measurement
+inline quantized_measurement_t quantize(const sensor::measurement_t& m)
+{
+	quantized_measurement_t q;
+	quantize(&m, &q, 1);
+	return q;
+}
+
+/// Decode a single measurement
+inline sensor::measurement_t dequantize(const quantized_measurement_t& q)
+{
+	sensor::measurement_t m;
+	dequantize(&q, &m, 1);
+	return m;
+}
+
+/** Fixed-footprint ring of quantized measurements
+ *
+ * Stores the last Capacity measurements at 20 bytes each, decoding on demand.
+ * For example, 24 hours of 1 Hz samples requires 1.7 MB instead of 3.4 MB.
+ *
+ * @tparam Capacity The number of samples retained.
+ */
+template<size_t Capacity>
+class compact_history
+{
+	static_assert(Capacity > 0, "History capacity must be non-zero");
+
+  public:
+	/// Add a sample, overwriting the oldest sample once Capacity samples are stored
+	void push(const sensor::measurement_t& m)
+	{
+		samples_[next_index_ % Capacity] = quantize(m);
+		next_index_++;
+	}
+
+	/// The number of samples currently stored
+	size_t size() const
+	{
+		return next_index_ < Capacity ? next_index_ : Capacity;
+	}
+
+	/** Decode a stored sample
+	 *
+	 * @param [in] age 0 for the newest sample, 1 for the one before it, and so on.
+	 *  Must be less than size().
+	 */
+	sensor::measurement_t at(size_t age) const
+	{
+		assert(age < size());
+		return dequantize(samples_[(next_index_ - 1 - age) % Capacity]);
+	}
+
+	/** Decode the stored samples, oldest first
+	 *
+	 * @param [out] out Storage for at least size() measurements
+	 *
+	 * @returns The number of measurements decoded
+	 */
+	size_t copy(sensor::measurement_t* out) const
+	{
+		const size_t count = size();
+		const size_t first = (next_index_ - count) % Capacity;
+		const size_t head = count < Capacity - first ? count : Capacity - first;
+
+		// The ring holds at most two contiguous runs, which are decoded in bulk
+		dequantize(&samples_[first], out, head);
+		dequantize(&samples_[0], out + head, count - head);
+
+		return count;
+	}
+
+	void clear()
+	{
+		next_index_ = 0;
+	}
+
+  private:
+	std::array<quantized_measurement_t, Capacity> samples_;
+	size_t next_index_ = 0;
+};
+
+}; // end namespace sps30
+
+#endif // SPS_30_QUANTIZED_MEASUREMENT_HPP_
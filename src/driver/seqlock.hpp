@@ -0,0 +1,126 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_SEQLOCK_HPP_
+#define SPS_30_SEQLOCK_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace sps30
+{
+/** Single-writer, multi-reader sequence lock
+ *
+ * A seqlock lets one writer publish a value that any number of readers can copy out
+ * without taking a mutex and without ever blocking the writer. The writer bumps the
+ * sequence counter to an odd value, stores the payload, and bumps it back to an even
+ * value. Readers copy the payload and retry if the counter was odd or changed underneath
+ * them.
+ *
+ * The payload is held in an array of relaxed atomic words so that the concurrent
+ * copy is well-defined under the C++ memory model. This also keeps the layout
+ * address-free, so a seqlock can be placed in memory shared between processes.
+ *
+ * @tparam T The published type. Must be trivially copyable.
+ *
+ * @note Only one thread may call store() at a time. Readers are unrestricted.
+ */
+template<typename T>
+class seqlock
+{
+	static_assert(std::is_trivially_copyable<T>::value,
+				  "seqlock payloads must be trivially copyable");
+
+  public:
+	/// The number of 32-bit words used to hold the payload
+	static constexpr size_t WORD_COUNT = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+	/** Publish a new value
+	 *
+	 * @param [in] value The value to publish.
+	 */
+	void store(const T& value) noexcept
+	{
+		uint32_t words[WORD_COUNT] = {};
+		memcpy(words, &value, sizeof(T));
+
+		const auto seq = sequence_.load(std::memory_order_relaxed);
+		sequence_.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		for(size_t i = 0; i < WORD_COUNT; i++)
+		{
+			data_[i].store(words[i], std::memory_order_relaxed);
+		}
+
+		sequence_.store(seq + 2, std::memory_order_release);
+	}
+
+	/** Attempt a single consistent read of the published value
+	 *
+	 * @param [out] value Storage for the value. Only modified on success.
+	 *
+	 * @returns true if a consistent copy was made, false if a store was in progress.
+	 */
+	bool try_load(T& value) const noexcept
+	{
+		uint32_t words[WORD_COUNT];
+
+		const auto before = sequence_.load(std::memory_order_acquire);
+		if(before & 1)
+		{
+			return false;
+		}
+
+		for(size_t i = 0; i < WORD_COUNT; i++)
+		{
+			words[i] = data_[i].load(std::memory_order_relaxed);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(sequence_.load(std::memory_order_relaxed) != before)
+		{
+			return false;
+		}
+
+		memcpy(&value, words, sizeof(T));
+		return true;
+	}
+
+	/** Read the published value
+	 *
+	 * Spins until a consistent copy is obtained. The writer is never blocked.
+	 *
+	 * @returns A copy of the most recently published value. A value-initialized T is
+	 *  returned if store() has never been called.
+	 */
+	T load() const noexcept
+	{
+		T value{};
+
+		while(!try_load(value))
+		{
+		}
+
+		return value;
+	}
+
+	/// The number of completed store() calls
+	uint32_t sequence() const noexcept
+	{
+		return sequence_.load(std::memory_order_acquire) >> 1;
+	}
+
+  private:
+	std::atomic<uint32_t> sequence_{0};
+	std::atomic<uint32_t> data_[WORD_COUNT] = {};
+};
+
+}; // end namespace sps30
+
+#endif // SPS_30_SEQLOCK_HPP_
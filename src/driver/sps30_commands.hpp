@@ -0,0 +1,327 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_COMMANDS_HPP_
+#define SPS_30_COMMANDS_HPP_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sensirion_common.h>
+#include <sps30_commands.h>
+#include <sps30_transport.hpp>
+
+namespace sps30
+{
+/// Describes how a transport::command_t is sent, from the SPS30_COMMANDS() table
+struct command_descriptor_t
+{
+	using delay_t = std::chrono::duration<uint32_t, std::micro>;
+
+	/// The 16-bit command sent on the bus
+	uint16_t opcode;
+	/// Argument words written after the opcode
+	uint8_t argument_words;
+	/// Words read back
+	uint8_t response_words;
+	/// How long to wait after the command before the next transfer
+	delay_t delay;
+	/// The first firmware version that supports the command
+	uint8_t firmware_major;
+	uint8_t firmware_minor;
+	/// Whether writing the arguments stores them in flash
+	bool writes_flash;
+	/// The size of each value in the arguments and response, which are big-endian on the bus
+	uint8_t value_bytes;
+
+	/// The size of the arguments, or of the response, without CRC bytes
+	constexpr size_t argument_bytes() const
+	{
+		return argument_words * 2u;
+	}
+
+	constexpr size_t response_bytes() const
+	{
+		return response_words * 2u;
+	}
+
+	/// The size of a write on the bus: the opcode, then the arguments with their CRC bytes
+	constexpr size_t write_frame_bytes() const
+	{
+		return 2u + SPS30_FRAME_BYTES(argument_words);
+	}
+
+	/// The size of a read on the bus: the response with its CRC bytes
+	constexpr size_t read_frame_bytes() const
+	{
+		return SPS30_FRAME_BYTES(response_words);
+	}
+
+	/// How long to wait after writing the command's arguments
+	constexpr delay_t write_delay() const
+	{
+		return writes_flash ? delay_t(SPS30_WRITE_FLASH_DELAY_USEC) : delay;
+	}
+};
+
+/// The descriptor of every transport::command_t, indexed by the command
+static constexpr command_descriptor_t COMMAND_DESCRIPTORS[] = {
+#define SPS30_COMMAND_DESCRIPTOR_(name, opcode, args, resp, delay_usec, major, minor, flash, \
+								  value)                                                   \
+	{opcode, args, resp, std::chrono::microseconds(delay_usec), major, minor, flash != 0, value},
+	SPS30_COMMANDS(SPS30_COMMAND_DESCRIPTOR_)
+#undef SPS30_COMMAND_DESCRIPTOR_
+};
+
+/// Look up how a command is sent
+constexpr const command_descriptor_t& describe(transport::command_t command)
+{
+	return COMMAND_DESCRIPTORS[command];
+}
+
+// The table is indexed by command_t, so its rows must stay in the order of the enumeration
+#define SPS30_COMMAND_ORDER_CHECK_(name, opcode, args, resp, delay_usec, major, minor, flash, \
+								   value)                                                   \
+	static_assert(static_cast<int>(transport::command_t::SPS30_CMD_##name) ==                \
+					  static_cast<int>(SPS30_COMMAND_INDEX_##name),                             \
+				  "SPS30_COMMANDS() is out of order with transport::command_t at " #name);
+SPS30_COMMANDS(SPS30_COMMAND_ORDER_CHECK_)
+#undef SPS30_COMMAND_ORDER_CHECK_
+
+static_assert(sizeof(COMMAND_DESCRIPTORS) / sizeof(COMMAND_DESCRIPTORS[0]) ==
+				  transport::command_t::SPS30_CMD_WAKE_UP + 1,
+			  "Every transport::command_t needs a descriptor");
+
+/// Whether two commands share an opcode. START_MEASUREMENT_ARG is an argument, not a
+/// command, so it may share the opcode of READ_MEASUREMENT.
+constexpr bool command_opcodes_unique()
+{
+	constexpr size_t count = sizeof(COMMAND_DESCRIPTORS) / sizeof(COMMAND_DESCRIPTORS[0]);
+	for(size_t i = 0; i < count; i++)
+	{
+		for(size_t j = i + 1; j < count; j++)
+		{
+			if(i != transport::command_t::SPS30_CMD_START_MEASUREMENT_ARG &&
+			   j != transport::command_t::SPS30_CMD_START_MEASUREMENT_ARG &&
+			   COMMAND_DESCRIPTORS[i].opcode == COMMAND_DESCRIPTORS[j].opcode)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static_assert(command_opcodes_unique(), "Two commands in SPS30_COMMANDS() share an opcode");
+
+/// Whether every command's arguments and response hold whole values
+constexpr bool command_values_whole()
+{
+	for(const auto& descriptor : COMMAND_DESCRIPTORS)
+	{
+		if(descriptor.value_bytes == 0 || descriptor.argument_bytes() % descriptor.value_bytes ||
+		   descriptor.response_bytes() % descriptor.value_bytes)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static_assert(command_values_whole(),
+			  "A command in SPS30_COMMANDS() has a payload that is not a whole number of values");
+
+/// Whether the host stores the most significant byte of a value first, as the bus does
+constexpr bool HOST_BIG_ENDIAN = __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+
+/** The position on the bus of a payload byte, from its position in host order
+ *
+ * The transport exchanges values in host byte order, while the bus carries them big-endian.
+ * On a little-endian host, the bytes of each value are therefore reversed. Byte strings,
+ * with value_bytes 1, are never reordered.
+ *
+ * @param [in] byte The position of the byte in the payload, as the caller stores it
+ * @param [in] value_bytes The size of each value, see command_descriptor_t::value_bytes
+ *
+ * @returns The position of the byte in the payload on the bus, without CRC bytes
+ */
+constexpr size_t bus_byte(const size_t byte, const size_t value_bytes)
+{
+	const size_t offset = byte % value_bytes;
+	return HOST_BIG_ENDIAN ? byte : byte - offset + value_bytes - 1 - offset;
+}
+
+/** The CRC of a word, as sent after each word on the bus
+ *
+ * @param [in] word The word
+ *
+ * @returns The CRC-8 (polynomial 0x31, initial value 0xff) of the word's big-endian bytes
+ */
+constexpr uint8_t crc8(const uint16_t word)
+{
+	uint8_t crc = 0xff;
+	for(const uint8_t byte : {static_cast<uint8_t>(word >> 8), static_cast<uint8_t>(word)})
+	{
+		crc ^= byte;
+		for(int bit = 0; bit < 8; bit++)
+		{
+			crc = static_cast<uint8_t>((crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1);
+		}
+	}
+	return crc;
+}
+
+/// The bytes of a command as written on the bus
+template<size_t ArgumentWords>
+using frame_t = std::array<uint8_t, 2 + SPS30_FRAME_BYTES(ArgumentWords)>;
+
+/** Build the bytes of a command at compile time
+ *
+ * @param [in] command The command
+ * @param [in] arguments The command's argument words, each followed by its CRC in the frame
+ *
+ * @returns The opcode followed by the arguments, ready to be written as-is
+ */
+template<size_t ArgumentWords>
+constexpr frame_t<ArgumentWords> make_frame(const transport::command_t command,
+											const uint16_t (&arguments)[ArgumentWords])
+{
+	frame_t<ArgumentWords> frame = {};
+	const uint16_t opcode = describe(command).opcode;
+	frame[0] = static_cast<uint8_t>(opcode >> 8);
+	frame[1] = static_cast<uint8_t>(opcode);
+	for(size_t i = 0; i < ArgumentWords; i++)
+	{
+		frame[2 + 3 * i] = static_cast<uint8_t>(arguments[i] >> 8);
+		frame[3 + 3 * i] = static_cast<uint8_t>(arguments[i]);
+		frame[4 + 3 * i] = crc8(arguments[i]);
+	}
+	return frame;
+}
+
+/// Build the bytes of a command without arguments at compile time
+constexpr frame_t<0> make_frame(const transport::command_t command)
+{
+	const uint16_t opcode = describe(command).opcode;
+	return {static_cast<uint8_t>(opcode >> 8), static_cast<uint8_t>(opcode)};
+}
+
+/// The frames of commands that are always sent with the same bytes
+namespace frames
+{
+static constexpr auto START_MEASUREMENT =
+	make_frame(transport::command_t::SPS30_CMD_START_MEASUREMENT,
+			   {describe(transport::command_t::SPS30_CMD_START_MEASUREMENT_ARG).opcode});
+static constexpr auto START_MEASUREMENT_UINT16 = make_frame(
+	transport::command_t::SPS30_CMD_START_MEASUREMENT, {SPS30_START_MEASUREMENT_ARG_UINT16});
+static constexpr auto STOP_MEASUREMENT =
+	make_frame(transport::command_t::SPS30_CMD_STOP_MEASUREMENT);
+static constexpr auto READ_MEASUREMENT =
+	make_frame(transport::command_t::SPS30_CMD_READ_MEASUREMENT);
+static constexpr auto GET_DATA_READY = make_frame(transport::command_t::SPS30_CMD_GET_DATA_READY);
+static constexpr auto SLEEP = make_frame(transport::command_t::SPS30_CMD_SLEEP);
+static constexpr auto WAKE_UP = make_frame(transport::command_t::SPS30_CMD_WAKE_UP);
+static constexpr auto RESET = make_frame(transport::command_t::SPS30_CMD_RESET);
+static constexpr auto READ_DEVICE_STATUS_REG =
+	make_frame(transport::command_t::SPS30_CMD_READ_DEVICE_STATUS_REG);
+}; // namespace frames
+
+/** Check the CRC of each word of a frame, then store the payload's values in the destinations
+ *
+ * The payload is decoded directly from the frame into iov[0], iov[1], and so on, without
+ * an intermediate copy. Each value is stored in host byte order, see bus_byte(). Nothing is
+ * stored unless every CRC matches.
+ *
+ * @param [in] frame The words as read on the bus, each followed by its CRC
+ * @param [in] words The number of words in frame
+ * @param [in] value_bytes The size of each value in the payload
+ * @param [in] iov The destinations, which together hold at most words * 2 bytes
+ * @param [in] count The number of destinations
+ *
+ * @returns OK, or BUS_ERROR if a CRC does not match
+ */
+inline transport::status_t unpack_frame(const uint8_t* const frame, const size_t words,
+										const size_t value_bytes,
+										const transport::rx_span_t* const iov, const size_t count)
+{
+	for(size_t i = 0; i < words; i++)
+	{
+		const uint8_t* const word = &frame[SPS30_FRAME_BYTES(i)];
+		if(crc8(static_cast<uint16_t>((word[0] << 8) | word[1])) != word[2])
+		{
+			return transport::status_t::BUS_ERROR;
+		}
+	}
+
+	size_t byte = 0;
+	for(size_t i = 0; i < count; i++)
+	{
+		for(size_t j = 0; j < iov[i].length; j++, byte++)
+		{
+			const size_t bus = bus_byte(byte, value_bytes);
+			assert(bus < words * 2u);
+			// Skip the CRC after every second byte
+			iov[i].data[j] = frame[bus + bus / 2];
+		}
+	}
+
+	return transport::status_t::OK;
+}
+
+/** The receive buffer for a command's response, as read on the bus
+ *
+ * The buffer is aligned and padded to whole cache lines, so a DMA backend can receive into
+ * it and invalidate its cache lines without touching neighbouring data. The response is then
+ * checked and decoded in place, into host byte order, with unpack().
+ */
+template<transport::command_t Command>
+struct alignas(SENSIRION_CACHE_LINE_SIZE) rx_frame_t
+{
+	/// The bytes of the response on the bus, including a CRC byte per word
+	static constexpr size_t FRAME_BYTES = describe(Command).read_frame_bytes();
+	static_assert(FRAME_BYTES > 0, "The command has no response");
+
+	uint8_t bytes[SENSIRION_RX_BUFFER_SIZE(FRAME_BYTES)];
+
+	/// The part of the buffer that the response is read into
+	transport::rx_span_t frame()
+	{
+		return {bytes, FRAME_BYTES};
+	}
+
+	/// Check the response and store its payload in the destinations, see unpack_frame()
+	transport::status_t unpack(const transport::rx_span_t* const iov, const size_t count) const
+	{
+		return unpack_frame(bytes, describe(Command).response_words, describe(Command).value_bytes,
+							iov, count);
+	}
+};
+
+// SPS30_CRC8() builds the C drivers' frames from per-bit constants; they must agree with crc8()
+static_assert(SPS30_CRC8(0) == crc8(0));
+#define SPS30_CRC8_CHECK_BIT_(bit) \
+	static_assert(SPS30_CRC8(1u << (bit)) == crc8(1u << (bit)), "SPS30_CRC8() bit " #bit);
+SPS30_CRC8_CHECK_BIT_(0)
+SPS30_CRC8_CHECK_BIT_(1)
+SPS30_CRC8_CHECK_BIT_(2)
+SPS30_CRC8_CHECK_BIT_(3)
+SPS30_CRC8_CHECK_BIT_(4)
+SPS30_CRC8_CHECK_BIT_(5)
+SPS30_CRC8_CHECK_BIT_(6)
+SPS30_CRC8_CHECK_BIT_(7)
+SPS30_CRC8_CHECK_BIT_(8)
+SPS30_CRC8_CHECK_BIT_(9)
+SPS30_CRC8_CHECK_BIT_(10)
+SPS30_CRC8_CHECK_BIT_(11)
+SPS30_CRC8_CHECK_BIT_(12)
+SPS30_CRC8_CHECK_BIT_(13)
+SPS30_CRC8_CHECK_BIT_(14)
+SPS30_CRC8_CHECK_BIT_(15)
+#undef SPS30_CRC8_CHECK_BIT_
+
+}; // end namespace sps30
+
+#endif // SPS_30_COMMANDS_HPP_
@@ -1,81 +1,201 @@
 #include <cassert>
 #include <chrono>
+#include <sensirion_i2c.h>
+#include <sps30.h>
+#include <sps30_commands.hpp>
 #include <sps30_transport.hpp>
 
-static constexpr std::chrono::duration<uint16_t, std::micro> START_STOP_DELAY_USEC =
-	std::chrono::microseconds(20000);
-static constexpr std::chrono::duration<uint16_t, std::micro> CMD_DELAY_USEC =
-	std::chrono::microseconds(5000);
-static constexpr std::chrono::duration<uint16_t, std::micro> WRITE_FLASH_DELAY_USEC =
-	std::chrono::microseconds(20000);
-
-static constexpr uint16_t i2c_transport_command_conversion[] = {
-	// SPS30_CMD_START_MEASUREMENT
-	0x0010,
-	// SPS30_CMD_START_MEASUREMENT_ARG
-	0x0300,
-	// SPS30_CMD_STOP_MEASUREMENT
-	0x0104,
-	// SPS30_CMD_READ_MEASUREMENT
-	0x0300,
-	// SPS30_CMD_GET_DATA_READY
-	0x2020,
-	// SPS30_CMD_AUTOCLEAN_INTERVAL
-	0x8004,
-	// SPS30_CMD_GET_FIRMWARE_VERSION
-	0xd100,
-	// SPS30_CMD_GET_SERIAL
-	0xd033,
-	// SPS30_CMD_RESET
-	0xd304,
-	// SPS30_CMD_SLEEP
-	0x1001,
-	// SPS30_CMD_READ_DEVICE_STATUS_REG
-	0xd206,
-	// SPS30_CMD_START_MANUAL_FAN_CLEANING
-	0x5607,
-	// SPS30_CMD_WAKE_UP
-	0x1103};
-
-#if 0
-transport::status_t transport::read(const transport::command_t command, uint8_t* const data,
-									const size_t length) const
+using namespace sps30;
+
+/// Opcodes are taken from the command registry, which is indexed by transport::command_t
+static constexpr uint16_t i2c_transport_opcode(const transport::command_t command)
 {
-	assert(data && length);
+	return describe(command).opcode;
+}
 
-	switch(command)
+namespace
+{
+/// The most argument words, and response words, of any command
+constexpr size_t max_words(const bool response)
+{
+	size_t most = 0;
+	for(const auto& descriptor : COMMAND_DESCRIPTORS)
 	{
-		case transport::command_t::SPS30_CMD_GET_SERIAL:
-			handle_get_serial(data, length);
-			break;
-		case transport::command_t::SPS30_CMD_AUTOCLEAN_INTERVAL:
-			handle_get_autoclean_interval(data, length);
-			break;
-		case transport::command_t::SPS30_CMD_GET_FIRMWARE_VERSION:
-			handle_get_version(data, length);
-			break;
-		default:
-			assert(0); // unexpected input
+		const size_t words = response ? descriptor.response_words : descriptor.argument_words;
+		most = words > most ? words : most;
 	}
-
-	return transport::status_t::OK;
+	return most;
 }
 
-transport::status_t transport::write(const transport::command_t command, const uint8_t* const data,
-									 const size_t length) const
+/// Every write fits in this many bytes: the opcode, then the arguments with their CRCs
+constexpr size_t I2C_TRANSPORT_TX_BYTES = 2 + SPS30_FRAME_BYTES(max_words(false));
+/// Every response fits in this many bytes, padded to whole cache lines
+constexpr size_t I2C_TRANSPORT_RX_BYTES =
+	SENSIRION_RX_BUFFER_SIZE(SPS30_FRAME_BYTES(max_words(true)));
+/// The most steps run() submits; every script in the driver is shorter
+constexpr size_t I2C_TRANSPORT_MAX_STEPS = 8;
+
+/// A response as read on the bus. Cache-line aligned, so a DMA HAL can receive straight into it.
+struct alignas(SENSIRION_CACHE_LINE_SIZE) i2c_rx_frame_t
 {
-	assert(data && length);
+	uint8_t bytes[I2C_TRANSPORT_RX_BYTES];
+};
 
-	switch(command)
+/** The messages of a sequence of steps, and the frames they write and read
+ *
+ * Writes and reads are appended as sensirion_i2c_msg entries, and a delay extends the
+ * wait after the message before it, so the whole sequence is one sensirion_i2c_transfer().
+ * A write is not followed by its command's delay, which the caller waits out, see
+ * transport::writev(). Responses stay in their frames until they are unpacked after the
+ * transfer.
+ */
+class i2c_batch
+{
+  public:
+	/// Append a command, with its arguments gathered from iov in host byte order
+	void write(const transport::command_t command, const transport::tx_span_t* const iov,
+			   const size_t count)
 	{
-		case transport::command_t::SPS30_CMD_AUTOCLEAN_INTERVAL:
-			handle_set_autoclean_interval(data, length);
-			break;
-		default:
-			assert(0); // unexpected input
+		assert(writes_ < I2C_TRANSPORT_MAX_STEPS && msg_count_ < MAX_MESSAGES);
+		assert(iov || count == 0);
+
+		const auto& descriptor = describe(command);
+		uint8_t* const frame = tx_frames_[writes_++];
+		const uint16_t opcode = i2c_transport_opcode(command);
+		frame[0] = static_cast<uint8_t>(opcode >> 8);
+		frame[1] = static_cast<uint8_t>(opcode);
+
+		// Each value is sent big-endian, then each argument word is followed by its CRC
+		size_t byte = 0;
+		for(size_t i = 0; i < count; i++)
+		{
+			for(size_t j = 0; j < iov[i].length; j++, byte++)
+			{
+				const size_t bus = bus_byte(byte, descriptor.value_bytes);
+				frame[2 + bus + bus / 2] = iov[i].data[j];
+			}
+		}
+		assert(byte == descriptor.argument_bytes());
+		for(size_t i = 0; i < descriptor.argument_words; i++)
+		{
+			uint8_t* const word = &frame[2 + SPS30_FRAME_BYTES(i)];
+			word[2] = crc8(static_cast<uint16_t>((word[0] << 8) | word[1]));
+		}
+
+		sensirion_i2c_msg& msg = msgs_[msg_count_++];
+		msg = {};
+		msg.address = SPS30_I2C_ADDRESS;
+		msg.count = static_cast<uint16_t>(descriptor.write_frame_bytes());
+		msg.tx = frame;
 	}
 
-	return transport::status_t::OK;
+	/// Append a command and the read of its response; returns the response's index
+	size_t read(const transport::command_t command)
+	{
+		assert(reads_ < I2C_TRANSPORT_MAX_STEPS && msg_count_ + 2 <= MAX_MESSAGES);
+
+		const auto& descriptor = describe(command);
+		const uint16_t opcode = i2c_transport_opcode(command);
+		uint8_t* const request = requests_[reads_];
+		request[0] = static_cast<uint8_t>(opcode >> 8);
+		request[1] = static_cast<uint8_t>(opcode);
+		assert(descriptor.read_frame_bytes() <= sizeof(i2c_rx_frame_t));
+
+		sensirion_i2c_msg& request_msg = msgs_[msg_count_++];
+		request_msg = {};
+		request_msg.address = SPS30_I2C_ADDRESS;
+		request_msg.count = 2;
+		request_msg.tx = request;
+		request_msg.delay_usec = descriptor.delay.count();
+
+		sensirion_i2c_msg& response_msg = msgs_[msg_count_++];
+		response_msg = {};
+		response_msg.address = SPS30_I2C_ADDRESS;
+		response_msg.flags = SENSIRION_I2C_MSG_READ;
+		response_msg.count = static_cast<uint16_t>(descriptor.read_frame_bytes());
+		response_msg.rx = rx_frames_[reads_].bytes;
+
+		response_words_[reads_] = descriptor.response_words;
+		value_bytes_[reads_] = descriptor.value_bytes;
+		return reads_++;
+	}
+
+	/// Wait before the next message. A delay before any message is slept right away.
+	void delay(const std::chrono::microseconds delay)
+	{
+		if(msg_count_ == 0)
+		{
+			sensirion_sleep_usec(static_cast<uint32_t>(delay.count()));
+		}
+		else
+		{
+			msgs_[msg_count_ - 1].delay_usec += static_cast<uint32_t>(delay.count());
+		}
+	}
+
+	/// Execute the messages as one transfer, which stops at the first that fails
+	transport::status_t submit() const
+	{
+		if(msg_count_ == 0)
+		{
+			return transport::status_t::OK;
+		}
+
+		return sensirion_i2c_transfer(msgs_, static_cast<uint16_t>(msg_count_)) == NO_ERROR ?
+				   transport::status_t::OK :
+				   transport::status_t::BUS_ERROR;
+	}
+
+	/// Check a response and store its values in the destinations, see unpack_frame()
+	transport::status_t unpack(const size_t response, const transport::rx_span_t* const iov,
+							   const size_t count) const
+	{
+		assert(response < reads_);
+		return unpack_frame(rx_frames_[response].bytes, response_words_[response],
+							value_bytes_[response], iov, count);
+	}
+
+  private:
+	static constexpr size_t MAX_MESSAGES = 2 * I2C_TRANSPORT_MAX_STEPS;
+
+	i2c_rx_frame_t rx_frames_[I2C_TRANSPORT_MAX_STEPS];
+	sensirion_i2c_msg msgs_[MAX_MESSAGES];
+	size_t msg_count_ = 0;
+	uint8_t tx_frames_[I2C_TRANSPORT_MAX_STEPS][I2C_TRANSPORT_TX_BYTES];
+	size_t writes_ = 0;
+	uint8_t requests_[I2C_TRANSPORT_MAX_STEPS][2];
+	uint8_t response_words_[I2C_TRANSPORT_MAX_STEPS];
+	uint8_t value_bytes_[I2C_TRANSPORT_MAX_STEPS];
+	size_t reads_ = 0;
+};
+} // namespace
+
+transport::status_t transport::readv(const transport::command_t command,
+									 const transport::rx_span_t* const iov,
+									 const size_t count) const
+{
+	assert(iov && count);
+
+	i2c_batch batch;
+	const size_t response = batch.read(command);
+	const auto status = batch.submit();
+	if(status != transport::status_t::OK)
+	{
+		return status;
+	}
+
+	// The CRCs are checked and stripped, and the values put in host byte order, as the payload
+	// is stored in the caller's buffers
+	return batch.unpack(response, iov, count);
+}
+
+transport::status_t transport::writev(const transport::command_t command,
+									  const transport::tx_span_t* const iov,
+									  const size_t count) const
+{
+	i2c_batch batch;
+	batch.write(command, iov, count);
+	return batch.submit();
 }
 
 transport::status_t transport::transcieve(const transport::command_t command,
@@ -93,4 +213,48 @@ transport::status_t transport::transcieve(const transport::command_t command,
 
 	return transport::status_t::OK;
 }
-#endif
+
+/*
+ * The steps are translated into sensirion_i2c_msg entries and submitted with one
+ * sensirion_i2c_transfer(), so the HAL can chain the transfers between delays. The HAL stops
+ * at the first message that fails. CRCs are checked after the transfer, in order, so a
+ * response that fails its check has already been followed on the bus by the steps after it.
+ */
+transport::status_t transport::run(const transport::step_t* const steps, const size_t count) const
+{
+	assert(steps || count == 0);
+	assert(count <= I2C_TRANSPORT_MAX_STEPS);
+
+	size_t responses[I2C_TRANSPORT_MAX_STEPS];
+	i2c_batch batch;
+	for(size_t i = 0; i < count; i++)
+	{
+		const step_t& step = steps[i];
+		const tx_span_t args = {step.tx_data, step.length};
+
+		switch(step.kind)
+		{
+			case step_t::WRITE:
+				batch.write(step.command, &args, step.length ? 1 : 0);
+				break;
+			case step_t::READ:
+				responses[i] = batch.read(step.command);
+				break;
+			case step_t::DELAY:
+				batch.delay(step.delay);
+				break;
+		}
+	}
+
+	auto status = batch.submit();
+	for(size_t i = 0; i < count && status == transport::status_t::OK; i++)
+	{
+		if(steps[i].kind == step_t::READ)
+		{
+			const rx_span_t destination = {steps[i].rx_data, steps[i].length};
+			status = batch.unpack(responses[i], &destination, 1);
+		}
+	}
+
+	return status;
+}
@@ -1,8 +1,10 @@
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <driver.hpp> // for some details, like SPS30_SERIAL_NUM_BUFFER_LEN
 #include <sps30_transport.hpp>
 #include <stdio.h>
+#include <thread>
 
 using namespace sps30;
 
@@ -19,6 +21,33 @@ constexpr const char SPS30_TEST_SERIAL[] = "SPS30TESTTRANSPORT";
 // will leave this as-is for now and think about how to update it in the future if it causes
 // problems.
 std::chrono::duration<uint32_t> autoclean_interval_(604800); // defaults to one week (in seconds)
+// Like firmware older than 2.2, the interval that is read back is the one set before the last
+// reset
+std::chrono::duration<uint32_t> reported_autoclean_interval_ = autoclean_interval_;
+
+/// Measurements recorded from a real device (see sps30_recorded_data.c).
+/// The test transport cycles through these values on each measurement read.
+constexpr sensor::measurement_t simulated_measurements_[] = {
+	{0.1628956050f, 0.2644746304f, 0.3391090930f, 0.3540358543f, 0.8901749253f, 1.1843987703f,
+	 1.2940582037f, 1.3163284063f, 1.3195588589f, 0.7204053998f},
+	{1.0780845881f, 1.4293757677f, 1.6635462046f, 1.7103787661f, 6.7429466248f, 8.2304849625f,
+	 8.5852422714f, 8.6565103531f, 8.6674308777f, 0.6293675900f},
+	{6.4453110695f, 7.2207860947f, 7.5486493111f, 7.6142153740f, 43.8269462585f, 50.8229331970f,
+	 51.4127349854f, 51.5246505737f, 51.5467681885f, 0.6570276618f},
+	{8.3007287979f, 12.5388498306f, 15.5828180313f, 16.1916084290f, 47.8495903015f, 61.4989509583f,
+	 66.0026779175f, 66.9150390625f, 67.0490875244f, 0.8576955795f},
+	{8.4688024521f, 19.5325355530f, 28.0928020477f, 29.8048496246f, 30.9383926392f, 54.5167579651f,
+	 66.9015884399f, 69.4307708740f, 69.7871704102f, 1.1527029276f},
+	{0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.6299999952f},
+};
+
+/// Scattered reads and gathered writes pass through here, as the handlers take one buffer
+constexpr size_t BOUNCE_BUFFER_SIZE =
+	std::max(sensor::SPS30_SERIAL_NUM_BUFFER_LEN, sizeof(sensor::measurement_t));
+
+size_t simulated_measurement_index_ = 0;
+bool measuring_ = false;
+bool sleeping_ = false;
 }; // namespace
 
 #pragma mark - Private Functions -
@@ -41,22 +70,79 @@ void handle_get_version(uint8_t* const data, const size_t length)
 void handle_get_autoclean_interval(uint8_t* const data, const size_t length)
 {
 	assert(length == 4); // expected data size
-	*reinterpret_cast<uint32_t* const>(data) = autoclean_interval_.count();
+	*reinterpret_cast<uint32_t* const>(data) = reported_autoclean_interval_.count();
 }
 
 void handle_set_autoclean_interval(const uint8_t* const data, const size_t length)
 {
-	assert(length == 4); // expected data size
+	assert(data && length == 4); // expected data size
 	autoclean_interval_ =
 		std::chrono::duration<uint32_t>(*reinterpret_cast<const uint32_t* const>(data));
 }
 
-}; // namespace
+void handle_start_measurement(const uint8_t* const data, const size_t length)
+{
+	assert(data && length == 2); // output format + dummy byte, as one word
+	// only the float format is simulated
+	assert(*reinterpret_cast<const uint16_t* const>(data) == 0x0300);
+	assert(!sleeping_);
+	measuring_ = true;
+}
 
-#pragma mark - Public Interface -
+void handle_stop_measurement()
+{
+	measuring_ = false;
+}
 
-transport::status_t transport::read(const transport::command_t command, uint8_t* const data,
-									const size_t length) const
+void handle_sleep()
+{
+	assert(!measuring_); // only accepted in idle mode
+	sleeping_ = true;
+}
+
+void handle_wake_up()
+{
+	sleeping_ = false;
+}
+
+void handle_reset()
+{
+	assert(!sleeping_);
+	// The sensor restarts idle
+	measuring_ = false;
+	reported_autoclean_interval_ = autoclean_interval_;
+}
+
+void handle_get_data_ready(uint8_t* const data, const size_t length)
+{
+	assert(length == 2); // one word
+	*reinterpret_cast<uint16_t* const>(data) = measuring_ ? 1 : 0;
+}
+
+void handle_read_measurement(uint8_t* const data, const size_t length)
+{
+	assert(length == sizeof(sensor::measurement_t));
+	assert(measuring_);
+
+	memcpy(data, &simulated_measurements_[simulated_measurement_index_],
+		   sizeof(sensor::measurement_t));
+	simulated_measurement_index_ =
+		(simulated_measurement_index_ + 1) %
+		(sizeof(simulated_measurements_) / sizeof(simulated_measurements_[0]));
+}
+
+template<typename T>
+size_t total_length(const transport::span_t<T>* const iov, const size_t count)
+{
+	size_t length = 0;
+	for(size_t i = 0; i < count; i++)
+	{
+		length += iov[i].length;
+	}
+	return length;
+}
+
+void read_response(const transport::command_t command, uint8_t* const data, const size_t length)
 {
 	assert(data && length);
 
@@ -71,26 +157,99 @@ transport::status_t transport::read(const transport::command_t command, uint8_t*
 		case transport::command_t::SPS30_CMD_GET_FIRMWARE_VERSION:
 			handle_get_version(data, length);
 			break;
+		case transport::command_t::SPS30_CMD_GET_DATA_READY:
+			handle_get_data_ready(data, length);
+			break;
+		case transport::command_t::SPS30_CMD_READ_MEASUREMENT:
+			handle_read_measurement(data, length);
+			break;
 		default:
 			assert(0); // unexpected input
 	}
-
-	return transport::status_t::OK;
 }
 
-transport::status_t transport::write(const transport::command_t command, const uint8_t* const data,
-									 const size_t length) const
+void write_command(const transport::command_t command, const uint8_t* const data,
+				   const size_t length)
 {
-	assert(data && length);
-
 	switch(command)
 	{
 		case transport::command_t::SPS30_CMD_AUTOCLEAN_INTERVAL:
 			handle_set_autoclean_interval(data, length);
 			break;
+		case transport::command_t::SPS30_CMD_START_MEASUREMENT:
+			handle_start_measurement(data, length);
+			break;
+		case transport::command_t::SPS30_CMD_STOP_MEASUREMENT:
+			handle_stop_measurement();
+			break;
+		case transport::command_t::SPS30_CMD_SLEEP:
+			handle_sleep();
+			break;
+		case transport::command_t::SPS30_CMD_WAKE_UP:
+			handle_wake_up();
+			break;
+		case transport::command_t::SPS30_CMD_RESET:
+			handle_reset();
+			break;
 		default:
 			assert(0); // unexpected input
 	}
+}
+
+}; // namespace
+
+#pragma mark - Public Interface -
+
+transport::status_t transport::readv(const transport::command_t command,
+									 const transport::rx_span_t* const iov,
+									 const size_t count) const
+{
+	assert(iov && count);
+
+	if(count == 1)
+	{
+		read_response(command, iov[0].data, iov[0].length);
+		return transport::status_t::OK;
+	}
+
+	uint8_t bounce[BOUNCE_BUFFER_SIZE];
+	const size_t length = total_length(iov, count);
+	assert(length <= sizeof(bounce));
+	read_response(command, bounce, length);
+
+	const uint8_t* from = bounce;
+	for(size_t i = 0; i < count; i++)
+	{
+		memcpy(iov[i].data, from, iov[i].length);
+		from += iov[i].length;
+	}
+
+	return transport::status_t::OK;
+}
+
+transport::status_t transport::writev(const transport::command_t command,
+									  const transport::tx_span_t* const iov,
+									  const size_t count) const
+{
+	assert(iov || count == 0);
+
+	if(count <= 1)
+	{
+		write_command(command, count ? iov[0].data : nullptr, count ? iov[0].length : 0);
+		return transport::status_t::OK;
+	}
+
+	uint8_t bounce[BOUNCE_BUFFER_SIZE];
+	const size_t length = total_length(iov, count);
+	assert(length <= sizeof(bounce));
+
+	uint8_t* to = bounce;
+	for(size_t i = 0; i < count; i++)
+	{
+		memcpy(to, iov[i].data, iov[i].length);
+		to += iov[i].length;
+	}
+	write_command(command, bounce, length);
 
 	return transport::status_t::OK;
 }
@@ -110,3 +269,34 @@ transport::status_t transport::transcieve(const transport::command_t command,
 
 	return transport::status_t::OK;
 }
+
+transport::status_t transport::run(const transport::step_t* const steps, const size_t count) const
+{
+	assert(steps || count == 0);
+
+	for(size_t i = 0; i < count; i++)
+	{
+		const step_t& step = steps[i];
+		auto status = transport::status_t::OK;
+
+		switch(step.kind)
+		{
+			case step_t::WRITE:
+				status = write(step.command, step.tx_data, step.length);
+				break;
+			case step_t::READ:
+				status = read(step.command, step.rx_data, step.length);
+				break;
+			case step_t::DELAY:
+				std::this_thread::sleep_for(step.delay);
+				break;
+		}
+
+		if(status != transport::status_t::OK)
+		{
+			return status;
+		}
+	}
+
+	return transport::status_t::OK;
+}
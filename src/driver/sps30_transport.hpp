@@ -1,6 +1,8 @@
 #ifndef SPS30_TRANSPORT_INTERFACE_HPP_
 #define SPS30_TRANSPORT_INTERFACE_HPP_
 
+#include <cassert>
+#include <chrono>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -50,7 +52,135 @@ class transport
 		SPS30_CMD_WAKE_UP,
 	};
 
+	/** A region of memory that is read into or written from
+	 *
+	 * readv() and writev() take arrays of spans so that a response can be decoded straight
+	 * into the fields it belongs to, and arguments can be sent from where they are stored,
+	 * without first being copied into one contiguous buffer.
+	 */
+	template<typename T>
+	struct span_t
+	{
+		T* data;
+		size_t length;
+	};
+
+	/// A destination of a read
+	using rx_span_t = span_t<uint8_t>;
+	/// A source of a write
+	using tx_span_t = span_t<const uint8_t>;
+
+	/// One step of a script: a command written, a response read, or a delay
+	struct step_t
+	{
+		enum kind_t
+		{
+			WRITE,
+			READ,
+			DELAY,
+		};
+
+		kind_t kind;
+		/// The command written, or whose response is read
+		command_t command;
+		/// The arguments of a WRITE; may be nullptr if length is 0
+		const uint8_t* tx_data;
+		/// Where a READ stores the response
+		uint8_t* rx_data;
+		/// The number of bytes in tx_data or rx_data
+		size_t length;
+		/// How long a DELAY waits
+		std::chrono::microseconds delay;
+	};
+
+	/** A sequence of steps submitted to the transport at once with run()
+	 *
+	 * Sequences such as probing (serial, firmware version, auto-cleaning interval) or
+	 * re-reading the interval (reset, wait, read) are built up front, then executed by the
+	 * transport back-to-back. Responses are stored in the caller's buffers, which must stay
+	 * valid until run() returns. Scripts do not allocate; Capacity is the most steps a
+	 * script holds.
+	 */
+	template<size_t Capacity>
+	class script
+	{
+	  public:
+		/// Append a command write. data may be nullptr for commands without arguments.
+		script& write(const command_t command, const uint8_t* const data = nullptr,
+					  const size_t length = 0)
+		{
+			return append({step_t::WRITE, command, data, nullptr, length, {}});
+		}
+
+		/// Append a command whose response is stored in data
+		script& read(const command_t command, uint8_t* const data, const size_t length)
+		{
+			return append({step_t::READ, command, nullptr, data, length, {}});
+		}
+
+		/// Append a wait before the next step
+		script& delay(const std::chrono::microseconds delay)
+		{
+			return append({step_t::DELAY, command_t{}, nullptr, nullptr, 0, delay});
+		}
+
+		const step_t* steps() const
+		{
+			return steps_;
+		}
+
+		size_t size() const
+		{
+			return size_;
+		}
+
+	  private:
+		script& append(const step_t& step)
+		{
+			assert(size_ < Capacity);
+			steps_[size_++] = step;
+			return *this;
+		}
+
+	  private:
+		step_t steps_[Capacity] = {};
+		size_t size_ = 0;
+	};
+
   public:
+	/** Read a response over the transport, scattered across several buffers
+	 *
+	 * The response bytes fill iov[0], then iov[1], and so on. The transport strips
+	 * whatever framing the bus adds (e.g., the CRC after each I2C word) as it decodes,
+	 * so only payload bytes are stored. Values (integers and floats) are stored in host
+	 * byte order, whatever order the bus uses; byte strings such as the serial number are
+	 * stored as sent.
+	 *
+	 * @param [in] command The command whose response is read
+	 * @param [in] iov The destinations, in the order of the response
+	 * @param [in] count The number of destinations
+	 *
+	 * @returns a status_t value indiating the state of the transfer
+	 */
+	status_t readv(const command_t command, const rx_span_t* const iov, const size_t count) const;
+
+	/** Write a command over the transport, with its arguments gathered from several buffers
+	 *
+	 * The transport prepends the command and adds its framing as it encodes the arguments.
+	 * Values are taken in host byte order, and put in the bus's byte order by the transport.
+	 * The transport returns once the command is written, without waiting for the sensor to
+	 * process it: the caller waits out the command's delay before its next transfer, or
+	 * appends a delay step to the script that writes it.
+	 *
+	 * @param [in] command The command to write
+	 * @param [in] iov The arguments, in the order they are sent. May be nullptr for
+	 *  commands that take no arguments, in which case count must be 0.
+	 * @param [in] count The number of argument buffers
+	 *
+	 * @returns a status_t value indiating the state of the transfer
+	 */
+	status_t writev(const command_t command, const tx_span_t* const iov, const size_t count) const;
+
 	/** Read data over the transport
 	 *
 	 * @param [out] data Pointer to the buffer where the data should be stored
@@ -58,13 +188,25 @@ class transport
 	 *
 	 * @returns a status_t value indiating the state of the transfer
 	 */
-	status_t read(const command_t command, uint8_t* const data, const size_t length) const;
+	status_t read(const command_t command, uint8_t* const data, const size_t length) const
+	{
+		const rx_span_t iov = {data, length};
+		return readv(command, &iov, 1);
+	}
 
 	/** Write data over the transport
+	 *
+	 * @param [in] data Pointer to the command arguments. May be nullptr for commands
+	 *  that take no arguments, in which case length must be 0.
+	 * @param [in] length The number of bytes in data
 	 *
 	 * @returns a status_t value indiating the state of the transfer
 	 */
-	status_t write(const command_t command, const uint8_t* const data, const size_t length) const;
+	status_t write(const command_t command, const uint8_t* const data, const size_t length) const
+	{
+		const tx_span_t iov = {data, length};
+		return writev(command, &iov, length ? 1 : 0);
+	}
 
 	/** Send and recieve data over the transport
 	 *
@@ -73,6 +215,31 @@ class transport
 	status_t transcieve(const command_t command, const uint8_t* const tx_data,
 						const size_t tx_length, uint8_t* const rx_data,
 						const size_t rx_length) const;
+
+	/** Run a sequence of steps back-to-back
+	 *
+	 * The steps are executed in order without returning to the caller in between. A
+	 * transport may combine consecutive transfers into one bus transaction where the
+	 * delays allow. Execution stops at the first step that fails.
+	 *
+	 * @param [in] steps The steps to run
+	 * @param [in] count The number of steps
+	 *
+	 * @returns OK if every step succeeded, or the status of the step that failed
+	 */
+	status_t run(const step_t* const steps, const size_t count) const;
+
+	/** Run a script back-to-back
+	 *
+	 * @param [in] s The script to run
+	 *
+	 * @returns OK if every step succeeded, or the status of the step that failed
+	 */
+	template<size_t Capacity>
+	status_t run(const script<Capacity>& s) const
+	{
+		return run(s.steps(), s.size());
+	}
 };
 
 }; // end namespace sps30
@@ -0,0 +1,319 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#include "sps30_frame_batch.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__SSSE3__)
+	#include <tmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+#define FIELD_COUNT SPS30_RECORD_FIELD_COUNT
+/* Data bytes and CRC byte */
+#define WORD_BYTES 3
+/* Two words per value */
+#define VALUE_BYTES (2 * WORD_BYTES)
+/* Frames per vector iteration: one value from each frame per 4-lane float vector */
+#define GROUP_FRAMES 4
+/* Words checked per vector CRC step, one per byte lane. A group is exactly five steps. */
+#define CRC_STEP_WORDS 16
+
+static_assert(SPS30_FRAME_SIZE == FIELD_COUNT * VALUE_BYTES, "Unexpected frame layout");
+static_assert((GROUP_FRAMES * SPS30_FRAME_WORDS) % CRC_STEP_WORDS == 0,
+			  "A group of frames must hold whole CRC steps");
+
+/*
+ * The sensor's CRC-8 (polynomial 0x31, initial value 0xff, see sensirion_common.h) is
+ * linear apart from a constant: crc(word) = crc(0) ^ L(word), and L(word) is the XOR of
+ * the contributions of the word's four nibbles. Each nibble's contribution is a 16-entry
+ * table, which is exactly what a byte shuffle looks up, sixteen lanes at a time.
+ */
+#define CRC_OF_ZERO 0x81
+
+/* Nibble contributions, most significant nibble first */
+static const uint8_t crc_nibbles_[4][16] = {
+	{0x00, 0x6e, 0xdc, 0xb2, 0x89, 0xe7, 0x55, 0x3b, 0x23, 0x4d, 0xff, 0x91, 0xaa, 0xc4, 0x76,
+	 0x18},
+	{0x00, 0xf4, 0xd9, 0x2d, 0x83, 0x77, 0x5a, 0xae, 0x37, 0xc3, 0xee, 0x1a, 0xb4, 0x40, 0x6d,
+	 0x99},
+	{0x00, 0x43, 0x86, 0xc5, 0x3d, 0x7e, 0xbb, 0xf8, 0x7a, 0x39, 0xfc, 0xbf, 0x47, 0x04, 0xc1,
+	 0x82},
+	{0x00, 0x31, 0x62, 0x53, 0xc4, 0xf5, 0xa6, 0x97, 0xb9, 0x88, 0xdb, 0xea, 0x7d, 0x4c, 0x1f,
+	 0x2e},
+};
+
+#pragma mark - Scalar -
+
+static inline uint8_t word_crc(uint8_t high, uint8_t low)
+{
+	return CRC_OF_ZERO ^ crc_nibbles_[0][high >> 4] ^ crc_nibbles_[1][high & 0xf] ^
+		   crc_nibbles_[2][low >> 4] ^ crc_nibbles_[3][low & 0xf];
+}
+
+/* Clear the flag of every frame in [first, last) words with a bad CRC */
+static void check_words(const uint8_t* frames, size_t first, size_t last, uint8_t* valid)
+{
+	for(size_t w = first; w < last; w++)
+	{
+		const uint8_t* word = &frames[w * WORD_BYTES];
+		if(word_crc(word[0], word[1]) != word[2])
+		{
+			valid[w / SPS30_FRAME_WORDS] = 0;
+		}
+	}
+}
+
+/* Decode the values of frames [first, last) as sensirion_bytes_to_float() does */
+static void decode_values(const uint8_t* frames, size_t first, size_t last,
+						  float* const* columns)
+{
+	for(size_t i = first; i < last; i++)
+	{
+		const uint8_t* value = &frames[i * SPS30_FRAME_SIZE];
+		for(unsigned f = 0; f < FIELD_COUNT; f++, value += VALUE_BYTES)
+		{
+			const uint32_t bits = (uint32_t)value[0] << 24 | (uint32_t)value[1] << 16 |
+								  (uint32_t)value[3] << 8 | (uint32_t)value[4];
+			memcpy(&columns[f][i], &bits, sizeof(bits));
+		}
+	}
+}
+
+static size_t count_valid(const uint8_t* valid, size_t count)
+{
+	size_t total = 0;
+	for(size_t i = 0; i < count; i++)
+	{
+		total += valid[i];
+	}
+	return total;
+}
+
+size_t sps30_frame_decode_batch_scalar(const uint8_t* frames, size_t count,
+									   float* const* columns, uint8_t* valid)
+{
+	assert((frames && columns && valid) || count == 0);
+
+	memset(valid, 1, count);
+	check_words(frames, 0, count * SPS30_FRAME_WORDS, valid);
+	decode_values(frames, 0, count, columns);
+
+	return count_valid(valid, count);
+}
+
+#pragma mark - Vector -
+
+#if defined(__SSSE3__)
+
+/* Whether the CRCs of the 16 words at data all match */
+static inline bool step_matches(const uint8_t* data)
+{
+	const __m128i a = _mm_loadu_si128((const __m128i*)&data[0]);
+	const __m128i b = _mm_loadu_si128((const __m128i*)&data[16]);
+	const __m128i c = _mm_loadu_si128((const __m128i*)&data[32]);
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+
+	// Gather every third byte: the high data bytes, the low data bytes, and the CRCs
+	const __m128i high = _mm_or_si128(
+		_mm_or_si128(
+			_mm_shuffle_epi8(a, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1,
+											  -1, -1, -1)),
+			_mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1,
+											  -1, -1, -1))),
+		_mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7,
+										  10, 13)));
+	const __m128i low = _mm_or_si128(
+		_mm_or_si128(
+			_mm_shuffle_epi8(a, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1,
+											  -1, -1, -1)),
+			_mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1,
+											  -1, -1, -1))),
+		_mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8,
+										  11, 14)));
+	const __m128i crc = _mm_or_si128(
+		_mm_or_si128(
+			_mm_shuffle_epi8(a, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1,
+											  -1, -1, -1)),
+			_mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1,
+											  -1, -1, -1))),
+		_mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9,
+										  12, 15)));
+
+	// Shifting 16-bit lanes moves bits across bytes, which the mask then clears
+	__m128i expected = _mm_xor_si128(
+		_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)crc_nibbles_[0]),
+						 _mm_and_si128(_mm_srli_epi16(high, 4), nibble)),
+		_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)crc_nibbles_[1]),
+						 _mm_and_si128(high, nibble)));
+	expected = _mm_xor_si128(
+		expected, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)crc_nibbles_[2]),
+								   _mm_and_si128(_mm_srli_epi16(low, 4), nibble)));
+	expected = _mm_xor_si128(
+		expected, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)crc_nibbles_[3]),
+								   _mm_and_si128(low, nibble)));
+	expected = _mm_xor_si128(expected, _mm_set1_epi8((char)CRC_OF_ZERO));
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(expected, crc)) == 0xffff;
+}
+
+/*
+ * Four values (24 frame bytes) in host order. Values 0 and 1 are in the bytes loaded from
+ * offset 0, and values 2 and 3 in the bytes loaded from offset 8.
+ */
+static inline __m128 swap_four(const uint8_t* value)
+{
+	const __m128i first = _mm_loadu_si128((const __m128i*)&value[0]);
+	const __m128i second = _mm_loadu_si128((const __m128i*)&value[8]);
+
+	return _mm_castsi128_ps(_mm_or_si128(
+		_mm_shuffle_epi8(first, _mm_setr_epi8(4, 3, 1, 0, 10, 9, 7, 6, -1, -1, -1, -1, -1, -1,
+											  -1, -1)),
+		_mm_shuffle_epi8(second, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 8, 7, 5, 4, 14,
+											   13, 11, 10))));
+}
+
+/* The last two values of a frame, in the low lanes, without reading past the frame */
+static inline __m128 swap_last_two(const uint8_t* frame)
+{
+	const __m128i last = _mm_loadu_si128((const __m128i*)&frame[SPS30_FRAME_SIZE - 16]);
+
+	return _mm_castsi128_ps(_mm_shuffle_epi8(
+		last, _mm_setr_epi8(8, 7, 5, 4, 14, 13, 11, 10, -1, -1, -1, -1, -1, -1, -1, -1)));
+}
+
+static inline void decode_group(const uint8_t* frames, size_t first, float* const* columns)
+{
+	const uint8_t* f0 = &frames[first * SPS30_FRAME_SIZE];
+	const uint8_t* f1 = f0 + SPS30_FRAME_SIZE;
+	const uint8_t* f2 = f1 + SPS30_FRAME_SIZE;
+	const uint8_t* f3 = f2 + SPS30_FRAME_SIZE;
+
+	// Frames are rows; transposing gives one vector per field
+	for(unsigned f = 0; f < 8; f += 4)
+	{
+		__m128 r0 = swap_four(&f0[f * VALUE_BYTES]);
+		__m128 r1 = swap_four(&f1[f * VALUE_BYTES]);
+		__m128 r2 = swap_four(&f2[f * VALUE_BYTES]);
+		__m128 r3 = swap_four(&f3[f * VALUE_BYTES]);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		_mm_storeu_ps(&columns[f][first], r0);
+		_mm_storeu_ps(&columns[f + 1][first], r1);
+		_mm_storeu_ps(&columns[f + 2][first], r2);
+		_mm_storeu_ps(&columns[f + 3][first], r3);
+	}
+
+	const __m128 low = _mm_unpacklo_ps(swap_last_two(f0), swap_last_two(f1));
+	const __m128 high = _mm_unpacklo_ps(swap_last_two(f2), swap_last_two(f3));
+	_mm_storeu_ps(&columns[8][first], _mm_movelh_ps(low, high));
+	_mm_storeu_ps(&columns[9][first], _mm_movehl_ps(high, low));
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+/* Whether the CRCs of the 16 words at data all match */
+static inline bool step_matches(const uint8_t* data)
+{
+	// A structure load splits the high data bytes, low data bytes, and CRCs
+	const uint8x16x3_t words = vld3q_u8(data);
+	const uint8x16_t nibble = vdupq_n_u8(0x0f);
+
+	uint8x16_t expected =
+		veorq_u8(vqtbl1q_u8(vld1q_u8(crc_nibbles_[0]), vshrq_n_u8(words.val[0], 4)),
+				 vqtbl1q_u8(vld1q_u8(crc_nibbles_[1]), vandq_u8(words.val[0], nibble)));
+	expected = veorq_u8(expected,
+						vqtbl1q_u8(vld1q_u8(crc_nibbles_[2]), vshrq_n_u8(words.val[1], 4)));
+	expected = veorq_u8(expected,
+						vqtbl1q_u8(vld1q_u8(crc_nibbles_[3]), vandq_u8(words.val[1], nibble)));
+	expected = veorq_u8(expected, vdupq_n_u8(CRC_OF_ZERO));
+
+	return vminvq_u8(vceqq_u8(expected, words.val[2])) == 0xff;
+}
+
+static const uint8_t swap_four_index_[16] = {4,	 3,	 1,	 0,	 10, 9,	 7,	 6,
+											 16, 15, 13, 12, 22, 21, 19, 18};
+static const uint8_t swap_last_two_index_[16] = {8,	  7,   5,	4,	 14,  13,  11,	10,
+												 255, 255, 255, 255, 255, 255, 255, 255};
+
+/* Four values (24 frame bytes) in host order, from 32 bytes of frame */
+static inline float32x4_t swap_four(const uint8_t* value, uint8x16_t index)
+{
+	const uint8x16x2_t bytes = {{vld1q_u8(&value[0]), vld1q_u8(&value[16])}};
+	return vreinterpretq_f32_u8(vqtbl2q_u8(bytes, index));
+}
+
+/* The last two values of a frame, in the low lanes, without reading past the frame */
+static inline float32x4_t swap_last_two(const uint8_t* frame, uint8x16_t index)
+{
+	return vreinterpretq_f32_u8(vqtbl1q_u8(vld1q_u8(&frame[SPS30_FRAME_SIZE - 16]), index));
+}
+
+static inline void decode_group(const uint8_t* frames, size_t first, float* const* columns)
+{
+	const uint8_t* f0 = &frames[first * SPS30_FRAME_SIZE];
+	const uint8_t* f1 = f0 + SPS30_FRAME_SIZE;
+	const uint8_t* f2 = f1 + SPS30_FRAME_SIZE;
+	const uint8_t* f3 = f2 + SPS30_FRAME_SIZE;
+	const uint8x16_t four = vld1q_u8(swap_four_index_);
+	const uint8x16_t two = vld1q_u8(swap_last_two_index_);
+
+	// Frames are rows; transposing gives one vector per field. Values 4-7 start at byte 24,
+	// and the 32 bytes from there end inside the frame.
+	for(unsigned f = 0; f < 8; f += 4)
+	{
+		const float32x4x2_t r01 = vtrnq_f32(swap_four(&f0[f * VALUE_BYTES], four),
+											swap_four(&f1[f * VALUE_BYTES], four));
+		const float32x4x2_t r23 = vtrnq_f32(swap_four(&f2[f * VALUE_BYTES], four),
+											swap_four(&f3[f * VALUE_BYTES], four));
+		vst1q_f32(&columns[f][first],
+				  vcombine_f32(vget_low_f32(r01.val[0]), vget_low_f32(r23.val[0])));
+		vst1q_f32(&columns[f + 1][first],
+				  vcombine_f32(vget_low_f32(r01.val[1]), vget_low_f32(r23.val[1])));
+		vst1q_f32(&columns[f + 2][first],
+				  vcombine_f32(vget_high_f32(r01.val[0]), vget_high_f32(r23.val[0])));
+		vst1q_f32(&columns[f + 3][first],
+				  vcombine_f32(vget_high_f32(r01.val[1]), vget_high_f32(r23.val[1])));
+	}
+
+	const float32x4_t low = vzip1q_f32(swap_last_two(f0, two), swap_last_two(f1, two));
+	const float32x4_t high = vzip1q_f32(swap_last_two(f2, two), swap_last_two(f3, two));
+	vst1q_f32(&columns[8][first], vcombine_f32(vget_low_f32(low), vget_low_f32(high)));
+	vst1q_f32(&columns[9][first], vcombine_f32(vget_high_f32(low), vget_high_f32(high)));
+}
+
+#endif
+
+size_t sps30_frame_decode_batch(const uint8_t* frames, size_t count, float* const* columns,
+								uint8_t* valid)
+{
+	assert((frames && columns && valid) || count == 0);
+
+	size_t i = 0;
+	memset(valid, 1, count);
+
+#if defined(__SSSE3__) || (defined(__aarch64__) && defined(__ARM_NEON))
+	for(; i + GROUP_FRAMES <= count; i += GROUP_FRAMES)
+	{
+		const size_t first_word = i * SPS30_FRAME_WORDS;
+		for(size_t w = 0; w < GROUP_FRAMES * SPS30_FRAME_WORDS; w += CRC_STEP_WORDS)
+		{
+			// Bad CRCs are rare, so finding which words failed can be slow
+			if(!step_matches(&frames[(first_word + w) * WORD_BYTES]))
+			{
+				check_words(frames, first_word + w, first_word + w + CRC_STEP_WORDS, valid);
+			}
+		}
+		decode_group(frames, i, columns);
+	}
+#endif
+
+	check_words(frames, i * SPS30_FRAME_WORDS, count * SPS30_FRAME_WORDS, valid);
+	decode_values(frames, i, count, columns);
+
+	return count_valid(valid, count);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS30_FRAME_BATCH_H
+#define SPS30_FRAME_BATCH_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sps30_record.h"
+
+/*
+ * A measurement frame is the sensor's raw response to the read measurement command: for
+ * each field, in struct sps30_measurement order, a big-endian float sent as two 16-bit
+ * words, each word followed by its CRC-8 (see sensirion_i2c_read_words_as_bytes()).
+ */
+
+/** Bytes in a measurement frame: 20 words of 2 data bytes and a CRC byte */
+#define SPS30_FRAME_SIZE 60
+/** Words in a measurement frame */
+#define SPS30_FRAME_WORDS 20
+
+	/**
+	 * sps30_frame_decode_batch() - check and decode measurement frames into field columns
+	 *
+	 * @frames:   count frames, back to back (count * SPS30_FRAME_SIZE bytes). There is no
+	 *            alignment requirement.
+	 * @count:    Number of frames
+	 * @columns:  SPS30_RECORD_FIELD_COUNT arrays of count floats, one per field in struct
+	 *            sps30_measurement order. Element i of each array is decoded from frame i.
+	 * @valid:    count flags. Flag i is set to 1 if every CRC in frame i matches, and 0
+	 *            otherwise. The values of an invalid frame are still decoded, and must be
+	 *            ignored.
+	 *
+	 * Byte swaps use SSSE3 (x86) or NEON (AArch64) shuffles, four frames at a time, and the
+	 * CRCs are checked sixteen words at a time with nibble table lookups in the same
+	 * registers, when the compiler targets those instruction sets. Every implementation
+	 * produces the same output as sps30_frame_decode_batch_scalar().
+	 *
+	 * Return:  The number of valid frames
+	 */
+	size_t sps30_frame_decode_batch(const uint8_t* frames, size_t count, float* const* columns,
+									uint8_t* valid);
+
+	/**
+	 * sps30_frame_decode_batch_scalar() - the portable implementation of
+	 * sps30_frame_decode_batch()
+	 *
+	 * Values are bit-for-bit those sensirion_bytes_to_float() returns, including NaN
+	 * payloads.
+	 */
+	size_t sps30_frame_decode_batch_scalar(const uint8_t* frames, size_t count,
+										   float* const* columns, uint8_t* valid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_FRAME_BATCH_H */
@@ -0,0 +1,384 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#include "sps30_gorilla.h"
+#include <assert.h>
+#include <string.h>
+
+/* Marks a field whose leading/trailing zero window has not been established yet */
+#define NO_WINDOW 0xFF
+
+/* Bits used to store the leading zero count and meaningful bit count of an XOR */
+#define LEADING_BITS 5
+#define LENGTH_BITS 5
+
+static void measurement_to_words(const struct sps30_measurement* m,
+								 uint32_t words[SPS30_GORILLA_FIELD_COUNT])
+{
+	_Static_assert(sizeof(*m) == SPS30_GORILLA_FIELD_COUNT * sizeof(uint32_t),
+				   "sps30_measurement must contain exactly ten floats");
+	memcpy(words, m, sizeof(*m));
+}
+
+static void words_to_measurement(const uint32_t words[SPS30_GORILLA_FIELD_COUNT],
+								 struct sps30_measurement* m)
+{
+	memcpy(m, words, sizeof(*m));
+}
+
+static uint8_t leading_zeros(uint32_t value)
+{
+	return value ? (uint8_t)__builtin_clz(value) : 32;
+}
+
+static uint8_t trailing_zeros(uint32_t value)
+{
+	return value ? (uint8_t)__builtin_ctz(value) : 32;
+}
+
+#pragma mark - Encoder -
+
+static void put_bits(struct sps30_gorilla_encoder* e, uint64_t value, uint8_t num_bits)
+{
+	while(num_bits)
+	{
+		const size_t byte = e->bit_position >> 3;
+		const uint8_t offset = (uint8_t)(e->bit_position & 7);
+		const uint8_t space = (uint8_t)(8 - offset);
+		const uint8_t take = num_bits < space ? num_bits : space;
+		const uint8_t bits = (uint8_t)((value >> (num_bits - take)) & ((1u << take) - 1));
+
+		if(offset == 0)
+		{
+			e->buffer[byte] = 0;
+		}
+		e->buffer[byte] |= (uint8_t)(bits << (space - take));
+
+		e->bit_position += take;
+		num_bits = (uint8_t)(num_bits - take);
+	}
+}
+
+static void put_timestamp(struct sps30_gorilla_encoder* e, uint64_t timestamp)
+{
+	const int64_t delta = (int64_t)(timestamp - e->previous_timestamp);
+	const int64_t dod = delta - e->previous_delta;
+
+	if(dod == 0)
+	{
+		put_bits(e, 0x0, 1);
+	}
+	else if(dod >= -64 && dod <= 63)
+	{
+		put_bits(e, 0x2, 2);
+		put_bits(e, (uint64_t)dod, 7);
+	}
+	else if(dod >= -256 && dod <= 255)
+	{
+		put_bits(e, 0x6, 3);
+		put_bits(e, (uint64_t)dod, 9);
+	}
+	else if(dod >= -2048 && dod <= 2047)
+	{
+		put_bits(e, 0xE, 4);
+		put_bits(e, (uint64_t)dod, 12);
+	}
+	else
+	{
+		put_bits(e, 0xF, 4);
+		put_bits(e, (uint64_t)dod, 64);
+	}
+
+	e->previous_delta = delta;
+	e->previous_timestamp = timestamp;
+}
+
+static void put_value(struct sps30_gorilla_encoder* e, size_t field, uint32_t value)
+{
+	const uint32_t xor_value = value ^ e->previous_values[field];
+	e->previous_values[field] = value;
+
+	if(xor_value == 0)
+	{
+		put_bits(e, 0x0, 1);
+		return;
+	}
+
+	const uint8_t leading = leading_zeros(xor_value);
+	const uint8_t trailing = trailing_zeros(xor_value);
+
+	if(e->previous_leading[field] != NO_WINDOW && leading >= e->previous_leading[field] &&
+	   trailing >= e->previous_trailing[field])
+	{
+		// The meaningful bits fit in the previous window
+		const uint8_t length =
+			(uint8_t)(32 - e->previous_leading[field] - e->previous_trailing[field]);
+		put_bits(e, 0x2, 2);
+		put_bits(e, xor_value >> e->previous_trailing[field], length);
+		return;
+	}
+
+	const uint8_t length = (uint8_t)(32 - leading - trailing);
+
+	put_bits(e, 0x3, 2);
+	put_bits(e, leading, LEADING_BITS);
+	put_bits(e, (uint64_t)(length - 1), LENGTH_BITS);
+	put_bits(e, xor_value >> trailing, length);
+
+	e->previous_leading[field] = leading;
+	e->previous_trailing[field] = trailing;
+}
+
+void sps30_gorilla_encoder_init(struct sps30_gorilla_encoder* encoder, uint8_t* buffer,
+								size_t capacity)
+{
+	assert(encoder && buffer);
+
+	memset(encoder, 0, sizeof(*encoder));
+	encoder->buffer = buffer;
+	encoder->capacity = capacity;
+	memset(encoder->previous_leading, NO_WINDOW, sizeof(encoder->previous_leading));
+}
+
+int16_t sps30_gorilla_encode(struct sps30_gorilla_encoder* encoder, uint64_t timestamp_ms,
+							 const struct sps30_measurement* measurement)
+{
+	uint32_t words[SPS30_GORILLA_FIELD_COUNT];
+
+	assert(encoder && measurement);
+
+	if(encoder->capacity - sps30_gorilla_encoder_size(encoder) < SPS30_GORILLA_MAX_SAMPLE_BYTES)
+	{
+		return SPS30_GORILLA_ERROR_FULL;
+	}
+
+	measurement_to_words(measurement, words);
+
+	if(encoder->count == 0)
+	{
+		// The first sample is the reference for the rest of the stream
+		put_bits(encoder, timestamp_ms, 64);
+		encoder->previous_timestamp = timestamp_ms;
+		for(size_t i = 0; i < SPS30_GORILLA_FIELD_COUNT; i++)
+		{
+			put_bits(encoder, words[i], 32);
+			encoder->previous_values[i] = words[i];
+		}
+	}
+	else
+	{
+		assert(timestamp_ms >= encoder->previous_timestamp);
+
+		put_timestamp(encoder, timestamp_ms);
+		for(size_t i = 0; i < SPS30_GORILLA_FIELD_COUNT; i++)
+		{
+			put_value(encoder, i, words[i]);
+		}
+	}
+
+	encoder->count++;
+	return 0;
+}
+
+uint32_t sps30_gorilla_encoder_count(const struct sps30_gorilla_encoder* encoder)
+{
+	return encoder->count;
+}
+
+size_t sps30_gorilla_encoder_size(const struct sps30_gorilla_encoder* encoder)
+{
+	return (encoder->bit_position + 7) >> 3;
+}
+
+#pragma mark - Decoder -
+
+static int16_t get_bits(struct sps30_gorilla_decoder* d, uint8_t num_bits, uint64_t* value)
+{
+	uint64_t result = 0;
+
+	if(d->bit_position + num_bits > d->size * 8)
+	{
+		return SPS30_GORILLA_ERROR_CORRUPT;
+	}
+
+	while(num_bits)
+	{
+		const size_t byte = d->bit_position >> 3;
+		const uint8_t offset = (uint8_t)(d->bit_position & 7);
+		const uint8_t available = (uint8_t)(8 - offset);
+		const uint8_t take = num_bits < available ? num_bits : available;
+		const uint8_t bits =
+			(uint8_t)((d->buffer[byte] >> (available - take)) & ((1u << take) - 1));
+
+		result = (result << take) | bits;
+		d->bit_position += take;
+		num_bits = (uint8_t)(num_bits - take);
+	}
+
+	*value = result;
+	return 0;
+}
+
+/* Sign-extend the low num_bits of value */
+static int64_t sign_extend(uint64_t value, uint8_t num_bits)
+{
+	const uint64_t sign = 1ull << (num_bits - 1);
+	return (int64_t)((value ^ sign) - sign);
+}
+
+static int16_t get_timestamp(struct sps30_gorilla_decoder* d)
+{
+	static const uint8_t dod_bits[] = {7, 9, 12, 64};
+	uint64_t bit;
+	uint64_t raw;
+	int16_t error;
+	int64_t dod = 0;
+	uint8_t prefix = 0;
+
+	// Count the leading one bits of the prefix code (0, 10, 110, 1110, 1111)
+	while(prefix < 4)
+	{
+		if((error = get_bits(d, 1, &bit)) != 0)
+		{
+			return error;
+		}
+		if(!bit)
+		{
+			break;
+		}
+		prefix++;
+	}
+
+	if(prefix)
+	{
+		const uint8_t num_bits = dod_bits[prefix - 1];
+		if((error = get_bits(d, num_bits, &raw)) != 0)
+		{
+			return error;
+		}
+		dod = num_bits == 64 ? (int64_t)raw : sign_extend(raw, num_bits);
+	}
+
+	d->previous_delta += dod;
+	d->previous_timestamp += (uint64_t)d->previous_delta;
+	return 0;
+}
+
+static int16_t get_value(struct sps30_gorilla_decoder* d, size_t field)
+{
+	uint64_t control;
+	uint64_t leading;
+	uint64_t length;
+	uint64_t bits;
+	int16_t error;
+
+	if((error = get_bits(d, 1, &control)) != 0)
+	{
+		return error;
+	}
+	if(!control)
+	{
+		return 0; // Unchanged
+	}
+
+	if((error = get_bits(d, 1, &control)) != 0)
+	{
+		return error;
+	}
+
+	if(control)
+	{
+		if((error = get_bits(d, LEADING_BITS, &leading)) != 0 ||
+		   (error = get_bits(d, LENGTH_BITS, &length)) != 0)
+		{
+			return error;
+		}
+		length++;
+		if(leading + length > 32)
+		{
+			return SPS30_GORILLA_ERROR_CORRUPT;
+		}
+		d->previous_leading[field] = (uint8_t)leading;
+		d->previous_trailing[field] = (uint8_t)(32 - leading - length);
+	}
+	else if(d->previous_leading[field] == NO_WINDOW)
+	{
+		return SPS30_GORILLA_ERROR_CORRUPT;
+	}
+
+	length = 32u - d->previous_leading[field] - d->previous_trailing[field];
+	if((error = get_bits(d, (uint8_t)length, &bits)) != 0)
+	{
+		return error;
+	}
+
+	d->previous_values[field] ^= (uint32_t)(bits << d->previous_trailing[field]);
+	return 0;
+}
+
+void sps30_gorilla_decoder_init(struct sps30_gorilla_decoder* decoder, const uint8_t* buffer,
+								size_t size, uint32_t count)
+{
+	assert(decoder && (buffer || size == 0));
+
+	memset(decoder, 0, sizeof(*decoder));
+	decoder->buffer = buffer;
+	decoder->size = size;
+	decoder->count = count;
+	decoder->remaining = count;
+	memset(decoder->previous_leading, NO_WINDOW, sizeof(decoder->previous_leading));
+}
+
+int16_t sps30_gorilla_decode(struct sps30_gorilla_decoder* decoder, uint64_t* timestamp_ms,
+							 struct sps30_measurement* measurement)
+{
+	uint64_t raw;
+	int16_t error;
+
+	assert(decoder && timestamp_ms && measurement);
+
+	if(decoder->remaining == 0)
+	{
+		return SPS30_GORILLA_ERROR_END;
+	}
+
+	if(decoder->remaining == decoder->count)
+	{
+		if((error = get_bits(decoder, 64, &raw)) != 0)
+		{
+			return error;
+		}
+		decoder->previous_timestamp = raw;
+
+		for(size_t i = 0; i < SPS30_GORILLA_FIELD_COUNT; i++)
+		{
+			if((error = get_bits(decoder, 32, &raw)) != 0)
+			{
+				return error;
+			}
+			decoder->previous_values[i] = (uint32_t)raw;
+		}
+	}
+	else
+	{
+		if((error = get_timestamp(decoder)) != 0)
+		{
+			return error;
+		}
+
+		for(size_t i = 0; i < SPS30_GORILLA_FIELD_COUNT; i++)
+		{
+			if((error = get_value(decoder, i)) != 0)
+			{
+				return error;
+			}
+		}
+	}
+
+	decoder->remaining--;
+	*timestamp_ms = decoder->previous_timestamp;
+	words_to_measurement(decoder->previous_values, measurement);
+	return 0;
+}
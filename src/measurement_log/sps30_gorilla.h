@@ -0,0 +1,147 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS30_GORILLA_H
+#define SPS30_GORILLA_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sps30.h"
+
+/** The encoder ran out of buffer space. The sample was not encoded. */
+#define SPS30_GORILLA_ERROR_FULL (-1)
+/** The decoder has returned every encoded sample. */
+#define SPS30_GORILLA_ERROR_END (-2)
+/** The encoded stream is truncated or corrupt. */
+#define SPS30_GORILLA_ERROR_CORRUPT (-3)
+
+/** Number of float fields in struct sps30_measurement */
+#define SPS30_GORILLA_FIELD_COUNT 10
+
+/** Worst-case encoded size of one sample: 68 bits of timestamp and 44 bits per field */
+#define SPS30_GORILLA_MAX_SAMPLE_BYTES 64
+
+	/**
+	 * struct sps30_gorilla_encoder - streaming measurement compressor state
+	 *
+	 * Compresses a sequence of timestamped measurements using the scheme from
+	 * Facebook's Gorilla time series database:
+	 *
+	 * - Timestamps are stored as the delta of the previous delta, so a steady 1 Hz
+	 *   sample clock costs one bit per sample.
+	 * - Each field is XORed with its previous value. Unchanged fields cost one bit;
+	 *   otherwise only the meaningful (non-zero) bits of the XOR are stored, reusing
+	 *   the previous leading/trailing zero window when possible.
+	 *
+	 * The first sample of a stream is stored uncompressed. Streams are independent, so a
+	 * new stream can be started at any block boundary to bound the cost of corruption.
+	 *
+	 * All members are private to the implementation.
+	 */
+	struct sps30_gorilla_encoder
+	{
+		uint8_t* buffer;
+		size_t capacity;
+		size_t bit_position;
+		uint32_t count;
+		uint64_t previous_timestamp;
+		int64_t previous_delta;
+		uint32_t previous_values[SPS30_GORILLA_FIELD_COUNT];
+		uint8_t previous_leading[SPS30_GORILLA_FIELD_COUNT];
+		uint8_t previous_trailing[SPS30_GORILLA_FIELD_COUNT];
+	};
+
+	/**
+	 * struct sps30_gorilla_decoder - streaming measurement decompressor state
+	 *
+	 * All members are private to the implementation.
+	 */
+	struct sps30_gorilla_decoder
+	{
+		const uint8_t* buffer;
+		size_t size;
+		size_t bit_position;
+		uint32_t count;
+		uint32_t remaining;
+		uint64_t previous_timestamp;
+		int64_t previous_delta;
+		uint32_t previous_values[SPS30_GORILLA_FIELD_COUNT];
+		uint8_t previous_leading[SPS30_GORILLA_FIELD_COUNT];
+		uint8_t previous_trailing[SPS30_GORILLA_FIELD_COUNT];
+	};
+
+	/**
+	 * sps30_gorilla_encoder_init() - start a new compressed stream
+	 *
+	 * @encoder:    Encoder state
+	 * @buffer:     Output buffer for the compressed stream
+	 * @capacity:   Size of buffer in bytes
+	 */
+	void sps30_gorilla_encoder_init(struct sps30_gorilla_encoder* encoder, uint8_t* buffer,
+									size_t capacity);
+
+	/**
+	 * sps30_gorilla_encode() - append a sample to the stream
+	 *
+	 * @encoder:        Encoder state
+	 * @timestamp_ms:   Sample time in milliseconds. Must not decrease.
+	 * @measurement:    The measured values
+	 *
+	 * Return:  0 on success, SPS30_GORILLA_ERROR_FULL if fewer than
+	 *          SPS30_GORILLA_MAX_SAMPLE_BYTES remain in the buffer. The stream is left
+	 *          unchanged on error, so the caller can flush the block and retry with a
+	 *          freshly initialized encoder.
+	 */
+	int16_t sps30_gorilla_encode(struct sps30_gorilla_encoder* encoder, uint64_t timestamp_ms,
+								 const struct sps30_measurement* measurement);
+
+	/**
+	 * sps30_gorilla_encoder_count() - the number of samples in the stream
+	 */
+	uint32_t sps30_gorilla_encoder_count(const struct sps30_gorilla_encoder* encoder);
+
+	/**
+	 * sps30_gorilla_encoder_size() - the compressed stream size
+	 *
+	 * Return:  The number of bytes of the buffer used so far. The final byte is padded
+	 *          with zero bits.
+	 */
+	size_t sps30_gorilla_encoder_size(const struct sps30_gorilla_encoder* encoder);
+
+	/**
+	 * sps30_gorilla_decoder_init() - start decoding a compressed stream
+	 *
+	 * @decoder:    Decoder state
+	 * @buffer:     The compressed stream
+	 * @size:       Size of the compressed stream in bytes
+	 * @count:      Number of samples in the stream (from sps30_gorilla_encoder_count())
+	 */
+	void sps30_gorilla_decoder_init(struct sps30_gorilla_decoder* decoder, const uint8_t* buffer,
+									size_t size, uint32_t count);
+
+	/**
+	 * sps30_gorilla_decode() - read the next sample from the stream
+	 *
+	 * @decoder:        Decoder state
+	 * @timestamp_ms:   Memory where the sample time is written
+	 * @measurement:    Memory where the measured values are written
+	 *
+	 * Return:  0 on success, SPS30_GORILLA_ERROR_END once all samples have been read, or
+	 *          SPS30_GORILLA_ERROR_CORRUPT if the stream ends prematurely.
+	 */
+	int16_t sps30_gorilla_decode(struct sps30_gorilla_decoder* decoder, uint64_t* timestamp_ms,
+								 struct sps30_measurement* measurement);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_GORILLA_H */
@@ -0,0 +1,867 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#define _POSIX_C_SOURCE 200809L // posix_memalign, posix_madvise, sysconf
+
+#include "sps30_log_aggregate.h"
+#include "sps30_record_log.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+#define FIELD_COUNT SPS30_RECORD_FIELD_COUNT
+#define LANES SPS30_RECORD_BLOCK_RECORDS
+#define SUB_BINS (1u << SPS30_LOG_AGGREGATE_SUB_BITS)
+/* Smallest value with a bin of its own: 2^MIN_EXPONENT */
+#define MIN_BINNED_BITS ((uint32_t)(127 + SPS30_LOG_AGGREGATE_MIN_EXPONENT) << 23)
+/* Values from 2^(MAX_EXPONENT + 1) share the last bin */
+#define MAX_BINNED_BITS ((uint32_t)(127 + SPS30_LOG_AGGREGATE_MAX_EXPONENT + 1) << 23)
+#define INITIAL_SLOTS 64u
+#define EMPTY_SLOT (-1)
+
+/* A sensor's statistics, and the column block its records are staged in */
+struct sensor_state
+{
+	struct sps30_record_block block;
+	struct sps30_log_aggregate_stats stats;
+};
+
+/* Part of a mapped log file */
+struct chunk
+{
+	const uint8_t* data;
+	size_t size;
+	size_t begin;
+	size_t end;
+};
+
+struct engine;
+
+/*
+ * A worker owns a queue of chunks, the range [head, tail) of the engine's chunk array. The
+ * owner takes from the head, in file order; thieves take from the tail.
+ */
+struct worker
+{
+	pthread_t thread;
+	unsigned id;
+	struct engine* engine;
+	pthread_mutex_t lock;
+	size_t head;
+	size_t tail;
+	struct sensor_state** sensors;
+	size_t sensor_count;
+	size_t sensor_capacity;
+	int32_t* slots;
+	size_t slot_count;
+	uint64_t skipped;
+	uint64_t steals;
+	bool failed;
+};
+
+struct engine
+{
+	const struct sps30_log_aggregate_config* config;
+	struct chunk* chunks;
+	size_t chunk_count;
+	struct worker* workers;
+	unsigned worker_count;
+};
+
+#pragma mark - Statistics -
+
+void sps30_log_aggregate_stats_init(struct sps30_log_aggregate_stats* stats,
+									uint64_t sensor_id, uint16_t channel)
+{
+	assert(stats);
+
+	memset(stats, 0, sizeof(*stats));
+	stats->sensor_id = sensor_id;
+	stats->channel = channel;
+	stats->first_timestamp_ms = UINT64_MAX;
+	for(unsigned f = 0; f < FIELD_COUNT; f++)
+	{
+		stats->min[f] = FLT_MAX;
+		stats->max[f] = -FLT_MAX;
+	}
+}
+
+unsigned sps30_log_aggregate_bin(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	// Negative values have the sign bit set
+	if(bits < MIN_BINNED_BITS || bits >= 0x80000000u)
+	{
+		return 0;
+	}
+	if(bits >= MAX_BINNED_BITS)
+	{
+		return SPS30_LOG_AGGREGATE_BINS - 1;
+	}
+
+	// The exponent and the top mantissa bits, counted from 2^MIN_EXPONENT
+	return 1 + ((bits - MIN_BINNED_BITS) >> (23 - SPS30_LOG_AGGREGATE_SUB_BITS));
+}
+
+void sps30_log_aggregate_stats_add(struct sps30_log_aggregate_stats* stats,
+								   const struct sps30_record* record, const float* thresholds)
+{
+	assert(stats && record && thresholds);
+
+	stats->count++;
+	if(record->timestamp_ms < stats->first_timestamp_ms)
+	{
+		stats->first_timestamp_ms = record->timestamp_ms;
+	}
+	if(record->timestamp_ms > stats->last_timestamp_ms)
+	{
+		stats->last_timestamp_ms = record->timestamp_ms;
+	}
+
+	for(unsigned f = 0; f < FIELD_COUNT; f++)
+	{
+		const float value = record->values[f];
+		stats->min[f] = value < stats->min[f] ? value : stats->min[f];
+		stats->max[f] = value > stats->max[f] ? value : stats->max[f];
+		stats->sum[f] += (double)value;
+		stats->exceedances[f] += value > thresholds[f];
+		stats->histogram[f][sps30_log_aggregate_bin(value)]++;
+	}
+}
+
+void sps30_log_aggregate_stats_merge(struct sps30_log_aggregate_stats* into,
+									 const struct sps30_log_aggregate_stats* from)
+{
+	assert(into && from);
+
+	into->count += from->count;
+	if(from->first_timestamp_ms < into->first_timestamp_ms)
+	{
+		into->first_timestamp_ms = from->first_timestamp_ms;
+	}
+	if(from->last_timestamp_ms > into->last_timestamp_ms)
+	{
+		into->last_timestamp_ms = from->last_timestamp_ms;
+	}
+
+	for(unsigned f = 0; f < FIELD_COUNT; f++)
+	{
+		into->min[f] = from->min[f] < into->min[f] ? from->min[f] : into->min[f];
+		into->max[f] = from->max[f] > into->max[f] ? from->max[f] : into->max[f];
+		into->sum[f] += from->sum[f];
+		into->exceedances[f] += from->exceedances[f];
+		for(unsigned b = 0; b < SPS30_LOG_AGGREGATE_BINS; b++)
+		{
+			into->histogram[f][b] += from->histogram[f][b];
+		}
+	}
+}
+
+double sps30_log_aggregate_mean(const struct sps30_log_aggregate_stats* stats, unsigned field)
+{
+	assert(stats && field < FIELD_COUNT);
+
+	return stats->count ? stats->sum[field] / (double)stats->count : 0.0;
+}
+
+float sps30_log_aggregate_percentile(const struct sps30_log_aggregate_stats* stats,
+									 unsigned field, double quantile)
+{
+	assert(stats && field < FIELD_COUNT);
+
+	if(stats->count == 0)
+	{
+		return 0.0f;
+	}
+
+	// The rank of the percentile, counting from 1
+	double rank = ceil(quantile * (double)stats->count);
+	rank = rank < 1.0 ? 1.0 : rank;
+
+	uint64_t seen = 0;
+	unsigned bin = 0;
+	for(; bin < SPS30_LOG_AGGREGATE_BINS - 1; bin++)
+	{
+		seen += stats->histogram[field][bin];
+		if((double)seen >= rank)
+		{
+			break;
+		}
+	}
+
+	float value;
+	if(bin == 0)
+	{
+		value = 0.0f;
+	}
+	else if(bin == SPS30_LOG_AGGREGATE_BINS - 1)
+	{
+		value = stats->max[field];
+	}
+	else
+	{
+		const unsigned octave = (bin - 1) >> SPS30_LOG_AGGREGATE_SUB_BITS;
+		const unsigned step = (bin - 1) & (SUB_BINS - 1);
+		value = ldexpf(1.0f + ((float)step + 0.5f) / (float)SUB_BINS,
+					   (int)octave + SPS30_LOG_AGGREGATE_MIN_EXPONENT);
+	}
+
+	value = value < stats->min[field] ? stats->min[field] : value;
+	return value > stats->max[field] ? stats->max[field] : value;
+}
+
+#pragma mark - Column Reductions -
+
+/* Minimum, maximum, sum, and exceedance count of one full column */
+static void reduce_column(const float* column, float threshold, float* min, float* max,
+						  float* sum, uint32_t* exceedances)
+{
+#if defined(__SSE2__)
+	const __m128 a = _mm_load_ps(&column[0]);
+	const __m128 b = _mm_load_ps(&column[4]);
+	const __m128 c = _mm_load_ps(&column[8]);
+	const __m128 d = _mm_load_ps(&column[12]);
+	const __m128 limit = _mm_set1_ps(threshold);
+
+	__m128 lo = _mm_min_ps(_mm_min_ps(a, b), _mm_min_ps(c, d));
+	__m128 hi = _mm_max_ps(_mm_max_ps(a, b), _mm_max_ps(c, d));
+	__m128 total = _mm_add_ps(_mm_add_ps(a, b), _mm_add_ps(c, d));
+	const unsigned above = (unsigned)_mm_movemask_ps(_mm_cmpgt_ps(a, limit)) |
+						   (unsigned)_mm_movemask_ps(_mm_cmpgt_ps(b, limit)) << 4 |
+						   (unsigned)_mm_movemask_ps(_mm_cmpgt_ps(c, limit)) << 8 |
+						   (unsigned)_mm_movemask_ps(_mm_cmpgt_ps(d, limit)) << 12;
+
+	lo = _mm_min_ps(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(1, 0, 3, 2)));
+	lo = _mm_min_ps(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(2, 3, 0, 1)));
+	hi = _mm_max_ps(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(1, 0, 3, 2)));
+	hi = _mm_max_ps(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(2, 3, 0, 1)));
+	total = _mm_add_ps(total, _mm_shuffle_ps(total, total, _MM_SHUFFLE(1, 0, 3, 2)));
+	total = _mm_add_ps(total, _mm_shuffle_ps(total, total, _MM_SHUFFLE(2, 3, 0, 1)));
+
+	*min = _mm_cvtss_f32(lo);
+	*max = _mm_cvtss_f32(hi);
+	*sum = _mm_cvtss_f32(total);
+	*exceedances = (uint32_t)__builtin_popcount(above);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	const float32x4_t a = vld1q_f32(&column[0]);
+	const float32x4_t b = vld1q_f32(&column[4]);
+	const float32x4_t c = vld1q_f32(&column[8]);
+	const float32x4_t d = vld1q_f32(&column[12]);
+	const float32x4_t limit = vdupq_n_f32(threshold);
+
+	*min = vminvq_f32(vminq_f32(vminq_f32(a, b), vminq_f32(c, d)));
+	*max = vmaxvq_f32(vmaxq_f32(vmaxq_f32(a, b), vmaxq_f32(c, d)));
+	*sum = vaddvq_f32(vaddq_f32(vaddq_f32(a, b), vaddq_f32(c, d)));
+
+	// Comparisons give all-ones lanes; shifting leaves 1 per lane above the threshold
+	const uint32x4_t above = vaddq_u32(
+		vaddq_u32(vshrq_n_u32(vcgtq_f32(a, limit), 31), vshrq_n_u32(vcgtq_f32(b, limit), 31)),
+		vaddq_u32(vshrq_n_u32(vcgtq_f32(c, limit), 31), vshrq_n_u32(vcgtq_f32(d, limit), 31)));
+	*exceedances = vaddvq_u32(above);
+#else
+	float lo = column[0];
+	float hi = column[0];
+	float total = 0.0f;
+	uint32_t above = 0;
+
+	for(unsigned i = 0; i < LANES; i++)
+	{
+		lo = column[i] < lo ? column[i] : lo;
+		hi = column[i] > hi ? column[i] : hi;
+		total += column[i];
+		above += column[i] > threshold;
+	}
+
+	*min = lo;
+	*max = hi;
+	*sum = total;
+	*exceedances = above;
+#endif
+}
+
+/* Fold a staged block into its sensor's statistics, and empty it */
+static void reduce_block(struct sensor_state* sensor, const float* thresholds)
+{
+	struct sps30_record_block* block = &sensor->block;
+	struct sps30_log_aggregate_stats* stats = &sensor->stats;
+	const unsigned count = block->count;
+
+	if(count == 0)
+	{
+		return;
+	}
+
+	stats->count += count;
+	for(unsigned i = 0; i < count; i++)
+	{
+		// Chunks from different files can interleave, so blocks are not in time order
+		const uint64_t t = block->timestamp_ms[i];
+		stats->first_timestamp_ms = t < stats->first_timestamp_ms ? t : stats->first_timestamp_ms;
+		stats->last_timestamp_ms = t > stats->last_timestamp_ms ? t : stats->last_timestamp_ms;
+	}
+
+	for(unsigned f = 0; f < FIELD_COUNT; f++)
+	{
+		const float* column = block->values[f];
+
+		if(count == LANES)
+		{
+			float min, max, sum;
+			uint32_t exceedances;
+			reduce_column(column, thresholds[f], &min, &max, &sum, &exceedances);
+			stats->min[f] = min < stats->min[f] ? min : stats->min[f];
+			stats->max[f] = max > stats->max[f] ? max : stats->max[f];
+			stats->sum[f] += (double)sum;
+			stats->exceedances[f] += exceedances;
+		}
+		else
+		{
+			for(unsigned i = 0; i < count; i++)
+			{
+				stats->min[f] = column[i] < stats->min[f] ? column[i] : stats->min[f];
+				stats->max[f] = column[i] > stats->max[f] ? column[i] : stats->max[f];
+				stats->sum[f] += (double)column[i];
+				stats->exceedances[f] += column[i] > thresholds[f];
+			}
+		}
+
+		uint64_t* histogram = stats->histogram[f];
+		for(unsigned i = 0; i < count; i++)
+		{
+			histogram[sps30_log_aggregate_bin(column[i])]++;
+		}
+	}
+
+	sps30_record_block_init(block);
+}
+
+#pragma mark - Workers -
+
+static size_t slot_of(uint64_t sensor_id, uint16_t channel, size_t slot_count)
+{
+	const uint64_t key = (sensor_id ^ ((uint64_t)channel << 48)) * 0x9e3779b97f4a7c15u;
+	return (size_t)(key >> 32) & (slot_count - 1);
+}
+
+static bool grow_slots(struct worker* worker)
+{
+	const size_t slot_count = worker->slot_count ? 2 * worker->slot_count : INITIAL_SLOTS;
+	int32_t* slots = malloc(slot_count * sizeof(*slots));
+	if(!slots)
+	{
+		return false;
+	}
+
+	for(size_t i = 0; i < slot_count; i++)
+	{
+		slots[i] = EMPTY_SLOT;
+	}
+	for(size_t s = 0; s < worker->sensor_count; s++)
+	{
+		const struct sps30_log_aggregate_stats* stats = &worker->sensors[s]->stats;
+		size_t i = slot_of(stats->sensor_id, stats->channel, slot_count);
+		while(slots[i] != EMPTY_SLOT)
+		{
+			i = (i + 1) & (slot_count - 1);
+		}
+		slots[i] = (int32_t)s;
+	}
+
+	free(worker->slots);
+	worker->slots = slots;
+	worker->slot_count = slot_count;
+	return true;
+}
+
+static struct sensor_state* add_sensor(struct worker* worker, uint64_t sensor_id,
+									   uint16_t channel)
+{
+	struct sensor_state* sensor;
+
+	if(worker->sensor_count == worker->sensor_capacity)
+	{
+		const size_t capacity = worker->sensor_capacity ? 2 * worker->sensor_capacity : 16;
+		struct sensor_state** sensors =
+			realloc(worker->sensors, capacity * sizeof(*worker->sensors));
+		if(!sensors)
+		{
+			return NULL;
+		}
+		worker->sensors = sensors;
+		worker->sensor_capacity = capacity;
+	}
+
+	if(posix_memalign((void**)&sensor, SPS30_RECORD_SIZE, sizeof(*sensor)) != 0)
+	{
+		return NULL;
+	}
+	sps30_record_block_init(&sensor->block);
+	sps30_log_aggregate_stats_init(&sensor->stats, sensor_id, channel);
+	worker->sensors[worker->sensor_count++] = sensor;
+	return sensor;
+}
+
+static struct sensor_state* find_sensor(struct worker* worker, uint64_t sensor_id,
+										uint16_t channel)
+{
+	// Keep the table at most half full
+	if(2 * (worker->sensor_count + 1) > worker->slot_count && !grow_slots(worker))
+	{
+		return NULL;
+	}
+
+	size_t i = slot_of(sensor_id, channel, worker->slot_count);
+	for(; worker->slots[i] != EMPTY_SLOT; i = (i + 1) & (worker->slot_count - 1))
+	{
+		struct sensor_state* sensor = worker->sensors[worker->slots[i]];
+		if(sensor->stats.sensor_id == sensor_id && sensor->stats.channel == channel)
+		{
+			return sensor;
+		}
+	}
+
+	struct sensor_state* sensor = add_sensor(worker, sensor_id, channel);
+	if(sensor)
+	{
+		worker->slots[i] = (int32_t)(worker->sensor_count - 1);
+	}
+	return sensor;
+}
+
+static bool frame_at(const struct chunk* chunk, size_t position, int32_t* size)
+{
+	const uint8_t* payload;
+	uint16_t length;
+
+	*size = sps30_record_log_frame_decode(&chunk->data[position], chunk->size - position,
+										  &payload, &length);
+	return *size > 0;
+}
+
+/*
+ * The first frame that starts in the chunk. The previous chunk reads the frame that
+ * crosses into this one. Two consecutive valid frames are required, so payload bytes that
+ * happen to look like a frame are not mistaken for one.
+ */
+static size_t first_frame(const struct chunk* chunk)
+{
+	for(size_t position = chunk->begin; position < chunk->end; position++)
+	{
+		int32_t size;
+		int32_t next;
+
+		if(frame_at(chunk, position, &size) &&
+		   (position + (size_t)size >= chunk->size ||
+			frame_at(chunk, position + (size_t)size, &next) ||
+			next == SPS30_RECORD_LOG_ERROR_TRUNCATED))
+		{
+			return position;
+		}
+	}
+
+	return chunk->end;
+}
+
+static void process_chunk(struct worker* worker, const struct chunk* chunk)
+{
+	const struct sps30_log_aggregate_config* config = worker->engine->config;
+	size_t position = chunk->begin ? first_frame(chunk) : 0;
+	bool resynchronizing = false;
+
+	while(position < chunk->end && !worker->failed)
+	{
+		const uint8_t* payload;
+		uint16_t length;
+		struct sps30_record record;
+
+		const int32_t r = sps30_record_log_frame_decode(&chunk->data[position],
+														chunk->size - position, &payload,
+														&length);
+		if(r == SPS30_RECORD_LOG_ERROR_TRUNCATED)
+		{
+			break;
+		}
+		if(r < 0)
+		{
+			// Damaged data: count it once, and look for the next frame
+			worker->skipped += !resynchronizing;
+			resynchronizing = true;
+			position++;
+			continue;
+		}
+		resynchronizing = false;
+		position += (size_t)r;
+
+		if(length != SPS30_RECORD_SIZE || sps30_record_decode(payload, &record) != 0)
+		{
+			worker->skipped++;
+			continue;
+		}
+		if(record.timestamp_ms < config->start_ms || record.timestamp_ms > config->end_ms)
+		{
+			continue;
+		}
+
+		struct sensor_state* sensor = find_sensor(worker, record.sensor_id, record.channel);
+		if(!sensor)
+		{
+			worker->failed = true;
+			break;
+		}
+		(void)sps30_record_block_append(&sensor->block, &record);
+		if(sensor->block.count == LANES)
+		{
+			reduce_block(sensor, config->thresholds);
+		}
+	}
+}
+
+static bool take_chunk(struct worker* worker, size_t* chunk)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&worker->lock);
+	if(worker->head < worker->tail)
+	{
+		*chunk = worker->head++;
+		found = true;
+	}
+	pthread_mutex_unlock(&worker->lock);
+
+	return found;
+}
+
+static bool steal_chunk(struct worker* thief, size_t* chunk)
+{
+	const struct engine* engine = thief->engine;
+
+	for(unsigned i = 1; i < engine->worker_count; i++)
+	{
+		struct worker* victim = &engine->workers[(thief->id + i) % engine->worker_count];
+		bool found = false;
+
+		pthread_mutex_lock(&victim->lock);
+		if(victim->head < victim->tail)
+		{
+			*chunk = --victim->tail;
+			found = true;
+		}
+		pthread_mutex_unlock(&victim->lock);
+
+		if(found)
+		{
+			thief->steals++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void* worker_main(void* context)
+{
+	struct worker* worker = context;
+	const struct engine* engine = worker->engine;
+	size_t chunk;
+
+	while(!worker->failed && (take_chunk(worker, &chunk) || steal_chunk(worker, &chunk)))
+	{
+		process_chunk(worker, &engine->chunks[chunk]);
+	}
+
+	for(size_t s = 0; s < worker->sensor_count; s++)
+	{
+		reduce_block(worker->sensors[s], engine->config->thresholds);
+	}
+
+	return NULL;
+}
+
+#pragma mark - Engine -
+
+void sps30_log_aggregate_config_init(struct sps30_log_aggregate_config* config,
+									 const char* const* paths, size_t path_count)
+{
+	assert(config);
+
+	memset(config, 0, sizeof(*config));
+	config->paths = paths;
+	config->path_count = path_count;
+	config->end_ms = UINT64_MAX;
+	for(unsigned f = 0; f < FIELD_COUNT; f++)
+	{
+		config->thresholds[f] = INFINITY;
+	}
+}
+
+static int16_t map_files(const struct sps30_log_aggregate_config* config,
+						 struct sps30_log_aggregate_result* result, struct chunk** chunks,
+						 size_t* chunk_count)
+{
+	const size_t chunk_bytes = config->chunk_bytes ? config->chunk_bytes
+												   : SPS30_LOG_AGGREGATE_CHUNK_BYTES;
+	size_t capacity = 0;
+
+	*chunks = NULL;
+	*chunk_count = 0;
+
+	for(size_t p = 0; p < config->path_count; p++)
+	{
+		struct stat st;
+		const int fd = open(config->paths[p], O_RDONLY | O_CLOEXEC);
+		if(fd < 0 || fstat(fd, &st) != 0)
+		{
+			if(fd >= 0)
+			{
+				close(fd);
+			}
+			return SPS30_LOG_AGGREGATE_ERROR_IO;
+		}
+
+		const size_t size = (size_t)st.st_size;
+		void* map = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+		close(fd);
+		if(map == MAP_FAILED)
+		{
+			return SPS30_LOG_AGGREGATE_ERROR_IO;
+		}
+		if(size)
+		{
+			(void)posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+		}
+		result->bytes += size;
+
+		// An empty file still gets one chunk, which records its mapping for unmapping
+		for(size_t begin = 0; begin < size || begin == 0; begin += chunk_bytes)
+		{
+			if(*chunk_count == capacity)
+			{
+				capacity = capacity ? 2 * capacity : 64;
+				struct chunk* grown = realloc(*chunks, capacity * sizeof(**chunks));
+				if(!grown)
+				{
+					// Once the file's first chunk is recorded, unmap_files() unmaps it
+					if(map && begin == 0)
+					{
+						munmap(map, size);
+					}
+					return SPS30_LOG_AGGREGATE_ERROR_RESOURCES;
+				}
+				*chunks = grown;
+			}
+
+			struct chunk* chunk = &(*chunks)[(*chunk_count)++];
+			chunk->data = map;
+			chunk->size = size;
+			chunk->begin = begin;
+			chunk->end = size - begin > chunk_bytes ? begin + chunk_bytes : size;
+			if(size == 0)
+			{
+				break;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void unmap_files(struct chunk* chunks, size_t chunk_count)
+{
+	for(size_t c = 0; c < chunk_count; c++)
+	{
+		if(chunks[c].begin == 0 && chunks[c].data)
+		{
+			munmap((void*)(uintptr_t)chunks[c].data, chunks[c].size);
+		}
+	}
+	free(chunks);
+}
+
+static int compare_stats(const void* a, const void* b)
+{
+	const struct sps30_log_aggregate_stats* x = *(const struct sps30_log_aggregate_stats* const*)a;
+	const struct sps30_log_aggregate_stats* y = *(const struct sps30_log_aggregate_stats* const*)b;
+
+	if(x->sensor_id != y->sensor_id)
+	{
+		return x->sensor_id < y->sensor_id ? -1 : 1;
+	}
+	return (int)x->channel - (int)y->channel;
+}
+
+/* Combine the workers' per-sensor statistics into the result */
+static int16_t merge_workers(const struct engine* engine,
+							 struct sps30_log_aggregate_result* result)
+{
+	size_t total = 0;
+
+	for(unsigned w = 0; w < engine->worker_count; w++)
+	{
+		total += engine->workers[w].sensor_count;
+	}
+	if(total == 0)
+	{
+		return 0;
+	}
+
+	const struct sps30_log_aggregate_stats** all = malloc(total * sizeof(*all));
+	result->sensors = malloc(total * sizeof(*result->sensors));
+	if(!all || !result->sensors)
+	{
+		free(all);
+		return SPS30_LOG_AGGREGATE_ERROR_RESOURCES;
+	}
+
+	size_t n = 0;
+	for(unsigned w = 0; w < engine->worker_count; w++)
+	{
+		for(size_t s = 0; s < engine->workers[w].sensor_count; s++)
+		{
+			all[n++] = &engine->workers[w].sensors[s]->stats;
+		}
+	}
+	qsort(all, total, sizeof(*all), compare_stats);
+
+	struct sps30_log_aggregate_stats* last = NULL;
+	for(size_t i = 0; i < total; i++)
+	{
+		if(!last || last->sensor_id != all[i]->sensor_id || last->channel != all[i]->channel)
+		{
+			last = &result->sensors[result->sensor_count++];
+			sps30_log_aggregate_stats_init(last, all[i]->sensor_id, all[i]->channel);
+		}
+		sps30_log_aggregate_stats_merge(last, all[i]);
+		sps30_log_aggregate_stats_merge(&result->fleet, all[i]);
+	}
+
+	free(all);
+	return 0;
+}
+
+static unsigned worker_count(const struct sps30_log_aggregate_config* config, size_t chunks)
+{
+	long threads = config->threads ? (long)config->threads : sysconf(_SC_NPROCESSORS_ONLN);
+
+	threads = threads < 1 ? 1 : threads;
+	threads = threads > SPS30_LOG_AGGREGATE_MAX_THREADS ? SPS30_LOG_AGGREGATE_MAX_THREADS
+														: threads;
+	// Idle workers would only steal
+	if((size_t)threads > chunks)
+	{
+		threads = chunks ? (long)chunks : 1;
+	}
+	return (unsigned)threads;
+}
+
+int16_t sps30_log_aggregate_run(const struct sps30_log_aggregate_config* config,
+								struct sps30_log_aggregate_result* result)
+{
+	struct engine engine = {config, NULL, 0, NULL, 0};
+	int16_t r;
+
+	assert(config && result && (config->paths || config->path_count == 0));
+
+	memset(result, 0, sizeof(*result));
+	sps30_log_aggregate_stats_init(&result->fleet, 0, 0);
+
+	r = map_files(config, result, &engine.chunks, &engine.chunk_count);
+	if(r != 0)
+	{
+		unmap_files(engine.chunks, engine.chunk_count);
+		return r;
+	}
+
+	engine.worker_count = worker_count(config, engine.chunk_count);
+	engine.workers = calloc(engine.worker_count, sizeof(*engine.workers));
+	if(!engine.workers)
+	{
+		unmap_files(engine.chunks, engine.chunk_count);
+		return SPS30_LOG_AGGREGATE_ERROR_RESOURCES;
+	}
+
+	// Each worker starts with a contiguous share of the chunks
+	unsigned started = 0;
+	for(unsigned w = 0; w < engine.worker_count; w++)
+	{
+		struct worker* worker = &engine.workers[w];
+		worker->id = w;
+		worker->engine = &engine;
+		worker->head = engine.chunk_count * w / engine.worker_count;
+		worker->tail = engine.chunk_count * (w + 1) / engine.worker_count;
+		pthread_mutex_init(&worker->lock, NULL);
+	}
+	for(; started < engine.worker_count; started++)
+	{
+		struct worker* worker = &engine.workers[started];
+		if(pthread_create(&worker->thread, NULL, worker_main, worker) != 0)
+		{
+			// The running workers steal the chunks of the workers that did not start
+			r = started ? 0 : SPS30_LOG_AGGREGATE_ERROR_RESOURCES;
+			break;
+		}
+	}
+	for(unsigned w = 0; w < started; w++)
+	{
+		pthread_join(engine.workers[w].thread, NULL);
+	}
+
+	result->threads = started;
+	result->chunks = engine.chunk_count;
+	for(unsigned w = 0; w < engine.worker_count; w++)
+	{
+		result->skipped += engine.workers[w].skipped;
+		result->steals += engine.workers[w].steals;
+		if(engine.workers[w].failed)
+		{
+			r = SPS30_LOG_AGGREGATE_ERROR_RESOURCES;
+		}
+	}
+
+	if(r == 0)
+	{
+		r = merge_workers(&engine, result);
+	}
+
+	for(unsigned w = 0; w < engine.worker_count; w++)
+	{
+		struct worker* worker = &engine.workers[w];
+		for(size_t s = 0; s < worker->sensor_count; s++)
+		{
+			free(worker->sensors[s]);
+		}
+		free(worker->sensors);
+		free(worker->slots);
+		pthread_mutex_destroy(&worker->lock);
+	}
+	free(engine.workers);
+	unmap_files(engine.chunks, engine.chunk_count);
+
+	return r;
+}
+
+void sps30_log_aggregate_free(struct sps30_log_aggregate_result* result)
+{
+	assert(result);
+
+	free(result->sensors);
+	result->sensors = NULL;
+	result->sensor_count = 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS30_LOG_AGGREGATE_H
+#define SPS30_LOG_AGGREGATE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sps30_record.h"
+
+/** A log file could not be opened or mapped. errno describes the failure. */
+#define SPS30_LOG_AGGREGATE_ERROR_IO (-1)
+/** Memory for the statistics, or a worker thread, could not be allocated. */
+#define SPS30_LOG_AGGREGATE_ERROR_RESOURCES (-2)
+
+/** Default bytes of log per work item */
+#define SPS30_LOG_AGGREGATE_CHUNK_BYTES (4u << 20)
+/** Upper bound on worker threads */
+#define SPS30_LOG_AGGREGATE_MAX_THREADS 64
+
+/*
+ * Percentiles come from a histogram with logarithmic bins: each power of two between
+ * 2^MIN_EXPONENT and 2^(MAX_EXPONENT + 1) is split into 2^SUB_BITS bins, so a percentile is
+ * within 1/2^(SUB_BITS + 1) (1.6%) of the true value. Bin 0 holds values below
+ * 2^MIN_EXPONENT (1/16, below the sensor's resolution), including zero, and the last bin
+ * holds values above the sensor's range.
+ */
+#define SPS30_LOG_AGGREGATE_MIN_EXPONENT (-4)
+#define SPS30_LOG_AGGREGATE_MAX_EXPONENT 12
+#define SPS30_LOG_AGGREGATE_SUB_BITS 5
+#define SPS30_LOG_AGGREGATE_BINS                                                          \
+	(2 + ((SPS30_LOG_AGGREGATE_MAX_EXPONENT - SPS30_LOG_AGGREGATE_MIN_EXPONENT + 1)        \
+		  << SPS30_LOG_AGGREGATE_SUB_BITS))
+
+	/**
+	 * struct sps30_log_aggregate_stats - statistics for one sensor, or the whole fleet
+	 *
+	 * @sensor_id:           The sensor (0 for the fleet)
+	 * @channel:             The channel the sensor was read through (0 for the fleet)
+	 * @count:               Records
+	 * @first_timestamp_ms:  Earliest record
+	 * @last_timestamp_ms:   Latest record
+	 * @min:                 Per-field minimum
+	 * @max:                 Per-field maximum
+	 * @sum:                 Per-field sum. See sps30_log_aggregate_mean().
+	 * @exceedances:         Per-field count of values above the configured threshold
+	 * @histogram:           Per-field value histogram. See sps30_log_aggregate_percentile().
+	 */
+	struct sps30_log_aggregate_stats
+	{
+		uint64_t sensor_id;
+		uint16_t channel;
+		uint64_t count;
+		uint64_t first_timestamp_ms;
+		uint64_t last_timestamp_ms;
+		float min[SPS30_RECORD_FIELD_COUNT];
+		float max[SPS30_RECORD_FIELD_COUNT];
+		double sum[SPS30_RECORD_FIELD_COUNT];
+		uint64_t exceedances[SPS30_RECORD_FIELD_COUNT];
+		uint64_t histogram[SPS30_RECORD_FIELD_COUNT][SPS30_LOG_AGGREGATE_BINS];
+	};
+
+	/**
+	 * struct sps30_log_aggregate_config - what to aggregate, and how
+	 *
+	 * @paths:        Record log files (see sps30_record_log.h), in any order
+	 * @path_count:   Number of paths
+	 * @threads:      Worker threads, or 0 for one per online CPU
+	 * @chunk_bytes:  Bytes of log per work item, or 0 for SPS30_LOG_AGGREGATE_CHUNK_BYTES
+	 * @start_ms:     Only records at or after this time are included
+	 * @end_ms:       Only records at or before this time are included
+	 * @thresholds:   Per-field exceedance thresholds. Use INFINITY to count nothing.
+	 */
+	struct sps30_log_aggregate_config
+	{
+		const char* const* paths;
+		size_t path_count;
+		unsigned threads;
+		size_t chunk_bytes;
+		uint64_t start_ms;
+		uint64_t end_ms;
+		float thresholds[SPS30_RECORD_FIELD_COUNT];
+	};
+
+	/**
+	 * struct sps30_log_aggregate_result - the output of sps30_log_aggregate_run()
+	 *
+	 * @sensors:       Per-sensor statistics, ordered by sensor ID and channel
+	 * @sensor_count:  Entries in sensors
+	 * @fleet:         Statistics over every sensor
+	 * @bytes:         Log bytes read
+	 * @skipped:       Damaged regions, and frames that do not hold a struct sps30_record
+	 * @chunks:        Work items
+	 * @steals:        Work items taken from another worker's queue
+	 * @threads:       Worker threads used
+	 */
+	struct sps30_log_aggregate_result
+	{
+		struct sps30_log_aggregate_stats* sensors;
+		size_t sensor_count;
+		struct sps30_log_aggregate_stats fleet;
+		uint64_t bytes;
+		uint64_t skipped;
+		uint64_t chunks;
+		uint64_t steals;
+		unsigned threads;
+	};
+
+	/**
+	 * sps30_log_aggregate_config_init() - default configuration for a set of files
+	 *
+	 * Every record is included, no thresholds are set, and one thread runs per CPU.
+	 */
+	void sps30_log_aggregate_config_init(struct sps30_log_aggregate_config* config,
+										 const char* const* paths, size_t path_count);
+
+	/**
+	 * sps30_log_aggregate_run() - compute per-sensor and fleet statistics over log files
+	 *
+	 * The files are mapped and split into chunks. Each worker thread starts with an equal
+	 * share of the chunks, in file order, and steals from the far end of another worker's
+	 * queue when its own runs out, so uneven files and damaged regions do not leave
+	 * threads idle. Each worker transposes its records into per-sensor column blocks
+	 * (struct sps30_record_block) and reduces whole columns at once, with SIMD
+	 * instructions where available. Worker statistics are merged at the end.
+	 *
+	 * Release the result with sps30_log_aggregate_free(), whatever the return value.
+	 *
+	 * Return:  0 on success, SPS30_LOG_AGGREGATE_ERROR_IO, or
+	 *          SPS30_LOG_AGGREGATE_ERROR_RESOURCES
+	 */
+	int16_t sps30_log_aggregate_run(const struct sps30_log_aggregate_config* config,
+									struct sps30_log_aggregate_result* result);
+
+	/**
+	 * sps30_log_aggregate_free() - release the per-sensor statistics of a result
+	 */
+	void sps30_log_aggregate_free(struct sps30_log_aggregate_result* result);
+
+	/**
+	 * sps30_log_aggregate_stats_init() - empty statistics
+	 */
+	void sps30_log_aggregate_stats_init(struct sps30_log_aggregate_stats* stats,
+										uint64_t sensor_id, uint16_t channel);
+
+	/**
+	 * sps30_log_aggregate_stats_add() - add one record to statistics
+	 *
+	 * This is the scalar reference for the column reductions.
+	 */
+	void sps30_log_aggregate_stats_add(struct sps30_log_aggregate_stats* stats,
+									   const struct sps30_record* record,
+									   const float* thresholds);
+
+	/**
+	 * sps30_log_aggregate_stats_merge() - add the statistics in from to into
+	 */
+	void sps30_log_aggregate_stats_merge(struct sps30_log_aggregate_stats* into,
+										 const struct sps30_log_aggregate_stats* from);
+
+	/**
+	 * sps30_log_aggregate_mean() - a field's mean, or 0 if there are no records
+	 */
+	double sps30_log_aggregate_mean(const struct sps30_log_aggregate_stats* stats,
+									unsigned field);
+
+	/**
+	 * sps30_log_aggregate_percentile() - estimate a field's percentile
+	 *
+	 * @quantile:  Between 0 and 1, e.g., 0.95 for the 95th percentile
+	 *
+	 * Return:  The midpoint of the histogram bin holding the percentile, clamped to the
+	 *          field's minimum and maximum, or 0 if there are no records
+	 */
+	float sps30_log_aggregate_percentile(const struct sps30_log_aggregate_stats* stats,
+										 unsigned field, double quantile);
+
+	/**
+	 * sps30_log_aggregate_bin() - the histogram bin of a value
+	 */
+	unsigned sps30_log_aggregate_bin(float value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_LOG_AGGREGATE_H */
@@ -0,0 +1,863 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#define _POSIX_C_SOURCE 200809L // pread, ftruncate
+
+#include "sps30_log_index.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SLOT_COUNT (2 * SPS30_LOG_INDEX_MAX_SENSORS)
+#define EMPTY_SLOT (-1)
+/* Entries are written in batches of this many */
+#define WRITE_BATCH 16
+
+_Static_assert(sizeof(struct sps30_log_index_header) == 16, "The header is 16 bytes");
+_Static_assert(sizeof(struct sps30_log_index_entry) == 208, "Entries are 208 bytes");
+_Static_assert((SLOT_COUNT & (SLOT_COUNT - 1)) == 0, "The slot count is a power of two");
+
+static bool matches(uint64_t entry_sensor, uint16_t entry_channel, uint64_t sensor_id,
+					int32_t channel)
+{
+	return (sensor_id == SPS30_LOG_INDEX_ANY_SENSOR || entry_sensor == sensor_id) &&
+		   (channel == SPS30_LOG_INDEX_ANY_CHANNEL || (int32_t)entry_channel == channel);
+}
+
+static int16_t write_all(int fd, const void* data, size_t length)
+{
+	const uint8_t* p = data;
+
+	while(length)
+	{
+		const ssize_t r = write(fd, p, length);
+		if(r < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			return SPS30_LOG_INDEX_ERROR_IO;
+		}
+		p += r;
+		length -= (size_t)r;
+	}
+
+	return 0;
+}
+
+#pragma mark - Writer -
+
+static void reset_block(struct sps30_log_index_writer* writer, uint64_t offset)
+{
+	writer->block_offset = offset;
+	writer->block_frames = 0;
+	writer->sensor_count = 0;
+	memset(writer->slots, 0xff, sizeof(writer->slots));
+}
+
+static struct sps30_log_index_accumulator*
+find_sensor(struct sps30_log_index_writer* writer, uint64_t sensor_id, uint16_t channel)
+{
+	const uint64_t key = sensor_id ^ ((uint64_t)channel << 48);
+	uint32_t slot = (uint32_t)((key * 0x9e3779b97f4a7c15ull) >> 32) & (SLOT_COUNT - 1);
+
+	// Linear probing. The table is at most half full.
+	for(;; slot = (slot + 1) & (SLOT_COUNT - 1))
+	{
+		const int16_t i = writer->slots[slot];
+		if(i == EMPTY_SLOT)
+		{
+			break;
+		}
+		if(writer->sensors[i].sensor_id == sensor_id && writer->sensors[i].channel == channel)
+		{
+			return &writer->sensors[i];
+		}
+	}
+
+	if(writer->sensor_count == SPS30_LOG_INDEX_MAX_SENSORS)
+	{
+		return NULL;
+	}
+
+	struct sps30_log_index_accumulator* sensor = &writer->sensors[writer->sensor_count];
+	writer->slots[slot] = (int16_t)writer->sensor_count++;
+	sensor->sensor_id = sensor_id;
+	sensor->channel = channel;
+	sensor->count = 0;
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		sensor->min[f] = FLT_MAX;
+		sensor->max[f] = -FLT_MAX;
+		sensor->sum[f] = 0;
+	}
+
+	return sensor;
+}
+
+static void accumulate(struct sps30_log_index_accumulator* sensor,
+					   const struct sps30_record* record)
+{
+	if(sensor->count == 0)
+	{
+		sensor->first_timestamp_ms = record->timestamp_ms;
+	}
+	sensor->last_timestamp_ms = record->timestamp_ms;
+	sensor->count++;
+
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		const float value = record->values[f];
+		sensor->min[f] = value < sensor->min[f] ? value : sensor->min[f];
+		sensor->max[f] = value > sensor->max[f] ? value : sensor->max[f];
+		sensor->sum[f] += value;
+	}
+}
+
+/* Write the current block's entries, and start a new block at end_offset */
+static void write_block(struct sps30_log_index_writer* writer, uint64_t end_offset)
+{
+	struct sps30_log_index_entry batch[WRITE_BATCH];
+	unsigned batched = 0;
+
+	for(uint16_t i = 0; i < writer->sensor_count; i++)
+	{
+		const struct sps30_log_index_accumulator* sensor = &writer->sensors[i];
+		struct sps30_log_index_entry* entry = &batch[batched++];
+
+		memset(entry, 0, sizeof(*entry));
+		entry->sensor_id = sensor->sensor_id;
+		entry->first_timestamp_ms = sensor->first_timestamp_ms;
+		entry->last_timestamp_ms = sensor->last_timestamp_ms;
+		entry->offset = writer->block_offset;
+		entry->length = (uint32_t)(end_offset - writer->block_offset);
+		entry->count = sensor->count;
+		entry->channel = sensor->channel;
+		for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+		{
+			entry->min[f] = sensor->min[f];
+			entry->max[f] = sensor->max[f];
+			entry->sum[f] = sensor->sum[f];
+		}
+
+		if(batched == WRITE_BATCH || i + 1 == writer->sensor_count)
+		{
+			if(write_all(writer->fd, batch, batched * sizeof(batch[0])) != 0)
+			{
+				writer->stats.errors++;
+			}
+			writer->stats.entries += batched;
+			batched = 0;
+		}
+	}
+
+	if(writer->sensor_count)
+	{
+		writer->stats.blocks++;
+	}
+	reset_block(writer, end_offset);
+}
+
+static int16_t open_index(struct sps30_log_index_writer* writer, bool truncate)
+{
+	struct sps30_log_index_header header = {0};
+	struct stat st;
+
+	const int flags = O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0);
+
+	writer->fd = open(writer->path, flags, 0644);
+	if(writer->fd < 0 || fstat(writer->fd, &st) != 0)
+	{
+		return SPS30_LOG_INDEX_ERROR_IO;
+	}
+
+	if(st.st_size == 0)
+	{
+		header.magic = SPS30_LOG_INDEX_MAGIC;
+		header.version = SPS30_LOG_INDEX_VERSION;
+		header.entry_size = sizeof(struct sps30_log_index_entry);
+		header.block_records = writer->block_records;
+		return write_all(writer->fd, &header, sizeof(header));
+	}
+
+	if(pread(writer->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+	   header.magic != SPS30_LOG_INDEX_MAGIC || header.version != SPS30_LOG_INDEX_VERSION ||
+	   header.entry_size != sizeof(struct sps30_log_index_entry))
+	{
+		return SPS30_LOG_INDEX_ERROR_VERSION;
+	}
+
+	// Drop a partial entry left by an interrupted write
+	const size_t whole = ((size_t)st.st_size - sizeof(header)) / header.entry_size;
+	if(ftruncate(writer->fd, (off_t)(sizeof(header) + whole * header.entry_size)) != 0)
+	{
+		return SPS30_LOG_INDEX_ERROR_IO;
+	}
+
+	return 0;
+}
+
+static int16_t writer_start(struct sps30_log_index_writer* writer, const char* log_path,
+							uint32_t block_records, uint8_t keep_files, uint64_t log_bytes)
+{
+	assert(writer && log_path);
+
+	memset(writer, 0, sizeof(*writer));
+	writer->fd = -1;
+	if(strlen(log_path) + sizeof(SPS30_LOG_INDEX_SUFFIX) > SPS30_RECORD_LOG_PATH_MAX)
+	{
+		return SPS30_LOG_INDEX_ERROR_IO;
+	}
+	snprintf(writer->path, sizeof(writer->path), "%s%s", log_path, SPS30_LOG_INDEX_SUFFIX);
+	writer->block_records = block_records ? block_records : SPS30_LOG_INDEX_BLOCK_RECORDS;
+	writer->keep_files = keep_files;
+	writer->next_offset = log_bytes;
+	reset_block(writer, log_bytes);
+
+	// An empty log has nothing indexed
+	const int16_t r = open_index(writer, log_bytes == 0);
+	if(r != 0 && writer->fd >= 0)
+	{
+		close(writer->fd);
+		writer->fd = -1;
+	}
+	return r;
+}
+
+/* Index the frames of the log in [begin, end), as if they had just been committed */
+static int16_t index_log_range(struct sps30_log_index_writer* writer, const char* log_path,
+							   uint64_t begin, uint64_t end)
+{
+	const int fd = open(log_path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+	{
+		return SPS30_LOG_INDEX_ERROR_IO;
+	}
+
+	void* map = mmap(NULL, (size_t)end, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+	{
+		return SPS30_LOG_INDEX_ERROR_IO;
+	}
+
+	posix_madvise(map, (size_t)end, POSIX_MADV_SEQUENTIAL);
+	writer->next_offset = begin;
+	reset_block(writer, begin);
+	sps30_log_index_writer_add(writer, (const uint8_t*)map + begin, (size_t)(end - begin), begin);
+	munmap(map, (size_t)end);
+	return 0;
+}
+
+/* The log offset past the last block in the index file, or 0 if it has no entries */
+static int16_t writer_indexed_end(const struct sps30_log_index_writer* writer, uint64_t* end)
+{
+	struct sps30_log_index_entry last;
+	struct stat st;
+
+	*end = 0;
+	if(fstat(writer->fd, &st) != 0)
+	{
+		return SPS30_LOG_INDEX_ERROR_IO;
+	}
+	if((size_t)st.st_size < sizeof(struct sps30_log_index_header) + sizeof(last))
+	{
+		return 0;
+	}
+	if(pread(writer->fd, &last, sizeof(last), st.st_size - (off_t)sizeof(last)) !=
+	   (ssize_t)sizeof(last))
+	{
+		return SPS30_LOG_INDEX_ERROR_IO;
+	}
+
+	*end = last.offset + last.length;
+	return 0;
+}
+
+int16_t sps30_log_index_writer_open(struct sps30_log_index_writer* writer, const char* log_path,
+									uint32_t block_records, uint8_t keep_files)
+{
+	struct stat st;
+	const uint64_t log_bytes = stat(log_path, &st) == 0 ? (uint64_t)st.st_size : 0;
+	uint64_t indexed = 0;
+
+	int16_t r = writer_start(writer, log_path, block_records, keep_files, log_bytes);
+	if(r == 0)
+	{
+		r = writer_indexed_end(writer, &indexed);
+	}
+	if(r == 0 && indexed > log_bytes)
+	{
+		// The index describes another log, so it is replaced
+		r = ftruncate(writer->fd, sizeof(struct sps30_log_index_header)) == 0 ?
+				0 :
+				SPS30_LOG_INDEX_ERROR_IO;
+		indexed = 0;
+	}
+	if(r == 0 && indexed < log_bytes)
+	{
+		// Frames committed after the last block was written, e.g. before a crash. They
+		// continue the current block, which later commits extend.
+		r = index_log_range(writer, log_path, indexed, log_bytes);
+	}
+
+	if(r != 0 && writer->fd >= 0)
+	{
+		close(writer->fd);
+		writer->fd = -1;
+	}
+	return r;
+}
+
+/* The log started a new file: shift the index files in the same way */
+static void rotate_index(struct sps30_log_index_writer* writer)
+{
+	char log_path[sizeof(writer->path)];
+
+	close(writer->fd);
+	writer->fd = -1;
+
+	// The index of log.1 is log.1.idx
+	snprintf(log_path, sizeof(log_path), "%.*s",
+			 (int)(strlen(writer->path) - strlen(SPS30_LOG_INDEX_SUFFIX)), writer->path);
+	if(sps30_record_log_shift_files(log_path, SPS30_LOG_INDEX_SUFFIX, writer->keep_files) != 0 ||
+	   open_index(writer, true) != 0)
+	{
+		writer->stats.errors++;
+	}
+}
+
+void sps30_log_index_writer_add(void* context, const uint8_t* frames, size_t length,
+								uint64_t offset)
+{
+	struct sps30_log_index_writer* writer = context;
+	size_t position = 0;
+	bool resynchronizing = false;
+
+	assert(writer && (frames || length == 0));
+
+	if(offset != writer->next_offset)
+	{
+		write_block(writer, writer->next_offset);
+		if(offset == 0)
+		{
+			rotate_index(writer);
+		}
+		reset_block(writer, offset);
+	}
+
+	while(position < length)
+	{
+		const uint8_t* payload;
+		uint16_t payload_length;
+		struct sps30_record record;
+
+		const int32_t r = sps30_record_log_frame_decode(&frames[position], length - position,
+														&payload, &payload_length);
+		if(r == SPS30_RECORD_LOG_ERROR_TRUNCATED)
+		{
+			break;
+		}
+		if(r < 0)
+		{
+			// Damaged data: count it once, and look for the next frame
+			writer->stats.skipped += !resynchronizing;
+			resynchronizing = true;
+			position++;
+			continue;
+		}
+		resynchronizing = false;
+
+		if(payload_length != SPS30_RECORD_SIZE || sps30_record_decode(payload, &record) != 0)
+		{
+			writer->stats.skipped++;
+		}
+		else
+		{
+			struct sps30_log_index_accumulator* sensor =
+				find_sensor(writer, record.sensor_id, record.channel);
+			if(!sensor)
+			{
+				// Too many sensors for one block: end the block before this frame
+				write_block(writer, offset + position);
+				sensor = find_sensor(writer, record.sensor_id, record.channel);
+			}
+			accumulate(sensor, &record);
+		}
+
+		position += (size_t)r;
+		if(++writer->block_frames >= writer->block_records)
+		{
+			write_block(writer, offset + position);
+		}
+	}
+
+	writer->next_offset = offset + length;
+}
+
+int16_t sps30_log_index_writer_close(struct sps30_log_index_writer* writer)
+{
+	assert(writer);
+
+	if(writer->fd < 0)
+	{
+		return SPS30_LOG_INDEX_ERROR_IO;
+	}
+
+	write_block(writer, writer->next_offset);
+	close(writer->fd);
+	writer->fd = -1;
+
+	return writer->stats.errors ? SPS30_LOG_INDEX_ERROR_IO : 0;
+}
+
+int16_t sps30_log_index_build(const char* log_path, uint32_t block_records)
+{
+	struct sps30_log_index_writer writer;
+	struct stat st;
+
+	assert(log_path);
+
+	// Starting at offset 0 replaces any existing index
+	const int16_t r = writer_start(&writer, log_path, block_records, 0, 0);
+	if(r != 0)
+	{
+		return r;
+	}
+
+	const int fd = open(log_path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0 || fstat(fd, &st) != 0)
+	{
+		if(fd >= 0)
+		{
+			close(fd);
+		}
+		(void)sps30_log_index_writer_close(&writer);
+		return SPS30_LOG_INDEX_ERROR_IO;
+	}
+
+	if(st.st_size > 0)
+	{
+		void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if(map == MAP_FAILED)
+		{
+			close(fd);
+			(void)sps30_log_index_writer_close(&writer);
+			return SPS30_LOG_INDEX_ERROR_IO;
+		}
+		posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+		sps30_log_index_writer_add(&writer, map, (size_t)st.st_size, 0);
+		munmap(map, (size_t)st.st_size);
+	}
+	close(fd);
+
+	return sps30_log_index_writer_close(&writer);
+}
+
+#pragma mark - Queries -
+
+int16_t sps30_log_index_load(struct sps30_log_index* index, const char* log_path)
+{
+	char path[SPS30_RECORD_LOG_PATH_MAX + sizeof(SPS30_LOG_INDEX_SUFFIX)];
+	struct stat st;
+	int fd;
+
+	assert(index && log_path);
+
+	memset(index, 0, sizeof(*index));
+
+	fd = open(log_path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0 || fstat(fd, &st) != 0)
+	{
+		if(fd >= 0)
+		{
+			close(fd);
+		}
+		return SPS30_LOG_INDEX_ERROR_IO;
+	}
+	if(st.st_size > 0)
+	{
+		void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if(map == MAP_FAILED)
+		{
+			close(fd);
+			return SPS30_LOG_INDEX_ERROR_IO;
+		}
+		index->log = map;
+		index->log_size = (size_t)st.st_size;
+	}
+	close(fd);
+
+	snprintf(path, sizeof(path), "%s%s", log_path, SPS30_LOG_INDEX_SUFFIX);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+	{
+		return errno == ENOENT ? 0 : SPS30_LOG_INDEX_ERROR_IO;
+	}
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct sps30_log_index_header))
+	{
+		close(fd);
+		sps30_log_index_unload(index);
+		return SPS30_LOG_INDEX_ERROR_VERSION;
+	}
+
+	void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+	{
+		sps30_log_index_unload(index);
+		return SPS30_LOG_INDEX_ERROR_IO;
+	}
+	index->index_map = map;
+	index->index_map_size = (size_t)st.st_size;
+
+	const struct sps30_log_index_header* header = map;
+	if(header->magic != SPS30_LOG_INDEX_MAGIC || header->version != SPS30_LOG_INDEX_VERSION ||
+	   header->entry_size != sizeof(struct sps30_log_index_entry))
+	{
+		sps30_log_index_unload(index);
+		return SPS30_LOG_INDEX_ERROR_VERSION;
+	}
+
+	index->entries = (const struct sps30_log_index_entry*)(header + 1);
+	index->count = (index->index_map_size - sizeof(*header)) / sizeof(struct sps30_log_index_entry);
+	return 0;
+}
+
+void sps30_log_index_unload(struct sps30_log_index* index)
+{
+	assert(index);
+
+	if(index->log)
+	{
+		munmap((void*)(uintptr_t)index->log, index->log_size);
+	}
+	if(index->index_map)
+	{
+		munmap(index->index_map, index->index_map_size);
+	}
+	memset(index, 0, sizeof(*index));
+}
+
+void sps30_log_index_summary_init(struct sps30_log_index_summary* summary)
+{
+	assert(summary);
+
+	memset(summary, 0, sizeof(*summary));
+	summary->first_timestamp_ms = UINT64_MAX;
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		summary->min[f] = FLT_MAX;
+		summary->max[f] = -FLT_MAX;
+	}
+}
+
+static void summary_add_range(struct sps30_log_index_summary* summary, uint64_t count,
+							  uint64_t first_ms, uint64_t last_ms, const float* min,
+							  const float* max, const double* sum)
+{
+	summary->count += count;
+	summary->first_timestamp_ms =
+		first_ms < summary->first_timestamp_ms ? first_ms : summary->first_timestamp_ms;
+	summary->last_timestamp_ms =
+		last_ms > summary->last_timestamp_ms ? last_ms : summary->last_timestamp_ms;
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		summary->min[f] = min[f] < summary->min[f] ? min[f] : summary->min[f];
+		summary->max[f] = max[f] > summary->max[f] ? max[f] : summary->max[f];
+		summary->sum[f] += sum[f];
+	}
+}
+
+/* Visit every record in part of the log. Returns false if the visitor stopped early. */
+typedef bool (*record_visitor)(void* context, const struct sps30_record* record);
+
+static void scan_records(const struct sps30_log_index* index, uint64_t begin, uint64_t end,
+						 record_visitor visit, void* context)
+{
+	end = end < index->log_size ? end : index->log_size;
+
+	for(uint64_t position = begin; position < end;)
+	{
+		const uint8_t* payload;
+		uint16_t length;
+		struct sps30_record record;
+
+		const int32_t r = sps30_record_log_frame_decode(&index->log[position],
+														(size_t)(end - position), &payload,
+														&length);
+		if(r == SPS30_RECORD_LOG_ERROR_TRUNCATED)
+		{
+			break;
+		}
+		if(r < 0)
+		{
+			position++;
+			continue;
+		}
+
+		position += (uint64_t)r;
+		if(length == SPS30_RECORD_SIZE && sps30_record_decode(payload, &record) == 0 &&
+		   !visit(context, &record))
+		{
+			break;
+		}
+	}
+}
+
+/* The first entry of the block that holds entry i */
+static size_t block_start(const struct sps30_log_index* index, size_t i)
+{
+	while(i > 0 && index->entries[i - 1].offset == index->entries[i].offset)
+	{
+		i--;
+	}
+	return i;
+}
+
+/* The end of the block that starts at entry i */
+static size_t block_end(const struct sps30_log_index* index, size_t i)
+{
+	const uint64_t offset = index->entries[i].offset;
+	while(i < index->count && index->entries[i].offset == offset)
+	{
+		i++;
+	}
+	return i;
+}
+
+/*
+ * The first block that can hold records at or after timestamp_ms.
+ *
+ * Blocks are in time order, but the sensors within a block are not, so the entries are
+ * only partitioned by the search predicate outside of a single block. The search lands in
+ * that block or at the start of the next one, so back up a whole block.
+ */
+static size_t first_block(const struct sps30_log_index* index, uint64_t timestamp_ms)
+{
+	size_t low = 0;
+	size_t high = index->count;
+
+	while(low < high)
+	{
+		const size_t middle = low + (high - low) / 2;
+		if(index->entries[middle].last_timestamp_ms < timestamp_ms)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	if(low > 0)
+	{
+		low = block_start(index, low - 1);
+	}
+	return low;
+}
+
+/* The log offset past the last indexed block */
+static uint64_t indexed_end(const struct sps30_log_index* index)
+{
+	if(index->count == 0)
+	{
+		return 0;
+	}
+	const struct sps30_log_index_entry* last = &index->entries[index->count - 1];
+	return last->offset + last->length;
+}
+
+struct aggregate_query
+{
+	uint64_t sensor_id;
+	int32_t channel;
+	uint64_t start_ms;
+	uint64_t end_ms;
+	struct sps30_log_index_summary* summary;
+};
+
+static bool aggregate_record(void* context, const struct sps30_record* record)
+{
+	const struct aggregate_query* query = context;
+	double sum[SPS30_RECORD_FIELD_COUNT];
+
+	if(matches(record->sensor_id, record->channel, query->sensor_id, query->channel) &&
+	   record->timestamp_ms >= query->start_ms && record->timestamp_ms <= query->end_ms)
+	{
+		for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+		{
+			sum[f] = record->values[f];
+		}
+		summary_add_range(query->summary, 1, record->timestamp_ms, record->timestamp_ms,
+						  record->values, record->values, sum);
+	}
+	return true;
+}
+
+void sps30_log_index_aggregate(const struct sps30_log_index* index, uint64_t sensor_id,
+							   int32_t channel, uint64_t start_ms, uint64_t end_ms,
+							   struct sps30_log_index_summary* summary)
+{
+	struct aggregate_query query = {sensor_id, channel, start_ms, end_ms, summary};
+	size_t i;
+
+	assert(index && summary);
+
+	for(i = first_block(index, start_ms); i < index->count;)
+	{
+		const size_t end = block_end(index, i);
+		bool in_range = false;
+		bool partial = false;
+		bool covered = false;
+
+		for(size_t e = i; e < end; e++)
+		{
+			const struct sps30_log_index_entry* entry = &index->entries[e];
+			in_range |= entry->first_timestamp_ms <= end_ms;
+			if(!matches(entry->sensor_id, entry->channel, sensor_id, channel) ||
+			   entry->last_timestamp_ms < start_ms || entry->first_timestamp_ms > end_ms)
+			{
+				continue;
+			}
+			if(entry->first_timestamp_ms >= start_ms && entry->last_timestamp_ms <= end_ms)
+			{
+				covered = true;
+			}
+			else
+			{
+				partial = true;
+			}
+		}
+
+		// Later blocks only hold later records
+		if(!in_range)
+		{
+			return;
+		}
+
+		if(partial)
+		{
+			// Only some of the block's records are in range, so read them
+			scan_records(index, index->entries[i].offset,
+						 index->entries[i].offset + index->entries[i].length, aggregate_record,
+						 &query);
+			summary->blocks_scanned++;
+		}
+		else if(covered)
+		{
+			for(size_t e = i; e < end; e++)
+			{
+				const struct sps30_log_index_entry* entry = &index->entries[e];
+				if(matches(entry->sensor_id, entry->channel, sensor_id, channel) &&
+				   entry->first_timestamp_ms >= start_ms && entry->last_timestamp_ms <= end_ms)
+				{
+					summary_add_range(summary, entry->count, entry->first_timestamp_ms,
+									  entry->last_timestamp_ms, entry->min, entry->max,
+									  entry->sum);
+				}
+			}
+			summary->blocks_summarized++;
+		}
+
+		i = end;
+	}
+
+	// Records committed since the last index block was written
+	if(indexed_end(index) < index->log_size)
+	{
+		scan_records(index, indexed_end(index), index->log_size, aggregate_record, &query);
+		summary->blocks_scanned++;
+	}
+}
+
+struct find_query
+{
+	uint64_t sensor_id;
+	int32_t channel;
+	uint64_t timestamp_ms;
+	bool found;
+	struct sps30_record* record;
+};
+
+static bool find_record(void* context, const struct sps30_record* record)
+{
+	struct find_query* query = context;
+
+	if(matches(record->sensor_id, record->channel, query->sensor_id, query->channel) &&
+	   record->timestamp_ms <= query->timestamp_ms &&
+	   (!query->found || record->timestamp_ms >= query->record->timestamp_ms))
+	{
+		*query->record = *record;
+		query->found = true;
+	}
+	return true;
+}
+
+/* Scan the block starting at entry i if it holds a matching record at or before the time */
+static void find_in_block(const struct sps30_log_index* index, size_t i, size_t end,
+						  struct find_query* query)
+{
+	for(size_t e = i; e < end; e++)
+	{
+		const struct sps30_log_index_entry* entry = &index->entries[e];
+		if(matches(entry->sensor_id, entry->channel, query->sensor_id, query->channel) &&
+		   entry->first_timestamp_ms <= query->timestamp_ms)
+		{
+			scan_records(index, entry->offset, entry->offset + entry->length, find_record,
+						 query);
+			return;
+		}
+	}
+}
+
+int16_t sps30_log_index_find(const struct sps30_log_index* index, uint64_t sensor_id,
+							 int32_t channel, uint64_t timestamp_ms, struct sps30_record* record)
+{
+	struct find_query query = {sensor_id, channel, timestamp_ms, false, record};
+	const size_t first = first_block(index, timestamp_ms);
+	size_t i;
+
+	assert(index && record);
+
+	// Blocks around the time, up to the first block that starts after it
+	for(i = first; i < index->count;)
+	{
+		const size_t end = block_end(index, i);
+		bool in_range = false;
+		for(size_t e = i; e < end; e++)
+		{
+			in_range |= index->entries[e].first_timestamp_ms <= timestamp_ms;
+		}
+		if(!in_range)
+		{
+			break;
+		}
+		find_in_block(index, i, end, &query);
+		i = end;
+	}
+	if(i == index->count && indexed_end(index) < index->log_size)
+	{
+		scan_records(index, indexed_end(index), index->log_size, find_record, &query);
+	}
+
+	// Otherwise, the sensor's latest earlier block
+	for(i = first; !query.found && i > 0;)
+	{
+		const size_t start = block_start(index, i - 1);
+		find_in_block(index, start, i, &query);
+		i = start;
+	}
+
+	return query.found ? 0 : SPS30_LOG_INDEX_ERROR_NOT_FOUND;
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS30_LOG_INDEX_H
+#define SPS30_LOG_INDEX_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sps30_record.h"
+#include "sps30_record_log.h"
+
+/** A file operation failed. errno describes the failure. */
+#define SPS30_LOG_INDEX_ERROR_IO (-1)
+/** The index file has an unknown magic number, version, or entry size. */
+#define SPS30_LOG_INDEX_ERROR_VERSION (-2)
+/** No record matches the query. */
+#define SPS30_LOG_INDEX_ERROR_NOT_FOUND (-3)
+
+/** Identifies an index file ("S30X" when read as little-endian bytes) */
+#define SPS30_LOG_INDEX_MAGIC 0x58303353u
+#define SPS30_LOG_INDEX_VERSION 2
+/** Appended to the log path to name its index */
+#define SPS30_LOG_INDEX_SUFFIX ".idx"
+/** Default records per index block */
+#define SPS30_LOG_INDEX_BLOCK_RECORDS 4096
+/** Distinct sensors summarized per block. A block is closed early when it is exceeded. */
+#define SPS30_LOG_INDEX_MAX_SENSORS 256
+
+/** Matches any sensor ID in a query */
+#define SPS30_LOG_INDEX_ANY_SENSOR 0
+/** Matches any channel in a query */
+#define SPS30_LOG_INDEX_ANY_CHANNEL (-1)
+
+	/**
+	 * struct sps30_log_index_entry - summary of one sensor's records in one block
+	 *
+	 * @sensor_id:           The sensor summarized
+	 * @first_timestamp_ms:  Timestamp of the sensor's first record in the block
+	 * @last_timestamp_ms:   Timestamp of the sensor's last record in the block
+	 * @offset:              Log file offset of the block
+	 * @length:              Size of the block in bytes
+	 * @count:               The sensor's records in the block
+	 * @channel:             The channel the records were read through
+	 * @reserved:            Zero
+	 * @min:                 Per-field minimum
+	 * @max:                 Per-field maximum
+	 * @sum:                 Per-field sum. The mean is sum / count. It is kept in full
+	 *                       precision, so aggregates over blocks match a scan of the log.
+	 *
+	 * Index files use the host's byte order, so they are mapped and used in place. The
+	 * magic number rejects an index from a host of the other byte order; since the log
+	 * itself is portable, the index can be rebuilt with sps30_log_index_build().
+	 */
+	struct sps30_log_index_entry
+	{
+		uint64_t sensor_id;
+		uint64_t first_timestamp_ms;
+		uint64_t last_timestamp_ms;
+		uint64_t offset;
+		uint32_t length;
+		uint32_t count;
+		uint16_t channel;
+		uint16_t reserved[3];
+		float min[SPS30_RECORD_FIELD_COUNT];
+		float max[SPS30_RECORD_FIELD_COUNT];
+		double sum[SPS30_RECORD_FIELD_COUNT];
+	};
+
+	/**
+	 * struct sps30_log_index_header - the start of an index file
+	 *
+	 * Entries follow the header. The entries of a block are consecutive, and blocks are in
+	 * log file order.
+	 */
+	struct sps30_log_index_header
+	{
+		uint32_t magic;
+		uint16_t version;
+		uint16_t entry_size;
+		uint32_t block_records;
+		uint32_t reserved;
+	};
+
+	/* Private: a sensor's running summary for the current block */
+	struct sps30_log_index_accumulator
+	{
+		uint64_t sensor_id;
+		uint64_t first_timestamp_ms;
+		uint64_t last_timestamp_ms;
+		uint32_t count;
+		uint16_t channel;
+		float min[SPS30_RECORD_FIELD_COUNT];
+		float max[SPS30_RECORD_FIELD_COUNT];
+		double sum[SPS30_RECORD_FIELD_COUNT];
+	};
+
+	/**
+	 * struct sps30_log_index_writer_stats - index writer activity
+	 *
+	 * @blocks:    Blocks written
+	 * @entries:   Entries written
+	 * @skipped:   Frames that do not hold a struct sps30_record, or were damaged
+	 * @errors:    Failed index writes. The log itself is unaffected.
+	 */
+	struct sps30_log_index_writer_stats
+	{
+		uint64_t blocks;
+		uint64_t entries;
+		uint64_t skipped;
+		uint64_t errors;
+	};
+
+	/**
+	 * struct sps30_log_index_writer - maintains the sparse index of a record log
+	 *
+	 * The log is divided into blocks of at least block_records frames, cut at frame
+	 * boundaries. For each sensor (sensor ID and channel) in a block, the index holds one
+	 * entry with the block's location and the sensor's time range, count, and per-field
+	 * minimum, maximum, and mean. Range queries answer from these summaries, and only read
+	 * the log for blocks at the edges of the range.
+	 *
+	 * The index of the log at path is path.idx. It follows the record log's own rotation:
+	 * when the log starts a new file, path.idx is shifted to path.1.idx, and so on. Index
+	 * writes are not synced, since the index can be rebuilt from the log with
+	 * sps30_log_index_build().
+	 *
+	 * All members are private to the implementation.
+	 */
+	struct sps30_log_index_writer
+	{
+		char path[SPS30_RECORD_LOG_PATH_MAX + sizeof(SPS30_LOG_INDEX_SUFFIX)];
+		int fd;
+		uint32_t block_records;
+		uint8_t keep_files;
+		uint64_t block_offset;
+		uint64_t next_offset;
+		uint32_t block_frames;
+		uint16_t sensor_count;
+		int16_t slots[2 * SPS30_LOG_INDEX_MAX_SENSORS];
+		struct sps30_log_index_accumulator sensors[SPS30_LOG_INDEX_MAX_SENSORS];
+		struct sps30_log_index_writer_stats stats;
+	};
+
+	/**
+	 * sps30_log_index_writer_open() - open the index of a log for appending
+	 *
+	 * Records the index does not cover yet, such as the partial block lost when the writer
+	 * was not closed, are indexed from the log before the writer returns. An index that
+	 * covers more than the log, such as one left from a replaced log, is rebuilt.
+	 *
+	 * @writer:         Writer state
+	 * @log_path:       The record log's path (see struct sps30_record_log_config)
+	 * @block_records:  Frames per block, or 0 for SPS30_LOG_INDEX_BLOCK_RECORDS
+	 * @keep_files:     The record log's keep_files setting
+	 *
+	 * Return:  0 on success, SPS30_LOG_INDEX_ERROR_IO, or SPS30_LOG_INDEX_ERROR_VERSION if
+	 *          an existing index has a different format
+	 */
+	int16_t sps30_log_index_writer_open(struct sps30_log_index_writer* writer,
+										const char* log_path, uint32_t block_records,
+										uint8_t keep_files);
+
+	/**
+	 * sps30_log_index_writer_add() - index frames written to the log
+	 *
+	 * The signature matches sps30_record_log_commit_hook, so the writer can be attached
+	 * with sps30_record_log_set_commit_hook(log, sps30_log_index_writer_add, &writer).
+	 *
+	 * @context:  The struct sps30_log_index_writer
+	 * @frames:   Complete frames
+	 * @length:   Size of frames in bytes
+	 * @offset:   The log file offset of frames. 0 starts a new file.
+	 */
+	void sps30_log_index_writer_add(void* context, const uint8_t* frames, size_t length,
+									uint64_t offset);
+
+	/**
+	 * sps30_log_index_writer_close() - write the final, partial block and close the index
+	 *
+	 * Return:  0 on success or SPS30_LOG_INDEX_ERROR_IO if any index write failed
+	 */
+	int16_t sps30_log_index_writer_close(struct sps30_log_index_writer* writer);
+
+	/**
+	 * sps30_log_index_build() - create the index of an existing log file
+	 *
+	 * Any existing index at log_path.idx is replaced.
+	 *
+	 * Return:  0 on success or SPS30_LOG_INDEX_ERROR_IO
+	 */
+	int16_t sps30_log_index_build(const char* log_path, uint32_t block_records);
+
+	/**
+	 * struct sps30_log_index - a log file and its index, mapped for queries
+	 *
+	 * @entries:   The index entries
+	 * @count:     Number of entries
+	 * @log:       The log file contents
+	 * @log_size:  Size of the log file in bytes
+	 *
+	 * Other members are private to the implementation.
+	 */
+	struct sps30_log_index
+	{
+		const struct sps30_log_index_entry* entries;
+		size_t count;
+		const uint8_t* log;
+		size_t log_size;
+		void* index_map;
+		size_t index_map_size;
+	};
+
+	/**
+	 * struct sps30_log_index_summary - an aggregate over a time range
+	 *
+	 * @count:                Matching records
+	 * @first_timestamp_ms:   Earliest matching timestamp
+	 * @last_timestamp_ms:    Latest matching timestamp
+	 * @min:                  Per-field minimum
+	 * @max:                  Per-field maximum
+	 * @sum:                  Per-field sum. The mean is sum / count.
+	 * @blocks_summarized:    Blocks answered from their index entries
+	 * @blocks_scanned:       Blocks (or unindexed regions) read from the log
+	 */
+	struct sps30_log_index_summary
+	{
+		uint64_t count;
+		uint64_t first_timestamp_ms;
+		uint64_t last_timestamp_ms;
+		float min[SPS30_RECORD_FIELD_COUNT];
+		float max[SPS30_RECORD_FIELD_COUNT];
+		double sum[SPS30_RECORD_FIELD_COUNT];
+		uint32_t blocks_summarized;
+		uint32_t blocks_scanned;
+	};
+
+	/**
+	 * sps30_log_index_load() - map a log file and its index
+	 *
+	 * A missing index is treated as empty, so queries scan the whole log.
+	 *
+	 * Return:  0 on success, SPS30_LOG_INDEX_ERROR_IO, or SPS30_LOG_INDEX_ERROR_VERSION
+	 */
+	int16_t sps30_log_index_load(struct sps30_log_index* index, const char* log_path);
+
+	/**
+	 * sps30_log_index_unload() - release a loaded index
+	 */
+	void sps30_log_index_unload(struct sps30_log_index* index);
+
+	/**
+	 * sps30_log_index_summary_init() - start an empty summary
+	 */
+	void sps30_log_index_summary_init(struct sps30_log_index_summary* summary);
+
+	/**
+	 * sps30_log_index_aggregate() - summarize records in a time range
+	 *
+	 * Matching records are added to summary, so one summary can cover several files.
+	 *
+	 * @index:       A loaded index
+	 * @sensor_id:   The sensor, or SPS30_LOG_INDEX_ANY_SENSOR
+	 * @channel:     The channel, or SPS30_LOG_INDEX_ANY_CHANNEL
+	 * @start_ms:    Start of the range (inclusive)
+	 * @end_ms:      End of the range (inclusive)
+	 * @summary:     Updated with the matching records
+	 */
+	void sps30_log_index_aggregate(const struct sps30_log_index* index, uint64_t sensor_id,
+								   int32_t channel, uint64_t start_ms, uint64_t end_ms,
+								   struct sps30_log_index_summary* summary);
+
+	/**
+	 * sps30_log_index_find() - the latest record at or before a time
+	 *
+	 * Only the blocks that can hold the record are read.
+	 *
+	 * Return:  0 on success or SPS30_LOG_INDEX_ERROR_NOT_FOUND
+	 */
+	int16_t sps30_log_index_find(const struct sps30_log_index* index, uint64_t sensor_id,
+								 int32_t channel, uint64_t timestamp_ms,
+								 struct sps30_record* record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_LOG_INDEX_H */
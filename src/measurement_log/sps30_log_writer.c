@@ -0,0 +1,737 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#define _GNU_SOURCE // syscall
+
+#include "sps30_log_writer.h"
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+	#include <linux/io_uring.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <sys/uio.h>
+#endif
+
+#ifdef __APPLE__
+	// macOS does not provide fdatasync()
+	#define fdatasync fsync
+#endif
+
+/*
+ * Each segment has at most one write queued, and at most SPS30_LOG_WRITER_MAX_SEGMENTS
+ * closes may be queued, so a write always fits.
+ */
+#define QUEUE_CAPACITY (SPS30_LOG_WRITER_MAX_SEGMENTS * 2)
+
+static void note_submitted(struct sps30_log_writer* writer, uint32_t segment)
+{
+	writer->in_flight_mask |= 1u << segment;
+	writer->stats.submitted++;
+	const uint32_t count = (uint32_t)__builtin_popcount(writer->in_flight_mask);
+	if(count > writer->stats.max_in_flight)
+	{
+		writer->stats.max_in_flight = count;
+	}
+}
+
+/* Write a whole segment at its offset, then sync it. Returns false on failure. */
+static bool write_and_sync(const struct sps30_log_writer* writer,
+						   const struct sps30_log_writer_job* job)
+{
+	const uint8_t* data = sps30_log_writer_segment(writer, job->segment);
+	size_t written = 0;
+
+	while(written < job->length)
+	{
+		const ssize_t r =
+			pwrite(job->fd, data + written, job->length - written, (off_t)(job->offset + written));
+		if(r < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(r <= 0)
+		{
+			// A write that makes no progress would be retried forever
+			return false;
+		}
+		written += (size_t)r;
+	}
+
+	return fdatasync(job->fd) == 0;
+}
+
+#pragma mark - Writer Thread -
+
+static void* writer_thread(void* arg)
+{
+	struct sps30_log_writer* writer = arg;
+
+	pthread_mutex_lock(&writer->lock);
+	for(;;)
+	{
+		while(writer->queue_count == 0 && !writer->stopping)
+		{
+			pthread_cond_wait(&writer->wake, &writer->lock);
+		}
+		if(writer->queue_count == 0)
+		{
+			break;
+		}
+
+		// The job stays queued while it runs, so drain() can see it in flight
+		const struct sps30_log_writer_job job = writer->queue[writer->queue_head];
+		pthread_mutex_unlock(&writer->lock);
+
+		bool ok = true;
+		if(job.close_fd)
+		{
+			close(job.fd);
+		}
+		else
+		{
+			ok = write_and_sync(writer, &job);
+		}
+
+		pthread_mutex_lock(&writer->lock);
+		writer->queue_head = (writer->queue_head + 1) % QUEUE_CAPACITY;
+		writer->queue_count--;
+		if(job.close_fd)
+		{
+			writer->queued_closes--;
+		}
+		else
+		{
+			writer->in_flight_mask &= ~(1u << job.segment);
+			writer->free_mask |= 1u << job.segment;
+			writer->stats.completed++;
+		}
+		if(!ok)
+		{
+			writer->stats.errors++;
+		}
+		pthread_cond_broadcast(&writer->idle);
+	}
+	pthread_mutex_unlock(&writer->lock);
+
+	return NULL;
+}
+
+static int16_t enqueue(struct sps30_log_writer* writer, const struct sps30_log_writer_job* job)
+{
+	int16_t result = 0;
+
+	pthread_mutex_lock(&writer->lock);
+	if(job->close_fd && writer->queued_closes == SPS30_LOG_WRITER_MAX_SEGMENTS)
+	{
+		// The other half of the queue is kept for writes
+		result = SPS30_LOG_WRITER_ERROR_BUSY;
+	}
+	else
+	{
+		assert(writer->queue_count < QUEUE_CAPACITY);
+		writer->queue[(writer->queue_head + writer->queue_count) % QUEUE_CAPACITY] = *job;
+		writer->queue_count++;
+		if(job->close_fd)
+		{
+			writer->queued_closes++;
+		}
+		else
+		{
+			note_submitted(writer, job->segment);
+		}
+		pthread_cond_signal(&writer->wake);
+	}
+	pthread_mutex_unlock(&writer->lock);
+
+	return result;
+}
+
+static int16_t thread_start(struct sps30_log_writer* writer)
+{
+	pthread_mutex_init(&writer->lock, NULL);
+	pthread_cond_init(&writer->wake, NULL);
+	pthread_cond_init(&writer->idle, NULL);
+
+	if(pthread_create(&writer->thread, NULL, writer_thread, writer) != 0)
+	{
+		pthread_cond_destroy(&writer->idle);
+		pthread_cond_destroy(&writer->wake);
+		pthread_mutex_destroy(&writer->lock);
+		return SPS30_LOG_WRITER_ERROR_UNAVAILABLE;
+	}
+
+	writer->backend = SPS30_LOG_WRITER_THREAD;
+	return 0;
+}
+
+static void thread_stop(struct sps30_log_writer* writer)
+{
+	pthread_mutex_lock(&writer->lock);
+	writer->stopping = true;
+	pthread_cond_signal(&writer->wake);
+	pthread_mutex_unlock(&writer->lock);
+
+	pthread_join(writer->thread, NULL);
+	pthread_cond_destroy(&writer->idle);
+	pthread_cond_destroy(&writer->wake);
+	pthread_mutex_destroy(&writer->lock);
+}
+
+#pragma mark - io_uring -
+
+static bool uring_fd_in_flight(const struct sps30_log_writer* writer, int fd)
+{
+	for(uint32_t i = 0; i < writer->segment_count; i++)
+	{
+		if((writer->in_flight_mask & (1u << i)) && writer->segment_fd[i] == fd)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Linked requests look up their file when they are issued, so a file can only be closed
+// once nothing in the ring refers to it. Otherwise a reused descriptor could be written.
+static void uring_close_idle_files(struct sps30_log_writer* writer)
+{
+	uint32_t kept = 0;
+
+	for(uint32_t i = 0; i < writer->closing_count; i++)
+	{
+		if(uring_fd_in_flight(writer, writer->closing_fd[i]))
+		{
+			writer->closing_fd[kept++] = writer->closing_fd[i];
+		}
+		else
+		{
+			close(writer->closing_fd[i]);
+		}
+	}
+	writer->closing_count = kept;
+}
+
+#ifdef __linux__
+
+/*
+ * Each submitted segment is a WRITE_FIXED request linked to an FSYNC (datasync) request.
+ * The user data identifies the segment, and the low bit marks the sync completion, which
+ * is always delivered (cancelled if the write fails or is short). The segment is released
+ * once both have completed, unless a short write left data to write.
+ */
+	#define USER_DATA_SYNC 1u
+
+static uint32_t* ring_field(void* ring, uint32_t offset)
+{
+	return (uint32_t*)((uint8_t*)ring + offset);
+}
+
+static void uring_release(struct sps30_log_writer* writer)
+{
+	if(writer->sqes)
+	{
+		munmap(writer->sqes, writer->sqes_size);
+	}
+	if(writer->cq_ring && writer->cq_ring != writer->sq_ring)
+	{
+		munmap(writer->cq_ring, writer->cq_ring_size);
+	}
+	if(writer->sq_ring)
+	{
+		munmap(writer->sq_ring, writer->sq_ring_size);
+	}
+	if(writer->ring_fd >= 0)
+	{
+		close(writer->ring_fd);
+	}
+
+	writer->sqes = writer->cq_ring = writer->sq_ring = NULL;
+	writer->ring_fd = -1;
+}
+
+static int16_t uring_start(struct sps30_log_writer* writer)
+{
+	struct io_uring_params params;
+	struct io_uring_params* p = &params;
+	struct iovec iovecs[SPS30_LOG_WRITER_MAX_SEGMENTS];
+
+	memset(p, 0, sizeof(*p));
+	writer->ring_fd = (int)syscall(__NR_io_uring_setup, writer->segment_count * 2, p);
+	if(writer->ring_fd < 0)
+	{
+		return SPS30_LOG_WRITER_ERROR_UNAVAILABLE;
+	}
+
+	writer->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(uint32_t);
+	writer->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+	if(p->features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if(writer->cq_ring_size > writer->sq_ring_size)
+		{
+			writer->sq_ring_size = writer->cq_ring_size;
+		}
+		writer->cq_ring_size = writer->sq_ring_size;
+	}
+
+	writer->sq_ring = mmap(NULL, writer->sq_ring_size, PROT_READ | PROT_WRITE,
+						   MAP_SHARED | MAP_POPULATE, writer->ring_fd, IORING_OFF_SQ_RING);
+	if(writer->sq_ring == MAP_FAILED)
+	{
+		writer->sq_ring = NULL;
+		uring_release(writer);
+		return SPS30_LOG_WRITER_ERROR_UNAVAILABLE;
+	}
+
+	if(p->features & IORING_FEAT_SINGLE_MMAP)
+	{
+		writer->cq_ring = writer->sq_ring;
+	}
+	else
+	{
+		writer->cq_ring = mmap(NULL, writer->cq_ring_size, PROT_READ | PROT_WRITE,
+							   MAP_SHARED | MAP_POPULATE, writer->ring_fd, IORING_OFF_CQ_RING);
+		if(writer->cq_ring == MAP_FAILED)
+		{
+			writer->cq_ring = NULL;
+			uring_release(writer);
+			return SPS30_LOG_WRITER_ERROR_UNAVAILABLE;
+		}
+	}
+
+	writer->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	writer->sqes = mmap(NULL, writer->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+						writer->ring_fd, IORING_OFF_SQES);
+	if(writer->sqes == MAP_FAILED)
+	{
+		writer->sqes = NULL;
+		uring_release(writer);
+		return SPS30_LOG_WRITER_ERROR_UNAVAILABLE;
+	}
+
+	writer->sq_head = ring_field(writer->sq_ring, p->sq_off.head);
+	writer->sq_tail = ring_field(writer->sq_ring, p->sq_off.tail);
+	writer->sq_array = ring_field(writer->sq_ring, p->sq_off.array);
+	writer->sq_mask = *ring_field(writer->sq_ring, p->sq_off.ring_mask);
+	writer->cq_head = ring_field(writer->cq_ring, p->cq_off.head);
+	writer->cq_tail = ring_field(writer->cq_ring, p->cq_off.tail);
+	writer->cqes = (uint8_t*)writer->cq_ring + p->cq_off.cqes;
+	writer->cq_mask = *ring_field(writer->cq_ring, p->cq_off.ring_mask);
+
+	// Registered buffers are pinned once, instead of being mapped for every write
+	for(uint32_t i = 0; i < writer->segment_count; i++)
+	{
+		iovecs[i].iov_base = sps30_log_writer_segment(writer, i);
+		iovecs[i].iov_len = writer->segment_size;
+	}
+	if(syscall(__NR_io_uring_register, writer->ring_fd, IORING_REGISTER_BUFFERS, iovecs,
+			   writer->segment_count) != 0)
+	{
+		uring_release(writer);
+		return SPS30_LOG_WRITER_ERROR_UNAVAILABLE;
+	}
+
+	writer->backend = SPS30_LOG_WRITER_IO_URING;
+	return 0;
+}
+
+/* Queue a linked WRITE_FIXED and FSYNC for the part of a segment that is not written yet */
+static void uring_queue_segment(struct sps30_log_writer* writer, uint32_t segment)
+{
+	uint32_t* array = writer->sq_array;
+	struct io_uring_sqe* sqes = writer->sqes;
+	uint32_t tail = *writer->sq_tail;
+	const uint32_t written = writer->segment_written[segment];
+	const int fd = writer->segment_fd[segment];
+
+	// The ring holds two entries per segment, so there is always room
+	struct io_uring_sqe* write_sqe = &sqes[tail & writer->sq_mask];
+	memset(write_sqe, 0, sizeof(*write_sqe));
+	write_sqe->opcode = IORING_OP_WRITE_FIXED;
+	// IOSQE_ASYNC always punts to the kernel's worker pool, so a write that would block
+	// on the page cache does not block io_uring_enter()
+	write_sqe->flags = IOSQE_IO_LINK | IOSQE_ASYNC;
+	write_sqe->fd = fd;
+	write_sqe->addr = (uint64_t)(uintptr_t)(sps30_log_writer_segment(writer, segment) + written);
+	write_sqe->len = writer->segment_length[segment] - written;
+	write_sqe->off = writer->segment_offset[segment] + written;
+	write_sqe->buf_index = (uint16_t)segment;
+	write_sqe->user_data = (uint64_t)segment << 1;
+	array[tail & writer->sq_mask] = tail & writer->sq_mask;
+	tail++;
+
+	struct io_uring_sqe* sync_sqe = &sqes[tail & writer->sq_mask];
+	memset(sync_sqe, 0, sizeof(*sync_sqe));
+	sync_sqe->opcode = IORING_OP_FSYNC;
+	sync_sqe->flags = IOSQE_ASYNC;
+	sync_sqe->fd = fd;
+	sync_sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+	sync_sqe->user_data = ((uint64_t)segment << 1) | USER_DATA_SYNC;
+	array[tail & writer->sq_mask] = tail & writer->sq_mask;
+	tail++;
+
+	writer->segment_pending[segment] = 2;
+	__atomic_store_n(writer->sq_tail, tail, __ATOMIC_RELEASE);
+}
+
+/* Submit the queued entries, optionally waiting for completions. False if the kernel fails. */
+static bool uring_enter(struct sps30_log_writer* writer, uint32_t min_complete, uint32_t flags)
+{
+	for(;;)
+	{
+		// Entries left over from an earlier call are submitted along with the new ones
+		const uint32_t to_submit =
+			*writer->sq_tail - __atomic_load_n(writer->sq_head, __ATOMIC_ACQUIRE);
+		if(syscall(__NR_io_uring_enter, writer->ring_fd, to_submit, min_complete, flags, NULL,
+				   0) >= 0)
+		{
+			return true;
+		}
+		if(errno != EINTR)
+		{
+			return false;
+		}
+	}
+}
+
+/* Called once both requests of a segment's current write have completed */
+static bool uring_finish_segment(struct sps30_log_writer* writer, uint32_t segment)
+{
+	if(!writer->segment_failed[segment] &&
+	   writer->segment_written[segment] < writer->segment_length[segment])
+	{
+		// A short write: the rest is written and synced at the offset it belongs at
+		uring_queue_segment(writer, segment);
+		return true;
+	}
+
+	if(writer->segment_failed[segment])
+	{
+		writer->stats.errors++;
+	}
+	writer->in_flight_mask &= ~(1u << segment);
+	writer->free_mask |= 1u << segment;
+	writer->stats.completed++;
+	return false;
+}
+
+static void uring_reap(struct sps30_log_writer* writer)
+{
+	const uint32_t tail = __atomic_load_n(writer->cq_tail, __ATOMIC_ACQUIRE);
+	const struct io_uring_cqe* cqes = writer->cqes;
+	uint32_t head = *writer->cq_head;
+	bool requeued = false;
+
+	for(; head != tail; head++)
+	{
+		const struct io_uring_cqe* cqe = &cqes[head & writer->cq_mask];
+		const uint32_t segment = (uint32_t)(cqe->user_data >> 1);
+		const uint32_t remaining =
+			writer->segment_length[segment] - writer->segment_written[segment];
+
+		if(!(cqe->user_data & USER_DATA_SYNC))
+		{
+			// A write that makes no progress would be retried forever
+			if(cqe->res < 0 || (cqe->res == 0 && remaining > 0) || (uint32_t)cqe->res > remaining)
+			{
+				writer->segment_failed[segment] = true;
+			}
+			else
+			{
+				writer->segment_written[segment] += (uint32_t)cqe->res;
+			}
+		}
+		else if(cqe->res < 0 && !(cqe->res == -ECANCELED && remaining > 0))
+		{
+			// A failed or short write cancels its sync, which is sent again with the rest of
+			// a short write. A sync cancelled after a complete write is a failure.
+			writer->segment_failed[segment] = true;
+		}
+
+		if(--writer->segment_pending[segment] == 0)
+		{
+			requeued |= uring_finish_segment(writer, segment);
+		}
+	}
+
+	__atomic_store_n(writer->cq_head, head, __ATOMIC_RELEASE);
+	if(requeued)
+	{
+		// If this fails, the entries stay queued for the next call, or drain() drops them
+		(void)uring_enter(writer, 0, 0);
+	}
+	uring_close_idle_files(writer);
+}
+
+/*
+ * Drop the entries the kernel has not taken from the submission ring, failing their
+ * segments. Returns false if there were none.
+ */
+static bool uring_abandon_unsubmitted(struct sps30_log_writer* writer)
+{
+	const struct io_uring_sqe* sqes = writer->sqes;
+	const uint32_t head = __atomic_load_n(writer->sq_head, __ATOMIC_ACQUIRE);
+	const uint32_t tail = *writer->sq_tail;
+
+	for(uint32_t i = head; i != tail; i++)
+	{
+		const struct io_uring_sqe* sqe = &sqes[writer->sq_array[i & writer->sq_mask]];
+		const uint32_t segment = (uint32_t)(sqe->user_data >> 1);
+		writer->segment_failed[segment] = true;
+		if(--writer->segment_pending[segment] == 0)
+		{
+			(void)uring_finish_segment(writer, segment);
+		}
+	}
+
+	__atomic_store_n(writer->sq_tail, head, __ATOMIC_RELEASE);
+	return head != tail;
+}
+
+static int16_t uring_submit(struct sps30_log_writer* writer, int fd, uint32_t segment,
+							uint32_t length, uint64_t offset)
+{
+	const uint32_t tail = *writer->sq_tail;
+
+	writer->segment_fd[segment] = fd;
+	writer->segment_offset[segment] = offset;
+	writer->segment_length[segment] = length;
+	writer->segment_written[segment] = 0;
+	writer->segment_failed[segment] = false;
+	uring_queue_segment(writer, segment);
+
+	if(!uring_enter(writer, 0, 0) &&
+	   *writer->sq_tail - __atomic_load_n(writer->sq_head, __ATOMIC_ACQUIRE) >=
+		   *writer->sq_tail - tail)
+	{
+		// The kernel took neither request, so they are withdrawn and the caller keeps the
+		// segment. Entries left over from earlier calls are sent with the next one.
+		__atomic_store_n(writer->sq_tail, tail, __ATOMIC_RELEASE);
+		writer->segment_pending[segment] = 0;
+		return SPS30_LOG_WRITER_ERROR_BUSY;
+	}
+
+	note_submitted(writer, segment);
+	return 0;
+}
+
+static void uring_drain(struct sps30_log_writer* writer)
+{
+	for(uring_reap(writer); writer->in_flight_mask; uring_reap(writer))
+	{
+		// Requests the kernel refuses to take would never complete, so they are failed.
+		// If nothing is left to take and waiting fails too, the ring is unusable.
+		if(!uring_enter(writer, 1, IORING_ENTER_GETEVENTS) &&
+		   !uring_abandon_unsubmitted(writer))
+		{
+			writer->stats.errors += (uint64_t)__builtin_popcount(writer->in_flight_mask);
+			writer->stats.completed += (uint64_t)__builtin_popcount(writer->in_flight_mask);
+			writer->free_mask |= writer->in_flight_mask;
+			writer->in_flight_mask = 0;
+			break;
+		}
+	}
+}
+
+#else
+
+static int16_t uring_start(struct sps30_log_writer* writer)
+{
+	(void)writer;
+	errno = ENOSYS;
+	return SPS30_LOG_WRITER_ERROR_UNAVAILABLE;
+}
+
+static void uring_reap(struct sps30_log_writer* writer)
+{
+	(void)writer;
+}
+
+static int16_t uring_submit(struct sps30_log_writer* writer, int fd, uint32_t segment,
+							uint32_t length, uint64_t offset)
+{
+	(void)writer;
+	(void)fd;
+	(void)segment;
+	(void)length;
+	(void)offset;
+	return SPS30_LOG_WRITER_ERROR_UNAVAILABLE;
+}
+
+static void uring_drain(struct sps30_log_writer* writer)
+{
+	(void)writer;
+}
+
+static void uring_release(struct sps30_log_writer* writer)
+{
+	(void)writer;
+}
+
+#endif
+
+#pragma mark - Interface -
+
+int16_t sps30_log_writer_start(struct sps30_log_writer* writer,
+							   enum sps30_log_writer_backend backend, uint8_t* buffer,
+							   size_t segment_size, uint32_t segment_count)
+{
+	assert(writer && buffer && segment_size > 0);
+	assert(segment_count > 0 && segment_count <= SPS30_LOG_WRITER_MAX_SEGMENTS);
+	assert(backend != SPS30_LOG_WRITER_SYNC);
+
+	memset(writer, 0, sizeof(*writer));
+	writer->buffer = buffer;
+	writer->segment_size = segment_size;
+	writer->segment_count = segment_count;
+	writer->free_mask = (uint32_t)((1ull << segment_count) - 1);
+	writer->ring_fd = -1;
+
+	if(backend == SPS30_LOG_WRITER_IO_URING || backend == SPS30_LOG_WRITER_ASYNC)
+	{
+		if(uring_start(writer) == 0)
+		{
+			return 0;
+		}
+		if(backend == SPS30_LOG_WRITER_IO_URING)
+		{
+			return SPS30_LOG_WRITER_ERROR_UNAVAILABLE;
+		}
+	}
+
+	return thread_start(writer);
+}
+
+uint8_t* sps30_log_writer_segment(const struct sps30_log_writer* writer, uint32_t segment)
+{
+	assert(writer && segment < writer->segment_count);
+	return writer->buffer + (size_t)segment * writer->segment_size;
+}
+
+int32_t sps30_log_writer_acquire(struct sps30_log_writer* writer)
+{
+	int32_t segment = SPS30_LOG_WRITER_ERROR_BUSY;
+
+	assert(writer);
+
+	if(writer->backend == SPS30_LOG_WRITER_IO_URING)
+	{
+		uring_reap(writer);
+	}
+	else
+	{
+		pthread_mutex_lock(&writer->lock);
+	}
+
+	if(writer->free_mask)
+	{
+		segment = __builtin_ctz(writer->free_mask);
+		writer->free_mask &= ~(1u << segment);
+	}
+
+	if(writer->backend != SPS30_LOG_WRITER_IO_URING)
+	{
+		pthread_mutex_unlock(&writer->lock);
+	}
+
+	return segment;
+}
+
+int16_t sps30_log_writer_submit(struct sps30_log_writer* writer, int fd, uint32_t segment,
+								uint32_t length, uint64_t offset)
+{
+	assert(writer && segment < writer->segment_count && length <= writer->segment_size);
+	assert(!(writer->free_mask & (1u << segment)));
+
+	if(writer->backend == SPS30_LOG_WRITER_IO_URING)
+	{
+		return uring_submit(writer, fd, segment, length, offset);
+	}
+
+	// The queue holds every segment plus closes, so a write always fits
+	const struct sps30_log_writer_job job = {fd, segment, length, offset, false};
+	return enqueue(writer, &job);
+}
+
+int16_t sps30_log_writer_close_fd(struct sps30_log_writer* writer, int fd)
+{
+	assert(writer);
+
+	if(writer->backend == SPS30_LOG_WRITER_IO_URING)
+	{
+		if(writer->closing_count == SPS30_LOG_WRITER_MAX_SEGMENTS)
+		{
+			return SPS30_LOG_WRITER_ERROR_BUSY;
+		}
+		writer->closing_fd[writer->closing_count++] = fd;
+		uring_close_idle_files(writer);
+		return 0;
+	}
+
+	const struct sps30_log_writer_job job = {fd, 0, 0, 0, true};
+	return enqueue(writer, &job);
+}
+
+void sps30_log_writer_drain(struct sps30_log_writer* writer)
+{
+	assert(writer);
+
+	if(writer->backend == SPS30_LOG_WRITER_IO_URING)
+	{
+		uring_drain(writer);
+		return;
+	}
+
+	pthread_mutex_lock(&writer->lock);
+	while(writer->queue_count)
+	{
+		pthread_cond_wait(&writer->idle, &writer->lock);
+	}
+	pthread_mutex_unlock(&writer->lock);
+}
+
+void sps30_log_writer_stop(struct sps30_log_writer* writer)
+{
+	assert(writer);
+
+	sps30_log_writer_drain(writer);
+	if(writer->backend == SPS30_LOG_WRITER_IO_URING)
+	{
+		uring_release(writer);
+	}
+	else
+	{
+		thread_stop(writer);
+	}
+}
+
+struct sps30_log_writer_stats sps30_log_writer_get_stats(struct sps30_log_writer* writer)
+{
+	struct sps30_log_writer_stats stats;
+
+	assert(writer);
+
+	// After sps30_log_writer_stop(), the counters are final and the backend is gone
+	if(writer->backend == SPS30_LOG_WRITER_IO_URING)
+	{
+		if(writer->ring_fd >= 0)
+		{
+			uring_reap(writer);
+		}
+		return writer->stats;
+	}
+	if(writer->stopping)
+	{
+		return writer->stats;
+	}
+
+	pthread_mutex_lock(&writer->lock);
+	stats = writer->stats;
+	pthread_mutex_unlock(&writer->lock);
+	return stats;
+}
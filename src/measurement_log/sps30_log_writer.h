@@ -0,0 +1,211 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS30_LOG_WRITER_H
+#define SPS30_LOG_WRITER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** The backend could not be started. errno describes the failure. */
+#define SPS30_LOG_WRITER_ERROR_UNAVAILABLE (-1)
+/** The writer's queue is full. Retry after in-flight writes complete. */
+#define SPS30_LOG_WRITER_ERROR_BUSY (-2)
+
+/** Maximum number of buffer segments */
+#define SPS30_LOG_WRITER_MAX_SEGMENTS 16
+
+	/**
+	 * enum sps30_log_writer_backend - how log commits reach storage
+	 *
+	 * @SPS30_LOG_WRITER_SYNC:      write() and fdatasync() on the calling thread
+	 * @SPS30_LOG_WRITER_THREAD:    pwrite() and fdatasync() on a dedicated writer thread
+	 * @SPS30_LOG_WRITER_IO_URING:  Linked WRITE_FIXED and FSYNC (datasync) requests from
+	 *                              registered buffers, submitted through io_uring
+	 * @SPS30_LOG_WRITER_ASYNC:     io_uring when the kernel allows it, otherwise the
+	 *                              writer thread
+	 */
+	enum sps30_log_writer_backend
+	{
+		SPS30_LOG_WRITER_SYNC = 0,
+		SPS30_LOG_WRITER_THREAD,
+		SPS30_LOG_WRITER_IO_URING,
+		SPS30_LOG_WRITER_ASYNC,
+	};
+
+	/**
+	 * struct sps30_log_writer_stats - asynchronous writer activity
+	 *
+	 * @submitted:      Segments submitted for writing
+	 * @completed:      Segments written and synced (or failed)
+	 * @errors:         Failed or short writes and failed syncs
+	 * @max_in_flight:  Most segments in flight at once
+	 */
+	struct sps30_log_writer_stats
+	{
+		uint64_t submitted;
+		uint64_t completed;
+		uint64_t errors;
+		uint32_t max_in_flight;
+	};
+
+	/* Private: a queued operation for the writer thread */
+	struct sps30_log_writer_job
+	{
+		int fd;
+		uint32_t segment;
+		uint32_t length;
+		uint64_t offset;
+		bool close_fd;
+	};
+
+	/**
+	 * struct sps30_log_writer - asynchronous log storage backend
+	 *
+	 * The writer divides a caller-supplied buffer into equal segments. The log fills one
+	 * segment at a time, and submits it with the file offset it belongs at. The segment is
+	 * returned to the free pool after its data has been written and synced.
+	 *
+	 * Neither sps30_log_writer_acquire() nor sps30_log_writer_submit() waits for storage:
+	 * when every segment is in flight, acquire() fails instead of blocking.
+	 *
+	 * All members are private to the implementation.
+	 */
+	struct sps30_log_writer
+	{
+		enum sps30_log_writer_backend backend;
+		uint8_t* buffer;
+		size_t segment_size;
+		uint32_t segment_count;
+		uint32_t free_mask;
+		uint32_t in_flight_mask;
+		struct sps30_log_writer_stats stats;
+
+		// Writer thread
+		pthread_t thread;
+		pthread_mutex_t lock;
+		pthread_cond_t wake;
+		pthread_cond_t idle;
+		struct sps30_log_writer_job queue[SPS30_LOG_WRITER_MAX_SEGMENTS * 2];
+		uint32_t queue_head;
+		uint32_t queue_count;
+		uint32_t queued_closes;
+		bool stopping;
+
+		// io_uring
+		int ring_fd;
+		void* sq_ring;
+		size_t sq_ring_size;
+		void* cq_ring;
+		size_t cq_ring_size;
+		void* sqes;
+		size_t sqes_size;
+		uint32_t* sq_head;
+		uint32_t* sq_tail;
+		uint32_t* sq_array;
+		uint32_t sq_mask;
+		uint32_t* cq_head;
+		uint32_t* cq_tail;
+		void* cqes;
+		uint32_t cq_mask;
+		int segment_fd[SPS30_LOG_WRITER_MAX_SEGMENTS];
+		uint64_t segment_offset[SPS30_LOG_WRITER_MAX_SEGMENTS];
+		uint32_t segment_length[SPS30_LOG_WRITER_MAX_SEGMENTS];
+		uint32_t segment_written[SPS30_LOG_WRITER_MAX_SEGMENTS];
+		uint8_t segment_pending[SPS30_LOG_WRITER_MAX_SEGMENTS];
+		bool segment_failed[SPS30_LOG_WRITER_MAX_SEGMENTS];
+		int closing_fd[SPS30_LOG_WRITER_MAX_SEGMENTS];
+		uint32_t closing_count;
+	};
+
+	/**
+	 * sps30_log_writer_start() - start an asynchronous writer
+	 *
+	 * @writer:         Writer state
+	 * @backend:        SPS30_LOG_WRITER_THREAD, SPS30_LOG_WRITER_IO_URING, or
+	 *                  SPS30_LOG_WRITER_ASYNC
+	 * @buffer:         Storage divided into segments. Must remain valid until the writer
+	 *                  is stopped.
+	 * @segment_size:   Size of each segment in bytes
+	 * @segment_count:  Number of segments, up to SPS30_LOG_WRITER_MAX_SEGMENTS
+	 *
+	 * Return:  0 on success or SPS30_LOG_WRITER_ERROR_UNAVAILABLE
+	 */
+	int16_t sps30_log_writer_start(struct sps30_log_writer* writer,
+								   enum sps30_log_writer_backend backend, uint8_t* buffer,
+								   size_t segment_size, uint32_t segment_count);
+
+	/**
+	 * sps30_log_writer_acquire() - claim a free segment to fill
+	 *
+	 * Completed writes are reclaimed first. This never waits for storage.
+	 *
+	 * Return:  The segment index, or SPS30_LOG_WRITER_ERROR_BUSY if every segment is in
+	 *          flight
+	 */
+	int32_t sps30_log_writer_acquire(struct sps30_log_writer* writer);
+
+	/**
+	 * sps30_log_writer_segment() - the memory of a segment
+	 */
+	uint8_t* sps30_log_writer_segment(const struct sps30_log_writer* writer, uint32_t segment);
+
+	/**
+	 * sps30_log_writer_submit() - write a filled segment and sync it
+	 *
+	 * @writer:    Writer state
+	 * @fd:        The file to write. It must stay open until the write completes, or be
+	 *             closed with sps30_log_writer_close_fd().
+	 * @segment:   A segment from sps30_log_writer_acquire()
+	 * @length:    Bytes of the segment to write
+	 * @offset:    File offset for the data
+	 *
+	 * Return:  0 on success, or SPS30_LOG_WRITER_ERROR_BUSY if the write could not be
+	 *          queued, in which case the segment still belongs to the caller. Errors that
+	 *          occur during the write are counted in the stats.
+	 */
+	int16_t sps30_log_writer_submit(struct sps30_log_writer* writer, int fd, uint32_t segment,
+									uint32_t length, uint64_t offset);
+
+	/**
+	 * sps30_log_writer_close_fd() - close a file once its submitted writes are done
+	 *
+	 * Return:  0 on success or SPS30_LOG_WRITER_ERROR_BUSY if the close could not be queued
+	 */
+	int16_t sps30_log_writer_close_fd(struct sps30_log_writer* writer, int fd);
+
+	/**
+	 * sps30_log_writer_drain() - wait for every submitted write to complete
+	 *
+	 * Writes that can no longer be submitted, or waited for, are counted as errors instead
+	 * of being waited for forever.
+	 */
+	void sps30_log_writer_drain(struct sps30_log_writer* writer);
+
+	/**
+	 * sps30_log_writer_stop() - drain the writer and release its resources
+	 */
+	void sps30_log_writer_stop(struct sps30_log_writer* writer);
+
+	/**
+	 * sps30_log_writer_get_stats() - cumulative writer statistics
+	 *
+	 * The counters are updated by the writer, so the values are a snapshot. After
+	 * sps30_log_writer_stop(), they are final.
+	 */
+	struct sps30_log_writer_stats sps30_log_writer_get_stats(struct sps30_log_writer* writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_LOG_WRITER_H */
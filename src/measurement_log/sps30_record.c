@@ -0,0 +1,364 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#include "sps30_record.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+_Static_assert(sizeof(struct sps30_record) == SPS30_RECORD_SIZE, "Records are one cache line");
+_Static_assert(_Alignof(struct sps30_record) == SPS30_RECORD_SIZE, "Records are line-aligned");
+_Static_assert(offsetof(struct sps30_record, values) == 24, "Values follow the header");
+_Static_assert(sizeof(struct sps30_measurement) == SPS30_RECORD_FIELD_COUNT * sizeof(float),
+			   "sps30_measurement must contain ten floats");
+_Static_assert(sizeof(struct sps30_record_block) == SPS30_RECORD_BLOCK_SIZE,
+			   "A block holds exactly as much as its records");
+_Static_assert(offsetof(struct sps30_record_block, timestamp_ms) == 64,
+			   "The block header is one cache line");
+_Static_assert(offsetof(struct sps30_record_block, values) % 64 == 0,
+			   "Columns start on cache lines");
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+static const char* const field_names_[SPS30_RECORD_FIELD_COUNT] = {
+	"mc_1p0", "mc_2p5", "mc_4p0", "mc_10p0", "nc_0p5",
+	"nc_1p0", "nc_2p5", "nc_4p0", "nc_10p0", "typical_particle_size",
+};
+
+#pragma mark - Byte Order -
+
+#if !SPS30_RECORD_NATIVE_LAYOUT
+static void put_u16(uint8_t* p, uint16_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* p, uint32_t value)
+{
+	put_u16(p, (uint16_t)value);
+	put_u16(p + 2, (uint16_t)(value >> 16));
+}
+
+static void put_u64(uint8_t* p, uint64_t value)
+{
+	put_u32(p, (uint32_t)value);
+	put_u32(p + 4, (uint32_t)(value >> 32));
+}
+
+static void put_f32(uint8_t* p, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	put_u32(p, bits);
+}
+#endif
+
+static uint16_t get_u16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t* p)
+{
+	return (uint32_t)get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+#if !SPS30_RECORD_NATIVE_LAYOUT
+static uint64_t get_u64(const uint8_t* p)
+{
+	return (uint64_t)get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+static float get_f32(const uint8_t* p)
+{
+	const uint32_t bits = get_u32(p);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+#endif
+
+static bool aligned(const void* data)
+{
+	return ((uintptr_t)data % SPS30_RECORD_SIZE) == 0;
+}
+
+#pragma mark - Records -
+
+uint64_t sps30_record_sensor_id(const char* serial)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	assert(serial);
+
+	for(; *serial; serial++)
+	{
+		hash ^= (uint8_t)*serial;
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+const char* sps30_record_field_name(unsigned field)
+{
+	return field < SPS30_RECORD_FIELD_COUNT ? field_names_[field] : NULL;
+}
+
+int sps30_record_field_index(const char* name, size_t length)
+{
+	assert(name || length == 0);
+
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		if(strlen(field_names_[f]) == length && memcmp(field_names_[f], name, length) == 0)
+		{
+			return (int)f;
+		}
+	}
+
+	return -1;
+}
+
+void sps30_record_init(struct sps30_record* record, uint64_t sensor_id, uint16_t channel,
+					   uint32_t status, uint64_t timestamp_ms,
+					   const struct sps30_measurement* measurement)
+{
+	assert(record && measurement);
+
+	record->version = SPS30_RECORD_VERSION;
+	record->channel = channel;
+	record->status = status;
+	record->timestamp_ms = timestamp_ms;
+	record->sensor_id = sensor_id;
+	memcpy(record->values, measurement, sizeof(record->values));
+}
+
+void sps30_record_measurement(const struct sps30_record* record,
+							  struct sps30_measurement* measurement)
+{
+	assert(record && measurement);
+	memcpy(measurement, record->values, sizeof(*measurement));
+}
+
+void sps30_record_encode(const struct sps30_record* record, void* data)
+{
+	uint8_t* p = data;
+
+	assert(record && data);
+
+#if SPS30_RECORD_NATIVE_LAYOUT
+	memcpy(p, record, SPS30_RECORD_SIZE);
+#else
+	put_u16(&p[0], record->version);
+	put_u16(&p[2], record->channel);
+	put_u32(&p[4], record->status);
+	put_u64(&p[8], record->timestamp_ms);
+	put_u64(&p[16], record->sensor_id);
+	for(unsigned i = 0; i < SPS30_RECORD_FIELD_COUNT; i++)
+	{
+		put_f32(&p[24 + 4 * i], record->values[i]);
+	}
+#endif
+}
+
+int16_t sps30_record_decode(const void* data, struct sps30_record* record)
+{
+	const uint8_t* p = data;
+
+	assert(data && record);
+
+	if(get_u16(&p[0]) != SPS30_RECORD_VERSION)
+	{
+		return SPS30_RECORD_ERROR_VERSION;
+	}
+
+#if SPS30_RECORD_NATIVE_LAYOUT
+	memcpy(record, p, SPS30_RECORD_SIZE);
+#else
+	record->version = get_u16(&p[0]);
+	record->channel = get_u16(&p[2]);
+	record->status = get_u32(&p[4]);
+	record->timestamp_ms = get_u64(&p[8]);
+	record->sensor_id = get_u64(&p[16]);
+	for(unsigned i = 0; i < SPS30_RECORD_FIELD_COUNT; i++)
+	{
+		record->values[i] = get_f32(&p[24 + 4 * i]);
+	}
+#endif
+
+	return 0;
+}
+
+const struct sps30_record* sps30_record_array(const void* data, size_t size, size_t* count)
+{
+	assert(count);
+
+	*count = 0;
+	if(!SPS30_RECORD_NATIVE_LAYOUT || !aligned(data))
+	{
+		return NULL;
+	}
+
+	*count = size / SPS30_RECORD_SIZE;
+	return (const struct sps30_record*)data;
+}
+
+#pragma mark - Column Blocks -
+
+void sps30_record_block_init(struct sps30_record_block* block)
+{
+	assert(block);
+
+	memset(block, 0, sizeof(*block));
+	block->magic = SPS30_RECORD_BLOCK_MAGIC;
+	block->version = SPS30_RECORD_VERSION;
+}
+
+int16_t sps30_record_block_append(struct sps30_record_block* block,
+								  const struct sps30_record* record)
+{
+	assert(block && record);
+
+	const uint16_t row = block->count;
+	if(row == SPS30_RECORD_BLOCK_RECORDS)
+	{
+		return SPS30_RECORD_ERROR_FULL;
+	}
+
+	if(row == 0)
+	{
+		block->first_timestamp_ms = record->timestamp_ms;
+	}
+	block->last_timestamp_ms = record->timestamp_ms;
+	block->timestamp_ms[row] = record->timestamp_ms;
+	block->sensor_id[row] = record->sensor_id;
+	block->status[row] = record->status;
+	block->channel[row] = record->channel;
+	for(unsigned i = 0; i < SPS30_RECORD_FIELD_COUNT; i++)
+	{
+		block->values[i][row] = record->values[i];
+	}
+	block->count++;
+
+	return 0;
+}
+
+int16_t sps30_record_block_get(const struct sps30_record_block* block, uint16_t index,
+							   struct sps30_record* record)
+{
+	assert(block && record);
+
+	if(index >= block->count)
+	{
+		return SPS30_RECORD_ERROR_RANGE;
+	}
+
+	record->version = SPS30_RECORD_VERSION;
+	record->channel = block->channel[index];
+	record->status = block->status[index];
+	record->timestamp_ms = block->timestamp_ms[index];
+	record->sensor_id = block->sensor_id[index];
+	for(unsigned i = 0; i < SPS30_RECORD_FIELD_COUNT; i++)
+	{
+		record->values[i] = block->values[i][index];
+	}
+
+	return 0;
+}
+
+void sps30_record_block_encode(const struct sps30_record_block* block, void* data)
+{
+	uint8_t* p = data;
+
+	assert(block && data);
+
+#if SPS30_RECORD_NATIVE_LAYOUT
+	memcpy(p, block, SPS30_RECORD_BLOCK_SIZE);
+#else
+	memset(p, 0, SPS30_RECORD_BLOCK_SIZE);
+	put_u32(&p[offsetof(struct sps30_record_block, magic)], block->magic);
+	put_u16(&p[offsetof(struct sps30_record_block, version)], block->version);
+	put_u16(&p[offsetof(struct sps30_record_block, count)], block->count);
+	put_u64(&p[offsetof(struct sps30_record_block, first_timestamp_ms)],
+			block->first_timestamp_ms);
+	put_u64(&p[offsetof(struct sps30_record_block, last_timestamp_ms)], block->last_timestamp_ms);
+	for(unsigned row = 0; row < SPS30_RECORD_BLOCK_RECORDS; row++)
+	{
+		put_u16(&p[offsetof(struct sps30_record_block, channel) + 2 * row], block->channel[row]);
+		put_u64(&p[offsetof(struct sps30_record_block, timestamp_ms) + 8 * row],
+				block->timestamp_ms[row]);
+		put_u64(&p[offsetof(struct sps30_record_block, sensor_id) + 8 * row],
+				block->sensor_id[row]);
+		put_u32(&p[offsetof(struct sps30_record_block, status) + 4 * row], block->status[row]);
+		for(unsigned i = 0; i < SPS30_RECORD_FIELD_COUNT; i++)
+		{
+			put_f32(&p[offsetof(struct sps30_record_block, values) +
+					   4 * (i * SPS30_RECORD_BLOCK_RECORDS + row)],
+					block->values[i][row]);
+		}
+	}
+#endif
+}
+
+int16_t sps30_record_block_decode(const void* data, struct sps30_record_block* block)
+{
+	const uint8_t* p = data;
+
+	assert(data && block);
+
+	if(get_u32(&p[offsetof(struct sps30_record_block, magic)]) != SPS30_RECORD_BLOCK_MAGIC ||
+	   get_u16(&p[offsetof(struct sps30_record_block, version)]) != SPS30_RECORD_VERSION ||
+	   get_u16(&p[offsetof(struct sps30_record_block, count)]) > SPS30_RECORD_BLOCK_RECORDS)
+	{
+		return SPS30_RECORD_ERROR_VERSION;
+	}
+
+#if SPS30_RECORD_NATIVE_LAYOUT
+	memcpy(block, p, SPS30_RECORD_BLOCK_SIZE);
+#else
+	memset(block, 0, sizeof(*block));
+	block->magic = get_u32(&p[offsetof(struct sps30_record_block, magic)]);
+	block->version = get_u16(&p[offsetof(struct sps30_record_block, version)]);
+	block->count = get_u16(&p[offsetof(struct sps30_record_block, count)]);
+	block->first_timestamp_ms =
+		get_u64(&p[offsetof(struct sps30_record_block, first_timestamp_ms)]);
+	block->last_timestamp_ms = get_u64(&p[offsetof(struct sps30_record_block, last_timestamp_ms)]);
+	for(unsigned row = 0; row < SPS30_RECORD_BLOCK_RECORDS; row++)
+	{
+		block->channel[row] = get_u16(&p[offsetof(struct sps30_record_block, channel) + 2 * row]);
+		block->timestamp_ms[row] =
+			get_u64(&p[offsetof(struct sps30_record_block, timestamp_ms) + 8 * row]);
+		block->sensor_id[row] =
+			get_u64(&p[offsetof(struct sps30_record_block, sensor_id) + 8 * row]);
+		block->status[row] = get_u32(&p[offsetof(struct sps30_record_block, status) + 4 * row]);
+		for(unsigned i = 0; i < SPS30_RECORD_FIELD_COUNT; i++)
+		{
+			block->values[i][row] = get_f32(&p[offsetof(struct sps30_record_block, values) +
+												4 * (i * SPS30_RECORD_BLOCK_RECORDS + row)]);
+		}
+	}
+#endif
+
+	return 0;
+}
+
+const struct sps30_record_block* sps30_record_block_array(const void* data, size_t size,
+														  size_t* count)
+{
+	assert(count);
+
+	*count = 0;
+	if(!SPS30_RECORD_NATIVE_LAYOUT || !aligned(data))
+	{
+		return NULL;
+	}
+
+	*count = size / SPS30_RECORD_BLOCK_SIZE;
+	return (const struct sps30_record_block*)data;
+}
@@ -0,0 +1,248 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS30_RECORD_H
+#define SPS30_RECORD_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sps30.h"
+
+/** The record or block has an unknown magic number or format version. */
+#define SPS30_RECORD_ERROR_VERSION (-1)
+/** The block already holds SPS30_RECORD_BLOCK_RECORDS records. */
+#define SPS30_RECORD_ERROR_FULL (-2)
+/** The requested record is past the end of the block. */
+#define SPS30_RECORD_ERROR_RANGE (-3)
+
+/** Bumped whenever the layout of a record or block changes */
+#define SPS30_RECORD_VERSION 1
+/**
+ * Set in a record's status when the device status register could not be read for it (e.g.,
+ * firmware older than 2.2, or a failed read). The device leaves this bit reserved.
+ */
+#define SPS30_RECORD_STATUS_UNKNOWN (1u << 31)
+/** Size and alignment of a record: one cache line */
+#define SPS30_RECORD_SIZE 64
+/** Number of float fields in struct sps30_measurement */
+#define SPS30_RECORD_FIELD_COUNT 10
+
+/** Identifies a column block ("S30B" when read as little-endian bytes) */
+#define SPS30_RECORD_BLOCK_MAGIC 0x42303353u
+/** Records per column block. Each column is one cache line of 4-byte values. */
+#define SPS30_RECORD_BLOCK_RECORDS 16
+/** Size and alignment of a column block */
+#define SPS30_RECORD_BLOCK_SIZE 1024
+
+/*
+ * Stored records and blocks are little-endian. On little-endian hosts, the stored bytes are
+ * the in-memory structures below, so they can be used in place (e.g., from an mmap()ed
+ * file). Big-endian hosts must convert with the encode/decode functions. Defining
+ * SPS30_RECORD_NATIVE_LAYOUT as 0 selects those conversions on any host.
+ */
+#ifndef SPS30_RECORD_NATIVE_LAYOUT
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define SPS30_RECORD_NATIVE_LAYOUT 0
+#else
+#define SPS30_RECORD_NATIVE_LAYOUT 1
+#endif
+#endif
+
+#ifdef __cplusplus
+#define SPS30_RECORD_ALIGNAS(n) alignas(n)
+#else
+#define SPS30_RECORD_ALIGNAS(n) _Alignas(n)
+#endif
+
+	/**
+	 * struct sps30_record - one measurement, in a fixed 64-byte layout
+	 *
+	 * @version:       SPS30_RECORD_VERSION
+	 * @channel:       The bus or port the sensor was read through
+	 * @status:        The device status register (see SPS30_DEVICE_STATUS_* masks), or
+	 *                 SPS30_RECORD_STATUS_UNKNOWN
+	 * @timestamp_ms:  Milliseconds since the Unix epoch
+	 * @sensor_id:     Identifies the sensor; see sps30_record_sensor_id()
+	 * @values:        The measurement fields, in struct sps30_measurement order
+	 *
+	 * Every field is naturally aligned at a fixed offset, and the values start on an
+	 * 8-byte boundary so they can be loaded as vectors.
+	 */
+	struct sps30_record
+	{
+		SPS30_RECORD_ALIGNAS(SPS30_RECORD_SIZE) uint16_t version;
+		uint16_t channel;
+		uint32_t status;
+		uint64_t timestamp_ms;
+		uint64_t sensor_id;
+		float values[SPS30_RECORD_FIELD_COUNT];
+	};
+
+	/**
+	 * struct sps30_record_block - records stored column by column
+	 *
+	 * @magic:               SPS30_RECORD_BLOCK_MAGIC
+	 * @version:             SPS30_RECORD_VERSION
+	 * @count:               Records in the block. Unused column entries are zero.
+	 * @first_timestamp_ms:  Timestamp of the first record
+	 * @last_timestamp_ms:   Timestamp of the last record
+	 * @channel:             Record channels
+	 * @reserved:            Zero
+	 * @timestamp_ms:        Record timestamps
+	 * @sensor_id:           Record sensor IDs
+	 * @status:              Record status registers
+	 * @values:              One column per measurement field
+	 *
+	 * A block holds the same data as SPS30_RECORD_BLOCK_RECORDS records in the same space,
+	 * but each column starts on a cache line, so a scan over one field touches only that
+	 * field's memory and can be vectorized directly.
+	 */
+	struct sps30_record_block
+	{
+		SPS30_RECORD_ALIGNAS(SPS30_RECORD_SIZE) uint32_t magic;
+		uint16_t version;
+		uint16_t count;
+		uint64_t first_timestamp_ms;
+		uint64_t last_timestamp_ms;
+		uint16_t channel[SPS30_RECORD_BLOCK_RECORDS];
+		uint8_t reserved[8];
+		uint64_t timestamp_ms[SPS30_RECORD_BLOCK_RECORDS];
+		uint64_t sensor_id[SPS30_RECORD_BLOCK_RECORDS];
+		uint32_t status[SPS30_RECORD_BLOCK_RECORDS];
+		float values[SPS30_RECORD_FIELD_COUNT][SPS30_RECORD_BLOCK_RECORDS];
+	};
+
+	/**
+	 * sps30_record_sensor_id() - derive a stable sensor ID from a serial number
+	 *
+	 * The ID is the 64-bit FNV-1a hash of the serial string returned by sps30_get_serial().
+	 */
+	uint64_t sps30_record_sensor_id(const char* serial);
+
+	/**
+	 * sps30_record_field_name() - the name of a measurement field, e.g. "mc_2p5"
+	 *
+	 * Names are the struct sps30_measurement member names.
+	 *
+	 * Return:  The name, or NULL if field is not less than SPS30_RECORD_FIELD_COUNT
+	 */
+	const char* sps30_record_field_name(unsigned field);
+
+	/**
+	 * sps30_record_field_index() - find a measurement field by name
+	 *
+	 * @name:    The name. It does not need to be NUL-terminated.
+	 * @length:  Characters in name
+	 *
+	 * Return:  The field's index in struct sps30_measurement order, or -1
+	 */
+	int sps30_record_field_index(const char* name, size_t length);
+
+	/**
+	 * sps30_record_init() - fill a record
+	 *
+	 * @record:        The record to fill, in host byte order
+	 * @sensor_id:     See sps30_record_sensor_id()
+	 * @channel:       The bus or port the sensor was read through
+	 * @status:        The device status register, or SPS30_RECORD_STATUS_UNKNOWN
+	 * @timestamp_ms:  Milliseconds since the Unix epoch
+	 * @measurement:   The sample
+	 */
+	void sps30_record_init(struct sps30_record* record, uint64_t sensor_id, uint16_t channel,
+						   uint32_t status, uint64_t timestamp_ms,
+						   const struct sps30_measurement* measurement);
+
+	/**
+	 * sps30_record_measurement() - copy a record's values into a measurement
+	 */
+	void sps30_record_measurement(const struct sps30_record* record,
+								  struct sps30_measurement* measurement);
+
+	/**
+	 * sps30_record_encode() - write a record in its stored (little-endian) form
+	 *
+	 * @record:  The record, in host byte order
+	 * @data:    SPS30_RECORD_SIZE bytes. There is no alignment requirement.
+	 */
+	void sps30_record_encode(const struct sps30_record* record, void* data);
+
+	/**
+	 * sps30_record_decode() - read a record from its stored form
+	 *
+	 * @data:    SPS30_RECORD_SIZE bytes. There is no alignment requirement.
+	 * @record:  Set to the record in host byte order
+	 *
+	 * Return:  0 on success or SPS30_RECORD_ERROR_VERSION
+	 */
+	int16_t sps30_record_decode(const void* data, struct sps30_record* record);
+
+	/**
+	 * sps30_record_array() - use stored records in place
+	 *
+	 * @data:   Stored records, e.g. a mapped file
+	 * @size:   Bytes at data
+	 * @count:  Set to the number of whole records at data
+	 *
+	 * Return:  data as an array of records, or NULL if the records cannot be used in place:
+	 *          data is not aligned to SPS30_RECORD_SIZE, or the host is big-endian. Use
+	 *          sps30_record_decode() instead. Record versions are not checked.
+	 */
+	const struct sps30_record* sps30_record_array(const void* data, size_t size, size_t* count);
+
+	/**
+	 * sps30_record_block_init() - start an empty block
+	 */
+	void sps30_record_block_init(struct sps30_record_block* block);
+
+	/**
+	 * sps30_record_block_append() - add a record to the next row of a block
+	 *
+	 * Return:  0 on success or SPS30_RECORD_ERROR_FULL
+	 */
+	int16_t sps30_record_block_append(struct sps30_record_block* block,
+									  const struct sps30_record* record);
+
+	/**
+	 * sps30_record_block_get() - gather one row of a block into a record
+	 *
+	 * Return:  0 on success or SPS30_RECORD_ERROR_RANGE
+	 */
+	int16_t sps30_record_block_get(const struct sps30_record_block* block, uint16_t index,
+								   struct sps30_record* record);
+
+	/**
+	 * sps30_record_block_encode() - write a block in its stored (little-endian) form
+	 *
+	 * @data:  SPS30_RECORD_BLOCK_SIZE bytes. There is no alignment requirement.
+	 */
+	void sps30_record_block_encode(const struct sps30_record_block* block, void* data);
+
+	/**
+	 * sps30_record_block_decode() - read a block from its stored form
+	 *
+	 * Return:  0 on success or SPS30_RECORD_ERROR_VERSION if the magic number or version
+	 *          is wrong, or the count is out of range
+	 */
+	int16_t sps30_record_block_decode(const void* data, struct sps30_record_block* block);
+
+	/**
+	 * sps30_record_block_array() - use stored blocks in place
+	 *
+	 * Like sps30_record_array(), for blocks. Block headers are not checked.
+	 */
+	const struct sps30_record_block* sps30_record_block_array(const void* data, size_t size,
+															  size_t* count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_RECORD_H */
@@ -0,0 +1,220 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_RECORD_HPP_
+#define SPS_30_RECORD_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <sps30_record.h>
+
+namespace sps30
+{
+static_assert(sizeof(sps30_record) == SPS30_RECORD_SIZE, "Records are one cache line");
+static_assert(alignof(sps30_record) == SPS30_RECORD_SIZE, "Records are line-aligned");
+static_assert(sizeof(sps30_record_block) == SPS30_RECORD_BLOCK_SIZE, "Blocks are 1 KiB");
+
+namespace detail
+{
+inline const sps30_record* stored_array(const sps30_record*, const void* data, size_t size,
+										size_t* count) noexcept
+{
+	return sps30_record_array(data, size, count);
+}
+
+inline const sps30_record_block* stored_array(const sps30_record_block*, const void* data,
+											  size_t size, size_t* count) noexcept
+{
+	return sps30_record_block_array(data, size, count);
+}
+
+inline int16_t decode(const void* data, sps30_record& record) noexcept
+{
+	return sps30_record_decode(data, &record);
+}
+
+inline int16_t decode(const void* data, sps30_record_block& block) noexcept
+{
+	return sps30_record_block_decode(data, &block);
+}
+
+inline void encode(const sps30_record& record, void* data) noexcept
+{
+	sps30_record_encode(&record, data);
+}
+
+inline void encode(const sps30_record_block& block, void* data) noexcept
+{
+	sps30_record_block_encode(&block, data);
+}
+} // namespace detail
+
+/** Reads stored records or column blocks, e.g. from a mapped file
+ *
+ * When the storage is suitably aligned and the host is little-endian, data() exposes the
+ * stored elements directly, and nothing is copied. get() works for any storage, converting
+ * when necessary.
+ *
+ * @tparam Element sps30_record or sps30_record_block
+ */
+template<typename Element>
+class stored_reader
+{
+  public:
+	stored_reader(const void* data, size_t size) noexcept
+		: data_(static_cast<const uint8_t*>(data)), size_(size / sizeof(Element))
+	{
+		size_t count;
+		in_place_ = detail::stored_array(static_cast<const Element*>(nullptr), data, size, &count);
+	}
+
+	/// The number of whole elements in the storage
+	size_t size() const noexcept
+	{
+		return size_;
+	}
+
+	/// The stored elements, or nullptr if they cannot be used in place
+	const Element* data() const noexcept
+	{
+		return in_place_;
+	}
+
+	/// Iteration over the stored elements. Empty if they cannot be used in place.
+	const Element* begin() const noexcept
+	{
+		return in_place_;
+	}
+
+	const Element* end() const noexcept
+	{
+		return in_place_ ? in_place_ + size_ : nullptr;
+	}
+
+	/** Read one element in host byte order
+	 *
+	 * @returns false if the index is out of range or the element has the wrong version.
+	 */
+	bool get(size_t index, Element& element) const noexcept
+	{
+		return index < size_ && detail::decode(data_ + index * sizeof(Element), element) == 0;
+	}
+
+  private:
+	const uint8_t* data_;
+	size_t size_;
+	const Element* in_place_ = nullptr;
+};
+
+/** Appends records or column blocks in their stored form to a caller-supplied buffer
+ *
+ * The buffer can then be written to a file or a log frame as-is.
+ *
+ * @tparam Element sps30_record or sps30_record_block
+ */
+template<typename Element>
+class stored_writer
+{
+  public:
+	stored_writer(void* buffer, size_t capacity) noexcept
+		: buffer_(static_cast<uint8_t*>(buffer)), capacity_(capacity / sizeof(Element))
+	{
+	}
+
+	/// Store an element. Returns false if the buffer is full.
+	bool append(const Element& element) noexcept
+	{
+		if(size_ == capacity_)
+		{
+			return false;
+		}
+
+		detail::encode(element, buffer_ + size_ * sizeof(Element));
+		size_++;
+		return true;
+	}
+
+	/// The number of elements stored
+	size_t size() const noexcept
+	{
+		return size_;
+	}
+
+	/// The number of bytes stored
+	size_t bytes() const noexcept
+	{
+		return size_ * sizeof(Element);
+	}
+
+	const void* data() const noexcept
+	{
+		return buffer_;
+	}
+
+	/// Start again at the beginning of the buffer
+	void clear() noexcept
+	{
+		size_ = 0;
+	}
+
+  private:
+	uint8_t* buffer_;
+	size_t capacity_;
+	size_t size_ = 0;
+};
+
+/** Transposes records into column blocks as they arrive
+ *
+ * Each full block is appended to a stored_writer. Call flush() to store a final, partial
+ * block.
+ */
+class block_builder
+{
+  public:
+	explicit block_builder(stored_writer<sps30_record_block>& writer) noexcept : writer_(writer)
+	{
+		sps30_record_block_init(&block_);
+	}
+
+	/// Add a record. Returns false if a full block could not be stored.
+	bool append(const sps30_record& record) noexcept
+	{
+		if(block_.count == SPS30_RECORD_BLOCK_RECORDS && !flush())
+		{
+			return false;
+		}
+
+		return sps30_record_block_append(&block_, &record) == 0;
+	}
+
+	/// Store the current block if it holds any records. Returns false if the writer is full.
+	bool flush() noexcept
+	{
+		if(block_.count == 0)
+		{
+			return true;
+		}
+		if(!writer_.append(block_))
+		{
+			return false;
+		}
+
+		sps30_record_block_init(&block_);
+		return true;
+	}
+
+  private:
+	stored_writer<sps30_record_block>& writer_;
+	sps30_record_block block_;
+};
+
+using record_reader = stored_reader<sps30_record>;
+using record_writer = stored_writer<sps30_record>;
+using block_reader = stored_reader<sps30_record_block>;
+using block_writer = stored_writer<sps30_record_block>;
+
+}; // end namespace sps30
+
+#endif // SPS_30_RECORD_HPP_
@@ -0,0 +1,518 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#define _POSIX_C_SOURCE 200809L // fdatasync, clock_gettime
+
+#include "sps30_record_log.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+	// macOS does not provide fdatasync()
+	#define fdatasync fsync
+#endif
+
+#define SYNC_BYTES 2
+#define LENGTH_BYTES 2
+
+#define DEFAULT_SEGMENTS 4
+
+static uint64_t monotonic_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static void put_u16(uint8_t* p, uint16_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* p, uint32_t value)
+{
+	put_u16(p, (uint16_t)value);
+	put_u16(p + 2, (uint16_t)(value >> 16));
+}
+
+static uint16_t get_u16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t* p)
+{
+	return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+/* Reflected polynomial 0xEDB88320, sliced by 8: table[k][b] is the CRC of b followed by k zeros */
+static uint32_t crc_table_[8][256];
+static pthread_once_t crc_table_once_ = PTHREAD_ONCE_INIT;
+
+static void init_crc_table(void)
+{
+	for(uint32_t b = 0; b < 256; b++)
+	{
+		uint32_t crc = b;
+		for(unsigned bit = 0; bit < 8; bit++)
+		{
+			crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+		}
+		crc_table_[0][b] = crc;
+	}
+
+	for(uint32_t b = 0; b < 256; b++)
+	{
+		for(unsigned k = 1; k < 8; k++)
+		{
+			const uint32_t previous = crc_table_[k - 1][b];
+			crc_table_[k][b] = (previous >> 8) ^ crc_table_[0][previous & 0xff];
+		}
+	}
+}
+
+uint32_t sps30_record_log_crc32(const uint8_t* data, size_t length)
+{
+	uint32_t crc = 0xffffffff;
+
+	// Readers validate every frame, so this bounds how fast a log can be scanned
+	pthread_once(&crc_table_once_, init_crc_table);
+
+	for(; length >= 8; data += 8, length -= 8)
+	{
+		const uint32_t low = crc ^ get_u32(data);
+		const uint32_t high = get_u32(data + 4);
+		crc = crc_table_[7][low & 0xff] ^ crc_table_[6][(low >> 8) & 0xff] ^
+			  crc_table_[5][(low >> 16) & 0xff] ^ crc_table_[4][low >> 24] ^
+			  crc_table_[3][high & 0xff] ^ crc_table_[2][(high >> 8) & 0xff] ^
+			  crc_table_[1][(high >> 16) & 0xff] ^ crc_table_[0][high >> 24];
+	}
+
+	for(; length; data++, length--)
+	{
+		crc = (crc >> 8) ^ crc_table_[0][(crc ^ *data) & 0xff];
+	}
+
+	return ~crc;
+}
+
+#pragma mark - Writer -
+
+static bool is_async(const struct sps30_record_log* log)
+{
+	return log->config.writer != SPS30_LOG_WRITER_SYNC;
+}
+
+/* The memory that pending records are appended to */
+static uint8_t* pending_buffer(const struct sps30_record_log* log)
+{
+	return is_async(log) ? sps30_log_writer_segment(&log->async, (uint32_t)log->segment)
+						 : log->config.buffer;
+}
+
+static int16_t open_file(struct sps30_record_log* log)
+{
+	// Asynchronous writers use positioned writes, which may complete out of order
+	const int append = is_async(log) ? 0 : O_APPEND;
+	struct stat st;
+
+	log->fd = open(log->config.path, O_WRONLY | O_CREAT | O_CLOEXEC | append, 0644);
+	if(log->fd < 0)
+	{
+		return SPS30_RECORD_LOG_ERROR_IO;
+	}
+
+	if(fstat(log->fd, &st) != 0)
+	{
+		close(log->fd);
+		log->fd = -1;
+		return SPS30_RECORD_LOG_ERROR_IO;
+	}
+
+	log->file_bytes = (uint64_t)st.st_size;
+	return 0;
+}
+
+static int16_t rename_if_present(const char* from, const char* to)
+{
+	if(rename(from, to) != 0 && errno != ENOENT)
+	{
+		return SPS30_RECORD_LOG_ERROR_IO;
+	}
+	return 0;
+}
+
+int16_t sps30_record_log_shift_files(const char* path, const char* suffix, uint8_t keep_files)
+{
+	char from[SPS30_RECORD_LOG_PATH_MAX + 16];
+	char to[SPS30_RECORD_LOG_PATH_MAX + 16];
+
+	assert(path && suffix);
+
+	// Renaming over path.<keep_files> deletes the oldest file
+	for(unsigned i = keep_files; i > 1; i--)
+	{
+		snprintf(from, sizeof(from), "%s.%u%s", path, i - 1, suffix);
+		snprintf(to, sizeof(to), "%s.%u%s", path, i, suffix);
+		if(rename_if_present(from, to) != 0)
+		{
+			return SPS30_RECORD_LOG_ERROR_IO;
+		}
+	}
+
+	snprintf(from, sizeof(from), "%s%s", path, suffix);
+	if(keep_files)
+	{
+		snprintf(to, sizeof(to), "%s.1%s", path, suffix);
+		return rename_if_present(from, to);
+	}
+
+	if(unlink(from) != 0 && errno != ENOENT)
+	{
+		return SPS30_RECORD_LOG_ERROR_IO;
+	}
+	return 0;
+}
+
+/* Shift the rotated files and open a new active file. Pending records are not touched. */
+static int16_t rotate_files(struct sps30_record_log* log)
+{
+	if(log->fd >= 0)
+	{
+		// Writes in flight keep going to the old file
+		if(is_async(log) && sps30_log_writer_close_fd(&log->async, log->fd) != 0)
+		{
+			return SPS30_RECORD_LOG_ERROR_BUSY;
+		}
+		if(!is_async(log))
+		{
+			close(log->fd);
+		}
+		log->fd = -1;
+	}
+
+	if(sps30_record_log_shift_files(log->config.path, "", log->config.keep_files) != 0)
+	{
+		return SPS30_RECORD_LOG_ERROR_IO;
+	}
+
+	log->stats.rotations++;
+	return open_file(log);
+}
+
+int16_t sps30_record_log_open(struct sps30_record_log* log,
+							  const struct sps30_record_log_config* config)
+{
+	assert(log && config && config->path && config->buffer);
+
+	// Leave room for the ".NNN" rotation suffix
+	if(strlen(config->path) + 5 > SPS30_RECORD_LOG_PATH_MAX)
+	{
+		return SPS30_RECORD_LOG_ERROR_TOO_LARGE;
+	}
+
+	memset(log, 0, sizeof(*log));
+	log->config = *config;
+	log->segment_capacity = config->capacity;
+
+	if(is_async(log))
+	{
+		const uint32_t segments = config->segments ? config->segments : DEFAULT_SEGMENTS;
+		log->segment_capacity = config->capacity / segments;
+		if(sps30_log_writer_start(&log->async, config->writer, config->buffer,
+								  log->segment_capacity, segments) != 0)
+		{
+			return SPS30_RECORD_LOG_ERROR_IO;
+		}
+		log->segment = sps30_log_writer_acquire(&log->async);
+	}
+
+	if(open_file(log) != 0)
+	{
+		if(is_async(log))
+		{
+			sps30_log_writer_stop(&log->async);
+		}
+		return SPS30_RECORD_LOG_ERROR_IO;
+	}
+
+	return 0;
+}
+
+void sps30_record_log_set_commit_hook(struct sps30_record_log* log,
+									  sps30_record_log_commit_hook hook, void* context)
+{
+	assert(log);
+	log->commit_hook = hook;
+	log->commit_context = context;
+}
+
+static void notify_commit(const struct sps30_record_log* log, uint64_t offset)
+{
+	if(log->commit_hook)
+	{
+		log->commit_hook(log->commit_context, pending_buffer(log), log->pending_bytes, offset);
+	}
+}
+
+/* Hand the pending segment to the asynchronous writer and move on to a free one */
+static int16_t commit_async(struct sps30_record_log* log)
+{
+	if(sps30_log_writer_submit(&log->async, log->fd, (uint32_t)log->segment,
+							   (uint32_t)log->pending_bytes, log->file_bytes) != 0)
+	{
+		return SPS30_RECORD_LOG_ERROR_IO;
+	}
+	notify_commit(log, log->file_bytes);
+
+	log->file_bytes += log->pending_bytes;
+	log->stats.bytes += log->pending_bytes;
+	log->stats.commits++;
+	log->pending_bytes = 0;
+	log->pending_records = 0;
+
+	// If every segment is in flight, appends are dropped until one completes
+	log->segment = sps30_log_writer_acquire(&log->async);
+	return 0;
+}
+
+int16_t sps30_record_log_commit(struct sps30_record_log* log)
+{
+	size_t written = 0;
+	uint64_t start;
+
+	assert(log);
+
+	if(log->pending_bytes == 0)
+	{
+		return 0;
+	}
+
+	if(log->fd < 0 && open_file(log) != 0)
+	{
+		return SPS30_RECORD_LOG_ERROR_IO;
+	}
+
+	if(log->config.max_file_bytes && log->file_bytes &&
+	   log->file_bytes + log->pending_bytes > log->config.max_file_bytes)
+	{
+		if(rotate_files(log) != 0)
+		{
+			return SPS30_RECORD_LOG_ERROR_IO;
+		}
+	}
+
+	if(is_async(log))
+	{
+		return commit_async(log);
+	}
+
+	start = monotonic_ns();
+	while(written < log->pending_bytes)
+	{
+		const ssize_t r =
+			write(log->fd, log->config.buffer + written, log->pending_bytes - written);
+		if(r < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		written += (size_t)r;
+	}
+	log->stats.write_ns += monotonic_ns() - start;
+	log->stats.bytes += written;
+	log->file_bytes += written;
+
+	if(written < log->pending_bytes)
+	{
+		// Keep the unwritten tail so a retry does not duplicate records.
+		// A frame split by a failed write is skipped by readers as corruption.
+		memmove(log->config.buffer, log->config.buffer + written, log->pending_bytes - written);
+		log->pending_bytes -= written;
+		return SPS30_RECORD_LOG_ERROR_IO;
+	}
+	notify_commit(log, log->file_bytes - written);
+
+	start = monotonic_ns();
+	const int sync_result = fdatasync(log->fd);
+	log->stats.sync_ns += monotonic_ns() - start;
+
+	log->pending_bytes = 0;
+	log->pending_records = 0;
+	log->stats.commits++;
+
+	return sync_result == 0 ? 0 : SPS30_RECORD_LOG_ERROR_IO;
+}
+
+int16_t sps30_record_log_poll(struct sps30_record_log* log, uint64_t now_ms)
+{
+	assert(log);
+
+	if(is_async(log))
+	{
+		log->stats.write_errors = sps30_log_writer_get_stats(&log->async).errors;
+	}
+
+	if(log->pending_records && log->config.commit_interval_ms &&
+	   now_ms - log->oldest_pending_ms >= log->config.commit_interval_ms)
+	{
+		return sps30_record_log_commit(log);
+	}
+
+	return 0;
+}
+
+int16_t sps30_record_log_append(struct sps30_record_log* log, const void* payload,
+								uint16_t length, uint64_t now_ms)
+{
+	const size_t frame_size = (size_t)length + SPS30_RECORD_LOG_FRAME_OVERHEAD;
+	uint8_t* frame;
+
+	assert(log && (payload || length == 0));
+
+	if(length > SPS30_RECORD_LOG_MAX_PAYLOAD || frame_size > log->segment_capacity)
+	{
+		return SPS30_RECORD_LOG_ERROR_TOO_LARGE;
+	}
+
+	if(log->pending_bytes + frame_size > log->segment_capacity &&
+	   sps30_record_log_commit(log) != 0 &&
+	   log->pending_bytes + frame_size > log->segment_capacity)
+	{
+		return SPS30_RECORD_LOG_ERROR_IO;
+	}
+
+	if(is_async(log) && log->segment < 0)
+	{
+		log->segment = sps30_log_writer_acquire(&log->async);
+		if(log->segment < 0)
+		{
+			log->stats.dropped++;
+			return SPS30_RECORD_LOG_ERROR_BUSY;
+		}
+	}
+
+	frame = pending_buffer(log) + log->pending_bytes;
+	frame[0] = SPS30_RECORD_LOG_SYNC_0;
+	frame[1] = SPS30_RECORD_LOG_SYNC_1;
+	put_u16(&frame[SYNC_BYTES], length);
+	memcpy(&frame[SYNC_BYTES + LENGTH_BYTES], payload, length);
+	put_u32(&frame[SYNC_BYTES + LENGTH_BYTES + length],
+			sps30_record_log_crc32(&frame[SYNC_BYTES], LENGTH_BYTES + (size_t)length));
+
+	if(log->pending_records == 0)
+	{
+		log->oldest_pending_ms = now_ms;
+	}
+	log->pending_bytes += frame_size;
+	log->pending_records++;
+	log->stats.records++;
+
+	if(log->config.commit_records && log->pending_records >= log->config.commit_records)
+	{
+		return sps30_record_log_commit(log);
+	}
+
+	return sps30_record_log_poll(log, now_ms);
+}
+
+int16_t sps30_record_log_rotate(struct sps30_record_log* log)
+{
+	assert(log);
+
+	if(sps30_record_log_commit(log) != 0)
+	{
+		return SPS30_RECORD_LOG_ERROR_IO;
+	}
+
+	return rotate_files(log);
+}
+
+int16_t sps30_record_log_close(struct sps30_record_log* log)
+{
+	int16_t result;
+
+	assert(log);
+
+	result = sps30_record_log_commit(log);
+
+	if(is_async(log))
+	{
+		sps30_log_writer_stop(&log->async);
+		log->stats.write_errors = log->async.stats.errors;
+		if(log->stats.write_errors)
+		{
+			result = SPS30_RECORD_LOG_ERROR_IO;
+		}
+	}
+
+	if(log->fd >= 0)
+	{
+		close(log->fd);
+		log->fd = -1;
+	}
+
+	return result;
+}
+
+const struct sps30_record_log_stats* sps30_record_log_get_stats(const struct sps30_record_log* log)
+{
+	assert(log);
+	return &log->stats;
+}
+
+#pragma mark - Reader -
+
+int32_t sps30_record_log_frame_decode(const uint8_t* data, size_t size, const uint8_t** payload,
+									  uint16_t* length)
+{
+	uint16_t payload_length;
+	size_t frame_size;
+
+	assert((data || size == 0) && payload && length);
+
+	if(size < SYNC_BYTES + LENGTH_BYTES)
+	{
+		return SPS30_RECORD_LOG_ERROR_TRUNCATED;
+	}
+
+	if(data[0] != SPS30_RECORD_LOG_SYNC_0 || data[1] != SPS30_RECORD_LOG_SYNC_1)
+	{
+		return SPS30_RECORD_LOG_ERROR_CORRUPT;
+	}
+
+	payload_length = get_u16(&data[SYNC_BYTES]);
+	if(payload_length > SPS30_RECORD_LOG_MAX_PAYLOAD)
+	{
+		return SPS30_RECORD_LOG_ERROR_CORRUPT;
+	}
+
+	frame_size = (size_t)payload_length + SPS30_RECORD_LOG_FRAME_OVERHEAD;
+	if(size < frame_size)
+	{
+		return SPS30_RECORD_LOG_ERROR_TRUNCATED;
+	}
+
+	if(get_u32(&data[SYNC_BYTES + LENGTH_BYTES + payload_length]) !=
+	   sps30_record_log_crc32(&data[SYNC_BYTES], LENGTH_BYTES + (size_t)payload_length))
+	{
+		return SPS30_RECORD_LOG_ERROR_CORRUPT;
+	}
+
+	*payload = &data[SYNC_BYTES + LENGTH_BYTES];
+	*length = payload_length;
+	return (int32_t)frame_size;
+}
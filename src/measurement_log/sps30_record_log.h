@@ -0,0 +1,279 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS30_RECORD_LOG_H
+#define SPS30_RECORD_LOG_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sps30_log_writer.h"
+
+/** A file operation failed. errno describes the failure. */
+#define SPS30_RECORD_LOG_ERROR_IO (-1)
+/** The payload does not fit in a frame or in the log's buffer. */
+#define SPS30_RECORD_LOG_ERROR_TOO_LARGE (-2)
+/** The frame has a bad sync word, length, or CRC. */
+#define SPS30_RECORD_LOG_ERROR_CORRUPT (-3)
+/** The data ends partway through a frame. */
+#define SPS30_RECORD_LOG_ERROR_TRUNCATED (-4)
+/** Every buffer segment is waiting on storage, so the record was dropped. */
+#define SPS30_RECORD_LOG_ERROR_BUSY (-5)
+
+/** Frames begin with the sync bytes "SP" */
+#define SPS30_RECORD_LOG_SYNC_0 0x53
+#define SPS30_RECORD_LOG_SYNC_1 0x50
+
+/** Bytes added to every payload: sync (2), length (2), CRC-32 (4) */
+#define SPS30_RECORD_LOG_FRAME_OVERHEAD 8
+/** Largest payload accepted in a single frame */
+#define SPS30_RECORD_LOG_MAX_PAYLOAD 1024
+/** Longest supported log path, including the rotation suffix */
+#define SPS30_RECORD_LOG_PATH_MAX 256
+
+	/**
+	 * struct sps30_record_log_config - record log settings
+	 *
+	 * @path:                The active log file. Rotated files are named path.1 (newest)
+	 *                       through path.<keep_files> (oldest).
+	 * @buffer:              Storage for frames awaiting commit. This is the only memory
+	 *                       used by the log, so it bounds the log's footprint.
+	 * @capacity:            Size of buffer in bytes
+	 * @commit_records:      Commit once this many records are pending. 0 disables.
+	 * @commit_interval_ms:  Commit once the oldest pending record is this old. 0 disables.
+	 * @max_file_bytes:      Rotate before a commit would grow the file past this size.
+	 *                       0 disables size-based rotation.
+	 * @keep_files:          The number of rotated files retained. The oldest is deleted.
+	 * @writer:              How commits reach storage. With the default,
+	 *                       SPS30_LOG_WRITER_SYNC, commits block the caller until the data
+	 *                       is synced. Other backends never block appends on storage.
+	 * @segments:            For asynchronous writers, the number of equal parts the buffer
+	 *                       is divided into (default 4). One part is filled while the
+	 *                       others are written.
+	 */
+	struct sps30_record_log_config
+	{
+		const char* path;
+		uint8_t* buffer;
+		size_t capacity;
+		uint32_t commit_records;
+		uint32_t commit_interval_ms;
+		uint64_t max_file_bytes;
+		uint8_t keep_files;
+		enum sps30_log_writer_backend writer;
+		uint8_t segments;
+	};
+
+	/**
+	 * struct sps30_record_log_stats - cumulative log activity
+	 *
+	 * @records:        Records appended
+	 * @bytes:          Bytes written to log files
+	 * @commits:        Group commits (each is one or more write() calls and one sync)
+	 * @rotations:      Log rotations
+	 * @write_ns:       Time spent in write() (synchronous writer only)
+	 * @sync_ns:        Time spent in fdatasync() (synchronous writer only)
+	 * @dropped:        Records dropped because every buffer segment was waiting on storage
+	 * @write_errors:   Failed asynchronous writes and syncs, as of the last poll or close
+	 */
+	struct sps30_record_log_stats
+	{
+		uint64_t records;
+		uint64_t bytes;
+		uint64_t commits;
+		uint64_t rotations;
+		uint64_t write_ns;
+		uint64_t sync_ns;
+		uint64_t dropped;
+		uint64_t write_errors;
+	};
+
+	/**
+	 * typedef sps30_record_log_commit_hook - observes committed frames
+	 *
+	 * @context:  The context given to sps30_record_log_set_commit_hook()
+	 * @frames:   The committed frames
+	 * @length:   Size of frames in bytes
+	 * @offset:   The file offset the frames were written at. 0 means the frames start a new
+	 *            file (e.g., after rotation).
+	 */
+	typedef void (*sps30_record_log_commit_hook)(void* context, const uint8_t* frames,
+												 size_t length, uint64_t offset);
+
+	/**
+	 * struct sps30_record_log - rotating log of framed binary records
+	 *
+	 * Records are arbitrary payloads wrapped in a frame:
+	 *
+	 *     | 'S' 'P' | length (u16 LE) | payload | CRC-32 (u32 LE) |
+	 *
+	 * The CRC (IEEE 802.3) covers the length and payload, so a reader can resynchronize
+	 * after a torn write by scanning for the next valid frame.
+	 *
+	 * Appends are copied into the caller's buffer and written by group commit: a single
+	 * write() and fdatasync() covers every pending record once the configured record count
+	 * or age is reached, or when the buffer is full. A crash loses at most the pending
+	 * records. Frames are never split across files.
+	 *
+	 * With an asynchronous writer, a commit hands the filled buffer segment to the writer
+	 * and continues in the next segment; the write and sync complete in the background.
+	 * Rotation still renames and opens files on the calling thread.
+	 *
+	 * All members are private to the implementation.
+	 */
+	struct sps30_record_log
+	{
+		struct sps30_record_log_config config;
+		int fd;
+		uint64_t file_bytes;
+		size_t pending_bytes;
+		uint32_t pending_records;
+		uint64_t oldest_pending_ms;
+		struct sps30_record_log_stats stats;
+		struct sps30_log_writer async;
+		int32_t segment;
+		size_t segment_capacity;
+		sps30_record_log_commit_hook commit_hook;
+		void* commit_context;
+	};
+
+	/**
+	 * sps30_record_log_open() - open the log for appending
+	 *
+	 * An existing log file is appended to.
+	 *
+	 * @log:      Log state
+	 * @config:   Log settings. The path and buffer must remain valid until the log is closed.
+	 *
+	 * Return:  0 on success, SPS30_RECORD_LOG_ERROR_TOO_LARGE if the path is too long,
+	 *          or SPS30_RECORD_LOG_ERROR_IO if the file cannot be opened or the
+	 *          writer cannot be started.
+	 */
+	int16_t sps30_record_log_open(struct sps30_record_log* log,
+								  const struct sps30_record_log_config* config);
+
+	/**
+	 * sps30_record_log_append() - add a record to the log
+	 *
+	 * The record is buffered, and a group commit is made if the buffer is full or a
+	 * commit threshold is reached.
+	 *
+	 * @log:       Log state
+	 * @payload:   The record contents
+	 * @length:    Size of payload in bytes
+	 * @now_ms:    The current time in milliseconds, used for the commit interval
+	 *
+	 * Return:  0 on success, SPS30_RECORD_LOG_ERROR_TOO_LARGE, SPS30_RECORD_LOG_ERROR_IO,
+	 *          or SPS30_RECORD_LOG_ERROR_BUSY (asynchronous writers only).
+	 *          On an I/O error, buffered records are kept and the commit is retried on the
+	 *          next append, poll, or commit. The new record is only dropped if the failed
+	 *          commit left no room for it in the buffer.
+	 */
+	int16_t sps30_record_log_append(struct sps30_record_log* log, const void* payload,
+									uint16_t length, uint64_t now_ms);
+
+	/**
+	 * sps30_record_log_poll() - commit if the commit interval has elapsed
+	 *
+	 * Call this periodically so records are committed even when appends stop.
+	 *
+	 * Return:  0 on success or SPS30_RECORD_LOG_ERROR_IO
+	 */
+	int16_t sps30_record_log_poll(struct sps30_record_log* log, uint64_t now_ms);
+
+	/**
+	 * sps30_record_log_commit() - write and sync all pending records
+	 *
+	 * Return:  0 on success or SPS30_RECORD_LOG_ERROR_IO
+	 */
+	int16_t sps30_record_log_commit(struct sps30_record_log* log);
+
+	/**
+	 * sps30_record_log_rotate() - start a new log file
+	 *
+	 * Pending records are committed to the current file, rotated files are renamed
+	 * (path -> path.1 -> path.2 ...), and a new file is opened at path.
+	 *
+	 * This is also safe to call after an external tool (e.g., logrotate) has moved the
+	 * active file away: a missing file is skipped, and the new file is created at path.
+	 *
+	 * Return:  0 on success or SPS30_RECORD_LOG_ERROR_IO
+	 */
+	int16_t sps30_record_log_rotate(struct sps30_record_log* log);
+
+	/**
+	 * sps30_record_log_close() - commit pending records and close the log
+	 *
+	 * An asynchronous writer is drained and stopped, so this waits for storage.
+	 *
+	 * Return:  0 on success or SPS30_RECORD_LOG_ERROR_IO if the final commit failed
+	 */
+	int16_t sps30_record_log_close(struct sps30_record_log* log);
+
+	/**
+	 * sps30_record_log_set_commit_hook() - observe every commit
+	 *
+	 * The hook is called on the committing thread once a commit's frames have been written
+	 * (or, for asynchronous writers, submitted), e.g. to maintain an index of the log.
+	 * Frames that could not be written are not reported.
+	 *
+	 * @hook:     The hook, or NULL to remove it
+	 * @context:  Passed to the hook
+	 */
+	void sps30_record_log_set_commit_hook(struct sps30_record_log* log,
+										  sps30_record_log_commit_hook hook, void* context);
+
+	/**
+	 * sps30_record_log_shift_files() - rename path -> path.1 -> ... -> path.<keep_files>
+	 *
+	 * This is the renaming done by log rotation. Files kept alongside the log follow it by
+	 * passing their suffix: path<suffix> -> path.1<suffix>, and so on. The file at
+	 * path.<keep_files><suffix> is replaced, and path<suffix> is deleted if keep_files is 0.
+	 * Missing files are skipped.
+	 *
+	 * @path:    The log's path
+	 * @suffix:  Appended to each name, or "" for the log files themselves
+	 *
+	 * Return:  0 on success or SPS30_RECORD_LOG_ERROR_IO
+	 */
+	int16_t sps30_record_log_shift_files(const char* path, const char* suffix,
+										 uint8_t keep_files);
+
+	/**
+	 * sps30_record_log_get_stats() - cumulative statistics for the log
+	 */
+	const struct sps30_record_log_stats*
+		sps30_record_log_get_stats(const struct sps30_record_log* log);
+
+	/**
+	 * sps30_record_log_frame_decode() - parse one frame
+	 *
+	 * @data:      Log data, starting at a frame
+	 * @size:      Bytes available at data
+	 * @payload:   Set to the frame's payload on success
+	 * @length:    Set to the payload size on success
+	 *
+	 * Return:  The size of the frame in bytes, SPS30_RECORD_LOG_ERROR_TRUNCATED if size ends
+	 *          before the frame, or SPS30_RECORD_LOG_ERROR_CORRUPT. After corruption, a
+	 *          reader can advance one byte and retry to find the next frame.
+	 */
+	int32_t sps30_record_log_frame_decode(const uint8_t* data, size_t size,
+										  const uint8_t** payload, uint16_t* length);
+
+	/**
+	 * sps30_record_log_crc32() - CRC-32 (IEEE 802.3) of a buffer
+	 */
+	uint32_t sps30_record_log_crc32(const uint8_t* data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_RECORD_LOG_H */
@@ -0,0 +1,243 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#define _POSIX_C_SOURCE 200809L // fsync
+
+#include "sps30_sensor_table.h"
+#include "sps30_record.h"
+#include "sps30_record_log.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEMPORARY_SUFFIX ".tmp"
+
+_Static_assert(sizeof(struct sps30_sensor_table_header) == 16, "The header is 16 bytes");
+_Static_assert(sizeof(struct sps30_sensor_table_entry) == 80, "Entries are 80 bytes");
+_Static_assert(offsetof(struct sps30_sensor_table_entry, delays_us) ==
+				   SPS30_SENSOR_TABLE_V1_ENTRY_SIZE,
+			   "Version 1 entries are a prefix of the current entries");
+
+static int16_t table_path(char* path, size_t size, const char* log_path, const char* suffix)
+{
+	if(strlen(log_path) + strlen(SPS30_SENSOR_TABLE_SUFFIX) + strlen(suffix) >= size)
+	{
+		errno = ENAMETOOLONG;
+		return SPS30_SENSOR_TABLE_ERROR_IO;
+	}
+	snprintf(path, size, "%s%s%s", log_path, SPS30_SENSOR_TABLE_SUFFIX, suffix);
+	return 0;
+}
+
+static int16_t read_all(int fd, void* data, size_t length)
+{
+	uint8_t* p = data;
+
+	while(length)
+	{
+		const ssize_t r = read(fd, p, length);
+		if(r < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(r < 0)
+		{
+			return SPS30_SENSOR_TABLE_ERROR_IO;
+		}
+		if(r == 0)
+		{
+			return SPS30_SENSOR_TABLE_ERROR_CORRUPT;
+		}
+		p += r;
+		length -= (size_t)r;
+	}
+
+	return 0;
+}
+
+static int16_t write_all(int fd, const void* data, size_t length)
+{
+	const uint8_t* p = data;
+
+	while(length)
+	{
+		const ssize_t r = write(fd, p, length);
+		if(r < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			return SPS30_SENSOR_TABLE_ERROR_IO;
+		}
+		p += r;
+		length -= (size_t)r;
+	}
+
+	return 0;
+}
+
+void sps30_sensor_table_init(struct sps30_sensor_table* table)
+{
+	assert(table);
+
+	memset(table, 0, sizeof(*table));
+	for(unsigned c = 0; c < SPS30_SENSOR_TABLE_CHANNELS; c++)
+	{
+		table->entries[c].channel = (uint16_t)c;
+	}
+}
+
+struct sps30_sensor_table_entry* sps30_sensor_table_set(struct sps30_sensor_table* table,
+														 uint16_t channel, const char* serial,
+														 uint32_t flags)
+{
+	assert(table && serial && channel < SPS30_SENSOR_TABLE_CHANNELS);
+
+	struct sps30_sensor_table_entry* entry = &table->entries[channel];
+	memset(entry, 0, sizeof(*entry));
+	entry->channel = channel;
+	entry->flags = flags | SPS30_SENSOR_TABLE_PRESENT;
+	snprintf(entry->serial, sizeof(entry->serial), "%s", serial);
+	entry->sensor_id = sps30_record_sensor_id(entry->serial);
+	return entry;
+}
+
+int16_t sps30_sensor_table_load(struct sps30_sensor_table* table, const char* log_path)
+{
+	char path[SPS30_RECORD_LOG_PATH_MAX + sizeof(SPS30_SENSOR_TABLE_SUFFIX)];
+	struct sps30_sensor_table_header header;
+	uint8_t stored[SPS30_SENSOR_TABLE_CHANNELS * sizeof(struct sps30_sensor_table_entry)];
+	struct sps30_sensor_table_entry entry;
+	int16_t r;
+
+	assert(table && log_path);
+
+	sps30_sensor_table_init(table);
+	r = table_path(path, sizeof(path), log_path, "");
+	if(r != 0)
+	{
+		return r;
+	}
+
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+	{
+		return SPS30_SENSOR_TABLE_ERROR_IO;
+	}
+
+	r = read_all(fd, &header, sizeof(header));
+	if(r == 0 && (header.magic != SPS30_SENSOR_TABLE_MAGIC || header.version == 0 ||
+				  header.version > SPS30_SENSOR_TABLE_VERSION ||
+				  header.entry_size < SPS30_SENSOR_TABLE_V1_ENTRY_SIZE ||
+				  header.entry_size > sizeof(struct sps30_sensor_table_entry)))
+	{
+		r = SPS30_SENSOR_TABLE_ERROR_VERSION;
+	}
+	if(r == 0 && header.count > SPS30_SENSOR_TABLE_CHANNELS)
+	{
+		r = SPS30_SENSOR_TABLE_ERROR_CORRUPT;
+	}
+	const size_t stored_size = r == 0 ? (size_t)header.count * header.entry_size : 0;
+	if(r == 0)
+	{
+		r = read_all(fd, stored, stored_size);
+	}
+	close(fd);
+
+	if(r == 0 && sps30_record_log_crc32(stored, stored_size) != header.crc)
+	{
+		r = SPS30_SENSOR_TABLE_ERROR_CORRUPT;
+	}
+
+	for(uint32_t i = 0; r == 0 && i < header.count; i++)
+	{
+		memset(&entry, 0, sizeof(entry));
+		memcpy(&entry, &stored[i * header.entry_size], header.entry_size);
+		if(entry.channel >= SPS30_SENSOR_TABLE_CHANNELS ||
+		   !(entry.flags & SPS30_SENSOR_TABLE_PRESENT))
+		{
+			r = SPS30_SENSOR_TABLE_ERROR_CORRUPT;
+			break;
+		}
+		if(header.entry_size < sizeof(entry))
+		{
+			entry.flags &= ~SPS30_SENSOR_TABLE_CALIBRATED;
+		}
+		entry.serial[SPS30_MAX_SERIAL_LEN - 1] = '\0';
+		table->entries[entry.channel] = entry;
+	}
+
+	if(r != 0)
+	{
+		sps30_sensor_table_init(table);
+	}
+	return r;
+}
+
+int16_t sps30_sensor_table_save(const struct sps30_sensor_table* table, const char* log_path)
+{
+	char path[SPS30_RECORD_LOG_PATH_MAX + sizeof(SPS30_SENSOR_TABLE_SUFFIX)];
+	char temporary[sizeof(path) + sizeof(TEMPORARY_SUFFIX)];
+	struct sps30_sensor_table_header header = {0};
+	struct sps30_sensor_table_entry entries[SPS30_SENSOR_TABLE_CHANNELS];
+
+	assert(table && log_path);
+
+	if(table_path(path, sizeof(path), log_path, "") != 0 ||
+	   table_path(temporary, sizeof(temporary), log_path, TEMPORARY_SUFFIX) != 0)
+	{
+		return SPS30_SENSOR_TABLE_ERROR_IO;
+	}
+
+	for(unsigned c = 0; c < SPS30_SENSOR_TABLE_CHANNELS; c++)
+	{
+		if(table->entries[c].flags & SPS30_SENSOR_TABLE_PRESENT)
+		{
+			entries[header.count++] = table->entries[c];
+		}
+	}
+	header.magic = SPS30_SENSOR_TABLE_MAGIC;
+	header.version = SPS30_SENSOR_TABLE_VERSION;
+	header.entry_size = sizeof(struct sps30_sensor_table_entry);
+	header.crc =
+		sps30_record_log_crc32((const uint8_t*)entries, header.count * sizeof(entries[0]));
+
+	const int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0)
+	{
+		return SPS30_SENSOR_TABLE_ERROR_IO;
+	}
+
+	int16_t r = write_all(fd, &header, sizeof(header));
+	if(r == 0)
+	{
+		r = write_all(fd, entries, header.count * sizeof(entries[0]));
+	}
+	if(r == 0 && fsync(fd) != 0)
+	{
+		r = SPS30_SENSOR_TABLE_ERROR_IO;
+	}
+	if(close(fd) != 0 && r == 0)
+	{
+		r = SPS30_SENSOR_TABLE_ERROR_IO;
+	}
+	if(r == 0 && rename(temporary, path) != 0)
+	{
+		r = SPS30_SENSOR_TABLE_ERROR_IO;
+	}
+	if(r != 0)
+	{
+		const int error = errno;
+		(void)unlink(temporary);
+		errno = error;
+	}
+
+	return r;
+}
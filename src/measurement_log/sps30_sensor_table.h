@@ -0,0 +1,160 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS30_SENSOR_TABLE_H
+#define SPS30_SENSOR_TABLE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+#include "sps30.h"
+
+/** A file operation failed. errno describes the failure (ENOENT if there is no table). */
+#define SPS30_SENSOR_TABLE_ERROR_IO (-1)
+/** The table file has an unknown magic number, or a newer version or entry size. */
+#define SPS30_SENSOR_TABLE_ERROR_VERSION (-2)
+/** The table file is truncated, fails its checksum, or has an out-of-range channel. */
+#define SPS30_SENSOR_TABLE_ERROR_CORRUPT (-3)
+
+/** Identifies a sensor table file ("S30T" when read as little-endian bytes) */
+#define SPS30_SENSOR_TABLE_MAGIC 0x54303353u
+#define SPS30_SENSOR_TABLE_VERSION 2
+/** Version 1 entries end after the serial number; they load with no calibrated delays */
+#define SPS30_SENSOR_TABLE_V1_ENTRY_SIZE 64
+/** Appended to the log path to name its sensor table */
+#define SPS30_SENSOR_TABLE_SUFFIX ".sensors"
+/** Channels (e.g., I2C bus indices) a table describes */
+#define SPS30_SENSOR_TABLE_CHANNELS 256
+
+/** The entry describes a sensor */
+#define SPS30_SENSOR_TABLE_PRESENT (1u << 0)
+/** The sensor was left measuring, so it can be read without being restarted */
+#define SPS30_SENSOR_TABLE_MEASURING (1u << 1)
+/** The entry's delays were calibrated on the sensor */
+#define SPS30_SENSOR_TABLE_CALIBRATED (1u << 2)
+
+/** Indices of the command delays kept per sensor */
+#define SPS30_DELAY_COMMAND 0
+#define SPS30_DELAY_START_STOP 1
+#define SPS30_DELAY_WRITE_FLASH 2
+#define SPS30_DELAY_RESET 3
+#define SPS30_DELAY_COUNT 4
+
+	/**
+	 * struct sps30_sensor_table_entry - what is known about the sensor on one channel
+	 *
+	 * @sensor_id:             sps30_record_sensor_id() of the serial
+	 * @started_ms:            When measurement was started, in milliseconds since the Unix
+	 *                         epoch, or 0 if unknown
+	 * @flags:                 SPS30_SENSOR_TABLE_* flags
+	 * @autoclean_interval_s:  The fan auto-cleaning interval
+	 * @firmware_major:        Firmware major version
+	 * @firmware_minor:        Firmware minor version
+	 * @channel:               The channel, which is also the entry's index in the table
+	 * @reserved:              Zero
+	 * @serial:                The serial number, NUL-terminated
+	 * @delays_us:             The SPS30_DELAY_* delays the sensor needs, with a safety
+	 *                         margin, if SPS30_SENSOR_TABLE_CALIBRATED is set
+	 */
+	struct sps30_sensor_table_entry
+	{
+		uint64_t sensor_id;
+		uint64_t started_ms;
+		uint32_t flags;
+		uint32_t autoclean_interval_s;
+		uint8_t firmware_major;
+		uint8_t firmware_minor;
+		uint16_t channel;
+		uint8_t reserved[4];
+		char serial[SPS30_MAX_SERIAL_LEN];
+		uint32_t delays_us[SPS30_DELAY_COUNT];
+	};
+
+	/**
+	 * struct sps30_sensor_table_header - the start of a sensor table file
+	 *
+	 * @magic:       SPS30_SENSOR_TABLE_MAGIC
+	 * @version:     SPS30_SENSOR_TABLE_VERSION
+	 * @entry_size:  sizeof(struct sps30_sensor_table_entry)
+	 * @count:       Entries following the header: only those that are present
+	 * @crc:         sps30_record_log_crc32() of the entries
+	 *
+	 * Like the log index, the file uses the host's byte order; the magic number rejects a
+	 * table from a host of the other byte order. Fields are only ever appended to entries,
+	 * so tables with an older version and smaller entries still load, with the missing
+	 * fields zeroed.
+	 */
+	struct sps30_sensor_table_header
+	{
+		uint32_t magic;
+		uint16_t version;
+		uint16_t entry_size;
+		uint32_t count;
+		uint32_t crc;
+	};
+
+	/**
+	 * struct sps30_sensor_table - sensor metadata that outlives the collector process
+	 *
+	 * @entries:  One entry per channel
+	 *
+	 * A restarted collector uses the table to resume reading sensors that are still
+	 * measuring, without the start/stop sequence and settling time of a cold start.
+	 */
+	struct sps30_sensor_table
+	{
+		struct sps30_sensor_table_entry entries[SPS30_SENSOR_TABLE_CHANNELS];
+	};
+
+	/**
+	 * sps30_sensor_table_init() - start a table with no sensors
+	 */
+	void sps30_sensor_table_init(struct sps30_sensor_table* table);
+
+	/**
+	 * sps30_sensor_table_set() - describe the sensor on a channel
+	 *
+	 * @serial:  The serial number. The sensor ID is derived from it.
+	 * @flags:   SPS30_SENSOR_TABLE_* flags; SPS30_SENSOR_TABLE_PRESENT is implied
+	 *
+	 * Return:  The entry, for the caller to fill in any other metadata
+	 */
+	struct sps30_sensor_table_entry* sps30_sensor_table_set(struct sps30_sensor_table* table,
+															 uint16_t channel, const char* serial,
+															 uint32_t flags);
+
+	/**
+	 * sps30_sensor_table_load() - read the sensor table kept next to a log
+	 *
+	 * @log_path:  The log path; SPS30_SENSOR_TABLE_SUFFIX is appended
+	 *
+	 * The table is left empty on error.
+	 *
+	 * Return:  0 on success, SPS30_SENSOR_TABLE_ERROR_IO, SPS30_SENSOR_TABLE_ERROR_VERSION,
+	 *          or SPS30_SENSOR_TABLE_ERROR_CORRUPT
+	 */
+	int16_t sps30_sensor_table_load(struct sps30_sensor_table* table, const char* log_path);
+
+	/**
+	 * sps30_sensor_table_save() - write the sensor table kept next to a log
+	 *
+	 * @log_path:  The log path; SPS30_SENSOR_TABLE_SUFFIX is appended
+	 *
+	 * The table is written to a temporary file, synced, and renamed over the previous
+	 * table, so a crash leaves either the old or the new table.
+	 *
+	 * Return:  0 on success, or SPS30_SENSOR_TABLE_ERROR_IO
+	 */
+	int16_t sps30_sensor_table_save(const struct sps30_sensor_table* table, const char* log_path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_SENSOR_TABLE_H */
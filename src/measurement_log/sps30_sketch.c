@@ -0,0 +1,285 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#include "sps30_sketch.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+/* ln(gamma), gamma = (1 + a) / (1 - a) for a = SPS30_SKETCH_RELATIVE_ACCURACY */
+#define LOG_GAMMA 0.020000666706669435
+/* ceil(log_gamma(SPS30_SKETCH_MIN_VALUE)): the bucket exponent of bucket 0 */
+#define FIRST_EXPONENT (-230)
+
+static void put_u16(uint8_t* p, uint16_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* p, uint32_t value)
+{
+	put_u16(p, (uint16_t)value);
+	put_u16(p + 2, (uint16_t)(value >> 16));
+}
+
+static void put_u64(uint8_t* p, uint64_t value)
+{
+	put_u32(p, (uint32_t)value);
+	put_u32(p + 4, (uint32_t)(value >> 32));
+}
+
+static void put_f32(uint8_t* p, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	put_u32(p, bits);
+}
+
+static uint16_t get_u16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t* p)
+{
+	return (uint32_t)get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+static uint64_t get_u64(const uint8_t* p)
+{
+	return (uint64_t)get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+static float get_f32(const uint8_t* p)
+{
+	const uint32_t bits = get_u32(p);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static inline uint32_t saturating_add(uint32_t a, uint32_t b)
+{
+	const uint32_t sum = a + b;
+	return sum < a ? UINT32_MAX : sum;
+}
+
+/* The bucket holding value >= SPS30_SKETCH_MIN_VALUE */
+static inline unsigned bucket_of(float value)
+{
+	const int exponent = (int)ceil(log((double)value) / LOG_GAMMA);
+	const int bucket = exponent - FIRST_EXPONENT;
+
+	// Rounding in log() can put SPS30_SKETCH_MIN_VALUE itself one bucket low
+	if(bucket < 0)
+	{
+		return 0;
+	}
+	return bucket < SPS30_SKETCH_BUCKETS ? (unsigned)bucket : SPS30_SKETCH_BUCKETS - 1;
+}
+
+/* The value reported for a bucket: within a relative error of a of its whole range */
+static inline double bucket_value(unsigned bucket)
+{
+	const int exponent = (int)bucket + FIRST_EXPONENT;
+	return exp(exponent * LOG_GAMMA) * (1 - SPS30_SKETCH_RELATIVE_ACCURACY);
+}
+
+void sps30_sketch_init(struct sps30_sketch* sketch)
+{
+	assert(sketch);
+
+	memset(sketch, 0, sizeof(*sketch));
+	sketch->min = INFINITY;
+	sketch->max = -INFINITY;
+	sketch->low = SPS30_SKETCH_BUCKETS;
+}
+
+void sps30_sketch_add(struct sps30_sketch* sketch, float value)
+{
+	assert(sketch);
+
+	if(isnan(value))
+	{
+		return;
+	}
+
+	sketch->count++;
+	sketch->min = value < sketch->min ? value : sketch->min;
+	sketch->max = value > sketch->max ? value : sketch->max;
+
+	if(value < SPS30_SKETCH_MIN_VALUE)
+	{
+		sketch->zero_count = saturating_add(sketch->zero_count, 1);
+		return;
+	}
+
+	const unsigned bucket = bucket_of(value);
+	sketch->buckets[bucket] = saturating_add(sketch->buckets[bucket], 1);
+	sketch->low = bucket < sketch->low ? (uint16_t)bucket : sketch->low;
+	sketch->high = bucket > sketch->high ? (uint16_t)bucket : sketch->high;
+}
+
+void sps30_sketch_add_fields(struct sps30_sketch* sketches, const float* values)
+{
+	assert(sketches && values);
+
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		sps30_sketch_add(&sketches[f], values[f]);
+	}
+}
+
+void sps30_sketch_merge(struct sps30_sketch* into, const struct sps30_sketch* from)
+{
+	assert(into && from);
+
+	if(from->count == 0)
+	{
+		return;
+	}
+
+	into->count += from->count;
+	into->zero_count = saturating_add(into->zero_count, from->zero_count);
+	into->min = from->min < into->min ? from->min : into->min;
+	into->max = from->max > into->max ? from->max : into->max;
+
+	// Only the occupied span is added
+	for(unsigned i = from->low; i <= from->high && i < SPS30_SKETCH_BUCKETS; i++)
+	{
+		into->buckets[i] = saturating_add(into->buckets[i], from->buckets[i]);
+	}
+	into->low = from->low < into->low ? from->low : into->low;
+	into->high = from->high > into->high ? from->high : into->high;
+}
+
+float sps30_sketch_quantile(const struct sps30_sketch* sketch, double q)
+{
+	assert(sketch);
+
+	if(sketch->count == 0 || !(q >= 0 && q <= 1))
+	{
+		return NAN;
+	}
+
+	// The extremes are kept exactly
+	if(q == 0)
+	{
+		return sketch->min;
+	}
+	if(q == 1)
+	{
+		return sketch->max;
+	}
+
+	// The value of this rank (from 0) in sorted order is estimated
+	const double rank = q * (double)(sketch->count - 1);
+	double value = 0;
+	uint64_t cumulative = sketch->zero_count;
+
+	if(rank >= (double)cumulative)
+	{
+		// Ends at the top occupied bucket, which holds the rank unless counts saturated
+		unsigned i = sketch->low;
+		for(; i < sketch->high; i++)
+		{
+			cumulative += sketch->buckets[i];
+			if((double)cumulative > rank)
+			{
+				break;
+			}
+		}
+		value = bucket_value(i);
+	}
+
+	if(value < sketch->min)
+	{
+		return sketch->min;
+	}
+	return value > sketch->max ? sketch->max : (float)value;
+}
+
+size_t sps30_sketch_encode(const struct sps30_sketch* sketch, void* data, size_t size)
+{
+	assert(sketch);
+
+	const unsigned span = sketch->low <= sketch->high ? sketch->high - sketch->low + 1u : 0;
+	const size_t encoded = SPS30_SKETCH_HEADER_SIZE + 4 * (size_t)span;
+	uint8_t* p = data;
+
+	if(!p || size < encoded)
+	{
+		return encoded;
+	}
+
+	put_u32(p, SPS30_SKETCH_MAGIC);
+	put_u16(p + 4, SPS30_SKETCH_VERSION);
+	put_u16(p + 6, SPS30_SKETCH_BUCKETS);
+	put_u64(p + 8, sketch->count);
+	put_u32(p + 16, sketch->zero_count);
+	put_f32(p + 20, sketch->min);
+	put_f32(p + 24, sketch->max);
+	put_u16(p + 28, span ? sketch->low : 0);
+	put_u16(p + 30, (uint16_t)span);
+	for(unsigned i = 0; i < span; i++)
+	{
+		put_u32(p + SPS30_SKETCH_HEADER_SIZE + 4 * i, sketch->buckets[sketch->low + i]);
+	}
+
+	return encoded;
+}
+
+int16_t sps30_sketch_decode(const void* data, size_t size, struct sps30_sketch* sketch,
+							size_t* used)
+{
+	const uint8_t* p = data;
+
+	assert(sketch && (data || size == 0));
+
+	if(size < SPS30_SKETCH_HEADER_SIZE)
+	{
+		return SPS30_SKETCH_ERROR_TRUNCATED;
+	}
+
+	if(get_u32(p) != SPS30_SKETCH_MAGIC || get_u16(p + 4) != SPS30_SKETCH_VERSION ||
+	   get_u16(p + 6) != SPS30_SKETCH_BUCKETS)
+	{
+		return SPS30_SKETCH_ERROR_VERSION;
+	}
+
+	const unsigned low = get_u16(p + 28);
+	const unsigned span = get_u16(p + 30);
+	const size_t encoded = SPS30_SKETCH_HEADER_SIZE + 4 * (size_t)span;
+	if(low + span > SPS30_SKETCH_BUCKETS)
+	{
+		return SPS30_SKETCH_ERROR_CORRUPT;
+	}
+	if(size < encoded)
+	{
+		return SPS30_SKETCH_ERROR_TRUNCATED;
+	}
+
+	sps30_sketch_init(sketch);
+	sketch->count = get_u64(p + 8);
+	sketch->zero_count = get_u32(p + 16);
+	sketch->min = get_f32(p + 20);
+	sketch->max = get_f32(p + 24);
+	if(span)
+	{
+		sketch->low = (uint16_t)low;
+		sketch->high = (uint16_t)(low + span - 1);
+	}
+	for(unsigned i = 0; i < span; i++)
+	{
+		sketch->buckets[low + i] = get_u32(p + SPS30_SKETCH_HEADER_SIZE + 4 * i);
+	}
+
+	if(used)
+	{
+		*used = encoded;
+	}
+	return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS30_SKETCH_H
+#define SPS30_SKETCH_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sps30_record.h"
+
+/** The encoded sketch has an unknown magic number, version, or bucket layout. */
+#define SPS30_SKETCH_ERROR_VERSION (-1)
+/** The encoded sketch is longer than the data. */
+#define SPS30_SKETCH_ERROR_TRUNCATED (-2)
+/** The encoded sketch has an out-of-range bucket span. */
+#define SPS30_SKETCH_ERROR_CORRUPT (-3)
+
+/** Identifies an encoded sketch ("S30Q" when read as little-endian bytes) */
+#define SPS30_SKETCH_MAGIC 0x51303353u
+#define SPS30_SKETCH_VERSION 1
+
+/** Quantiles are within this fraction of the exact value (see struct sps30_sketch) */
+#define SPS30_SKETCH_RELATIVE_ACCURACY 0.01
+/** Smaller values, including negative values, are counted as 0 */
+#define SPS30_SKETCH_MIN_VALUE 0.01f
+/** Larger values share the top bucket */
+#define SPS30_SKETCH_MAX_VALUE 10000.0f
+/** Buckets covering [SPS30_SKETCH_MIN_VALUE, SPS30_SKETCH_MAX_VALUE] */
+#define SPS30_SKETCH_BUCKETS 692
+
+/** Encoded size of a sketch header; each occupied bucket adds 4 bytes */
+#define SPS30_SKETCH_HEADER_SIZE 32
+/** Largest encoded size of a sketch */
+#define SPS30_SKETCH_MAX_ENCODED_SIZE (SPS30_SKETCH_HEADER_SIZE + 4 * SPS30_SKETCH_BUCKETS)
+
+	/**
+	 * struct sps30_sketch - a mergeable quantile sketch of one measurement field
+	 *
+	 * @count:       Values added, excluding NaN
+	 * @zero_count:  Values below SPS30_SKETCH_MIN_VALUE
+	 * @min:         Smallest value added, or INFINITY
+	 * @max:         Largest value added, or -INFINITY
+	 * @low:         Lowest occupied bucket, or SPS30_SKETCH_BUCKETS if none
+	 * @high:        Highest occupied bucket, or 0 if none
+	 * @buckets:     Value counts
+	 *
+	 * A DDSketch with a fixed logarithmic bucket layout: bucket i counts the values in
+	 * (gamma^(k-1), gamma^k], where k = i - 230 and gamma = (1 + a) / (1 - a) for the
+	 * relative accuracy a (SPS30_SKETCH_RELATIVE_ACCURACY). The layout covers every value
+	 * the SPS-30 reports with a = 1% in 2792 bytes per field, whatever the number of
+	 * samples, so a sensor's ten fields take 28 KiB.
+	 *
+	 * Guarantee: for values in [SPS30_SKETCH_MIN_VALUE, SPS30_SKETCH_MAX_VALUE], the
+	 * q-quantile is within a relative error of a of the exact value of rank
+	 * floor(q * (count - 1)) in sorted order. Smaller values are reported as 0 (an absolute
+	 * error below SPS30_SKETCH_MIN_VALUE), and the result never leaves [min, max]. The
+	 * quantiles at q = 0 and q = 1 are exactly min and max.
+	 *
+	 * Since every sketch uses the same buckets, merging adds bucket counts, and a merge of
+	 * per-sensor sketches is exactly the sketch of all of their values. Bucket counts
+	 * saturate at UINT32_MAX: over 130 years of 1 Hz samples within 2% of each other.
+	 */
+	struct sps30_sketch
+	{
+		uint64_t count;
+		uint32_t zero_count;
+		float min;
+		float max;
+		uint16_t low;
+		uint16_t high;
+		uint32_t buckets[SPS30_SKETCH_BUCKETS];
+	};
+
+	/**
+	 * sps30_sketch_init() - start an empty sketch
+	 */
+	void sps30_sketch_init(struct sps30_sketch* sketch);
+
+	/**
+	 * sps30_sketch_add() - add a value to a sketch
+	 *
+	 * NaN values are ignored.
+	 */
+	void sps30_sketch_add(struct sps30_sketch* sketch, float value);
+
+	/**
+	 * sps30_sketch_add_fields() - add a sample to one sketch per field
+	 *
+	 * @sketches:  SPS30_RECORD_FIELD_COUNT sketches, in field order
+	 * @values:    SPS30_RECORD_FIELD_COUNT values (e.g., struct sps30_record values)
+	 */
+	void sps30_sketch_add_fields(struct sps30_sketch* sketches, const float* values);
+
+	/**
+	 * sps30_sketch_merge() - add the values of one sketch to another
+	 *
+	 * @into:  The sketch to update
+	 * @from:  The sketch to add. It may be the same sketch as into.
+	 */
+	void sps30_sketch_merge(struct sps30_sketch* into, const struct sps30_sketch* from);
+
+	/**
+	 * sps30_sketch_quantile() - estimate a quantile
+	 *
+	 * @q:  The quantile, in [0, 1] (e.g., 0.95 for p95)
+	 *
+	 * Return:  The estimate, or NaN if the sketch is empty or q is out of range
+	 */
+	float sps30_sketch_quantile(const struct sps30_sketch* sketch, double q);
+
+	/**
+	 * sps30_sketch_encode() - write a sketch in a portable form for transfer
+	 *
+	 * @sketch:  The sketch
+	 * @data:    Where to write the encoding, or NULL to compute its size
+	 * @size:    Bytes available at data
+	 *
+	 * The encoding is little-endian, and holds only the occupied bucket span, so a sensor
+	 * whose values stay within a factor of ten takes about 500 bytes.
+	 *
+	 * Return:  The encoded size. Nothing is written if it is larger than size.
+	 */
+	size_t sps30_sketch_encode(const struct sps30_sketch* sketch, void* data, size_t size);
+
+	/**
+	 * sps30_sketch_decode() - read an encoded sketch
+	 *
+	 * @data:    The encoding. There is no alignment requirement.
+	 * @size:    Bytes available at data
+	 * @sketch:  Set to the sketch
+	 * @used:    Set to the encoded size, if not NULL, so that sketches can be concatenated
+	 *
+	 * Return:  0 on success, SPS30_SKETCH_ERROR_VERSION, SPS30_SKETCH_ERROR_TRUNCATED, or
+	 *          SPS30_SKETCH_ERROR_CORRUPT
+	 */
+	int16_t sps30_sketch_decode(const void* data, size_t size, struct sps30_sketch* sketch,
+								size_t* used);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_SKETCH_H */
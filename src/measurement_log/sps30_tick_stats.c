@@ -0,0 +1,346 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#include "sps30_tick_stats.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+#if defined(__AVX2__)
+	#define LANES 8
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	#define LANES 4
+#endif
+
+/* What the first pass accumulates */
+struct partial
+{
+	uint32_t count;
+	uint32_t exceedances;
+	float min;
+	float max;
+	double sum;
+};
+
+#pragma mark - Scalar -
+
+/* Min, max, sum, and exceedances of values [first, last) */
+static void first_pass(const float* column, const uint8_t* valid, size_t first, size_t last,
+					   float threshold, uint64_t* mask, struct partial* p)
+{
+	for(size_t i = first; i < last; i++)
+	{
+		if(valid && !valid[i])
+		{
+			continue;
+		}
+
+		const float v = column[i];
+		p->min = v < p->min ? v : p->min;
+		p->max = v > p->max ? v : p->max;
+		p->sum += v;
+		p->count++;
+		if(v > threshold)
+		{
+			p->exceedances++;
+			if(mask)
+			{
+				mask[i / 64] |= 1ull << (i % 64);
+			}
+		}
+	}
+}
+
+/* Sum of the squared deviations from mean of values [first, last) */
+static double second_pass(const float* column, const uint8_t* valid, size_t first, size_t last,
+						  double mean)
+{
+	double squares = 0;
+
+	for(size_t i = first; i < last; i++)
+	{
+		if(!valid || valid[i])
+		{
+			const double deviation = (double)column[i] - mean;
+			squares += deviation * deviation;
+		}
+	}
+
+	return squares;
+}
+
+static void start(size_t count, uint64_t* mask, struct partial* p)
+{
+	if(mask)
+	{
+		memset(mask, 0, SPS30_TICK_MASK_WORDS(count) * sizeof(*mask));
+	}
+
+	p->count = 0;
+	p->exceedances = 0;
+	p->min = INFINITY;
+	p->max = -INFINITY;
+	p->sum = 0;
+}
+
+static void finish(const struct partial* p, double squares, struct sps30_tick_field_stats* stats)
+{
+	if(p->count == 0)
+	{
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	stats->count = p->count;
+	stats->exceedances = p->exceedances;
+	stats->min = p->min;
+	stats->max = p->max;
+	stats->mean = p->sum / p->count;
+	stats->variance = squares / p->count;
+}
+
+void sps30_tick_column_stats_scalar(const float* column, const uint8_t* valid, size_t count,
+									float threshold, uint64_t* mask,
+									struct sps30_tick_field_stats* stats)
+{
+	struct partial p;
+
+	assert(column || count == 0);
+	assert(stats);
+
+	start(count, mask, &p);
+	first_pass(column, valid, 0, count, threshold, mask, &p);
+	const double mean = p.count ? p.sum / p.count : 0;
+	finish(&p, second_pass(column, valid, 0, count, mean), stats);
+}
+
+#pragma mark - Vector -
+
+#if defined(__AVX2__)
+
+/* All-ones lanes for the valid values at i */
+static inline __m256i included(const uint8_t* valid, size_t i)
+{
+	if(!valid)
+	{
+		return _mm256_set1_epi32(-1);
+	}
+
+	const __m256i flags = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&valid[i]));
+	return _mm256_cmpgt_epi32(flags, _mm256_setzero_si256());
+}
+
+/* The vector part of the first pass. Returns the number of values processed. */
+static size_t first_pass_vector(const float* column, const uint8_t* valid, size_t count,
+								float threshold, uint64_t* mask, struct partial* p)
+{
+	const __m256 limit = _mm256_set1_ps(threshold);
+	const __m256 positive = _mm256_set1_ps(INFINITY);
+	const __m256 negative = _mm256_set1_ps(-INFINITY);
+	__m256 lo = positive;
+	__m256 hi = negative;
+	__m256d sum_low = _mm256_setzero_pd();
+	__m256d sum_high = _mm256_setzero_pd();
+	size_t i = 0;
+
+	for(; i + LANES <= count; i += LANES)
+	{
+		const __m256 v = _mm256_loadu_ps(&column[i]);
+		const __m256 include = _mm256_castsi256_ps(included(valid, i));
+
+		// Excluded lanes become values that cannot change the result
+		lo = _mm256_min_ps(_mm256_blendv_ps(positive, v, include), lo);
+		hi = _mm256_max_ps(_mm256_blendv_ps(negative, v, include), hi);
+		const __m256 kept = _mm256_and_ps(v, include);
+		sum_low = _mm256_add_pd(sum_low, _mm256_cvtps_pd(_mm256_castps256_ps128(kept)));
+		sum_high = _mm256_add_pd(sum_high, _mm256_cvtps_pd(_mm256_extractf128_ps(kept, 1)));
+
+		const unsigned above = (unsigned)_mm256_movemask_ps(
+			_mm256_and_ps(_mm256_cmp_ps(v, limit, _CMP_GT_OQ), include));
+		p->count += (uint32_t)__builtin_popcount((unsigned)_mm256_movemask_ps(include));
+		p->exceedances += (uint32_t)__builtin_popcount(above);
+		if(mask)
+		{
+			mask[i / 64] |= (uint64_t)above << (i % 64);
+		}
+	}
+
+	float lanes[LANES];
+	_mm256_storeu_ps(lanes, lo);
+	for(unsigned l = 0; l < LANES; l++)
+	{
+		p->min = lanes[l] < p->min ? lanes[l] : p->min;
+	}
+	_mm256_storeu_ps(lanes, hi);
+	for(unsigned l = 0; l < LANES; l++)
+	{
+		p->max = lanes[l] > p->max ? lanes[l] : p->max;
+	}
+
+	double sums[4];
+	_mm256_storeu_pd(sums, _mm256_add_pd(sum_low, sum_high));
+	p->sum += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+
+	return i;
+}
+
+/* The vector part of the second pass, over the first processed values */
+static double second_pass_vector(const float* column, const uint8_t* valid, size_t processed,
+								 double mean)
+{
+	const __m256d center = _mm256_set1_pd(mean);
+	__m256d squares = _mm256_setzero_pd();
+
+	for(size_t i = 0; i < processed; i += LANES)
+	{
+		const __m256 v = _mm256_loadu_ps(&column[i]);
+		const __m256i include = included(valid, i);
+
+		// Widening the lane masks keeps them all-ones or zero
+		const __m256d low = _mm256_and_pd(
+			_mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)), center),
+			_mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(include))));
+		const __m256d high = _mm256_and_pd(
+			_mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)), center),
+			_mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(include, 1))));
+		squares = _mm256_add_pd(squares, _mm256_add_pd(_mm256_mul_pd(low, low),
+													   _mm256_mul_pd(high, high)));
+	}
+
+	double sums[4];
+	_mm256_storeu_pd(sums, squares);
+	return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+static inline uint32x4_t included(const uint8_t* valid, size_t i)
+{
+	if(!valid)
+	{
+		return vdupq_n_u32(UINT32_MAX);
+	}
+
+	uint32_t flags;
+	memcpy(&flags, &valid[i], sizeof(flags));
+	const uint32x4_t wide = vmovl_u16(vget_low_u16(vmovl_u8(vcreate_u8(flags))));
+	return vcgtq_u32(wide, vdupq_n_u32(0));
+}
+
+static size_t first_pass_vector(const float* column, const uint8_t* valid, size_t count,
+								float threshold, uint64_t* mask, struct partial* p)
+{
+	static const uint32_t lane_bits[LANES] = {1, 2, 4, 8};
+	const uint32x4_t bits = vld1q_u32(lane_bits);
+	const float32x4_t limit = vdupq_n_f32(threshold);
+	const float32x4_t positive = vdupq_n_f32(INFINITY);
+	const float32x4_t negative = vdupq_n_f32(-INFINITY);
+	float32x4_t lo = positive;
+	float32x4_t hi = negative;
+	float64x2_t sum_low = vdupq_n_f64(0);
+	float64x2_t sum_high = vdupq_n_f64(0);
+	size_t i = 0;
+
+	for(; i + LANES <= count; i += LANES)
+	{
+		const float32x4_t v = vld1q_f32(&column[i]);
+		const uint32x4_t include = included(valid, i);
+
+		// Excluded lanes become values that cannot change the result
+		lo = vminq_f32(vbslq_f32(include, v, positive), lo);
+		hi = vmaxq_f32(vbslq_f32(include, v, negative), hi);
+		const float32x4_t kept =
+			vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), include));
+		sum_low = vaddq_f64(sum_low, vcvt_f64_f32(vget_low_f32(kept)));
+		sum_high = vaddq_f64(sum_high, vcvt_high_f64_f32(kept));
+
+		// NEON has no movemask, so lanes are weighted by their bit and summed
+		const uint32_t above =
+			vaddvq_u32(vandq_u32(vandq_u32(vcgtq_f32(v, limit), include), bits));
+		p->count += (uint32_t)__builtin_popcount(vaddvq_u32(vandq_u32(include, bits)));
+		p->exceedances += (uint32_t)__builtin_popcount(above);
+		if(mask)
+		{
+			mask[i / 64] |= (uint64_t)above << (i % 64);
+		}
+	}
+
+	p->min = fminf(p->min, vminvq_f32(lo));
+	p->max = fmaxf(p->max, vmaxvq_f32(hi));
+	p->sum += vaddvq_f64(vaddq_f64(sum_low, sum_high));
+
+	return i;
+}
+
+static double second_pass_vector(const float* column, const uint8_t* valid, size_t processed,
+								 double mean)
+{
+	const float64x2_t center = vdupq_n_f64(mean);
+	float64x2_t squares = vdupq_n_f64(0);
+
+	for(size_t i = 0; i < processed; i += LANES)
+	{
+		const float32x4_t v = vld1q_f32(&column[i]);
+		const int32x4_t include = vreinterpretq_s32_u32(included(valid, i));
+
+		// Sign-extending the lane masks keeps them all-ones or zero
+		const float64x2_t low = vreinterpretq_f64_u64(
+			vandq_u64(vreinterpretq_u64_f64(vsubq_f64(vcvt_f64_f32(vget_low_f32(v)), center)),
+					  vreinterpretq_u64_s64(vmovl_s32(vget_low_s32(include)))));
+		const float64x2_t high = vreinterpretq_f64_u64(
+			vandq_u64(vreinterpretq_u64_f64(vsubq_f64(vcvt_high_f64_f32(v), center)),
+					  vreinterpretq_u64_s64(vmovl_high_s32(include))));
+		squares = vfmaq_f64(vfmaq_f64(squares, low, low), high, high);
+	}
+
+	return vaddvq_f64(squares);
+}
+
+#endif
+
+void sps30_tick_column_stats(const float* column, const uint8_t* valid, size_t count,
+							 float threshold, uint64_t* mask, struct sps30_tick_field_stats* stats)
+{
+	struct partial p;
+	size_t processed = 0;
+	double squares = 0;
+
+	assert(column || count == 0);
+	assert(stats);
+
+	start(count, mask, &p);
+#ifdef LANES
+	processed = first_pass_vector(column, valid, count, threshold, mask, &p);
+#endif
+	first_pass(column, valid, processed, count, threshold, mask, &p);
+
+	const double mean = p.count ? p.sum / p.count : 0;
+#ifdef LANES
+	squares = second_pass_vector(column, valid, processed, mean);
+#endif
+	squares += second_pass(column, valid, processed, count, mean);
+
+	finish(&p, squares, stats);
+}
+
+void sps30_tick_stats(const float* const* columns, const uint8_t* valid, size_t count,
+					  const float* thresholds, uint64_t* masks,
+					  struct sps30_tick_field_stats* stats)
+{
+	assert(columns && thresholds && stats);
+
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		sps30_tick_column_stats(columns[f], valid, count, thresholds[f],
+								masks ? &masks[f * SPS30_TICK_MASK_WORDS(count)] : NULL,
+								&stats[f]);
+	}
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS30_TICK_STATS_H
+#define SPS30_TICK_STATS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sps30_record.h"
+
+/** Words in an exceedance mask over count sensors: one bit per sensor */
+#define SPS30_TICK_MASK_WORDS(count) (((count) + 63) / 64)
+
+	/**
+	 * struct sps30_tick_field_stats - one field across the sensors sampled in a tick
+	 *
+	 * @count:        Valid values
+	 * @exceedances:  Valid values above the threshold
+	 * @min:          Smallest valid value
+	 * @max:          Largest valid value
+	 * @mean:         Mean of the valid values
+	 * @variance:     Population variance of the valid values
+	 *
+	 * Every member is 0 if there are no valid values.
+	 */
+	struct sps30_tick_field_stats
+	{
+		uint32_t count;
+		uint32_t exceedances;
+		float min;
+		float max;
+		double mean;
+		double variance;
+	};
+
+	/**
+	 * sps30_tick_column_stats() - statistics of one field column
+	 *
+	 * @column:     count values, one per sensor (e.g., a column of
+	 *              sps30_frame_decode_batch())
+	 * @valid:      count flags, nonzero for values to include, or NULL to include all
+	 * @count:      Number of values
+	 * @threshold:  Values above this are exceedances. Use INFINITY to count nothing.
+	 * @mask:       SPS30_TICK_MASK_WORDS(count) words, or NULL. Bit i % 64 of word i / 64 is
+	 *              set if value i is valid and above the threshold.
+	 * @stats:      Set to the statistics
+	 *
+	 * Uses AVX2 (x86) or NEON (AArch64) when the compiler targets them. Sums are
+	 * accumulated in double precision, and the variance is computed in a second pass over
+	 * the deviations from the mean, so the result does not depend on the size of the values.
+	 * Every implementation gives the same counts, masks, minimum, and maximum as
+	 * sps30_tick_column_stats_scalar(); the mean and variance differ only by rounding.
+	 * NaN values give unspecified results.
+	 */
+	void sps30_tick_column_stats(const float* column, const uint8_t* valid, size_t count,
+								 float threshold, uint64_t* mask,
+								 struct sps30_tick_field_stats* stats);
+
+	/**
+	 * sps30_tick_column_stats_scalar() - the portable implementation of
+	 * sps30_tick_column_stats()
+	 */
+	void sps30_tick_column_stats_scalar(const float* column, const uint8_t* valid, size_t count,
+										float threshold, uint64_t* mask,
+										struct sps30_tick_field_stats* stats);
+
+	/**
+	 * sps30_tick_stats() - statistics of every field
+	 *
+	 * @columns:     SPS30_RECORD_FIELD_COUNT columns of count values
+	 * @valid:       As for sps30_tick_column_stats()
+	 * @count:       Number of sensors
+	 * @thresholds:  SPS30_RECORD_FIELD_COUNT thresholds
+	 * @masks:       SPS30_RECORD_FIELD_COUNT * SPS30_TICK_MASK_WORDS(count) words, one mask
+	 *               per field in field order, or NULL
+	 * @stats:       SPS30_RECORD_FIELD_COUNT statistics
+	 */
+	void sps30_tick_stats(const float* const* columns, const uint8_t* valid, size_t count,
+						  const float* thresholds, uint64_t* masks,
+						  struct sps30_tick_field_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_TICK_STATS_H */
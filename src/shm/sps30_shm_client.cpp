@@ -0,0 +1,84 @@
+#include <cassert>
+#include <fcntl.h>
+#include <sps30_shm_client.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace sps30::shm;
+
+client::~client()
+{
+	detach();
+}
+
+bool client::attach()
+{
+	assert(name_);
+	assert(mapping_ == nullptr);
+
+	int fd = shm_open(name_, O_RDONLY, 0);
+	if(fd < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if(fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(header_t))
+	{
+		close(fd);
+		return false;
+	}
+
+	const auto size = static_cast<size_t>(info.st_size);
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED)
+	{
+		return false;
+	}
+
+	auto header = static_cast<const header_t*>(mapping);
+	if(header->magic.load(std::memory_order_acquire) != SEGMENT_MAGIC ||
+	   header->version != SEGMENT_VERSION || header->slot_size != sizeof(slot_t) ||
+	   segment_size(header->slot_count) > size)
+	{
+		munmap(mapping, size);
+		return false;
+	}
+
+	mapping_ = mapping;
+	mapping_size_ = size;
+	slot_count_ = header->slot_count;
+	slots_ = reinterpret_cast<const slot_t*>(static_cast<const uint8_t*>(mapping) +
+											 sizeof(header_t));
+
+	return true;
+}
+
+void client::detach()
+{
+	if(mapping_)
+	{
+		munmap(const_cast<void*>(mapping_), mapping_size_);
+		mapping_ = nullptr;
+		slots_ = nullptr;
+		slot_count_ = 0;
+	}
+}
+
+record_t client::read(size_t slot) const
+{
+	assert(slots_);
+	assert(slot < slot_count_);
+
+	return slots_[slot].lock.load();
+}
+
+uint32_t client::sequence(size_t slot) const
+{
+	assert(slots_);
+	assert(slot < slot_count_);
+
+	return slots_[slot].lock.sequence();
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_SHM_CLIENT_HPP_
+#define SPS_30_SHM_CLIENT_HPP_
+
+#include <sps30_shm_layout.hpp>
+
+namespace sps30
+{
+namespace shm
+{
+/** Read-only view of a segment created by shm::publisher
+ *
+ * Clients map the segment with PROT_READ, so they can never disturb the publisher or
+ * other readers. Reads never block the publisher; a read that races with a publish
+ * simply retries.
+ */
+class client
+{
+  public:
+	/** Create a client
+	 *
+	 * @param [in] name The POSIX shared-memory object name used by the publisher. Must
+	 *  outlive the client.
+	 */
+	explicit client(const char* name) : name_(name)
+	{
+	}
+	~client();
+
+	/** Attach to the segment
+	 *
+	 * @returns true if the segment exists and has a compatible layout, false otherwise.
+	 *  A false return may indicate that the publisher has not started yet.
+	 */
+	bool attach();
+
+	/// Unmap the segment
+	void detach();
+
+	/// The number of sensor slots in the attached segment
+	size_t slotCount() const
+	{
+		return slot_count_;
+	}
+
+	/** Read the latest record for a sensor
+	 *
+	 * @pre attach() succeeded
+	 * @param [in] slot The sensor's slot index
+	 *
+	 * @returns A consistent copy of the record. record_t::sequence is 0 if nothing has been
+	 *  published to the slot yet.
+	 */
+	record_t read(size_t slot) const;
+
+	/** Cheaply check whether a slot has been updated
+	 *
+	 * @param [in] slot The sensor's slot index
+	 *
+	 * @returns The number of records published to the slot so far. Compare against a
+	 *  previously observed record_t::sequence to detect new data without copying it.
+	 */
+	uint32_t sequence(size_t slot) const;
+
+  private:
+	const char* name_;
+	size_t slot_count_ = 0;
+	size_t mapping_size_ = 0;
+	const void* mapping_ = nullptr;
+	const slot_t* slots_ = nullptr;
+};
+
+}; // end namespace shm
+}; // end namespace sps30
+
+#endif // SPS_30_SHM_CLIENT_HPP_
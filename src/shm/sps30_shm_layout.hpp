@@ -0,0 +1,68 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_SHM_LAYOUT_HPP_
+#define SPS_30_SHM_LAYOUT_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <driver.hpp>
+#include <seqlock.hpp>
+
+namespace sps30
+{
+namespace shm
+{
+/// Identifies a valid SPS-30 measurement segment ("S30M")
+static constexpr uint32_t SEGMENT_MAGIC = 0x5333304d;
+/// Bumped whenever the layout below changes in an incompatible way
+static constexpr uint16_t SEGMENT_VERSION = 1;
+/// Segments are laid out in cache-line sized units to avoid false sharing between slots
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
+/// The values published for one sensor
+struct record_t
+{
+	/// The most recent measurement
+	sensor::measurement_t measurement;
+	/// The time the measurement was read, in nanoseconds of CLOCK_MONOTONIC
+	/// (std::chrono::steady_clock). Comparable across processes on the same host.
+	int64_t timestamp_ns;
+	/// The device status register (see SPS30_DEVICE_STATUS_* masks)
+	uint32_t status_flags;
+	/// Number of records published to this slot. 0 means the slot has never been written.
+	uint32_t sequence;
+};
+
+/// One seqlock-protected record, padded to its own cache line(s)
+struct alignas(CACHE_LINE_SIZE) slot_t
+{
+	seqlock<record_t> lock;
+};
+
+/// Fixed header at the start of the segment. Slots follow immediately after it.
+struct alignas(CACHE_LINE_SIZE) header_t
+{
+	/// Written last by the publisher (with release semantics) once the segment is ready
+	std::atomic<uint32_t> magic;
+	uint16_t version;
+	uint16_t slot_size;
+	uint32_t slot_count;
+};
+
+static_assert(sizeof(slot_t) % CACHE_LINE_SIZE == 0, "Slots must be cache-line multiples");
+static_assert(sizeof(header_t) == CACHE_LINE_SIZE, "Header must occupy a single cache line");
+
+/// Total size of a segment that holds slot_count sensors
+constexpr size_t segment_size(size_t slot_count)
+{
+	return sizeof(header_t) + slot_count * sizeof(slot_t);
+}
+
+}; // end namespace shm
+}; // end namespace sps30
+
+#endif // SPS_30_SHM_LAYOUT_HPP_
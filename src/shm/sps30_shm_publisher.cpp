@@ -0,0 +1,94 @@
+#include <cassert>
+#include <chrono>
+#include <fcntl.h>
+#include <new>
+#include <sps30_shm_publisher.hpp>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace sps30::shm;
+
+publisher::~publisher()
+{
+	close();
+}
+
+bool publisher::open()
+{
+	assert(name_ && slot_count_);
+	assert(mapping_ == nullptr);
+
+	const size_t size = segment_size(slot_count_);
+
+	// Remove any stale segment left behind by a previous owner, so readers attached to it
+	// do not see a mix of old and new layouts.
+	shm_unlink(name_);
+
+	int fd = shm_open(name_, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if(fd < 0)
+	{
+		return false;
+	}
+
+	if(ftruncate(fd, static_cast<off_t>(size)) != 0)
+	{
+		::close(fd);
+		shm_unlink(name_);
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(mapping == MAP_FAILED)
+	{
+		shm_unlink(name_);
+		return false;
+	}
+
+	// ftruncate() zero-fills the object, which is a valid initial state for every slot.
+	// The header is written last so clients only accept a fully sized segment.
+	auto header = new(mapping) header_t{};
+	slots_ = reinterpret_cast<slot_t*>(static_cast<uint8_t*>(mapping) + sizeof(header_t));
+	for(size_t i = 0; i < slot_count_; i++)
+	{
+		new(&slots_[i]) slot_t{};
+	}
+
+	header->version = SEGMENT_VERSION;
+	header->slot_size = sizeof(slot_t);
+	header->slot_count = static_cast<uint32_t>(slot_count_);
+	header->magic.store(SEGMENT_MAGIC, std::memory_order_release);
+
+	mapping_ = mapping;
+	return true;
+}
+
+void publisher::close()
+{
+	if(mapping_)
+	{
+		munmap(mapping_, segment_size(slot_count_));
+		shm_unlink(name_);
+		mapping_ = nullptr;
+		slots_ = nullptr;
+	}
+}
+
+void publisher::publish(size_t slot, const sensor::sample_t& sample, uint32_t status_flags)
+{
+	assert(slots_);
+	assert(slot < slot_count_);
+
+	auto& lock = slots_[slot].lock;
+
+	record_t record;
+	record.measurement = sample.measurement;
+	record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+							  sample.timestamp.time_since_epoch())
+							  .count();
+	record.status_flags = status_flags;
+	// We are the only writer, so the lock's store count is the previous sequence number
+	record.sequence = lock.sequence() + 1;
+
+	lock.store(record);
+}
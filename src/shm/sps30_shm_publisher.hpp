@@ -0,0 +1,79 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS_30_SHM_PUBLISHER_HPP_
+#define SPS_30_SHM_PUBLISHER_HPP_
+
+#include <sps30_shm_layout.hpp>
+
+namespace sps30
+{
+namespace shm
+{
+/** Publishes live measurements into a POSIX shared-memory segment
+ *
+ * The process that owns the I2C bus creates a publisher and calls publish() after each
+ * sensor::read(). Any number of other processes can attach a shm::client to the same
+ * segment name and read the latest values at memory speed, without touching the bus.
+ *
+ * Each sensor is assigned a slot index by the owning process. Slots are independent
+ * seqlocks, so publishing to one slot never interferes with readers of another.
+ *
+ * @note Only one thread may publish to a given slot.
+ */
+class publisher
+{
+  public:
+	/** Create a publisher
+	 *
+	 * @param [in] name The POSIX shared-memory object name, e.g. "/sps30". Must outlive
+	 *  the publisher.
+	 * @param [in] slot_count The number of sensors that will be published.
+	 */
+	publisher(const char* name, size_t slot_count) : name_(name), slot_count_(slot_count)
+	{
+	}
+	~publisher();
+
+	/** Create (or recreate) and map the shared-memory segment
+	 *
+	 * @post On success, all slots are zeroed and the header is valid.
+	 *
+	 * @returns true if the segment is ready for publishing, false otherwise.
+	 */
+	bool open();
+
+	/** Unmap the segment and remove its name
+	 *
+	 * Clients that are already attached keep their mapping until they detach.
+	 */
+	void close();
+
+	/** Publish the latest sample for a sensor
+	 *
+	 * @pre open() succeeded
+	 * @param [in] slot The sensor's slot index
+	 * @param [in] sample The sample to publish, typically sensor::latest()
+	 * @param [in] status_flags The current device status register value
+	 */
+	void publish(size_t slot, const sensor::sample_t& sample, uint32_t status_flags = 0);
+
+	/// The number of slots in the segment
+	size_t slotCount() const
+	{
+		return slot_count_;
+	}
+
+  private:
+	const char* name_;
+	size_t slot_count_;
+	void* mapping_ = nullptr;
+	slot_t* slots_ = nullptr;
+};
+
+}; // end namespace shm
+}; // end namespace sps30
+
+#endif // SPS_30_SHM_PUBLISHER_HPP_
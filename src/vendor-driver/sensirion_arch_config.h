@@ -93,4 +93,14 @@
  */
 #define SENSIRION_I2C_CLOCK_PERIOD_USEC 10
 
+/**
+ * The data cache line size in bytes. Receive buffers declared with
+ * SENSIRION_RX_BUFFER() are aligned to, and padded to a multiple of, this size, so
+ * a DMA-capable HAL can receive into them directly and invalidate their cache lines
+ * without touching neighbouring data.
+ */
+#ifndef SENSIRION_CACHE_LINE_SIZE
+	#define SENSIRION_CACHE_LINE_SIZE 64
+#endif
+
 #endif /* SENSIRION_ARCH_CONFIG_H */
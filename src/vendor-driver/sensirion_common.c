@@ -61,6 +61,29 @@ float sensirion_bytes_to_float(const uint8_t* bytes)
 	return tmp.float32;
 }
 
+uint16_t sensirion_frame_to_uint16_t(const uint8_t* frame, uint16_t word)
+{
+	return sensirion_bytes_to_uint16_t(&frame[SENSIRION_FRAME_BYTES(word)]);
+}
+
+uint32_t sensirion_frame_to_uint32_t(const uint8_t* frame, uint16_t word)
+{
+	return (uint32_t)sensirion_frame_to_uint16_t(frame, word) << 16 |
+		   sensirion_frame_to_uint16_t(frame, word + 1);
+}
+
+float sensirion_frame_to_float(const uint8_t* frame, uint16_t word)
+{
+	union
+	{
+		uint32_t u32_value;
+		float float32;
+	} tmp;
+
+	tmp.u32_value = sensirion_frame_to_uint32_t(frame, word);
+	return tmp.float32;
+}
+
 uint8_t sensirion_common_generate_crc(const uint8_t* data, uint16_t count)
 {
 	uint16_t current_byte;
@@ -116,48 +139,80 @@ uint16_t sensirion_fill_cmd_send_buf(uint8_t* buf, uint16_t cmd, const uint16_t*
 	return idx;
 }
 
-int16_t sensirion_i2c_read_words_as_bytes(uint8_t address, uint8_t* data, uint16_t num_words)
+int16_t sensirion_common_unpack_words(const uint8_t* frame, uint8_t* data, uint16_t num_words)
 {
 	int16_t ret;
 	uint16_t i, j;
 	uint16_t size = num_words * (SENSIRION_WORD_SIZE + CRC8_LEN);
-	uint16_t word_buf[SENSIRION_MAX_BUFFER_WORDS];
-	uint8_t* const buf8 = (uint8_t*)word_buf;
-
-	ret = sensirion_i2c_read(address, buf8, size);
-	if(ret != NO_ERROR)
-		return ret;
 
-	/* check the CRC for each word */
+	/* check the CRC for each word. j never passes i, so data may be frame */
 	for(i = 0, j = 0; i < size; i += SENSIRION_WORD_SIZE + CRC8_LEN)
 	{
-		ret = sensirion_common_check_crc(&buf8[i], SENSIRION_WORD_SIZE,
-										 buf8[i + SENSIRION_WORD_SIZE]);
+		ret = sensirion_common_check_crc(&frame[i], SENSIRION_WORD_SIZE,
+										 frame[i + SENSIRION_WORD_SIZE]);
 		if(ret != NO_ERROR)
 			return ret;
 
-		data[j++] = buf8[i];
-		data[j++] = buf8[i + 1];
+		data[j++] = frame[i];
+		data[j++] = frame[i + 1];
+	}
+
+	return NO_ERROR;
+}
+
+int16_t sensirion_common_check_frame(const uint8_t* frame, uint16_t num_words)
+{
+	int16_t ret;
+	uint16_t i;
+	uint16_t size = SENSIRION_FRAME_BYTES(num_words);
+
+	for(i = 0; i < size; i += SENSIRION_WORD_SIZE + CRC8_LEN)
+	{
+		ret = sensirion_common_check_crc(&frame[i], SENSIRION_WORD_SIZE,
+										 frame[i + SENSIRION_WORD_SIZE]);
+		if(ret != NO_ERROR)
+			return ret;
 	}
 
 	return NO_ERROR;
 }
 
+int16_t sensirion_i2c_read_frame(uint8_t address, uint8_t* frame, uint16_t num_words)
+{
+	int16_t ret;
+
+	ret = sensirion_i2c_read(address, frame, SENSIRION_FRAME_BYTES(num_words));
+	if(ret != NO_ERROR)
+		return ret;
+
+	return sensirion_common_check_frame(frame, num_words);
+}
+
+int16_t sensirion_i2c_read_words_as_bytes(uint8_t address, uint8_t* data, uint16_t num_words)
+{
+	int16_t ret;
+	SENSIRION_RX_BUFFER(frame, SENSIRION_MAX_BUFFER_WORDS);
+
+	ret = sensirion_i2c_read(address, frame, SENSIRION_FRAME_BYTES(num_words));
+	if(ret != NO_ERROR)
+		return ret;
+
+	return sensirion_common_unpack_words(frame, data, num_words);
+}
+
 int16_t sensirion_i2c_read_words(uint8_t address, uint16_t* data_words, uint16_t num_words)
 {
 	int16_t ret;
-	uint8_t i;
-	const uint8_t* word_bytes;
+	uint16_t i;
+	SENSIRION_RX_BUFFER(frame, SENSIRION_MAX_BUFFER_WORDS);
 
-	ret = sensirion_i2c_read_words_as_bytes(address, (uint8_t*)data_words, num_words);
+	/* the words are decoded straight from the received frame */
+	ret = sensirion_i2c_read_frame(address, frame, num_words);
 	if(ret != NO_ERROR)
 		return ret;
 
 	for(i = 0; i < num_words; ++i)
-	{
-		word_bytes = (uint8_t*)&data_words[i];
-		data_words[i] = ((uint16_t)word_bytes[0] << 8) | word_bytes[1];
-	}
+		data_words[i] = sensirion_frame_to_uint16_t(frame, i);
 
 	return NO_ERROR;
 }
@@ -202,3 +257,27 @@ int16_t sensirion_i2c_read_cmd(uint8_t address, uint16_t cmd, uint16_t* data_wor
 {
 	return sensirion_i2c_delayed_read_cmd(address, cmd, 0, data_words, num_words);
 }
+
+int16_t sensirion_i2c_transfer_sequential(const struct sensirion_i2c_msg* msgs, uint16_t count)
+{
+	int16_t ret;
+	uint16_t i;
+
+	for(i = 0; i < count; i++)
+	{
+		const struct sensirion_i2c_msg* msg = &msgs[i];
+
+		if(msg->flags & SENSIRION_I2C_MSG_READ)
+			ret = sensirion_i2c_read(msg->address, msg->rx, msg->count);
+		else
+			ret = sensirion_i2c_write(msg->address, msg->tx, msg->count);
+
+		if(ret != NO_ERROR && !(msg->flags & SENSIRION_I2C_MSG_IGNORE_NACK))
+			return ret;
+
+		if(msg->delay_usec)
+			sensirion_sleep_usec(msg->delay_usec);
+	}
+
+	return NO_ERROR;
+}
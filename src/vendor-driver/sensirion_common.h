@@ -57,6 +57,29 @@ extern "C"
 #define SENSIRION_NUM_WORDS(x) (sizeof(x) / SENSIRION_WORD_SIZE)
 #define SENSIRION_MAX_BUFFER_WORDS 32
 
+/* The bytes on the bus for a number of words, each followed by its CRC */
+#define SENSIRION_FRAME_BYTES(num_words) ((num_words) * (SENSIRION_WORD_SIZE + CRC8_LEN))
+/* A receive buffer size, rounded up to whole cache lines */
+#define SENSIRION_RX_BUFFER_SIZE(bytes)                                                      \
+	(((bytes) + SENSIRION_CACHE_LINE_SIZE - 1) / SENSIRION_CACHE_LINE_SIZE *                \
+	 SENSIRION_CACHE_LINE_SIZE)
+
+#ifdef __cplusplus
+	#define SENSIRION_ALIGNAS(n) alignas(n)
+#else
+	#define SENSIRION_ALIGNAS(n) _Alignas(n)
+#endif
+
+/*
+ * Declare a buffer that receives the frame of num_words words. It is cache-line
+ * aligned and padded so a DMA-capable HAL can receive into it directly. Read it with
+ * sensirion_i2c_read_frame(), then decode the words where they are with the
+ * sensirion_frame_to_*() functions.
+ */
+#define SENSIRION_RX_BUFFER(name, num_words)                                                 \
+	SENSIRION_ALIGNAS(SENSIRION_CACHE_LINE_SIZE)                                             \
+	uint8_t name[SENSIRION_RX_BUFFER_SIZE(SENSIRION_FRAME_BYTES(num_words))]
+
 	/**
 	 * sensirion_bytes_to_uint16_t() - Convert an array of bytes to an uint16_t
 	 *
@@ -90,10 +113,57 @@ extern "C"
 	 */
 	float sensirion_bytes_to_float(const uint8_t* bytes);
 
+	/**
+	 * sensirion_frame_to_uint16_t() - Decode a word of a received frame
+	 *
+	 * The sensirion_frame_to_*() functions read values straight out of a frame as it
+	 * was received, skipping the CRC bytes, so the payload is never copied out of the
+	 * receive buffer. The frame's CRCs must have been checked, e.g. by
+	 * sensirion_i2c_read_frame().
+	 *
+	 * @frame: The received frame
+	 * @word:  The index of the word in the frame
+	 * Return: The word
+	 */
+	uint16_t sensirion_frame_to_uint16_t(const uint8_t* frame, uint16_t word);
+
+	/**
+	 * sensirion_frame_to_uint32_t() - Decode two words of a received frame as an
+	 *                                 uint32_t, most significant word first
+	 */
+	uint32_t sensirion_frame_to_uint32_t(const uint8_t* frame, uint16_t word);
+
+	/**
+	 * sensirion_frame_to_float() - Decode two words of a received frame as a float
+	 */
+	float sensirion_frame_to_float(const uint8_t* frame, uint16_t word);
+
 	uint8_t sensirion_common_generate_crc(const uint8_t* data, uint16_t count);
 
 	int8_t sensirion_common_check_crc(const uint8_t* data, uint16_t count, uint8_t checksum);
 
+	/**
+	 * sensirion_common_unpack_words() - check the CRCs of received words and strip them
+	 *
+	 * @frame:     The words as received, each followed by its CRC
+	 * @data:      Memory where the words are written as bytes, without CRCs. May be
+	 *             frame, to strip the CRCs in place.
+	 * @num_words: Number of words
+	 *
+	 * Return:     0 on success, an error code if a CRC does not match
+	 */
+	int16_t sensirion_common_unpack_words(const uint8_t* frame, uint8_t* data, uint16_t num_words);
+
+	/**
+	 * sensirion_common_check_frame() - check the CRCs of received words in place
+	 *
+	 * @frame:     The words as received, each followed by its CRC
+	 * @num_words: Number of words
+	 *
+	 * Return:     0 on success, an error code if a CRC does not match
+	 */
+	int16_t sensirion_common_check_frame(const uint8_t* frame, uint16_t num_words);
+
 	/**
 	 * sensirion_i2c_general_call_reset() - Send a general call reset.
 	 *
@@ -133,6 +203,22 @@ extern "C"
 	 */
 	int16_t sensirion_i2c_read_words(uint8_t address, uint16_t* data_words, uint16_t num_words);
 
+	/**
+	 * sensirion_i2c_read_frame() - read data words and check their CRCs, without
+	 *                              removing the CRCs
+	 *
+	 * The frame stays as it was received, so nothing is copied; decode it with the
+	 * sensirion_frame_to_*() functions.
+	 *
+	 * @address:    Sensor i2c address
+	 * @frame:      Buffer of at least SENSIRION_FRAME_BYTES(num_words) bytes, e.g.
+	 *              declared with SENSIRION_RX_BUFFER()
+	 * @num_words:  Number of data words to read (without CRC bytes)
+	 *
+	 * @return      NO_ERROR on success, an error code otherwise
+	 */
+	int16_t sensirion_i2c_read_frame(uint8_t address, uint8_t* frame, uint16_t num_words);
+
 	/**
 	 * sensirion_i2c_read_words_as_bytes() - read data words as byte-stream from
 	 *                                       sensor
@@ -199,6 +285,24 @@ extern "C"
 	int16_t sensirion_i2c_read_cmd(uint8_t address, uint16_t cmd, uint16_t* data_words,
 								   uint16_t num_words);
 
+	struct sensirion_i2c_msg;
+
+	/**
+	 * sensirion_i2c_transfer_sequential() - execute the messages of a transfer one at a
+	 *                                       time
+	 *
+	 * An implementation of sensirion_i2c_transfer() for platforms that cannot chain
+	 * transfers: each message is a separate sensirion_i2c_write() or
+	 * sensirion_i2c_read(), followed by sensirion_sleep_usec() if it has a delay.
+	 *
+	 * @msgs:       The messages, in order
+	 * @count:      Number of messages
+	 *
+	 * @return      NO_ERROR on success, the error code of the failed message otherwise
+	 */
+	int16_t sensirion_i2c_transfer_sequential(const struct sensirion_i2c_msg* msgs,
+											  uint16_t count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -105,6 +105,46 @@ extern "C"
 	 */
 	void sensirion_sleep_usec(uint32_t useconds);
 
+/** The message reads into rx instead of writing tx */
+#define SENSIRION_I2C_MSG_READ 0x01u
+/** The transfer continues if the message is not acknowledged */
+#define SENSIRION_I2C_MSG_IGNORE_NACK 0x02u
+
+	/**
+	 * One message of sensirion_i2c_transfer(): a write or a read, then a delay
+	 */
+	struct sensirion_i2c_msg
+	{
+		/** 7-bit I2C address */
+		uint8_t address;
+		/** SENSIRION_I2C_MSG_* flags */
+		uint8_t flags;
+		/** Number of bytes written from tx, or read into rx */
+		uint16_t count;
+		union
+		{
+			const uint8_t* tx;
+			uint8_t* rx;
+		};
+		/** How long to wait after the message, before the next one */
+		uint32_t delay_usec;
+	};
+
+	/**
+	 * Execute a sequence of messages back-to-back. Reads store the raw bytes, CRCs
+	 * included, in the caller's buffers. The transfer stops at the first message that
+	 * fails, unless it is flagged SENSIRION_I2C_MSG_IGNORE_NACK.
+	 *
+	 * Implementations that can chain transfers (e.g. a single I2C_RDWR ioctl, or a DMA
+	 * descriptor chain) should submit each run of messages between delays at once.
+	 * Others may call sensirion_i2c_transfer_sequential().
+	 *
+	 * @param msgs  the messages, in order
+	 * @param count number of messages
+	 * @returns 0 on success, the error code of the failed message otherwise
+	 */
+	int16_t sensirion_i2c_transfer(const struct sensirion_i2c_msg* msgs, uint16_t count);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -33,26 +33,56 @@
 #include "sensirion_arch_config.h"
 #include "sensirion_common.h"
 #include "sensirion_i2c.h"
-
-#define SPS_CMD_START_MEASUREMENT 0x0010
-#define SPS_CMD_START_MEASUREMENT_ARG 0x0300
-#define SPS_CMD_STOP_MEASUREMENT 0x0104
-#define SPS_CMD_READ_MEASUREMENT 0x0300
-#define SPS_CMD_START_STOP_DELAY_USEC 20000
-#define SPS_CMD_GET_DATA_READY 0x0202
-#define SPS_CMD_AUTOCLEAN_INTERVAL 0x8004
-#define SPS_CMD_GET_FIRMWARE_VERSION 0xd100
-#define SPS_CMD_GET_SERIAL 0xd033
-#define SPS_CMD_RESET 0xd304
-#define SPS_CMD_SLEEP 0x1001
-#define SPS_CMD_READ_DEVICE_STATUS_REG 0xd206
-#define SPS_CMD_START_MANUAL_FAN_CLEANING 0x5607
-#define SPS_CMD_WAKE_UP 0x1103
-#define SPS_CMD_DELAY_USEC 5000
-#define SPS_CMD_DELAY_WRITE_FLASH_USEC 20000
+#include "sps30_commands.h"
+
+#define SPS_CMD_START_MEASUREMENT SPS30_OPCODE_START_MEASUREMENT
+#define SPS_CMD_START_MEASUREMENT_ARG SPS30_OPCODE_START_MEASUREMENT_ARG
+#define SPS_CMD_STOP_MEASUREMENT SPS30_OPCODE_STOP_MEASUREMENT
+#define SPS_CMD_READ_MEASUREMENT SPS30_OPCODE_READ_MEASUREMENT
+#define SPS_CMD_START_STOP_DELAY_USEC SPS30_DELAY_USEC_START_MEASUREMENT
+#define SPS_CMD_GET_DATA_READY SPS30_OPCODE_GET_DATA_READY
+#define SPS_CMD_AUTOCLEAN_INTERVAL SPS30_OPCODE_AUTOCLEAN_INTERVAL
+#define SPS_CMD_GET_FIRMWARE_VERSION SPS30_OPCODE_GET_FIRMWARE_VERSION
+#define SPS_CMD_GET_SERIAL SPS30_OPCODE_GET_SERIAL
+#define SPS_CMD_RESET SPS30_OPCODE_RESET
+#define SPS_CMD_SLEEP SPS30_OPCODE_SLEEP
+#define SPS_CMD_READ_DEVICE_STATUS_REG SPS30_OPCODE_READ_DEVICE_STATUS_REG
+#define SPS_CMD_START_MANUAL_FAN_CLEANING SPS30_OPCODE_START_MANUAL_FAN_CLEANING
+#define SPS_CMD_WAKE_UP SPS30_OPCODE_WAKE_UP
+#define SPS_CMD_DELAY_WRITE_FLASH_USEC SPS30_WRITE_FLASH_DELAY_USEC
 
 #define SPS30_SERIAL_NUM_WORDS ((SPS30_MAX_SERIAL_LEN) / 2)
 
+/* The delays and buffers below are shared between commands, so they must agree with
+ * sps30_commands.h for each of them */
+_Static_assert(SPS30_DELAY_USEC_STOP_MEASUREMENT == SPS_CMD_START_STOP_DELAY_USEC,
+			   "Start and stop share a delay");
+_Static_assert(SPS30_RESET_DELAY_USEC == SPS30_DELAY_USEC_RESET, "sps30.h has the reset delay");
+_Static_assert(SPS30_RESPONSE_WORDS_GET_SERIAL == SPS30_SERIAL_NUM_WORDS,
+			   "The serial number fills the response");
+
+const uint8_t sps30_frame_start_measurement[] =
+	SPS30_FRAME_CMD_ARG(SPS_CMD_START_MEASUREMENT, SPS_CMD_START_MEASUREMENT_ARG);
+const uint8_t sps30_frame_start_measurement_uint16[] =
+	SPS30_FRAME_CMD_ARG(SPS_CMD_START_MEASUREMENT, SPS30_START_MEASUREMENT_ARG_UINT16);
+const uint8_t sps30_frame_stop_measurement[] = SPS30_FRAME_CMD(SPS_CMD_STOP_MEASUREMENT);
+const uint8_t sps30_frame_read_measurement[] = SPS30_FRAME_CMD(SPS_CMD_READ_MEASUREMENT);
+const uint8_t sps30_frame_get_data_ready[] = SPS30_FRAME_CMD(SPS_CMD_GET_DATA_READY);
+const uint8_t sps30_frame_autoclean_interval[] = SPS30_FRAME_CMD(SPS_CMD_AUTOCLEAN_INTERVAL);
+const uint8_t sps30_frame_get_firmware_version[] = SPS30_FRAME_CMD(SPS_CMD_GET_FIRMWARE_VERSION);
+const uint8_t sps30_frame_get_serial[] = SPS30_FRAME_CMD(SPS_CMD_GET_SERIAL);
+const uint8_t sps30_frame_reset[] = SPS30_FRAME_CMD(SPS_CMD_RESET);
+const uint8_t sps30_frame_sleep[] = SPS30_FRAME_CMD(SPS_CMD_SLEEP);
+const uint8_t sps30_frame_read_device_status_reg[] =
+	SPS30_FRAME_CMD(SPS_CMD_READ_DEVICE_STATUS_REG);
+const uint8_t sps30_frame_start_manual_fan_cleaning[] =
+	SPS30_FRAME_CMD(SPS_CMD_START_MANUAL_FAN_CLEANING);
+const uint8_t sps30_frame_wake_up[] = SPS30_FRAME_CMD(SPS_CMD_WAKE_UP);
+
+/* Sends one of the constant frames above as-is, without building it */
+#define SPS30_WRITE_FRAME(frame) \
+	sensirion_i2c_write(SPS30_I2C_ADDRESS, (frame), (uint16_t)sizeof(frame))
+
 int16_t sps30_probe(void)
 {
 	char serial[SPS30_MAX_SERIAL_LEN];
@@ -68,17 +98,60 @@ int16_t sps30_read_firmware_version(uint8_t* major, uint8_t* minor)
 	uint16_t version;
 	int16_t ret;
 
-	ret = sensirion_i2c_read_cmd(SPS30_I2C_ADDRESS, SPS_CMD_GET_FIRMWARE_VERSION, &version, 1);
+	ret = SPS30_WRITE_FRAME(sps30_frame_get_firmware_version);
+	if(ret == NO_ERROR)
+	{
+		ret = sensirion_i2c_read_words(SPS30_I2C_ADDRESS, &version, 1);
+	}
 	*major = (version & 0xff00) >> 8;
 	*minor = (version & 0x00ff);
 	return ret;
 }
 
+int16_t sps30_read_device_info(struct sps30_device_info* info)
+{
+	SENSIRION_RX_BUFFER(serial, SPS30_SERIAL_NUM_WORDS);
+	SENSIRION_RX_BUFFER(version, SPS30_RESPONSE_WORDS_GET_FIRMWARE_VERSION);
+	SENSIRION_RX_BUFFER(interval, SPS30_RESPONSE_WORDS_AUTOCLEAN_INTERVAL);
+	int16_t ret;
+
+	const struct sensirion_i2c_msg msgs[] = {
+		/* wake-up must be sent twice within 100ms, and fails if the sensor is awake */
+		SPS30_I2C_MSG_WRITE(sps30_frame_wake_up, SENSIRION_I2C_MSG_IGNORE_NACK, 0),
+		SPS30_I2C_MSG_WRITE(sps30_frame_wake_up, SENSIRION_I2C_MSG_IGNORE_NACK,
+							SPS30_DELAY_USEC_WAKE_UP),
+		SPS30_I2C_MSG_WRITE(sps30_frame_get_serial, 0, 0),
+		SPS30_I2C_MSG_READ(serial, SPS30_SERIAL_NUM_WORDS, 0),
+		SPS30_I2C_MSG_WRITE(sps30_frame_get_firmware_version, 0, 0),
+		SPS30_I2C_MSG_READ(version, SPS30_RESPONSE_WORDS_GET_FIRMWARE_VERSION, 0),
+		SPS30_I2C_MSG_WRITE(sps30_frame_autoclean_interval, 0,
+							SPS30_DELAY_USEC_AUTOCLEAN_INTERVAL),
+		SPS30_I2C_MSG_READ(interval, SPS30_RESPONSE_WORDS_AUTOCLEAN_INTERVAL, 0),
+	};
+
+	ret = sensirion_i2c_transfer(msgs, ARRAY_SIZE(msgs));
+	if(ret == NO_ERROR)
+		ret = sensirion_common_unpack_words(serial, (uint8_t*)info->serial,
+											SPS30_SERIAL_NUM_WORDS);
+	if(ret == NO_ERROR)
+		ret = sensirion_common_check_frame(version, SPS30_RESPONSE_WORDS_GET_FIRMWARE_VERSION);
+	if(ret == NO_ERROR)
+		ret = sensirion_common_check_frame(interval, SPS30_RESPONSE_WORDS_AUTOCLEAN_INTERVAL);
+	if(ret != NO_ERROR)
+		return ret;
+
+	info->serial[SPS30_MAX_SERIAL_LEN - 1] = '\0';
+	info->firmware_major = version[0];
+	info->firmware_minor = version[1];
+	info->autoclean_interval_seconds = sensirion_frame_to_uint32_t(interval, 0);
+	return 0;
+}
+
 int16_t sps30_get_serial(char* serial)
 {
 	int16_t error;
 
-	error = sensirion_i2c_write_cmd(SPS30_I2C_ADDRESS, SPS_CMD_GET_SERIAL);
+	error = SPS30_WRITE_FRAME(sps30_frame_get_serial);
 
 	if(error != NO_ERROR)
 	{
@@ -98,10 +171,7 @@ int16_t sps30_get_serial(char* serial)
 
 int16_t sps30_start_measurement(void)
 {
-	const uint16_t arg = SPS_CMD_START_MEASUREMENT_ARG;
-
-	int16_t ret = sensirion_i2c_write_cmd_with_args(SPS30_I2C_ADDRESS, SPS_CMD_START_MEASUREMENT,
-													&arg, SENSIRION_NUM_WORDS(arg));
+	int16_t ret = SPS30_WRITE_FRAME(sps30_frame_start_measurement);
 
 	sensirion_sleep_usec(SPS_CMD_START_STOP_DELAY_USEC);
 
@@ -110,70 +180,81 @@ int16_t sps30_start_measurement(void)
 
 int16_t sps30_stop_measurement(void)
 {
-	int16_t ret = sensirion_i2c_write_cmd(SPS30_I2C_ADDRESS, SPS_CMD_STOP_MEASUREMENT);
+	int16_t ret = SPS30_WRITE_FRAME(sps30_frame_stop_measurement);
 	sensirion_sleep_usec(SPS_CMD_START_STOP_DELAY_USEC);
 	return ret;
 }
 
 int16_t sps30_read_data_ready(uint16_t* data_ready)
 {
-	return sensirion_i2c_read_cmd(SPS30_I2C_ADDRESS, SPS_CMD_GET_DATA_READY, data_ready,
-								  SENSIRION_NUM_WORDS(*data_ready));
+	int16_t ret = SPS30_WRITE_FRAME(sps30_frame_get_data_ready);
+	if(ret != NO_ERROR)
+		return ret;
+
+	return sensirion_i2c_read_words(SPS30_I2C_ADDRESS, data_ready,
+									SENSIRION_NUM_WORDS(*data_ready));
 }
 
 int16_t sps30_read_measurement(struct sps30_measurement* measurement)
 {
 	int16_t error;
-	uint8_t data[10][4];
+	SENSIRION_RX_BUFFER(frame, SPS30_RESPONSE_WORDS_READ_MEASUREMENT);
+	_Static_assert(sizeof(*measurement) / sizeof(float) * 2 ==
+					   SPS30_RESPONSE_WORDS_READ_MEASUREMENT,
+				   "A float per measured value");
 
-	error = sensirion_i2c_write_cmd(SPS30_I2C_ADDRESS, SPS_CMD_READ_MEASUREMENT);
+	error = SPS30_WRITE_FRAME(sps30_frame_read_measurement);
 	if(error != NO_ERROR)
 	{
 		return error;
 	}
 
-	error = sensirion_i2c_read_words_as_bytes(SPS30_I2C_ADDRESS, &data[0][0],
-											  SENSIRION_NUM_WORDS(data));
+	error = sensirion_i2c_read_frame(SPS30_I2C_ADDRESS, frame,
+									 SPS30_RESPONSE_WORDS_READ_MEASUREMENT);
 
 	if(error != NO_ERROR)
 	{
 		return error;
 	}
 
-	measurement->mc_1p0 = sensirion_bytes_to_float(data[0]);
-	measurement->mc_2p5 = sensirion_bytes_to_float(data[1]);
-	measurement->mc_4p0 = sensirion_bytes_to_float(data[2]);
-	measurement->mc_10p0 = sensirion_bytes_to_float(data[3]);
-	measurement->nc_0p5 = sensirion_bytes_to_float(data[4]);
-	measurement->nc_1p0 = sensirion_bytes_to_float(data[5]);
-	measurement->nc_2p5 = sensirion_bytes_to_float(data[6]);
-	measurement->nc_4p0 = sensirion_bytes_to_float(data[7]);
-	measurement->nc_10p0 = sensirion_bytes_to_float(data[8]);
-	measurement->typical_particle_size = sensirion_bytes_to_float(data[9]);
+	/* Each value is decoded straight from the received frame, two words per float */
+	measurement->mc_1p0 = sensirion_frame_to_float(frame, 0);
+	measurement->mc_2p5 = sensirion_frame_to_float(frame, 2);
+	measurement->mc_4p0 = sensirion_frame_to_float(frame, 4);
+	measurement->mc_10p0 = sensirion_frame_to_float(frame, 6);
+	measurement->nc_0p5 = sensirion_frame_to_float(frame, 8);
+	measurement->nc_1p0 = sensirion_frame_to_float(frame, 10);
+	measurement->nc_2p5 = sensirion_frame_to_float(frame, 12);
+	measurement->nc_4p0 = sensirion_frame_to_float(frame, 14);
+	measurement->nc_10p0 = sensirion_frame_to_float(frame, 16);
+	measurement->typical_particle_size = sensirion_frame_to_float(frame, 18);
 
 	return 0;
 }
 
 int16_t sps30_get_fan_auto_cleaning_interval(uint32_t* interval_seconds)
 {
-	uint8_t data[4];
+	SENSIRION_RX_BUFFER(frame, SPS30_RESPONSE_WORDS_AUTOCLEAN_INTERVAL);
 	int16_t error;
+	_Static_assert(sizeof(*interval_seconds) == SPS30_RESPONSE_WORDS_AUTOCLEAN_INTERVAL * 2,
+				   "The interval is a 32-bit value");
 
-	error = sensirion_i2c_write_cmd(SPS30_I2C_ADDRESS, SPS_CMD_AUTOCLEAN_INTERVAL);
+	error = SPS30_WRITE_FRAME(sps30_frame_autoclean_interval);
 	if(error != NO_ERROR)
 	{
 		return error;
 	}
 
-	sensirion_sleep_usec(SPS_CMD_DELAY_USEC);
+	sensirion_sleep_usec(SPS30_DELAY_USEC_AUTOCLEAN_INTERVAL);
 
-	error = sensirion_i2c_read_words_as_bytes(SPS30_I2C_ADDRESS, data, SENSIRION_NUM_WORDS(data));
+	error = sensirion_i2c_read_frame(SPS30_I2C_ADDRESS, frame,
+									 SPS30_RESPONSE_WORDS_AUTOCLEAN_INTERVAL);
 	if(error != NO_ERROR)
 	{
 		return error;
 	}
 
-	*interval_seconds = sensirion_bytes_to_uint32_t(data);
+	*interval_seconds = sensirion_frame_to_uint32_t(frame, 0);
 
 	return 0;
 }
@@ -190,6 +271,36 @@ int16_t sps30_set_fan_auto_cleaning_interval(uint32_t interval_seconds)
 	return ret;
 }
 
+int16_t sps30_reconfigure_fan_auto_cleaning_interval(uint32_t interval_seconds,
+													 uint32_t* reported_seconds)
+{
+	uint8_t set[SENSIRION_COMMAND_SIZE + SPS30_FRAME_BYTES(SPS30_ARG_WORDS_AUTOCLEAN_INTERVAL)];
+	SENSIRION_RX_BUFFER(interval, SPS30_RESPONSE_WORDS_AUTOCLEAN_INTERVAL);
+	int16_t ret;
+	const uint16_t words[] = {(uint16_t)((interval_seconds & 0xFFFF0000) >> 16),
+							  (uint16_t)(interval_seconds & 0x0000FFFF)};
+
+	(void)sensirion_fill_cmd_send_buf(set, SPS_CMD_AUTOCLEAN_INTERVAL, words,
+									  SENSIRION_NUM_WORDS(words));
+
+	const struct sensirion_i2c_msg msgs[] = {
+		SPS30_I2C_MSG_WRITE(set, 0, SPS_CMD_DELAY_WRITE_FLASH_USEC),
+		SPS30_I2C_MSG_WRITE(sps30_frame_reset, 0, SPS30_RESET_DELAY_USEC),
+		SPS30_I2C_MSG_WRITE(sps30_frame_autoclean_interval, 0,
+							SPS30_DELAY_USEC_AUTOCLEAN_INTERVAL),
+		SPS30_I2C_MSG_READ(interval, SPS30_RESPONSE_WORDS_AUTOCLEAN_INTERVAL, 0),
+	};
+
+	ret = sensirion_i2c_transfer(msgs, ARRAY_SIZE(msgs));
+	if(ret == NO_ERROR)
+		ret = sensirion_common_check_frame(interval, SPS30_RESPONSE_WORDS_AUTOCLEAN_INTERVAL);
+	if(ret != NO_ERROR)
+		return ret;
+
+	*reported_seconds = sensirion_frame_to_uint32_t(interval, 0);
+	return 0;
+}
+
 int16_t sps30_get_fan_auto_cleaning_interval_days(uint8_t* interval_days)
 {
 	int16_t ret;
@@ -212,53 +323,56 @@ int16_t sps30_start_manual_fan_cleaning(void)
 {
 	int16_t ret;
 
-	ret = sensirion_i2c_write_cmd(SPS30_I2C_ADDRESS, SPS_CMD_START_MANUAL_FAN_CLEANING);
+	ret = SPS30_WRITE_FRAME(sps30_frame_start_manual_fan_cleaning);
 	if(ret)
 		return ret;
 
-	sensirion_sleep_usec(SPS_CMD_DELAY_USEC);
+	sensirion_sleep_usec(SPS30_DELAY_USEC_START_MANUAL_FAN_CLEANING);
 	return 0;
 }
 
 int16_t sps30_reset(void)
 {
-	return sensirion_i2c_write_cmd(SPS30_I2C_ADDRESS, SPS_CMD_RESET);
+	return SPS30_WRITE_FRAME(sps30_frame_reset);
 }
 
 int16_t sps30_sleep(void)
 {
 	int16_t ret;
 
-	ret = sensirion_i2c_write_cmd(SPS30_I2C_ADDRESS, SPS_CMD_SLEEP);
+	ret = SPS30_WRITE_FRAME(sps30_frame_sleep);
 	if(ret)
 		return ret;
 
-	sensirion_sleep_usec(SPS_CMD_DELAY_USEC);
+	sensirion_sleep_usec(SPS30_DELAY_USEC_SLEEP);
 	return 0;
 }
 
 int16_t sps30_wake_up(void)
 {
-	int16_t ret;
-
 	/* wake-up must be sent twice within 100ms, ignore first return value */
-	(void)sensirion_i2c_write_cmd(SPS30_I2C_ADDRESS, SPS_CMD_WAKE_UP);
-	ret = sensirion_i2c_write_cmd(SPS30_I2C_ADDRESS, SPS_CMD_WAKE_UP);
-	if(ret)
-		return ret;
+	const struct sensirion_i2c_msg msgs[] = {
+		SPS30_I2C_MSG_WRITE(sps30_frame_wake_up, SENSIRION_I2C_MSG_IGNORE_NACK, 0),
+		SPS30_I2C_MSG_WRITE(sps30_frame_wake_up, 0, SPS30_DELAY_USEC_WAKE_UP),
+	};
 
-	sensirion_sleep_usec(SPS_CMD_DELAY_USEC);
-	return 0;
+	return sensirion_i2c_transfer(msgs, ARRAY_SIZE(msgs));
 }
 
 int16_t sps30_read_device_status_register(uint32_t* device_status_flags)
 {
 	int16_t ret;
 	uint16_t word_buf[2];
+	_Static_assert(SENSIRION_NUM_WORDS(word_buf) == SPS30_RESPONSE_WORDS_READ_DEVICE_STATUS_REG,
+				   "The status register is 32 bits");
+
+	ret = SPS30_WRITE_FRAME(sps30_frame_read_device_status_reg);
+	if(ret)
+		return ret;
+
+	sensirion_sleep_usec(SPS30_DELAY_USEC_READ_DEVICE_STATUS_REG);
 
-	ret =
-		sensirion_i2c_delayed_read_cmd(SPS30_I2C_ADDRESS, SPS_CMD_READ_DEVICE_STATUS_REG,
-									   SPS_CMD_DELAY_USEC, word_buf, SENSIRION_NUM_WORDS(word_buf));
+	ret = sensirion_i2c_read_words(SPS30_I2C_ADDRESS, word_buf, SENSIRION_NUM_WORDS(word_buf));
 	if(ret)
 		return ret;
 
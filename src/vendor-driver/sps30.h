@@ -56,6 +56,23 @@ extern "C"
 /** The fan speed is out of range */
 #define SPS30_DEVICE_STATUS_FAN_SPEED_WARNING (1 << 21)
 
+/*
+ * Initializers for the messages of a sensirion_i2c_transfer() with the sensor: a frame
+ * written, followed by a delay in microseconds, or a response of num_words words read
+ * into a buffer, e.g. one declared with SENSIRION_RX_BUFFER(). A written frame must be
+ * an array, as its size is the message size.
+ */
+#define SPS30_I2C_MSG_WRITE(frame, msg_flags, delay)                                            \
+	{                                                                                           \
+		.address = SPS30_I2C_ADDRESS, .flags = (msg_flags), .count = (uint16_t)sizeof(frame),   \
+		.tx = (frame), .delay_usec = (delay)                                                    \
+	}
+#define SPS30_I2C_MSG_READ(buf, num_words, msg_flags)                                           \
+	{                                                                                           \
+		.address = SPS30_I2C_ADDRESS, .flags = SENSIRION_I2C_MSG_READ | (msg_flags),            \
+		.count = SENSIRION_FRAME_BYTES(num_words), .rx = (buf), .delay_usec = 0                 \
+	}
+
 	struct sps30_measurement
 	{
 		float mc_1p0;
@@ -70,6 +87,15 @@ extern "C"
 		float typical_particle_size;
 	};
 
+	/** The metadata read by sps30_read_device_info() */
+	struct sps30_device_info
+	{
+		char serial[SPS30_MAX_SERIAL_LEN];
+		uint8_t firmware_major;
+		uint8_t firmware_minor;
+		uint32_t autoclean_interval_seconds;
+	};
+
 	/**
 	 * sps30_probe() - check if SPS sensor is available and initialize it
 	 *
@@ -90,6 +116,20 @@ extern "C"
 	 */
 	int16_t sps30_read_firmware_version(uint8_t* major, uint8_t* minor);
 
+	/**
+	 * sps30_read_device_info() - wake the sensor and read its metadata in one transfer
+	 *
+	 * The wake-up commands, and the serial number, firmware version, and auto-cleaning
+	 * interval reads are submitted together with sensirion_i2c_transfer(). As in
+	 * sps30_probe(), the wake-up commands may fail if the sensor is not asleep.
+	 *
+	 * Note that info must be discarded when the return code is non-zero.
+	 *
+	 * @info:   Memory where the metadata is written into
+	 * Return:  0 on success, an error code otherwise
+	 */
+	int16_t sps30_read_device_info(struct sps30_device_info* info);
+
 	/**
 	 * sps30_get_serial() - retrieve the serial number
 	 *
@@ -167,6 +207,23 @@ extern "C"
 	 */
 	int16_t sps30_set_fan_auto_cleaning_interval(uint32_t interval_seconds);
 
+	/**
+	 * sps30_reconfigure_fan_auto_cleaning_interval() - set the auto-cleaning
+	 * interval, reset the sensor, and read the interval back in one transfer
+	 *
+	 * The reset makes firmware older than 2.2 report the interval just set. The
+	 * flash write and reset delays are part of the transfer.
+	 *
+	 * Note that reported_seconds must be discarded when the return code is
+	 * non-zero.
+	 *
+	 * @interval_seconds:   The interval to set, 0 to disable auto cleaning
+	 * @reported_seconds:   Memory where the interval read back is stored
+	 * Return:              0 on success, an error code otherwise
+	 */
+	int16_t sps30_reconfigure_fan_auto_cleaning_interval(uint32_t interval_seconds,
+														 uint32_t* reported_seconds);
+
 	/**
 	 * sps30_get_fan_auto_cleaning_interval_days() - convenience function to read
 	 * the current(*) auto-cleaning interval in days
@@ -0,0 +1,179 @@
+/*
+ * Copyright © 2021 Embedded Artistry LLC.
+ * See LICENSE file for licensing information.
+ */
+
+#ifndef SPS30_COMMANDS_H
+#define SPS30_COMMANDS_H
+
+#include <stdint.h>
+
+/*
+ * The SPS30 I2C command set, described once
+ *
+ * Every place that sends a command (sps30.c, the C++ driver's I2C transport, the collector's
+ * fleet bring-up, and the simulated HAL) derives its opcodes, buffer sizes, and delays from
+ * SPS30_COMMANDS() instead of keeping its own copy of the interface description.
+ *
+ * SPS30_COMMANDS(X) invokes X once per command, in the order of sps30::transport::command_t,
+ * with these arguments:
+ *
+ * @name:            The command, as in SPS30_CMD_<name>
+ * @opcode:          The 16-bit command sent on the bus
+ * @arg_words:       Argument words written after the opcode (each followed by a CRC byte)
+ * @response_words:  Words read back (each followed by a CRC byte)
+ * @delay_usec:      How long to wait after the command before the next transfer
+ * @fw_major:        The first firmware version that supports the command...
+ * @fw_minor:        ...and its minor number
+ * @writes_flash:    1 if writing the arguments stores them in flash, in which case the delay
+ *                   after the write is SPS30_WRITE_FLASH_DELAY_USEC instead
+ * @value_bytes:     The size of each value in the arguments and response: 1 for byte strings
+ *                   such as the serial number, 2 for 16-bit words, 4 for 32-bit integers and
+ *                   floats. Values are big-endian on the bus.
+ *
+ * START_MEASUREMENT_ARG is not a command, but the measurement output format argument of
+ * START_MEASUREMENT (big-endian IEEE754 floats), kept in the table because command_t has it.
+ * READ_MEASUREMENT's values are the floats of that format; in the uint16 format of
+ * SPS30_START_MEASUREMENT_ARG_UINT16, they are 16-bit words instead.
+ */
+/* clang-format off */
+#define SPS30_COMMANDS(X) \
+	/* name                        opcode  args resp  delay  fw      flash value */ \
+	X(START_MEASUREMENT,           0x0010, 1,   0,    20000, 1, 0,   0,   2) \
+	X(START_MEASUREMENT_ARG,       0x0300, 0,   0,    0,     1, 0,   0,   2) \
+	X(STOP_MEASUREMENT,            0x0104, 0,   0,    20000, 1, 0,   0,   2) \
+	X(READ_MEASUREMENT,            0x0300, 0,   20,   0,     1, 0,   0,   4) \
+	X(GET_DATA_READY,              0x0202, 0,   1,    0,     1, 0,   0,   2) \
+	X(AUTOCLEAN_INTERVAL,          0x8004, 2,   2,    5000,  1, 0,   1,   4) \
+	X(GET_FIRMWARE_VERSION,        0xd100, 0,   1,    0,     1, 0,   0,   2) \
+	X(GET_SERIAL,                  0xd033, 0,   16,   0,     1, 0,   0,   1) \
+	X(RESET,                       0xd304, 0,   0,   100000, 1, 0,   0,   2) \
+	X(SLEEP,                       0x1001, 0,   0,    5000,  2, 0,   0,   2) \
+	X(READ_DEVICE_STATUS_REG,      0xd206, 0,   2,    5000,  2, 2,   0,   4) \
+	X(START_MANUAL_FAN_CLEANING,   0x5607, 0,   0,    5000,  1, 0,   0,   2) \
+	X(WAKE_UP,                     0x1103, 0,   0,    5000,  2, 0,   0,   2)
+/* clang-format on */
+
+/** How long to wait after a command's arguments were written to flash */
+#define SPS30_WRITE_FLASH_DELAY_USEC 20000
+
+/** Bytes on the bus for a number of words: two data bytes and a CRC byte per word */
+#define SPS30_FRAME_BYTES(words) ((words) * 3)
+
+/** The uint16 measurement output format argument of START_MEASUREMENT (firmware 2.0) */
+#define SPS30_START_MEASUREMENT_ARG_UINT16 0x0500
+
+/*
+ * SPS30_CRC8() - the CRC of a word, as a constant expression
+ *
+ * The CRC (polynomial 0x31, initial value 0xff) is affine in the bits of the word: it is the
+ * CRC of 0, XORed with the change that each set bit makes on its own. Frames with constant
+ * arguments therefore get their CRC from the compiler rather than from
+ * sensirion_common_generate_crc() at run time. The constants are checked against the CRC
+ * in sps30_commands.hpp.
+ */
+#define SPS30_CRC8_ZERO 0x81u
+#define SPS30_CRC8_BIT_(word, bit, change) ((((word) >> (bit)) & 1u) ? (change) : 0u)
+#define SPS30_CRC8(word)                                                                        \
+	((uint8_t)(SPS30_CRC8_ZERO ^ SPS30_CRC8_BIT_(word, 0, 0x31u) ^                            \
+			   SPS30_CRC8_BIT_(word, 1, 0x62u) ^ SPS30_CRC8_BIT_(word, 2, 0xc4u) ^            \
+			   SPS30_CRC8_BIT_(word, 3, 0xb9u) ^ SPS30_CRC8_BIT_(word, 4, 0x43u) ^            \
+			   SPS30_CRC8_BIT_(word, 5, 0x86u) ^ SPS30_CRC8_BIT_(word, 6, 0x3du) ^            \
+			   SPS30_CRC8_BIT_(word, 7, 0x7au) ^ SPS30_CRC8_BIT_(word, 8, 0xf4u) ^            \
+			   SPS30_CRC8_BIT_(word, 9, 0xd9u) ^ SPS30_CRC8_BIT_(word, 10, 0x83u) ^           \
+			   SPS30_CRC8_BIT_(word, 11, 0x37u) ^ SPS30_CRC8_BIT_(word, 12, 0x6eu) ^          \
+			   SPS30_CRC8_BIT_(word, 13, 0xdcu) ^ SPS30_CRC8_BIT_(word, 14, 0x89u) ^          \
+			   SPS30_CRC8_BIT_(word, 15, 0x23u)))
+
+/** Initializers for the bytes of a command without arguments, and with one argument word */
+#define SPS30_FRAME_CMD(opcode) {(uint8_t)((opcode) >> 8), (uint8_t)((opcode)&0xff)}
+#define SPS30_FRAME_CMD_ARG(opcode, arg)                                                       \
+	{                                                                                          \
+		(uint8_t)((opcode) >> 8), (uint8_t)((opcode)&0xff), (uint8_t)((arg) >> 8),             \
+			(uint8_t)((arg)&0xff), SPS30_CRC8(arg)                                             \
+	}
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define SPS30_COMMAND_INDEX_(name, opcode, args, resp, delay, major, minor, flash, value) \
+	SPS30_COMMAND_INDEX_##name,
+#define SPS30_COMMAND_OPCODE_(name, opcode, args, resp, delay, major, minor, flash, value) \
+	SPS30_OPCODE_##name = (opcode),
+#define SPS30_COMMAND_ARG_WORDS_(name, opcode, args, resp, delay, major, minor, flash, value) \
+	SPS30_ARG_WORDS_##name = (args),
+#define SPS30_COMMAND_RESPONSE_WORDS_(name, opcode, args, resp, delay, major, minor, flash, value) \
+	SPS30_RESPONSE_WORDS_##name = (resp),
+#define SPS30_COMMAND_DELAY_USEC_(name, opcode, args, resp, delay, major, minor, flash, value) \
+	SPS30_DELAY_USEC_##name = (delay),
+#define SPS30_COMMAND_MIN_FIRMWARE_(name, opcode, args, resp, delay, major, minor, flash, value) \
+	SPS30_MIN_FIRMWARE_##name = ((major) << 8) | (minor),
+
+	/** SPS30_COMMAND_INDEX_<name>: the command's position in SPS30_COMMANDS() */
+	enum sps30_command_index
+	{
+		SPS30_COMMANDS(SPS30_COMMAND_INDEX_) SPS30_COMMAND_COUNT
+	};
+
+	/** SPS30_OPCODE_<name>: the command sent on the bus */
+	enum sps30_command_opcode
+	{
+		SPS30_COMMANDS(SPS30_COMMAND_OPCODE_)
+	};
+
+	/** SPS30_ARG_WORDS_<name>: the number of argument words */
+	enum sps30_command_arg_words
+	{
+		SPS30_COMMANDS(SPS30_COMMAND_ARG_WORDS_)
+	};
+
+	/** SPS30_RESPONSE_WORDS_<name>: the number of response words */
+	enum sps30_command_response_words
+	{
+		SPS30_COMMANDS(SPS30_COMMAND_RESPONSE_WORDS_)
+	};
+
+	/** SPS30_DELAY_USEC_<name>: the delay after the command, in microseconds */
+	enum sps30_command_delay_usec
+	{
+		SPS30_COMMANDS(SPS30_COMMAND_DELAY_USEC_)
+	};
+
+	/** SPS30_MIN_FIRMWARE_<name>: the first supporting firmware, as (major << 8) | minor */
+	enum sps30_command_min_firmware
+	{
+		SPS30_COMMANDS(SPS30_COMMAND_MIN_FIRMWARE_)
+	};
+
+	/*
+	 * The frames of commands that are always sent with the same bytes, ready to pass to
+	 * sensirion_i2c_write() as-is. They are constant, so they can stay in flash.
+	 */
+	extern const uint8_t sps30_frame_start_measurement[SPS30_FRAME_BYTES(1) + 2];
+	extern const uint8_t sps30_frame_start_measurement_uint16[SPS30_FRAME_BYTES(1) + 2];
+	extern const uint8_t sps30_frame_stop_measurement[2];
+	extern const uint8_t sps30_frame_read_measurement[2];
+	extern const uint8_t sps30_frame_get_data_ready[2];
+	extern const uint8_t sps30_frame_autoclean_interval[2];
+	extern const uint8_t sps30_frame_get_firmware_version[2];
+	extern const uint8_t sps30_frame_get_serial[2];
+	extern const uint8_t sps30_frame_reset[2];
+	extern const uint8_t sps30_frame_sleep[2];
+	extern const uint8_t sps30_frame_read_device_status_reg[2];
+	extern const uint8_t sps30_frame_start_manual_fan_cleaning[2];
+	extern const uint8_t sps30_frame_wake_up[2];
+
+#undef SPS30_COMMAND_INDEX_
+#undef SPS30_COMMAND_OPCODE_
+#undef SPS30_COMMAND_ARG_WORDS_
+#undef SPS30_COMMAND_RESPONSE_WORDS_
+#undef SPS30_COMMAND_DELAY_USEC_
+#undef SPS30_COMMAND_MIN_FIRMWARE_
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_COMMANDS_H */
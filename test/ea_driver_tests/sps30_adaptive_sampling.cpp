@@ -0,0 +1,382 @@
+#include <adaptive_sampling.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <sps30_transport.hpp>
+
+using sps30::adaptive_reader;
+using sps30::adaptive_sampler;
+using clock_type = std::chrono::steady_clock;
+using std::chrono::seconds;
+
+namespace
+{
+using sampling_mode = adaptive_sampler::mode_t;
+
+sps30::sensor::measurement_t pm(float mc_2p5)
+{
+	sps30::sensor::measurement_t m = {};
+	m.mc_2p5 = mc_2p5;
+	return m;
+}
+
+// A sensor reporting a PM2.5 profile over time, which checks the order of power commands
+// and counts reads taken before the sensor settled
+struct profile_sensor
+{
+	std::function<float(double)> profile;
+	clock_type::time_point origin = clock_type::time_point() + std::chrono::hours(1);
+	clock_type::time_point now = origin;
+	clock_type::time_point started_at =
+		origin - sps30::NUM_CONCENTRATION_3000_200_SETTLING_TIME_USEC;
+	bool started = true;
+	bool sleeping = false;
+	uint32_t unsettled_reads = 0;
+	std::mt19937 rng{40};
+	std::normal_distribution<float> noise{0, 0.2f};
+
+	explicit profile_sensor(std::function<float(double)> p) : profile(std::move(p)) {}
+
+	double elapsed() const
+	{
+		return std::chrono::duration<double>(now - origin).count();
+	}
+
+	sps30::sensor::measurement_t read()
+	{
+		CHECK(started);
+		if(now - started_at < sps30::NUM_CONCENTRATION_3000_200_SETTLING_TIME_USEC)
+		{
+			unsettled_reads++;
+		}
+		return pm(std::max(0.0f, profile(elapsed()) + noise(rng)));
+	}
+
+	void start()
+	{
+		CHECK((!started && !sleeping));
+		started = true;
+		started_at = now;
+	}
+
+	void stop()
+	{
+		CHECK(started);
+		started = false;
+	}
+
+	sps30::transport::status_t sleep()
+	{
+		CHECK((!started && !sleeping));
+		sleeping = true;
+		return sps30::transport::status_t::OK;
+	}
+
+	sps30::transport::status_t wake()
+	{
+		CHECK(sleeping);
+		sleeping = false;
+		return sps30::transport::status_t::OK;
+	}
+};
+
+constexpr double DAY = 24 * 60 * 60;
+constexpr double SMOKE_START = DAY / 2;
+
+float stable(double)
+{
+	return 8;
+}
+
+float diurnal(double t)
+{
+	return static_cast<float>(12 + 6 * std::sin(2 * M_PI * t / DAY));
+}
+
+// Stable air until a plume arrives, ramping up over ten minutes and clearing over hours
+float smoke(double t)
+{
+	if(t < SMOKE_START)
+	{
+		return 8;
+	}
+	const double ramp = std::min(1.0, (t - SMOKE_START) / 600);
+	const double clearing = std::exp(-std::max(0.0, t - SMOKE_START - 600) / 3600);
+	return static_cast<float>(8 + 142 * ramp * clearing);
+}
+
+struct run_result_t
+{
+	uint32_t reads;
+	uint32_t transactions;
+	uint32_t power_cycles;
+	uint32_t unsettled_reads;
+	double energy_mj;
+	double average_current_ma;
+	// Time from the profile first reaching the event threshold to the first read seeing it,
+	// or NaN without an event. Noise can make it slightly negative.
+	double event_latency;
+};
+
+run_result_t simulate(float (*profile)(double), const adaptive_sampler::config_t& config,
+					  double duration)
+{
+	profile_sensor s(profile);
+	adaptive_reader<profile_sensor> reader(s, config, s.origin);
+	const auto end = s.origin + std::chrono::duration_cast<clock_type::duration>(
+									std::chrono::duration<double>(duration));
+	double event_seen = -1;
+
+	while(s.now < end)
+	{
+		if(reader.poll(s.now) && event_seen < 0 &&
+		   reader.sampler().mode() == sampling_mode::event)
+		{
+			event_seen = s.elapsed();
+		}
+		s.now = reader.next_wakeup();
+	}
+
+	double event_start = -1;
+	for(double t = 0; t < duration; t += 1)
+	{
+		if(profile(t) >= config.event_enter)
+		{
+			event_start = t;
+			break;
+		}
+	}
+
+	return {reader.reads(),
+			reader.energy().transactions(),
+			reader.power_cycles(),
+			s.unsettled_reads,
+			reader.energy().energy_mj(end),
+			reader.energy().average_current_ma(end),
+			event_start < 0 || event_seen < 0 ? NAN : event_seen - event_start};
+}
+
+adaptive_sampler::config_t fixed_rate()
+{
+	adaptive_sampler::config_t config;
+	config.max_interval = config.min_interval;
+	config.power_down_after = clock_type::duration::zero();
+	return config;
+}
+
+adaptive_sampler::config_t measuring()
+{
+	adaptive_sampler::config_t config;
+	config.power_down_after = clock_type::duration::zero();
+	return config;
+}
+} // namespace
+
+TEST_CASE("Quiet air backs off to the maximum interval", "[test/sps30_adaptive_sampling]")
+{
+	adaptive_sampler sampler;
+	auto t = clock_type::time_point();
+	std::vector<long> intervals;
+
+	for(int i = 0; i < 10; i++)
+	{
+		const auto next = sampler.observe(pm(8), t);
+		intervals.push_back(std::chrono::duration_cast<seconds>(next - t).count());
+		t = next;
+	}
+
+	CHECK(intervals == std::vector<long>{1, 2, 4, 8, 16, 32, 60, 60, 60, 60});
+	CHECK(sampler.mode() == sampling_mode::quiet);
+	CHECK(sampler.transitions() == 0);
+}
+
+TEST_CASE("Threshold crossings use hysteresis", "[test/sps30_adaptive_sampling]")
+{
+	adaptive_sampler::config_t config;
+	// Only the thresholds matter here
+	config.active_deviation = 1000;
+	config.quiet_deviation = 1000;
+	adaptive_sampler sampler(config);
+	auto t = clock_type::time_point();
+
+	for(int i = 0; i < 8; i++)
+	{
+		t = sampler.observe(pm(20), t);
+	}
+	CHECK(sampler.interval() == seconds(60));
+
+	// Crossing in resets to the minimum interval immediately
+	t = sampler.observe(pm(36), t);
+	CHECK(sampler.mode() == sampling_mode::event);
+	CHECK(sampler.interval() == seconds(1));
+
+	// Hovering inside the band neither ends the event nor slows sampling
+	for(float v : {30.0f, 35.0f, 26.0f, 34.0f, 25.0f})
+	{
+		t = sampler.observe(pm(v), t);
+		CHECK(sampler.mode() == sampling_mode::event);
+		CHECK(sampler.interval() == seconds(1));
+	}
+
+	t = sampler.observe(pm(24), t);
+	CHECK(sampler.mode() == sampling_mode::quiet);
+	CHECK(sampler.interval() == seconds(1));
+	t = sampler.observe(pm(30), t);
+	CHECK(sampler.mode() == sampling_mode::quiet);
+	CHECK(sampler.interval() == seconds(2));
+	CHECK(sampler.transitions() == 2);
+}
+
+TEST_CASE("Changing air is sampled at the full rate", "[test/sps30_adaptive_sampling]")
+{
+	adaptive_sampler sampler;
+	auto t = clock_type::time_point();
+
+	for(int i = 0; i < 10; i++)
+	{
+		t = sampler.observe(pm(5), t);
+	}
+	CHECK(sampler.mode() == sampling_mode::quiet);
+
+	// A step well below the event threshold still shows up in the deviation
+	t = sampler.observe(pm(15), t);
+	CHECK(sampler.mode() == sampling_mode::active);
+	CHECK(sampler.interval() == seconds(1));
+
+	// Once the level settles, the deviation decays through the hysteresis band
+	int active_reads = 0;
+	while(sampler.mode() == sampling_mode::active)
+	{
+		t = sampler.observe(pm(15), t);
+		active_reads++;
+	}
+	CHECK(active_reads > 5);
+	CHECK(sampler.deviation() < sampler.config().quiet_deviation);
+}
+
+TEST_CASE("Sensors power down after quiet air", "[test/sps30_adaptive_sampling]")
+{
+	adaptive_sampler sampler;
+	auto t = clock_type::time_point();
+	const auto start = t;
+
+	while(!sampler.power_down())
+	{
+		t = sampler.observe(pm(8), t);
+		REQUIRE(t - start < std::chrono::minutes(10));
+	}
+	CHECK(t - start >= sampler.config().power_down_after);
+
+	sampler.observe(pm(40), t);
+	CHECK_FALSE(sampler.power_down());
+
+	adaptive_sampler::config_t config;
+	config.power_down_after = clock_type::duration::zero();
+	adaptive_sampler always_on(config);
+	for(int i = 0; i < 1000; i++)
+	{
+		t = always_on.observe(pm(8), t);
+		CHECK_FALSE(always_on.power_down());
+	}
+}
+
+TEST_CASE("The reader sleeps and wakes the sensor", "[test/sps30_adaptive_sampling]")
+{
+	sps30::transport transport;
+	sps30::sensor s(transport);
+	s.probe();
+	s.start();
+
+	// The simulated measurements vary widely, so the full rate is expected until the
+	// thresholds are raised out of reach
+	adaptive_sampler::config_t config;
+	config.event_enter = config.event_exit = 1e6f;
+	config.active_deviation = config.quiet_deviation = 1e6f;
+	config.power_down_after = seconds(30);
+	auto now = clock_type::time_point();
+	adaptive_reader<> reader(s, config, now);
+
+	while(reader.power_cycles() < 3)
+	{
+		CHECK(reader.poll(now) != reader.powered_down());
+		now = reader.next_wakeup();
+	}
+	CHECK(reader.powered_down());
+
+	// The read after waking is one settling time after the restart
+	const auto wake = reader.next_wakeup();
+	CHECK_FALSE(reader.poll(wake));
+	CHECK_FALSE(reader.powered_down());
+	CHECK(reader.next_wakeup() - wake == sps30::NUM_CONCENTRATION_3000_200_SETTLING_TIME_USEC);
+	CHECK(reader.poll(reader.next_wakeup()));
+	CHECK(s.latest().timestamp != clock_type::time_point());
+
+	// Each power cycle is stop and sleep, then wake and start, unless it is still asleep
+	const uint32_t asleep = reader.powered_down() ? 1 : 0;
+	CHECK(reader.energy().transactions() ==
+		  reader.reads() + 4 * reader.power_cycles() - 2 * asleep);
+	if(asleep)
+	{
+		s.wake();
+	}
+	else
+	{
+		s.stop();
+	}
+}
+
+TEST_CASE("Adaptive sampling saves energy on simulated profiles", "[test/sps30_adaptive_sampling]")
+{
+	const auto baseline = simulate(smoke, fixed_rate(), DAY);
+	const auto adaptive = simulate(smoke, measuring(), DAY);
+	const auto duty_cycled = simulate(smoke, adaptive_sampler::config_t(), DAY);
+
+	CHECK(baseline.reads == DAY);
+	// Every sample is read during the plume, which takes hours to clear
+	CHECK(adaptive.reads < baseline.reads / 8);
+	CHECK(duty_cycled.reads <= adaptive.reads);
+	CHECK(adaptive.energy_mj == baseline.energy_mj);
+	CHECK(duty_cycled.energy_mj < baseline.energy_mj / 4);
+	CHECK(duty_cycled.power_cycles > 0);
+	CHECK(duty_cycled.unsettled_reads == 0);
+
+	// The plume is seen within one read interval
+	CHECK(std::fabs(baseline.event_latency) <= 2);
+	CHECK(adaptive.event_latency >= -2);
+	CHECK(adaptive.event_latency <= 60);
+	CHECK(duty_cycled.event_latency >= -2);
+	CHECK(duty_cycled.event_latency <= 60);
+	CHECK(std::isnan(simulate(stable, adaptive_sampler::config_t(), DAY).event_latency));
+}
+
+TEST_CASE("Benchmark adaptive sampling", "[.][benchmark][test/sps30_adaptive_sampling]")
+{
+	const struct
+	{
+		const char* name;
+		float (*profile)(double);
+	} profiles[] = {{"stable", stable}, {"diurnal", diurnal}, {"smoke", smoke}};
+	const struct
+	{
+		const char* name;
+		adaptive_sampler::config_t config;
+	} policies[] = {{"fixed 1 Hz", fixed_rate()},
+					{"adaptive", measuring()},
+					{"adaptive + sleep", adaptive_sampler::config_t()}};
+
+	printf("%-8s %-17s %9s %9s %12s %9s %10s %8s\n", "profile", "policy", "reads", "bus txns",
+		   "stored B", "energy J", "avg mA", "latency");
+	for(const auto& p : profiles)
+	{
+		for(const auto& policy : policies)
+		{
+			const auto r = simulate(p.profile, policy.config, DAY);
+			printf("%-8s %-17s %9u %9u %12zu %9.1f %10.2f %8.0f\n", p.name, policy.name, r.reads,
+				   r.transactions, r.reads * sizeof(sps30::sensor::sample_t), r.energy_mj / 1000,
+				   r.average_current_ma, r.event_latency);
+		}
+	}
+}
@@ -0,0 +1,445 @@
+#include <aqi.hpp>
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using sps30::aqi::pollutant_t;
+
+// Every breakpoint boundary is evaluated at compile time
+static_assert(sps30::aqi::index(0.0, pollutant_t::pm2_5) == 0, "");
+static_assert(sps30::aqi::index(9.0, pollutant_t::pm2_5) == 50, "");
+static_assert(sps30::aqi::index(9.1, pollutant_t::pm2_5) == 51, "");
+static_assert(sps30::aqi::index(35.4, pollutant_t::pm2_5) == 100, "");
+static_assert(sps30::aqi::index(35.5, pollutant_t::pm2_5) == 101, "");
+static_assert(sps30::aqi::index(325.4, pollutant_t::pm2_5) == 500, "");
+static_assert(sps30::aqi::index(54, pollutant_t::pm10) == 50, "");
+static_assert(sps30::aqi::index(55, pollutant_t::pm10) == 51, "");
+static_assert(sps30::aqi::index(604, pollutant_t::pm10) == 500, "");
+static_assert(sps30::aqi::truncate(35.49, pollutant_t::pm2_5) == 35.4, "");
+static_assert(sps30::aqi::truncate(154.9, pollutant_t::pm10) == 154, "");
+
+namespace
+{
+constexpr size_t HOURS = sps30::aqi::NOWCAST_HOURS;
+
+// The NowCast as written in the EPA's description: the hours are collected first, and
+// weights are powers of w.
+double reference_nowcast(const std::vector<double>& hourly, pollutant_t pollutant)
+{
+	std::vector<std::pair<size_t, double>> available;
+	for(size_t h = 0; h < hourly.size() && h < HOURS; h++)
+	{
+		if(!std::isnan(hourly[h]))
+		{
+			available.emplace_back(h, hourly[h]);
+		}
+	}
+
+	size_t recent = 0;
+	for(const auto& a : available)
+	{
+		recent += a.first < 3;
+	}
+	if(recent < 2)
+	{
+		return NAN;
+	}
+
+	double lo = available[0].second;
+	double hi = available[0].second;
+	for(const auto& a : available)
+	{
+		lo = std::min(lo, a.second);
+		hi = std::max(hi, a.second);
+	}
+
+	const double w = hi > 0 ? std::max(lo / hi, 0.5) : 1;
+	double sum = 0;
+	double weights = 0;
+	for(const auto& a : available)
+	{
+		sum += std::pow(w, a.first) * a.second;
+		weights += std::pow(w, a.first);
+	}
+
+	const double c = sum / weights;
+	return pollutant == pollutant_t::pm2_5 ? std::floor(c * 10) / 10 : std::floor(c);
+}
+
+int reference_index(double truncated, pollutant_t pollutant)
+{
+	const auto& table = sps30::aqi::breakpoints(pollutant);
+	for(size_t j = table.size(); j-- > 0;)
+	{
+		if(truncated >= table[j].c_low)
+		{
+			const auto& b = table[j];
+			return static_cast<int>(std::lround((b.i_high - b.i_low) / (b.c_high - b.c_low) *
+													(truncated - b.c_low) +
+												b.i_low));
+		}
+	}
+	return -1;
+}
+
+bool same(float a, float b)
+{
+	return (std::isnan(a) && std::isnan(b)) || a == b;
+}
+
+// A slowly drifting concentration with short smoke events
+struct simulated_sensor
+{
+	explicit simulated_sensor(uint32_t seed) : rng(seed) {}
+
+	std::pair<float, float> next()
+	{
+		level = std::max(1.0, level + step(rng));
+		if(event(rng))
+		{
+			plume = 200;
+		}
+		plume *= 0.99;
+		const double pm2_5 = level + plume;
+		return {static_cast<float>(pm2_5), static_cast<float>(pm2_5 * 1.4 + 3)};
+	}
+
+	std::mt19937 rng;
+	std::normal_distribution<double> step{0, 0.3};
+	std::bernoulli_distribution event{0.0005};
+	double level = 12;
+	double plume = 0;
+};
+} // namespace
+
+TEST_CASE("AQI follows the breakpoint tables", "[test/sps30_aqi]")
+{
+	CHECK(sps30::aqi::index(16.6, pollutant_t::pm2_5) == 65);
+	CHECK(sps30::aqi::index(35.9, pollutant_t::pm2_5) == 102);
+	CHECK(sps30::aqi::index(500, pollutant_t::pm2_5) == 848);
+	CHECK(sps30::aqi::index(100, pollutant_t::pm10) == 73);
+	CHECK(sps30::aqi::truncate(-3, pollutant_t::pm2_5) == 0);
+
+	for(auto pollutant : {pollutant_t::pm2_5, pollutant_t::pm10})
+	{
+		const double step = pollutant == pollutant_t::pm2_5 ? 0.1 : 1;
+		for(int i = 0; i < 7000; i++)
+		{
+			const double c = sps30::aqi::truncate(i * step, pollutant);
+			CHECK(sps30::aqi::index(c, pollutant) == reference_index(c, pollutant));
+		}
+	}
+}
+
+TEST_CASE("NowCast weights recent hours", "[test/sps30_aqi]")
+{
+	std::array<float, HOURS> hourly;
+	hourly.fill(NAN);
+
+	hourly[0] = 20;
+	hourly[1] = 10;
+	// w = 0.5: (20 + 0.5 * 10) / 1.5 = 16.67
+	CHECK(sps30::aqi::nowcast(hourly.data(), pollutant_t::pm2_5) == 16.6);
+	CHECK(sps30::aqi::nowcast(hourly.data(), pollutant_t::pm10) == 16);
+
+	hourly.fill(7.5f);
+	CHECK(sps30::aqi::nowcast(hourly.data(), pollutant_t::pm2_5) == 7.5);
+
+	hourly.fill(0);
+	CHECK(sps30::aqi::nowcast(hourly.data(), pollutant_t::pm2_5) == 0);
+}
+
+TEST_CASE("NowCast needs two of the three latest hours", "[test/sps30_aqi]")
+{
+	std::array<float, HOURS> hourly;
+	hourly.fill(5);
+
+	hourly[0] = NAN;
+	CHECK(sps30::aqi::nowcast(hourly.data(), pollutant_t::pm2_5) == 5);
+	hourly[2] = NAN;
+	CHECK(std::isnan(sps30::aqi::nowcast(hourly.data(), pollutant_t::pm2_5)));
+	hourly[0] = 5;
+	CHECK(sps30::aqi::nowcast(hourly.data(), pollutant_t::pm2_5) == 5);
+}
+
+TEST_CASE("NowCast matches the reference on random hours", "[test/sps30_aqi]")
+{
+	std::mt19937 rng(38);
+	std::lognormal_distribution<float> value(2.5f, 1.0f);
+	std::bernoulli_distribution missing(0.2);
+
+	for(int trial = 0; trial < 20000; trial++)
+	{
+		std::array<float, HOURS> hourly;
+		std::vector<double> reference(HOURS);
+		for(size_t h = 0; h < HOURS; h++)
+		{
+			hourly[h] = missing(rng) ? NAN : value(rng);
+			reference[h] = hourly[h];
+		}
+
+		for(auto pollutant : {pollutant_t::pm2_5, pollutant_t::pm10})
+		{
+			const double expected = reference_nowcast(reference, pollutant);
+			const double actual = sps30::aqi::nowcast(hourly.data(), pollutant);
+			REQUIRE(same(static_cast<float>(actual), static_cast<float>(expected)));
+			if(!std::isnan(actual))
+			{
+				REQUIRE(sps30::aqi::index(actual, pollutant) ==
+						reference_index(expected, pollutant));
+			}
+		}
+	}
+}
+
+TEST_CASE("The engine matches a recomputation from raw samples", "[test/sps30_aqi]")
+{
+	using namespace std::chrono;
+
+	// 40 hours of samples every 10 seconds, with an outage to leave hours missing
+	constexpr uint32_t MIN_SAMPLES = 180;
+	const auto start = steady_clock::time_point(hours(1000));
+	sps30::aqi::engine engine(MIN_SAMPLES);
+	simulated_sensor sensor(7);
+	std::vector<std::vector<std::pair<float, float>>> raw(1);
+	int64_t hour = 1000;
+	size_t compared = 0;
+
+	for(int64_t t = 0; t < 40 * 3600; t += 10)
+	{
+		const auto sample = sensor.next();
+		const bool outage = (t >= 20 * 3600 && t < 22 * 3600 + 1200) ||
+							(t >= 30 * 3600 && t < 30 * 3600 + 2700);
+		if(outage)
+		{
+			continue;
+		}
+
+		const auto time = start + seconds(t);
+		const int64_t sample_hour = duration_cast<hours>(time.time_since_epoch()).count();
+		if(sample_hour != hour)
+		{
+			raw.resize(raw.size() + static_cast<size_t>(sample_hour - hour));
+			hour = sample_hour;
+		}
+
+		sps30::sensor::sample_t s{};
+		s.measurement.mc_2p5 = sample.first;
+		s.measurement.mc_10p0 = sample.second;
+		s.timestamp = time;
+		engine.push(s);
+
+		if(raw.back().empty() && raw.size() > 1)
+		{
+			// The engine has just closed the previous hours; recompute from scratch
+			for(auto pollutant : {pollutant_t::pm2_5, pollutant_t::pm10})
+			{
+				std::vector<double> hourly;
+				for(size_t age = 0; age < HOURS && age + 1 < raw.size(); age++)
+				{
+					const auto& bucket = raw[raw.size() - 2 - age];
+					double sum = 0;
+					for(const auto& r : bucket)
+					{
+						sum += pollutant == pollutant_t::pm2_5 ? r.first : r.second;
+					}
+					hourly.push_back(bucket.size() >= MIN_SAMPLES
+										 ? static_cast<float>(sum / bucket.size())
+										 : NAN);
+					REQUIRE(same(engine.hourly(pollutant, age), static_cast<float>(hourly.back())));
+				}
+
+				const double expected = reference_nowcast(hourly, pollutant);
+				const auto& result = engine.result();
+				const float actual =
+					pollutant == pollutant_t::pm2_5 ? result.nowcast_pm2_5 : result.nowcast_pm10;
+				const int16_t index =
+					pollutant == pollutant_t::pm2_5 ? result.aqi_pm2_5 : result.aqi_pm10;
+				REQUIRE(same(actual, static_cast<float>(expected)));
+				REQUIRE(index == (std::isnan(expected) ? sps30::aqi::NO_INDEX
+													   : reference_index(expected, pollutant)));
+			}
+			compared++;
+		}
+
+		raw.back().push_back(sample);
+	}
+
+	CHECK(compared > 30);
+	const auto& result = engine.result();
+	CHECK(result.aqi == std::max(result.aqi_pm2_5, result.aqi_pm10));
+	CHECK(result.aqi != sps30::aqi::NO_INDEX);
+
+	engine.clear();
+	CHECK(engine.result().aqi == sps30::aqi::NO_INDEX);
+	CHECK(std::isnan(engine.hourly(pollutant_t::pm2_5, 0)));
+}
+
+TEST_CASE("The engine treats a long gap as missing hours", "[test/sps30_aqi]")
+{
+	using namespace std::chrono;
+	sps30::aqi::engine engine;
+	const auto start = steady_clock::time_point(hours(10));
+
+	engine.push(start, 50, 60);
+	engine.push(start + hours(1), 50, 60);
+	engine.push(start + hours(2), 50, 60);
+	CHECK(engine.result().nowcast_pm2_5 == 50);
+	CHECK(engine.result().aqi_pm2_5 == sps30::aqi::index(50, pollutant_t::pm2_5));
+	CHECK(engine.result().dominant == pollutant_t::pm2_5);
+
+	engine.push(start + hours(20), 50, 60);
+	CHECK(std::isnan(engine.result().nowcast_pm2_5));
+	CHECK(engine.result().aqi == sps30::aqi::NO_INDEX);
+	for(size_t age = 0; age < HOURS; age++)
+	{
+		CHECK(std::isnan(engine.hourly(pollutant_t::pm10, age)));
+	}
+}
+
+TEST_CASE("Batch NowCast matches the per-sensor computation", "[test/sps30_aqi]")
+{
+	std::mt19937 rng(4096);
+	std::lognormal_distribution<float> value(3.0f, 1.2f);
+	std::bernoulli_distribution missing(0.25);
+
+	for(size_t count : {0, 1, 2, 3, 5, 64, 1001})
+	{
+		std::vector<float> storage(HOURS * count);
+		std::array<const float*, HOURS> columns;
+		for(size_t h = 0; h < HOURS; h++)
+		{
+			columns[h] = &storage[h * count];
+			for(size_t s = 0; s < count; s++)
+			{
+				storage[h * count + s] = missing(rng) ? NAN : value(rng);
+			}
+		}
+
+		for(auto pollutant : {pollutant_t::pm2_5, pollutant_t::pm10})
+		{
+			std::vector<float> nowcasts(count);
+			std::vector<int16_t> indices(count);
+			sps30::aqi::nowcast_batch(columns.data(), count, pollutant, nowcasts.data(),
+									  indices.data());
+
+			for(size_t s = 0; s < count; s++)
+			{
+				float hourly[HOURS];
+				for(size_t h = 0; h < HOURS; h++)
+				{
+					hourly[h] = columns[h][s];
+				}
+				const double c = sps30::aqi::nowcast(hourly, pollutant);
+				REQUIRE(same(nowcasts[s], static_cast<float>(c)));
+				REQUIRE(indices[s] == (std::isnan(c) ? sps30::aqi::NO_INDEX
+													 : sps30::aqi::index(c, pollutant)));
+			}
+		}
+	}
+}
+
+TEST_CASE("Benchmark AQI", "[.][benchmark][test/sps30_aqi]")
+{
+	using namespace std::chrono;
+
+	// One day of 1 Hz samples, against recomputing 12 hours of raw samples every second
+	{
+		simulated_sensor sensor(1);
+		sps30::aqi::engine engine;
+		std::vector<std::pair<float, float>> samples(24 * 3600);
+		for(auto& s : samples)
+		{
+			s = sensor.next();
+		}
+
+		auto begin = steady_clock::now();
+		int64_t checksum = 0;
+		for(size_t t = 0; t < samples.size(); t++)
+		{
+			engine.push(steady_clock::time_point(seconds(t)), samples[t].first, samples[t].second);
+			checksum += engine.result().aqi;
+		}
+		const auto incremental = duration<double>(steady_clock::now() - begin);
+
+		begin = steady_clock::now();
+		constexpr size_t NAIVE_SECONDS = 600;
+		for(size_t t = samples.size() - NAIVE_SECONDS; t < samples.size(); t++)
+		{
+			std::vector<double> hourly;
+			for(size_t age = 0; age < HOURS; age++)
+			{
+				const size_t end = (t / 3600 - age) * 3600;
+				double sum = 0;
+				for(size_t i = end - 3600; i < end; i++)
+				{
+					sum += samples[i].first;
+				}
+				hourly.push_back(sum / 3600);
+			}
+			checksum += reference_index(reference_nowcast(hourly, pollutant_t::pm2_5),
+										pollutant_t::pm2_5);
+		}
+		const auto naive = duration<double>(steady_clock::now() - begin);
+
+		printf("aqi engine: %.1f ns/sample, naive recomputation %.1f us/sample (%lld)\n",
+			   incremental.count() / static_cast<double>(samples.size()) * 1e9,
+			   naive.count() / NAIVE_SECONDS * 1e6, static_cast<long long>(checksum));
+	}
+
+	// A fleet's hourly update
+	for(size_t count : {1000, 10000})
+	{
+		std::mt19937 rng(1);
+		std::lognormal_distribution<float> value(3.0f, 1.0f);
+		std::vector<float> storage(HOURS * count);
+		std::array<const float*, HOURS> columns;
+		for(size_t h = 0; h < HOURS; h++)
+		{
+			columns[h] = &storage[h * count];
+		}
+		for(auto& v : storage)
+		{
+			v = value(rng);
+		}
+		std::vector<float> nowcasts(count);
+		std::vector<int16_t> indices(count);
+		const size_t rounds = 10000000 / count;
+		int64_t checksum = 0;
+
+		auto begin = steady_clock::now();
+		for(size_t r = 0; r < rounds; r++)
+		{
+			for(size_t s = 0; s < count; s++)
+			{
+				float hourly[HOURS];
+				for(size_t h = 0; h < HOURS; h++)
+				{
+					hourly[h] = columns[h][s];
+				}
+				const double c = sps30::aqi::nowcast(hourly, pollutant_t::pm2_5);
+				indices[s] = sps30::aqi::index(c, pollutant_t::pm2_5);
+			}
+			checksum += indices[r % count];
+		}
+		const auto scalar = duration<double>(steady_clock::now() - begin);
+
+		begin = steady_clock::now();
+		for(size_t r = 0; r < rounds; r++)
+		{
+			sps30::aqi::nowcast_batch(columns.data(), count, pollutant_t::pm2_5, nowcasts.data(),
+									  indices.data());
+			checksum += indices[r % count];
+		}
+		const auto batch = duration<double>(steady_clock::now() - begin);
+
+		printf("aqi %5zu sensors: scalar %8.1f us, batch %8.1f us (%lld)\n", count,
+			   scalar.count() / static_cast<double>(rounds) * 1e6,
+			   batch.count() / static_cast<double>(rounds) * 1e6,
+			   static_cast<long long>(checksum));
+	}
+}
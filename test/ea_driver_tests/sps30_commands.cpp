@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <sps30_commands.hpp>
+#include <sps30_recorded_data.h>
+
+using namespace sps30;
+
+namespace
+{
+uint16_t recorded_opcode(const uint8_t* frame)
+{
+	return static_cast<uint16_t>((frame[0] << 8) | frame[1]);
+}
+} // namespace
+
+TEST_CASE("Command opcodes match frames recorded from a device", "[test/sps30_commands]")
+{
+	CHECK(describe(transport::SPS30_CMD_WAKE_UP).opcode == recorded_opcode(sps30_wakeup_command));
+	CHECK(describe(transport::SPS30_CMD_SLEEP).opcode == recorded_opcode(sps30_sleep_command));
+	CHECK(describe(transport::SPS30_CMD_RESET).opcode == recorded_opcode(sps30_reset_command));
+	CHECK(describe(transport::SPS30_CMD_GET_FIRMWARE_VERSION).opcode ==
+		  recorded_opcode(sps30_request_fw_ver));
+	CHECK(describe(transport::SPS30_CMD_READ_DEVICE_STATUS_REG).opcode ==
+		  recorded_opcode(sps30_request_device_status));
+	CHECK(describe(transport::SPS30_CMD_GET_DATA_READY).opcode ==
+		  recorded_opcode(sps30_request_data_ready));
+	CHECK(describe(transport::SPS30_CMD_AUTOCLEAN_INTERVAL).opcode ==
+		  recorded_opcode(sps30_request_fan_auto_cleaning_interval));
+	CHECK(describe(transport::SPS30_CMD_AUTOCLEAN_INTERVAL).opcode ==
+		  recorded_opcode(sps30_set_fan_auto_cleaning_interval_1));
+	CHECK(describe(transport::SPS30_CMD_START_MANUAL_FAN_CLEANING).opcode ==
+		  recorded_opcode(sps30_request_start_manual_fan_cleaning));
+	CHECK(describe(transport::SPS30_CMD_START_MEASUREMENT).opcode ==
+		  recorded_opcode(sps30_request_start_measurement));
+	CHECK(describe(transport::SPS30_CMD_START_MEASUREMENT_ARG).opcode ==
+		  recorded_opcode(sps30_request_start_measurement + 2));
+	CHECK(describe(transport::SPS30_CMD_STOP_MEASUREMENT).opcode ==
+		  recorded_opcode(sps30_request_stop_measurement));
+	CHECK(describe(transport::SPS30_CMD_GET_SERIAL).opcode ==
+		  recorded_opcode(sps30_request_serial_number));
+	CHECK(describe(transport::SPS30_CMD_READ_MEASUREMENT).opcode ==
+		  recorded_opcode(sps30_read_measurement_command));
+}
+
+TEST_CASE("Command frame sizes match frames recorded from a device", "[test/sps30_commands]")
+{
+	STATIC_REQUIRE(describe(transport::SPS30_CMD_START_MEASUREMENT).write_frame_bytes() ==
+				   sizeof(sps30_request_start_measurement));
+	STATIC_REQUIRE(describe(transport::SPS30_CMD_AUTOCLEAN_INTERVAL).write_frame_bytes() ==
+				   sizeof(sps30_set_fan_auto_cleaning_interval_1));
+	STATIC_REQUIRE(describe(transport::SPS30_CMD_STOP_MEASUREMENT).write_frame_bytes() ==
+				   sizeof(sps30_request_stop_measurement));
+
+	STATIC_REQUIRE(describe(transport::SPS30_CMD_GET_FIRMWARE_VERSION).read_frame_bytes() ==
+				   sizeof(sps30_fw_ver_response));
+	STATIC_REQUIRE(describe(transport::SPS30_CMD_READ_DEVICE_STATUS_REG).read_frame_bytes() ==
+				   sizeof(sps30_device_status_response_1));
+	STATIC_REQUIRE(describe(transport::SPS30_CMD_GET_DATA_READY).read_frame_bytes() ==
+				   sizeof(sps30_data_ready_response_1));
+	STATIC_REQUIRE(describe(transport::SPS30_CMD_AUTOCLEAN_INTERVAL).read_frame_bytes() ==
+				   sizeof(sps30_fan_auto_cleaning_interval_response_1));
+	STATIC_REQUIRE(describe(transport::SPS30_CMD_GET_SERIAL).read_frame_bytes() ==
+				   sizeof(sps30_serial_number_response));
+	STATIC_REQUIRE(describe(transport::SPS30_CMD_READ_MEASUREMENT).read_frame_bytes() ==
+				   sizeof(sps30_measurement_zero_particle_response));
+}
+
+TEST_CASE("Writing the auto-cleaning interval waits for flash", "[test/sps30_commands]")
+{
+	const auto& autoclean = describe(transport::SPS30_CMD_AUTOCLEAN_INTERVAL);
+	CHECK(autoclean.writes_flash);
+	CHECK(autoclean.write_delay() > autoclean.delay);
+	CHECK(describe(transport::SPS30_CMD_SLEEP).write_delay() ==
+		  describe(transport::SPS30_CMD_SLEEP).delay);
+	CHECK(describe(transport::SPS30_CMD_READ_DEVICE_STATUS_REG).firmware_major == 2);
+	CHECK(describe(transport::SPS30_CMD_READ_DEVICE_STATUS_REG).firmware_minor == 2);
+}
+
+TEST_CASE("Constant command frames match frames recorded from a device", "[test/sps30_commands]")
+{
+	const auto matches = [](const auto& frame, const uint8_t* recorded) {
+		return std::equal(frame.begin(), frame.end(), recorded);
+	};
+
+	CHECK(matches(frames::START_MEASUREMENT, sps30_request_start_measurement));
+	CHECK(matches(frames::STOP_MEASUREMENT, sps30_request_stop_measurement));
+	CHECK(matches(frames::READ_MEASUREMENT, sps30_read_measurement_command));
+	CHECK(matches(frames::GET_DATA_READY, sps30_request_data_ready));
+	CHECK(matches(frames::SLEEP, sps30_sleep_command));
+	CHECK(matches(frames::WAKE_UP, sps30_wakeup_command));
+	CHECK(matches(frames::RESET, sps30_reset_command));
+	CHECK(matches(frames::READ_DEVICE_STATUS_REG, sps30_request_device_status));
+
+	// The frame builder computes argument CRCs at compile time
+	STATIC_REQUIRE(frames::START_MEASUREMENT_UINT16.size() ==
+				   sizeof(sps30_request_start_measurement));
+	STATIC_REQUIRE(frames::START_MEASUREMENT_UINT16[4] == crc8(SPS30_START_MEASUREMENT_ARG_UINT16));
+	STATIC_REQUIRE(make_frame(transport::SPS30_CMD_AUTOCLEAN_INTERVAL, {0x0009, 0x3a80})[7] ==
+				   crc8(0x3a80));
+}
+
+TEST_CASE("Payload bytes are reordered between host and bus byte order", "[test/sps30_commands]")
+{
+	// On a little-endian host, the bytes of each value are reversed
+	STATIC_REQUIRE(bus_byte(0, sizeof(uint32_t)) == (HOST_BIG_ENDIAN ? 0 : 3));
+	STATIC_REQUIRE(bus_byte(5, sizeof(uint32_t)) == (HOST_BIG_ENDIAN ? 5 : 6));
+	STATIC_REQUIRE(bus_byte(1, sizeof(uint16_t)) == (HOST_BIG_ENDIAN ? 1 : 0));
+	// Byte strings keep their order
+	STATIC_REQUIRE(bus_byte(5, 1) == 5);
+}
+
+TEST_CASE("Receive frames are decoded straight into scattered buffers", "[test/sps30_commands]")
+{
+	using frame_t = rx_frame_t<transport::SPS30_CMD_READ_MEASUREMENT>;
+	STATIC_REQUIRE(alignof(frame_t) == SENSIRION_CACHE_LINE_SIZE);
+	STATIC_REQUIRE(sizeof(frame_t) % SENSIRION_CACHE_LINE_SIZE == 0);
+	STATIC_REQUIRE(frame_t::FRAME_BYTES == sizeof(sps30_measurement_low_particle_response_1));
+
+	frame_t rx;
+	auto frame = rx.frame();
+	REQUIRE(frame.length == frame_t::FRAME_BYTES);
+	std::copy_n(sps30_measurement_low_particle_response_1, frame.length, frame.data);
+
+	// The mass concentrations and the rest of the response go to separate buffers, as floats
+	// in host byte order
+	float mass[4] = {};
+	float rest[6] = {};
+	const transport::rx_span_t iov[] = {{reinterpret_cast<uint8_t*>(mass), sizeof(mass)},
+										{reinterpret_cast<uint8_t*>(rest), sizeof(rest)}};
+	REQUIRE(rx.unpack(iov, 2) == transport::status_t::OK);
+
+	CHECK(mass[0] == 0.1628956050f);
+	CHECK(mass[1] == 0.2644746304f);
+	CHECK(mass[2] == 0.3391090930f);
+	CHECK(mass[3] == 0.3540358543f);
+	CHECK(rest[0] == 0.8901749253f);
+	CHECK(rest[5] == 0.7204053998f);
+
+	// A damaged word stores nothing
+	uint8_t untouched[16] = {};
+	const transport::rx_span_t damaged_iov[] = {{untouched, sizeof(untouched)}};
+	rx.bytes[SPS30_FRAME_BYTES(7)] ^= 1;
+	CHECK(rx.unpack(damaged_iov, 1) == transport::status_t::BUS_ERROR);
+	CHECK(std::all_of(std::begin(untouched), std::end(untouched),
+					  [](const uint8_t b) { return b == 0; }));
+}
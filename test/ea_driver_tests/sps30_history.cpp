@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <history.hpp>
+#include <random>
+#include <vector>
+
+namespace
+{
+sps30::sensor::measurement_t random_measurement(std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> dist(0.0f, 1000.0f);
+	sps30::sensor::measurement_t m;
+	for(auto field : sps30::measurement_fields)
+	{
+		m.*field = dist(rng);
+	}
+	return m;
+}
+} // namespace
+
+TEST_CASE("Empty history reports no samples", "[test/sps30_history]")
+{
+	sps30::history<8, 2> h({4, 8});
+
+	CHECK(h.size() == 0);
+	CHECK(h.statistics(0).count == 0);
+	CHECK(h.statistics(1).mean.mc_2p5 == 0.0f);
+}
+
+TEST_CASE("History matches brute force window statistics", "[test/sps30_history]")
+{
+	constexpr size_t CAPACITY = 64;
+	constexpr std::array<size_t, 3> WINDOWS = {1, 17, CAPACITY};
+
+	sps30::history<CAPACITY, WINDOWS.size()> h(WINDOWS);
+	std::vector<sps30::sensor::measurement_t> all;
+	std::mt19937 rng(1234);
+
+	for(size_t n = 0; n < 5 * CAPACITY; n++)
+	{
+		auto m = random_measurement(rng);
+		h.push(m);
+		all.push_back(m);
+
+		CHECK(h.size() == std::min(all.size(), CAPACITY));
+		CHECK(h.at(0).mc_1p0 == m.mc_1p0);
+
+		for(size_t w = 0; w < WINDOWS.size(); w++)
+		{
+			auto stats = h.statistics(w);
+			const size_t count = std::min(all.size(), WINDOWS[w]);
+			REQUIRE(stats.count == count);
+
+			for(auto field : sps30::measurement_fields)
+			{
+				double sum = 0;
+				float lo = all.back().*field;
+				float hi = lo;
+				for(size_t i = all.size() - count; i < all.size(); i++)
+				{
+					sum += all[i].*field;
+					lo = std::min(lo, all[i].*field);
+					hi = std::max(hi, all[i].*field);
+				}
+
+				CHECK(stats.min.*field == lo);
+				CHECK(stats.max.*field == hi);
+				CHECK(std::fabs(stats.mean.*field - sum / count) < 1e-3);
+			}
+		}
+	}
+}
+
+TEST_CASE("Clearing the history resets all windows", "[test/sps30_history]")
+{
+	sps30::history<4, 1> h({4});
+	std::mt19937 rng(42);
+
+	for(int i = 0; i < 6; i++)
+	{
+		h.push(random_measurement(rng));
+	}
+	h.clear();
+	CHECK(h.size() == 0);
+
+	sps30::sensor::measurement_t m = {};
+	m.mc_10p0 = 7.0f;
+	h.push(m);
+	auto stats = h.statistics(0);
+	CHECK(stats.count == 1);
+	CHECK(stats.mean.mc_10p0 == 7.0f);
+	CHECK(stats.min.mc_10p0 == 7.0f);
+	CHECK(stats.max.mc_10p0 == 7.0f);
+}
+
+TEST_CASE("Benchmark history push", "[.][benchmark][test/sps30_history]")
+{
+	// 15 minutes of 1 Hz samples, with 1 minute and 15 minute windows
+	static sps30::history<900, 2> h({60, 900});
+	constexpr size_t ITERATIONS = 1000000;
+
+	std::mt19937 rng(7);
+	std::vector<sps30::sensor::measurement_t> input(1024);
+	for(auto& m : input)
+	{
+		m = random_measurement(rng);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < ITERATIONS; i++)
+	{
+		h.push(input[i % input.size()]);
+	}
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+	printf("history<900, 2>: %zu bytes, %.1f ns/push, pm2.5 1 min mean %f\n", sizeof(h),
+		   elapsed.count() * 1e9 / ITERATIONS, static_cast<double>(h.statistics(0).mean.mc_2p5));
+}
@@ -0,0 +1,164 @@
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdio>
+#include <driver.hpp>
+#include <seqlock.hpp>
+#include <sps30_transport.hpp>
+#include <thread>
+#include <vector>
+
+namespace
+{
+/// A payload where every field carries the same value, so torn reads are detectable
+struct stamped_t
+{
+	uint32_t values[12];
+};
+
+stamped_t make_stamped(uint32_t v)
+{
+	stamped_t s;
+	for(auto& value : s.values)
+	{
+		value = v;
+	}
+	return s;
+}
+
+bool is_consistent(const stamped_t& s)
+{
+	for(auto value : s.values)
+	{
+		if(value != s.values[0])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+} // namespace
+
+TEST_CASE("Latest sample is empty before the first read", "[test/sps30]")
+{
+	sps30::transport t;
+	sps30::sensor s(t);
+
+	auto sample = s.latest();
+	CHECK(sample.timestamp == std::chrono::steady_clock::time_point{});
+}
+
+TEST_CASE("Latest sample tracks read()", "[test/sps30]")
+{
+	sps30::transport t;
+	sps30::sensor s(t);
+
+	s.probe();
+	s.start();
+
+	for(int i = 0; i < 3; i++)
+	{
+		auto m = s.read();
+		auto sample = s.latest();
+
+		CHECK(sample.timestamp != std::chrono::steady_clock::time_point{});
+		CHECK(sample.measurement.mc_2p5 == m.mc_2p5);
+		CHECK(sample.measurement.nc_10p0 == m.nc_10p0);
+		CHECK(sample.measurement.typical_particle_size == m.typical_particle_size);
+	}
+
+	s.stop();
+}
+
+TEST_CASE("Seqlock readers never observe torn values", "[test/sps30]")
+{
+	constexpr uint32_t WRITES = 200000;
+	constexpr size_t READERS = 4;
+
+	sps30::seqlock<stamped_t> lock;
+	std::atomic<bool> done{false};
+	std::atomic<uint32_t> torn_reads{0};
+	std::vector<std::thread> readers;
+
+	for(size_t i = 0; i < READERS; i++)
+	{
+		readers.emplace_back([&]() {
+			while(!done.load(std::memory_order_relaxed))
+			{
+				if(!is_consistent(lock.load()))
+				{
+					torn_reads++;
+				}
+			}
+		});
+	}
+
+	for(uint32_t i = 1; i <= WRITES; i++)
+	{
+		lock.store(make_stamped(i));
+	}
+
+	done = true;
+	for(auto& reader : readers)
+	{
+		reader.join();
+	}
+
+	CHECK(torn_reads == 0);
+	CHECK(lock.sequence() == WRITES);
+	CHECK(lock.load().values[0] == WRITES);
+}
+
+TEST_CASE("Benchmark latest() reader throughput", "[.][benchmark][test/sps30]")
+{
+	constexpr auto RUN_TIME = std::chrono::milliseconds(250);
+
+	sps30::transport t;
+	sps30::sensor s(t);
+	s.probe();
+	s.start();
+
+	for(size_t reader_count : {1, 2, 4, 8, 16})
+	{
+		std::atomic<bool> done{false};
+		std::atomic<uint64_t> total_reads{0};
+		uint64_t total_writes = 0;
+		std::vector<std::thread> readers;
+
+		for(size_t i = 0; i < reader_count; i++)
+		{
+			readers.emplace_back([&]() {
+				uint64_t reads = 0;
+				while(!done.load(std::memory_order_relaxed))
+				{
+					auto sample = s.latest();
+					(void)sample;
+					reads++;
+				}
+				total_reads += reads;
+			});
+		}
+
+		// The acquisition thread updates as fast as possible, far faster than the 1 Hz
+		// sensor rate, to stress the retry path.
+		auto end = std::chrono::steady_clock::now() + RUN_TIME;
+		while(std::chrono::steady_clock::now() < end)
+		{
+			s.read();
+			total_writes++;
+		}
+
+		done = true;
+		for(auto& reader : readers)
+		{
+			reader.join();
+		}
+
+		auto seconds = std::chrono::duration<double>(RUN_TIME).count();
+		printf("latest(): %2zu readers, %12.0f reads/s total, %12.0f writes/s\n", reader_count,
+			   static_cast<double>(total_reads) / seconds,
+			   static_cast<double>(total_writes) / seconds);
+	}
+
+	s.stop();
+}
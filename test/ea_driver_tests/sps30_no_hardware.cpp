@@ -42,3 +42,196 @@ TEST_CASE("Probe, then set auto clean interval", "[test/sps30]")
 	CHECK(new_duration == FOUR_HOURS_IN_SEC);
 	CHECK(s.autoCleanInterval() == FOUR_HOURS_IN_SEC);
 }
+
+TEST_CASE("The next transfer waits for an auto clean interval to be written to flash",
+		  "[test/sps30]")
+{
+	sps30::transport t;
+	sps30::sensor s(t);
+	s.probe();
+	const auto original = s.autoCleanInterval();
+	const auto write_delay =
+		sps30::describe(sps30::transport::SPS30_CMD_AUTOCLEAN_INTERVAL).write_delay();
+
+	const auto written = std::chrono::steady_clock::now();
+	s.autoCleanInterval(FOUR_HOURS_IN_SEC);
+	s.start();
+	CHECK(std::chrono::steady_clock::now() - written >= write_delay);
+	s.stop();
+
+	// The test transport is shared with other tests
+	s.autoCleanInterval(original);
+}
+
+TEST_CASE("Capabilities follow the firmware version", "[test/sps30]")
+{
+	auto c = sps30::sensor::capabilities({1, 0});
+	CHECK_FALSE(c.sleep);
+	CHECK_FALSE(c.device_status);
+	CHECK_FALSE(c.current_autoclean_interval);
+
+	c = sps30::sensor::capabilities({2, 1});
+	CHECK(c.sleep);
+	CHECK_FALSE(c.device_status);
+	CHECK_FALSE(c.current_autoclean_interval);
+
+	c = sps30::sensor::capabilities({2, 2});
+	CHECK(c.sleep);
+	CHECK(c.device_status);
+	CHECK(c.current_autoclean_interval);
+
+	CHECK(sps30::sensor::capabilities({3, 0}).device_status);
+}
+
+TEST_CASE("Unsupported commands fail without a transaction", "[test/sps30]")
+{
+	sps30::transport t;
+	sps30::sensor s(t);
+	s.probe();
+
+	// The test transport reports firmware 2.1, and does not handle the status register
+	REQUIRE_FALSE(s.supports(sps30::transport::SPS30_CMD_READ_DEVICE_STATUS_REG));
+	uint32_t flags = 0xffffffff;
+	CHECK(s.deviceStatus(flags) ==
+		  sps30::transport::status_t::SENSOR_FIRWMARE_DOES_NOT_SUPPORT_COMMAND);
+	CHECK(flags == 0xffffffff);
+	CHECK(s.gatingStats().rejected == 1);
+
+	CHECK(s.sleep() == sps30::transport::status_t::OK);
+	CHECK(s.wake() == sps30::transport::status_t::OK);
+	CHECK(s.gatingStats().rejected == 1);
+}
+
+TEST_CASE("A stale auto clean interval is refreshed with a reset", "[test/sps30]")
+{
+	sps30::transport t;
+	sps30::sensor s(t);
+	s.probe();
+	REQUIRE_FALSE(s.capabilities().current_autoclean_interval);
+	const auto original = s.refreshAutoCleanInterval();
+	CHECK(s.gatingStats().resets_skipped == 1);
+
+	// Without a reset, the test transport reports the old interval, like firmware 2.1
+	s.autoCleanInterval(FOUR_HOURS_IN_SEC);
+	CHECK(s.refreshAutoCleanInterval() == FOUR_HOURS_IN_SEC);
+	CHECK(s.gatingStats().resets_skipped == 1);
+
+	// Once the sensor was reset, the interval is read without another
+	CHECK(s.refreshAutoCleanInterval() == FOUR_HOURS_IN_SEC);
+	CHECK(s.gatingStats().resets_skipped == 2);
+
+	// The test transport is shared with other tests
+	s.autoCleanInterval(original);
+	CHECK(s.refreshAutoCleanInterval() == original);
+}
+
+TEST_CASE("A reset while measuring stops the sensor", "[test/sps30]")
+{
+	sps30::transport t;
+	sps30::sensor s(t);
+	s.probe();
+	s.start();
+	s.read();
+
+	SECTION("reset()")
+	{
+		s.reset();
+	}
+
+	SECTION("refreshAutoCleanInterval() on a stale interval")
+	{
+		const auto original = s.autoCleanInterval();
+		s.autoCleanInterval(FOUR_HOURS_IN_SEC);
+		CHECK(s.refreshAutoCleanInterval() == FOUR_HOURS_IN_SEC);
+
+		// The test transport is shared with other tests
+		s.autoCleanInterval(original);
+	}
+
+	// Sleep is only accepted once the driver knows the sensor stopped measuring
+	CHECK(s.sleep() == sps30::transport::status_t::OK);
+	CHECK(s.wake() == sps30::transport::status_t::OK);
+
+	// Measurement resumes once it is started again
+	s.start();
+	CHECK(s.read().typical_particle_size > 0.0f);
+	s.stop();
+}
+
+TEST_CASE("A sensor left measuring is adopted without being started", "[test/sps30]")
+{
+	sps30::transport t;
+	sps30::sensor::probe_info_t cached;
+	{
+		// A previous run starts the sensor and exits without stopping it
+		sps30::sensor previous(t);
+		previous.probe();
+		previous.start();
+		cached = previous.probeInfo();
+	}
+
+	sps30::sensor s(t);
+	REQUIRE(s.resume(cached));
+	CHECK(s.dataReady());
+	CHECK(s.read().typical_particle_size > 0.0f);
+	s.stop();
+
+	// A stopped sensor is probed, but left for start()
+	sps30::sensor idle(t);
+	CHECK_FALSE(idle.resume(cached));
+	CHECK(idle.sleep() == sps30::transport::status_t::OK);
+	CHECK(idle.wake() == sps30::transport::status_t::OK);
+}
+
+TEST_CASE("Scripts run their steps back-to-back", "[test/sps30]")
+{
+	using command_t = sps30::transport::command_t;
+	const uint16_t output_format = 0x0300;
+	sps30::sensor::measurement_t measurement = {};
+	uint16_t version = 0;
+
+	sps30::transport t;
+	sps30::transport::script<5> s;
+	s.read(command_t::SPS30_CMD_GET_FIRMWARE_VERSION, reinterpret_cast<uint8_t*>(&version),
+		   sizeof(version))
+		.write(command_t::SPS30_CMD_START_MEASUREMENT,
+			   reinterpret_cast<const uint8_t*>(&output_format), sizeof(output_format))
+		.delay(std::chrono::microseconds(100))
+		.read(command_t::SPS30_CMD_READ_MEASUREMENT, reinterpret_cast<uint8_t*>(&measurement),
+			  sizeof(measurement))
+		.write(command_t::SPS30_CMD_STOP_MEASUREMENT);
+	REQUIRE(s.size() == 5);
+	CHECK(s.steps()[2].kind == sps30::transport::step_t::DELAY);
+
+	// Responses land in the buffers given when the script was built
+	CHECK(t.run(s) == sps30::transport::status_t::OK);
+	CHECK(version != 0);
+	CHECK(measurement.typical_particle_size > 0.0f);
+}
+
+TEST_CASE("Reads scatter and writes gather across buffers", "[test/sps30]")
+{
+	using command_t = sps30::transport::command_t;
+	sps30::transport t;
+
+	// The bytes of the output format word are sent from separate buffers
+	const uint16_t format = 0x0300;
+	const auto* const format_bytes = reinterpret_cast<const uint8_t*>(&format);
+	const sps30::transport::tx_span_t args[] = {{format_bytes, 1}, {format_bytes + 1, 1}};
+	REQUIRE(t.writev(command_t::SPS30_CMD_START_MEASUREMENT, args, 2) ==
+			sps30::transport::status_t::OK);
+
+	// The mass concentrations and the rest of the measurement land in separate buffers
+	float mass[4] = {};
+	float rest[6] = {};
+	const sps30::transport::rx_span_t iov[] = {
+		{reinterpret_cast<uint8_t*>(mass), sizeof(mass)},
+		{reinterpret_cast<uint8_t*>(rest), sizeof(rest)},
+	};
+	CHECK(t.readv(command_t::SPS30_CMD_READ_MEASUREMENT, iov, 2) ==
+		  sps30::transport::status_t::OK);
+	CHECK(rest[5] > 0.0f); // the typical particle size
+
+	CHECK(t.write(command_t::SPS30_CMD_STOP_MEASUREMENT, nullptr, 0) ==
+		  sps30::transport::status_t::OK);
+}
@@ -0,0 +1,275 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <power_manager.hpp>
+#include <sps30_transport.hpp>
+#include <string>
+
+using clock_type = std::chrono::steady_clock;
+using std::chrono::seconds;
+
+namespace
+{
+constexpr auto SETTLING = sps30::NUM_CONCENTRATION_3000_200_SETTLING_TIME_USEC;
+
+// Records the power commands and checks their order, as the sensor would
+struct logging_sensor
+{
+	clock_type::time_point now;
+	clock_type::time_point started_at;
+	bool started = false;
+	bool sleeping = false;
+	/// Firmware older than 2.0 has no sleep mode
+	bool sleep_supported = true;
+	uint32_t unsettled_reads = 0;
+	std::string log;
+
+	sps30::sensor::measurement_t read()
+	{
+		CHECK(started);
+		if(now - started_at < SETTLING)
+		{
+			unsettled_reads++;
+		}
+		log += 'r';
+		return {};
+	}
+
+	void start()
+	{
+		CHECK((!started && !sleeping));
+		started = true;
+		started_at = now;
+		log += '>';
+	}
+
+	void stop()
+	{
+		CHECK(started);
+		started = false;
+		log += '|';
+	}
+
+	sps30::transport::status_t sleep()
+	{
+		CHECK((!started && !sleeping));
+		if(!sleep_supported)
+		{
+			return sps30::transport::status_t::SENSOR_FIRWMARE_DOES_NOT_SUPPORT_COMMAND;
+		}
+		sleeping = true;
+		log += 'z';
+		return sps30::transport::status_t::OK;
+	}
+
+	sps30::transport::status_t wake()
+	{
+		CHECK(sleeping);
+		sleeping = false;
+		log += 'w';
+		return sps30::transport::status_t::OK;
+	}
+};
+
+using manager = sps30::power_manager<logging_sensor>;
+
+// Run until cycles are complete, stepping straight to each wakeup
+template<typename Manager, typename Sensor>
+void run(Manager& m, Sensor& s, uint32_t cycles, std::vector<typename Manager::sample_t>* samples)
+{
+	while(m.cycles() < cycles)
+	{
+		s.now = m.next_wakeup();
+		typename Manager::sample_t sample;
+		if(m.poll(s.now, &sample) && samples)
+		{
+			samples->push_back(sample);
+		}
+	}
+}
+
+bool near(double a, double b)
+{
+	return std::fabs(a - b) <= 1e-9 * std::fabs(b);
+}
+} // namespace
+
+TEST_CASE("The power manager reads only after settling", "[test/sps30_power_manager]")
+{
+	logging_sensor s;
+	manager::config_t config;
+	config.period = seconds(60);
+	config.samples = 3;
+	manager m(s, config, s.now);
+	const auto origin = s.now;
+	std::vector<manager::sample_t> samples;
+
+	run(m, s, 3, &samples);
+
+	CHECK(s.log == ">rrr|zw>rrr|zw>rrr|z");
+	CHECK(s.unsettled_reads == 0);
+	REQUIRE(samples.size() == 9);
+	for(size_t i = 0; i < samples.size(); i++)
+	{
+		CHECK(samples[i].valid);
+		const auto expected = origin + SETTLING + (i / 3) * seconds(60) + (i % 3) * seconds(1);
+		CHECK(samples[i].timestamp == expected);
+	}
+
+	// The sensor sleeps until one settling time before the next cycle's first read
+	CHECK_FALSE(m.measuring());
+	CHECK(m.next_wakeup() == origin + SETTLING + seconds(180) - SETTLING);
+	CHECK(m.last_cycle().valid_samples == 3);
+	CHECK(m.last_cycle().invalid_samples == 0);
+	CHECK(m.last_cycle().transactions == 7);
+}
+
+TEST_CASE("Reads during settling are tagged invalid", "[test/sps30_power_manager]")
+{
+	logging_sensor s;
+	manager::config_t config;
+	config.period = seconds(30);
+	config.samples = 2;
+	config.settling_reads = true;
+	manager m(s, config, s.now);
+	std::vector<manager::sample_t> samples;
+
+	run(m, s, 2, &samples);
+
+	const auto settling_reads = static_cast<size_t>(SETTLING / seconds(1));
+	REQUIRE(samples.size() == 2 * (settling_reads + 2));
+	for(size_t i = 0; i < samples.size(); i++)
+	{
+		CHECK(samples[i].valid == (i % (settling_reads + 2) >= settling_reads));
+	}
+	CHECK(s.unsettled_reads == 2 * settling_reads);
+	CHECK(m.last_cycle().invalid_samples == settling_reads);
+	CHECK(m.last_cycle().valid_samples == 2);
+
+	// A late poll moves the cycle, rather than counting an unsettled read as valid
+	logging_sensor late;
+	config.settling_reads = false;
+	manager l(late, config, late.now);
+	late.now += seconds(5);
+	CHECK_FALSE(l.poll(late.now));
+	CHECK(l.next_wakeup() == late.now + SETTLING);
+	run(l, late, 1, nullptr);
+	CHECK(late.unsettled_reads == 0);
+}
+
+TEST_CASE("Sensors without sleep mode idle between cycles", "[test/sps30_power_manager]")
+{
+	logging_sensor s;
+	s.sleep_supported = false;
+	manager::config_t config;
+	config.period = seconds(60);
+	config.samples = 3;
+	manager m(s, config, s.now);
+
+	run(m, s, 2, nullptr);
+
+	CHECK(s.log == ">rrr|>rrr|");
+	CHECK(m.last_cycle().transactions == 5);
+	CHECK(m.last_cycle().durations[2] == clock_type::duration::zero());
+}
+
+TEST_CASE("Short periods keep the sensor measuring", "[test/sps30_power_manager]")
+{
+	logging_sensor s;
+	manager::config_t config;
+	config.period = seconds(5);
+	config.samples = 2;
+	manager m(s, config, s.now);
+	CHECK(m.continuous());
+
+	run(m, s, 4, nullptr);
+
+	CHECK(s.log == ">rrrrrrrr");
+	CHECK(m.measuring());
+	CHECK(m.last_cycle().average_current_ma == sps30::SUPPLY_CURRENT_MA[0]);
+	CHECK(m.last_cycle().durations[0] == seconds(5));
+}
+
+TEST_CASE("Cycle energy follows the datasheet currents", "[test/sps30_power_manager]")
+{
+	for(bool sleep : {true, false})
+	{
+		logging_sensor s;
+		manager::config_t config;
+		config.period = std::chrono::minutes(10);
+		config.samples = 3;
+		config.sleep = sleep;
+		manager m(s, config, s.now);
+
+		run(m, s, 4, nullptr);
+
+		const auto& report = m.last_cycle();
+		const auto on = manager::on_time(config);
+		CHECK(on == seconds(10));
+		CHECK(report.durations[0] == on);
+		CHECK(report.durations[sleep ? 2 : 1] == config.period - on);
+		CHECK(report.durations[sleep ? 1 : 2] == clock_type::duration::zero());
+		CHECK(near(report.average_current_ma, manager::expected_average_current_ma(config)));
+		CHECK(near(report.energy_mj, report.average_current_ma * sps30::SUPPLY_VOLTAGE_V * 600));
+	}
+
+	manager::config_t config;
+	config.period = std::chrono::minutes(10);
+	CHECK(near(manager::expected_average_current_ma(config), (55.0 * 10 + 0.038 * 590) / 600));
+}
+
+TEST_CASE("The power manager drives the sensor", "[test/sps30_power_manager]")
+{
+	sps30::transport t;
+	sps30::sensor s(t);
+	s.probe();
+
+	sps30::power_manager<>::config_t config;
+	config.period = seconds(20);
+	config.settling_reads = true;
+	auto now = clock_type::time_point();
+	sps30::power_manager<> m(s, config, now);
+
+	while(m.cycles() < 3)
+	{
+		now = m.next_wakeup();
+		m.poll(now);
+	}
+	CHECK(m.last_cycle().valid_samples == config.samples);
+	CHECK(s.latest().timestamp != clock_type::time_point());
+
+	// The sensor is left asleep; the test transport is shared with other tests
+	CHECK_FALSE(m.measuring());
+	s.wake();
+}
+
+TEST_CASE("Benchmark duty cycles", "[.][benchmark][test/sps30_power_manager]")
+{
+	// A 2000 mAh cell
+	constexpr double CAPACITY_MAH = 2000;
+	printf("%8s %3s %6s %12s %10s %14s\n", "period", "K", "off", "mJ / cycle", "avg mA",
+		   "battery days");
+	for(auto period : {seconds(10), seconds(60), seconds(300), seconds(900), seconds(3600)})
+	{
+		for(uint32_t samples : {1u, 3u, 10u})
+		{
+			for(bool sleep : {false, true})
+			{
+				logging_sensor s;
+				manager::config_t config;
+				config.period = period;
+				config.samples = samples;
+				config.sleep = sleep;
+				manager m(s, config, s.now);
+				run(m, s, 3, nullptr);
+
+				const auto& report = m.last_cycle();
+				printf("%7llds %3u %6s %12.1f %10.3f %14.1f\n",
+					   static_cast<long long>(period.count()), samples,
+					   m.continuous() ? "-" : (sleep ? "sleep" : "idle"), report.energy_mj,
+					   report.average_current_ma, CAPACITY_MAH / report.average_current_ma / 24);
+			}
+		}
+	}
+}
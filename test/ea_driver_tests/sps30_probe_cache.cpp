@@ -0,0 +1,130 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <probe_cache.hpp>
+#include <sps30_transport.hpp>
+#include <string>
+
+namespace
+{
+// Counts the values read from the bus when probing
+struct counting_sensor
+{
+	std::string serial = "A1B2C3D4";
+	uint32_t reads = 0;
+	sps30::sensor::probe_info_t info = {};
+
+	bool probe()
+	{
+		reads += 3;
+		snprintf(info.serial, sizeof(info.serial), "%s", serial.c_str());
+		info.version = {2, 2};
+		info.autoclean_interval = std::chrono::duration<uint32_t>(604800);
+		return true;
+	}
+
+	bool probe(const sps30::sensor::probe_info_t& cached)
+	{
+		if(serial != cached.serial)
+		{
+			probe(); // the serial number is not read again
+			return false;
+		}
+		reads++;
+		info = cached;
+		return true;
+	}
+
+	sps30::sensor::probe_info_t probeInfo() const
+	{
+		return info;
+	}
+};
+
+using cache = sps30::probe_cache<4, counting_sensor>;
+} // namespace
+
+TEST_CASE("Probing with cached values verifies the serial number", "[test/sps30_probe_cache]")
+{
+	sps30::transport t;
+	sps30::sensor s(t);
+	s.probe();
+	auto info = s.probeInfo();
+	CHECK(std::string(info.serial) == s.serial());
+
+	// Only the serial number is read, so the cached values are used even if they differ
+	info.version = {9, 9};
+	CHECK(s.probe(info));
+	CHECK(s.firmwareVersion().major == 9);
+	CHECK(s.firmwareVersion().minor == 9);
+
+	// A different sensor is probed again
+	info.serial[0] ^= 1;
+	CHECK_FALSE(s.probe(info));
+	CHECK(s.firmwareVersion().major == 2);
+	CHECK(s.firmwareVersion().minor == 1);
+	CHECK(std::string(s.serial()) != info.serial);
+}
+
+TEST_CASE("The probe cache only reads metadata for new sensors", "[test/sps30_probe_cache]")
+{
+	counting_sensor sensors[4];
+	sensors[2].serial = "E5F6A7B8";
+	cache c;
+
+	for(size_t i = 0; i < 4; i++)
+	{
+		CHECK_FALSE(c.probe(i, sensors[i]));
+		CHECK(c.cached(i));
+	}
+	CHECK(c.stats().uncached == 4);
+	CHECK(c.hit_rate() == 0.0);
+
+	// A reboot with the stored image, and the sensor at position 2 replaced
+	cache restored;
+	REQUIRE(restored.load(c.image()));
+	sensors[2].serial = "C9D0E1F2";
+	uint32_t reads = 0;
+	for(size_t i = 0; i < 4; i++)
+	{
+		sensors[i].reads = 0;
+		CHECK(restored.probe(i, sensors[i]) == (i != 2));
+		reads += sensors[i].reads;
+	}
+	CHECK(reads == 3 + 3);
+	CHECK(restored.stats().hits == 3);
+	CHECK(restored.stats().misses == 1);
+	CHECK(restored.hit_rate() == 0.75);
+	CHECK(std::string(restored.image().entries[2].serial) == "C9D0E1F2");
+
+	// The replacement is verified from then on
+	sensors[2].reads = 0;
+	CHECK(restored.probe(2, sensors[2]));
+	CHECK(sensors[2].reads == 1);
+
+	restored.invalidate(1);
+	CHECK_FALSE(restored.cached(1));
+	restored.reset_stats();
+	CHECK(restored.hit_rate() == 0.0);
+}
+
+TEST_CASE("Damaged probe cache images are rejected", "[test/sps30_probe_cache]")
+{
+	counting_sensor s;
+	cache c;
+	c.probe(1, s);
+
+	cache::image_t image;
+	memcpy(&image, &c.image(), sizeof(image));
+	image.entries[1].version.minor++;
+	cache restored;
+	CHECK_FALSE(restored.load(image));
+	CHECK_FALSE(restored.cached(1));
+
+	memcpy(&image, &c.image(), sizeof(image));
+	image.magic = 0;
+	CHECK_FALSE(restored.load(image));
+
+	memcpy(&image, &c.image(), sizeof(image));
+	CHECK(restored.load(image));
+	CHECK(restored.cached(1));
+}
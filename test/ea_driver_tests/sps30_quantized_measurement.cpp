@@ -0,0 +1,169 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <quantized_measurement.hpp>
+#include <random>
+#include <vector>
+
+namespace
+{
+uint32_t float_bits(float f)
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+} // namespace
+
+TEST_CASE("Every half value round-trips through float", "[test/sps30_quantized]")
+{
+	for(uint32_t h = 0; h <= 0xffff; h++)
+	{
+		const auto f = sps30::half_to_float(static_cast<uint16_t>(h));
+		if(std::isnan(f))
+		{
+			// NaNs are quieted, but remain NaN
+			CHECK(std::isnan(sps30::half_to_float(sps30::float_to_half(f))));
+			continue;
+		}
+		REQUIRE(sps30::float_to_half(f) == h);
+	}
+}
+
+TEST_CASE("Half conversion rounds to nearest even", "[test/sps30_quantized]")
+{
+	// 2049 lies exactly between 2048 and 2050; 2048 has the even significand
+	CHECK(sps30::half_to_float(sps30::float_to_half(2049.0f)) == 2048.0f);
+	CHECK(sps30::half_to_float(sps30::float_to_half(2051.0f)) == 2052.0f);
+	CHECK(sps30::half_to_float(sps30::float_to_half(65504.0f)) == 65504.0f);
+	CHECK(std::isinf(sps30::half_to_float(sps30::float_to_half(65520.0f))));
+	CHECK(sps30::float_to_half(-0.0f) == 0x8000);
+	CHECK(sps30::float_to_half(1e-9f) == 0);
+}
+
+TEST_CASE("Quantization error stays within documented bounds", "[test/sps30_quantized]")
+{
+	struct range_t
+	{
+		float low;
+		float high;
+		float max_error;
+	};
+	// Mirrors the table in quantized_measurement.hpp
+	const range_t ranges[] = {
+		{0.0f, 100.0f, 0.03125f}, {100.0f, 1000.0f, 0.25f},	   {1000.0f, 3000.0f, 1.0f},
+		{0.0f, 10.0f, 0.00390625f}, {0.0f, 6.1e-5f, std::ldexp(1.0f, -25)},
+	};
+
+	std::mt19937 rng(99);
+	for(const auto& range : ranges)
+	{
+		std::uniform_real_distribution<float> dist(range.low, range.high);
+		for(int i = 0; i < 100000; i++)
+		{
+			const float v = dist(rng);
+			const float decoded = sps30::half_to_float(sps30::float_to_half(v));
+			REQUIRE(std::fabs(decoded - v) <= range.max_error);
+			if(v >= 6.1035156e-5f)
+			{
+				REQUIRE(std::fabs(decoded - v) <= v * (1.0f / 2048.0f));
+			}
+		}
+	}
+}
+
+TEST_CASE("Batch quantization matches the scalar conversion", "[test/sps30_quantized]")
+{
+	std::mt19937 rng(5);
+	std::uniform_int_distribution<uint32_t> bits_dist;
+	std::vector<sps30::sensor::measurement_t> in(37);
+
+	for(auto& m : in)
+	{
+		for(auto field : sps30::measurement_fields)
+		{
+			// Random bit patterns cover subnormals, overflow, infinities, and NaNs
+			uint32_t bits = bits_dist(rng);
+			memcpy(&(m.*field), &bits, sizeof(bits));
+		}
+	}
+
+	std::vector<sps30::quantized_measurement_t> q(in.size());
+	std::vector<sps30::sensor::measurement_t> out(in.size());
+	sps30::quantize(in.data(), q.data(), in.size());
+	sps30::dequantize(q.data(), out.data(), q.size());
+
+	for(size_t i = 0; i < in.size(); i++)
+	{
+		for(size_t f = 0; f < sps30::MEASUREMENT_FIELD_COUNT; f++)
+		{
+			const auto field = sps30::measurement_fields[f];
+			const auto expected = sps30::float_to_half(in[i].*field);
+			REQUIRE(q[i].values[f] == expected);
+			REQUIRE(float_bits(out[i].*field) == float_bits(sps30::half_to_float(expected)));
+		}
+	}
+}
+
+TEST_CASE("Compact history decodes samples on demand", "[test/sps30_quantized]")
+{
+	sps30::compact_history<4> h;
+	sps30::sensor::measurement_t m = {};
+
+	for(int i = 1; i <= 6; i++)
+	{
+		m.mc_2p5 = static_cast<float>(i);
+		h.push(m);
+	}
+
+	CHECK(h.size() == 4);
+	CHECK(h.at(0).mc_2p5 == 6.0f);
+	CHECK(h.at(3).mc_2p5 == 3.0f);
+
+	sps30::sensor::measurement_t all[4];
+	CHECK(h.copy(all) == 4);
+	for(int i = 0; i < 4; i++)
+	{
+		CHECK(all[i].mc_2p5 == static_cast<float>(i + 3));
+	}
+}
+
+TEST_CASE("Benchmark quantize and dequantize", "[.][benchmark][test/sps30_quantized]")
+{
+	constexpr size_t COUNT = 4096;
+	constexpr size_t ROUNDS = 1000;
+
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> dist(0.0f, 1000.0f);
+	std::vector<sps30::sensor::measurement_t> in(COUNT);
+	std::vector<sps30::quantized_measurement_t> q(COUNT);
+	std::vector<sps30::sensor::measurement_t> out(COUNT);
+	for(auto& m : in)
+	{
+		for(auto field : sps30::measurement_fields)
+		{
+			m.*field = dist(rng);
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for(size_t r = 0; r < ROUNDS; r++)
+	{
+		sps30::quantize(in.data(), q.data(), COUNT);
+	}
+	auto encode = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+	start = std::chrono::steady_clock::now();
+	for(size_t r = 0; r < ROUNDS; r++)
+	{
+		sps30::dequantize(q.data(), out.data(), COUNT);
+	}
+	auto decode = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+	const double samples = static_cast<double>(COUNT * ROUNDS);
+	printf("quantize: %.1f M measurements/s, dequantize: %.1f M measurements/s (%f)\n",
+		   samples / encode.count() / 1e6, samples / decode.count() / 1e6,
+		   static_cast<double>(out[COUNT - 1].mc_2p5));
+}
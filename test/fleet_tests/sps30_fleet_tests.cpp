@@ -0,0 +1,460 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <sensirion_i2c.h>
+#include <sps30.h>
+#include <sps30_fleet.h>
+#include <sps30_simulated_i2c.h>
+#include <sps30_recorded_data.h>
+#include <sps30_sensor_table.h>
+#include <string>
+
+namespace
+{
+/// Simulated sensors with bus timing, so that they are busy after commands like real units
+class simulated_fleet
+{
+  public:
+	simulated_fleet()
+	{
+		setenv("SPS30_SIMULATED_I2C_HZ", "1000000", 1);
+		sensirion_i2c_init();
+		sps30_sensor_table_init(&table);
+		memset(&report, 0, sizeof(report));
+	}
+
+	~simulated_fleet()
+	{
+		sensirion_i2c_release();
+		unsetenv("SPS30_SIMULATED_I2C_HZ");
+	}
+
+	simulated_fleet(const simulated_fleet&) = delete;
+	simulated_fleet& operator=(const simulated_fleet&) = delete;
+
+	void fault(uint8_t bus, const sps30_simulated_fault& f)
+	{
+		sps30_simulated_i2c_set_fault(bus, &f);
+	}
+
+	void bring_up(const sps30_fleet_config& config)
+	{
+		sps30_fleet_bring_up(&config, &table, &report);
+	}
+
+	/// The waits the calling thread has asked for, in microseconds, whether or not slept
+	uint32_t delays_us() const
+	{
+		return sps30_simulated_i2c_get_counters().delay_usec;
+	}
+
+	/// Whether the sensor on a bus has measurements to read
+	bool measuring(uint8_t bus)
+	{
+		sps30_measurement m;
+		return sensirion_i2c_select_bus(bus) == 0 && sps30_read_measurement(&m) == 0;
+	}
+
+	sps30_sensor_table table;
+	sps30_fleet_report report;
+};
+
+/// The serial number every simulated sensor reports
+std::string simulated_serial()
+{
+	char serial[SPS30_MAX_SERIAL_LEN];
+	REQUIRE(sensirion_i2c_select_bus(0) == 0);
+	REQUIRE(sps30_get_serial(serial) == 0);
+	return serial;
+}
+
+/// Table entries for the sensors on channels [first, end), as a previous run would save them
+void cache_sensors(sps30_sensor_table& table, unsigned first, unsigned end, const char* serial)
+{
+	for(unsigned c = first; c < end; c++)
+	{
+		sps30_sensor_table_entry* entry =
+			sps30_sensor_table_set(&table, static_cast<uint16_t>(c), serial, 0);
+		entry->autoclean_interval_s = 1234;
+	}
+}
+
+sps30_fleet_config start_config(unsigned sensor_count, unsigned buses)
+{
+	sps30_fleet_config config{};
+	config.sensor_count = sensor_count;
+	config.buses = buses;
+	config.start = true;
+	return config;
+}
+} // namespace
+
+TEST_CASE("Fleet bring-up probes and starts every sensor", "[test/sps30_fleet]")
+{
+	simulated_fleet fleet;
+	uint32_t interval_s = 0;
+	REQUIRE(sensirion_i2c_select_bus(0) == 0);
+	REQUIRE(sps30_get_fan_auto_cleaning_interval(&interval_s) == 0);
+
+	fleet.bring_up(start_config(8, 1));
+
+	CHECK(fleet.report.uncached == 8);
+	CHECK(fleet.report.hits == 0);
+	CHECK(fleet.report.misses == 0);
+	CHECK(fleet.report.absent == 0);
+	CHECK(fleet.report.started_count == 8);
+	CHECK(fleet.report.threads == 1);
+	for(uint8_t c = 0; c < 8; c++)
+	{
+		const sps30_sensor_table_entry& entry = fleet.table.entries[c];
+		CHECK(fleet.report.results[c] == SPS30_FLEET_PROBED);
+		CHECK(fleet.report.started[c]);
+		CHECK(entry.flags == (SPS30_SENSOR_TABLE_PRESENT | SPS30_SENSOR_TABLE_MEASURING));
+		CHECK(entry.serial == simulated_serial());
+		CHECK(entry.firmware_major == sps30_fw_ver_response[0]);
+		CHECK(entry.firmware_minor == sps30_fw_ver_response[1]);
+		CHECK(entry.autoclean_interval_s == interval_s);
+		CHECK(entry.started_ms != 0);
+		CHECK(fleet.measuring(c));
+	}
+	CHECK_FALSE(fleet.measuring(8));
+}
+
+TEST_CASE("The device status register is only read on firmware that has it",
+		  "[test/sps30_fleet]")
+{
+	simulated_fleet fleet;
+	sps30_simulated_i2c_set_firmware(1, 2, 1);
+	fleet.bring_up(start_config(2, 1));
+	REQUIRE(fleet.report.started_count == 2);
+	REQUIRE(fleet.table.entries[1].firmware_minor == 1);
+
+	uint32_t status = 0xffffffffu;
+	REQUIRE(sensirion_i2c_select_bus(0) == 0);
+	CHECK(sps30_fleet_read_status(&fleet.table.entries[0], &status) == 0);
+	CHECK(status == 0);
+
+	// Firmware 2.1 is not sent the command
+	status = 0xffffffffu;
+	REQUIRE(sensirion_i2c_select_bus(1) == 0);
+	const uint32_t messages = sps30_simulated_i2c_get_counters().messages;
+	CHECK(sps30_fleet_read_status(&fleet.table.entries[1], &status) ==
+		  SPS30_FLEET_ERROR_UNSUPPORTED);
+	CHECK(sps30_simulated_i2c_get_counters().messages == messages);
+	CHECK(status == 0xffffffffu);
+}
+
+TEST_CASE("Fleet bring-up verifies table entries with one serial number read",
+		  "[test/sps30_fleet]")
+{
+	simulated_fleet fleet;
+	cache_sensors(fleet.table, 0, 4, simulated_serial().c_str());
+	cache_sensors(fleet.table, 4, 5, "replaced");
+
+	fleet.bring_up(start_config(8, 1));
+
+	CHECK(fleet.report.hits == 4);
+	CHECK(fleet.report.misses == 1);
+	CHECK(fleet.report.uncached == 3);
+	CHECK(fleet.report.started_count == 8);
+	for(uint8_t c = 0; c < 4; c++)
+	{
+		CHECK(fleet.report.results[c] == SPS30_FLEET_VERIFIED);
+		// Verified entries are not read again
+		CHECK(fleet.table.entries[c].autoclean_interval_s == 1234);
+	}
+	for(uint8_t c = 4; c < 8; c++)
+	{
+		CHECK(fleet.report.results[c] == SPS30_FLEET_PROBED);
+		CHECK(fleet.table.entries[c].serial == simulated_serial());
+		CHECK(fleet.table.entries[c].autoclean_interval_s != 1234);
+	}
+}
+
+TEST_CASE("Fleet bring-up brings up each group of channels on its own thread",
+		  "[test/sps30_fleet]")
+{
+	simulated_fleet fleet;
+
+	SECTION("Groups split the channels")
+	{
+		fleet.bring_up(start_config(10, 3));
+
+		CHECK(fleet.report.threads == 3);
+		CHECK(fleet.report.started_count == 10);
+		for(uint8_t c = 0; c < 10; c++)
+		{
+			CHECK(fleet.report.results[c] == SPS30_FLEET_PROBED);
+			CHECK(fleet.measuring(c));
+		}
+	}
+
+	SECTION("There are no more groups than channels")
+	{
+		fleet.bring_up(start_config(2, 4));
+
+		CHECK(fleet.report.threads == 2);
+		CHECK(fleet.report.started_count == 2);
+	}
+
+	SECTION("Faults stay within their channel")
+	{
+		sps30_simulated_fault absent{};
+		absent.absent = true;
+		fleet.fault(1, absent);
+		fleet.fault(6, absent);
+
+		fleet.bring_up(start_config(8, 2));
+
+		CHECK(fleet.report.absent == 2);
+		CHECK(fleet.report.started_count == 6);
+		for(uint8_t c = 0; c < 8; c++)
+		{
+			const bool present = c != 1 && c != 6;
+			CHECK(fleet.report.results[c] ==
+				  (present ? SPS30_FLEET_PROBED : SPS30_FLEET_ABSENT));
+			CHECK(fleet.report.started[c] == present);
+		}
+	}
+}
+
+TEST_CASE("Fleet bring-up reports missing sensors", "[test/sps30_fleet]")
+{
+	simulated_fleet fleet;
+	sps30_simulated_fault absent{};
+	absent.absent = true;
+	fleet.fault(2, absent);
+	fleet.fault(3, absent);
+	// Channel 3 had a sensor in the last run, which has since been disconnected
+	cache_sensors(fleet.table, 3, 4, simulated_serial().c_str());
+	fleet.table.entries[3].flags |= SPS30_SENSOR_TABLE_MEASURING;
+
+	fleet.bring_up(start_config(4, 1));
+
+	CHECK(fleet.report.absent == 2);
+	CHECK(fleet.report.misses == 1);
+	CHECK(fleet.report.uncached == 3);
+	CHECK(fleet.report.started_count == 2);
+	CHECK(fleet.report.results[2] == SPS30_FLEET_ABSENT);
+	CHECK(fleet.report.results[3] == SPS30_FLEET_ABSENT);
+	CHECK_FALSE(fleet.report.started[2]);
+	CHECK_FALSE(fleet.report.started[3]);
+	CHECK_FALSE(fleet.table.entries[2].flags & SPS30_SENSOR_TABLE_PRESENT);
+	CHECK_FALSE(fleet.table.entries[3].flags & SPS30_SENSOR_TABLE_MEASURING);
+}
+
+TEST_CASE("Fleet bring-up reports sensors that do not acknowledge a phase's command",
+		  "[test/sps30_fleet]")
+{
+	simulated_fleet fleet;
+	sps30_fleet_config config = start_config(4, 1);
+
+	SECTION("Start measurement")
+	{
+		sps30_simulated_fault nack{};
+		nack.nack_opcode = SPS30_OPCODE_START_MEASUREMENT;
+		fleet.fault(1, nack);
+
+		fleet.bring_up(config);
+	}
+
+	SECTION("Reset")
+	{
+		sps30_simulated_fault nack{};
+		nack.nack_opcode = SPS30_OPCODE_RESET;
+		fleet.fault(1, nack);
+		config.reset = true;
+
+		fleet.bring_up(config);
+	}
+
+	SECTION("Reset, after which the sensor does not answer within the datasheet delay")
+	{
+		sps30_simulated_fault slow{};
+		slow.slow_opcode = SPS30_OPCODE_RESET;
+		slow.slow_busy_usec = 2 * SPS30_FLEET_DATASHEET_RESET_DELAY_USEC;
+		fleet.fault(1, slow);
+		config.reset = true;
+
+		fleet.bring_up(config);
+	}
+
+	// The sensor was found, but is reported as not started
+	CHECK(fleet.report.absent == 0);
+	CHECK(fleet.report.results[1] == SPS30_FLEET_PROBED);
+	CHECK_FALSE(fleet.report.started[1]);
+	CHECK_FALSE(fleet.table.entries[1].flags & SPS30_SENSOR_TABLE_MEASURING);
+	CHECK(fleet.report.started_count == 3);
+	CHECK(fleet.measuring(0));
+	CHECK(fleet.measuring(2));
+	CHECK(fleet.measuring(3));
+}
+
+TEST_CASE("Fleet bring-up leaves skipped channels alone", "[test/sps30_fleet]")
+{
+	simulated_fleet fleet;
+	bool skip[4] = {false, true, false, false};
+	cache_sensors(fleet.table, 1, 2, "measuring");
+	fleet.table.entries[1].flags |= SPS30_SENSOR_TABLE_MEASURING;
+	const sps30_sensor_table_entry before = fleet.table.entries[1];
+	sps30_fleet_config config = start_config(4, 2);
+	config.skip = skip;
+
+	fleet.bring_up(config);
+
+	CHECK(fleet.report.results[1] == SPS30_FLEET_SKIPPED);
+	CHECK_FALSE(fleet.report.started[1]);
+	CHECK(fleet.report.started_count == 3);
+	CHECK(memcmp(&fleet.table.entries[1], &before, sizeof(before)) == 0);
+	CHECK_FALSE(fleet.measuring(1));
+}
+
+TEST_CASE("Calibration stores the measured delays with a margin, capped at the datasheet",
+		  "[test/sps30_fleet]")
+{
+	simulated_fleet fleet;
+	cache_sensors(fleet.table, 0, 1, simulated_serial().c_str());
+	sps30_sensor_table_entry& entry = fleet.table.entries[0];
+	// How long the simulated sensor on bus 0 is busy after each kind of command
+	const uint32_t busy_us[SPS30_DELAY_COUNT] = {1200, 5000, 8000, 30000};
+	const uint32_t datasheet_us[SPS30_DELAY_COUNT] = {
+		SPS30_FLEET_DATASHEET_COMMAND_DELAY_USEC,
+		SPS30_FLEET_DATASHEET_START_STOP_DELAY_USEC,
+		SPS30_FLEET_DATASHEET_WRITE_FLASH_DELAY_USEC,
+		SPS30_FLEET_DATASHEET_RESET_DELAY_USEC,
+	};
+
+	SECTION("Measured delays get half again, plus 500 us")
+	{
+		REQUIRE(sps30_fleet_calibrate(0, &entry) == 0);
+
+		CHECK(entry.flags & SPS30_SENSOR_TABLE_CALIBRATED);
+		for(unsigned d = 0; d < SPS30_DELAY_COUNT; d++)
+		{
+			// The sensor answers a poll (every 100 us) after it is no longer busy
+			const uint32_t least = busy_us[d] + busy_us[d] / 2 + 500;
+			CHECK(entry.delays_us[d] >= least);
+			CHECK(entry.delays_us[d] < least + 3 * 2000);
+			CHECK(entry.delays_us[d] < datasheet_us[d]);
+			CHECK(sps30_fleet_delay_us(&entry, d) == entry.delays_us[d]);
+		}
+		CHECK_FALSE(fleet.measuring(0));
+	}
+
+	SECTION("Delays are capped at the datasheet delay")
+	{
+		sps30_simulated_fault slow{};
+		slow.slow_opcode = SPS30_OPCODE_RESET;
+		slow.slow_busy_usec = 80000;
+		fleet.fault(0, slow);
+
+		REQUIRE(sps30_fleet_calibrate(0, &entry) == 0);
+
+		CHECK(entry.delays_us[SPS30_DELAY_RESET] == SPS30_FLEET_DATASHEET_RESET_DELAY_USEC);
+		CHECK(entry.delays_us[SPS30_DELAY_COMMAND] < SPS30_FLEET_DATASHEET_COMMAND_DELAY_USEC);
+	}
+
+	SECTION("A sensor that does not answer within the datasheet delay is not calibrated")
+	{
+		sps30_simulated_fault slow{};
+		slow.slow_opcode = SPS30_OPCODE_START_MEASUREMENT;
+		slow.slow_busy_usec = 3 * SPS30_FLEET_DATASHEET_START_STOP_DELAY_USEC / 2;
+		fleet.fault(0, slow);
+
+		CHECK(sps30_fleet_calibrate(0, &entry) == SPS30_FLEET_ERROR_NACK);
+
+		CHECK_FALSE(entry.flags & SPS30_SENSOR_TABLE_CALIBRATED);
+		CHECK(sps30_fleet_delay_us(&entry, SPS30_DELAY_START_STOP) ==
+			  SPS30_FLEET_DATASHEET_START_STOP_DELAY_USEC);
+		// It was started, and is stopped again
+		CHECK_FALSE(fleet.measuring(0));
+	}
+}
+
+TEST_CASE("Fleet bring-up waits the calibrated delays", "[test/sps30_fleet]")
+{
+	simulated_fleet fleet;
+	cache_sensors(fleet.table, 0, 2, simulated_serial().c_str());
+	for(uint8_t c = 0; c < 2; c++)
+	{
+		sps30_sensor_table_entry& entry = fleet.table.entries[c];
+		entry.flags |= SPS30_SENSOR_TABLE_CALIBRATED;
+		entry.delays_us[SPS30_DELAY_COMMAND] = 2500;
+		entry.delays_us[SPS30_DELAY_START_STOP] = 10000;
+		entry.delays_us[SPS30_DELAY_WRITE_FLASH] = 15000;
+		entry.delays_us[SPS30_DELAY_RESET] = 45000;
+	}
+	sps30_fleet_config config = start_config(2, 1);
+	config.reset = true;
+
+	// One bus is brought up by the calling thread, whose waits are counted
+	const uint32_t delays_before = fleet.delays_us();
+
+	SECTION("Sensors that answer within their calibrated delays keep them")
+	{
+		fleet.bring_up(config);
+
+		CHECK(fleet.report.fallbacks == 0);
+		CHECK(fleet.report.started_count == 2);
+		CHECK(fleet.delays_us() - delays_before < SPS30_FLEET_DATASHEET_RESET_DELAY_USEC);
+		CHECK(fleet.table.entries[0].flags & SPS30_SENSOR_TABLE_CALIBRATED);
+		CHECK(fleet.table.entries[1].flags & SPS30_SENSOR_TABLE_CALIBRATED);
+	}
+
+	SECTION("A sensor that does not answer within its calibrated delay falls back")
+	{
+		// The sensor on channel 1 now needs longer than its calibrated reset delay
+		sps30_simulated_fault slow{};
+		slow.slow_opcode = SPS30_OPCODE_RESET;
+		slow.slow_busy_usec = 60000;
+		fleet.fault(1, slow);
+
+		fleet.bring_up(config);
+
+		CHECK(fleet.report.fallbacks == 1);
+		CHECK(fleet.report.started_count == 2);
+		CHECK(fleet.report.started[1]);
+		// It was given the rest of the datasheet delay, and lost its calibration
+		CHECK(fleet.delays_us() - delays_before >= SPS30_FLEET_DATASHEET_RESET_DELAY_USEC);
+		CHECK(fleet.table.entries[0].flags & SPS30_SENSOR_TABLE_CALIBRATED);
+		CHECK_FALSE(fleet.table.entries[1].flags & SPS30_SENSOR_TABLE_CALIBRATED);
+		CHECK(sps30_fleet_delay_us(&fleet.table.entries[1], SPS30_DELAY_RESET) ==
+			  SPS30_FLEET_DATASHEET_RESET_DELAY_USEC);
+	}
+
+	SECTION("An auto-cleaning interval write waits the calibrated flash write delay")
+	{
+		sps30_simulated_fault slow{};
+		slow.slow_opcode = SPS30_OPCODE_AUTOCLEAN_INTERVAL;
+		slow.slow_busy_usec = 18000;
+		fleet.fault(0, slow);
+		config.reset = false;
+		config.set_autoclean = true;
+		config.autoclean_interval_s = 86400;
+
+		fleet.bring_up(config);
+
+		CHECK(fleet.report.fallbacks == 1);
+		CHECK_FALSE(fleet.table.entries[0].flags & SPS30_SENSOR_TABLE_CALIBRATED);
+		CHECK(fleet.table.entries[1].flags & SPS30_SENSOR_TABLE_CALIBRATED);
+		CHECK(fleet.table.entries[0].autoclean_interval_s == 86400);
+		CHECK(fleet.table.entries[1].autoclean_interval_s == 86400);
+		CHECK(fleet.report.started_count == 2);
+	}
+
+	SECTION("A sensor that is probed again keeps its calibration")
+	{
+		// The sensor on channel 0 is asleep, so it only answers once it is woken up
+		sps30_simulated_fault asleep{};
+		asleep.asleep = true;
+		fleet.fault(0, asleep);
+
+		fleet.bring_up(config);
+
+		CHECK(fleet.report.misses == 1);
+		CHECK(fleet.report.results[0] == SPS30_FLEET_PROBED);
+		CHECK(fleet.report.started_count == 2);
+		CHECK(fleet.table.entries[0].flags & SPS30_SENSOR_TABLE_CALIBRATED);
+		CHECK(fleet.table.entries[0].delays_us[SPS30_DELAY_RESET] == 45000);
+	}
+}
@@ -0,0 +1,300 @@
+#include <catch2/catch_test_macros.hpp>
+#include <driver.hpp>
+#include <sensirion_i2c.h>
+#include <sps30.h>
+#include <sps30_recorded_data.h>
+#include <sps30_simulated_i2c.h>
+#include <cstdlib>
+#include <sps30_transport.hpp>
+#include <string>
+
+using command_t = sps30::transport::command_t;
+using status_t = sps30::transport::status_t;
+
+namespace
+{
+/// The I2C transport, talking to the simulated sensor on bus 0, which answers immediately
+class simulated_transport
+{
+  public:
+	simulated_transport()
+	{
+		sensirion_i2c_init();
+		sensirion_i2c_select_bus(0);
+	}
+
+	~simulated_transport()
+	{
+		sensirion_i2c_release();
+	}
+
+	simulated_transport(const simulated_transport&) = delete;
+	simulated_transport& operator=(const simulated_transport&) = delete;
+
+	void fault(const sps30_simulated_fault& f)
+	{
+		sps30_simulated_i2c_set_fault(0, &f);
+	}
+
+	sps30_simulated_i2c_counters counters() const
+	{
+		return sps30_simulated_i2c_get_counters();
+	}
+
+	sps30::transport t;
+};
+
+/// The interval every simulated sensor reports until it is written, in seconds
+constexpr uint32_t SIMULATED_INTERVAL = 172800;
+/// Another interval, whose bytes differ in each position from the simulated one's
+constexpr uint32_t DAILY_INTERVAL = 86400;
+} // namespace
+
+TEST_CASE_METHOD(simulated_transport, "readv scatters the payload without its CRCs",
+				 "[test/i2c_transport]")
+{
+	char head[8];
+	char tail[24];
+	const sps30::transport::rx_span_t iov[] = {
+		{reinterpret_cast<uint8_t*>(head), sizeof(head)},
+		{reinterpret_cast<uint8_t*>(tail), sizeof(tail)},
+	};
+
+	REQUIRE(t.readv(command_t::SPS30_CMD_GET_SERIAL, iov, 2) == status_t::OK);
+	CHECK(std::string(head, sizeof(head)) + tail == sps30_serial_number_response_string);
+
+	// The request and the response are one transfer, read into a cache-line aligned frame
+	CHECK(counters().transfers == 1);
+	CHECK(counters().messages == 2);
+	CHECK(counters().unaligned_reads == 0);
+}
+
+TEST_CASE_METHOD(simulated_transport, "writev frames the arguments with their CRCs",
+				 "[test/i2c_transport]")
+{
+	// The interval is gathered from the two halves of its host-order bytes
+	const auto* const bytes = reinterpret_cast<const uint8_t*>(&DAILY_INTERVAL);
+	const sps30::transport::tx_span_t args[] = {
+		{bytes, 2},
+		{bytes + 2, 2},
+	};
+	REQUIRE(t.writev(command_t::SPS30_CMD_AUTOCLEAN_INTERVAL, args, 2) == status_t::OK);
+	CHECK(counters().transfers == 1);
+
+	// The sensor does not acknowledge arguments with a wrong CRC, and the vendor driver
+	// decodes the interval from the bus independently of the transport
+	uint32_t interval = 0;
+	REQUIRE(sps30_get_fan_auto_cleaning_interval(&interval) == 0);
+	CHECK(interval == DAILY_INTERVAL);
+
+	interval = 0;
+	REQUIRE(t.read(command_t::SPS30_CMD_AUTOCLEAN_INTERVAL, reinterpret_cast<uint8_t*>(&interval),
+				   sizeof(interval)) == status_t::OK);
+	CHECK(interval == DAILY_INTERVAL);
+	CHECK(counters().unaligned_reads == 0);
+}
+
+TEST_CASE_METHOD(simulated_transport, "A script runs as one transfer", "[test/i2c_transport]")
+{
+	char serial[32] = {};
+	uint16_t version = 0;
+	uint32_t interval = 0;
+
+	sps30::transport::script<5> s;
+	s.read(command_t::SPS30_CMD_GET_SERIAL, reinterpret_cast<uint8_t*>(serial), sizeof(serial))
+		.read(command_t::SPS30_CMD_GET_FIRMWARE_VERSION, reinterpret_cast<uint8_t*>(&version),
+			  sizeof(version))
+		.write(command_t::SPS30_CMD_RESET)
+		.delay(std::chrono::microseconds(100))
+		.read(command_t::SPS30_CMD_AUTOCLEAN_INTERVAL, reinterpret_cast<uint8_t*>(&interval),
+			  sizeof(interval));
+
+	REQUIRE(t.run(s) == status_t::OK);
+	CHECK(counters().transfers == 1);
+	CHECK(counters().messages == 7);
+	CHECK(counters().unaligned_reads == 0);
+
+	CHECK(std::string(serial) == sps30_serial_number_response_string);
+	CHECK(version == 0x0202);
+	CHECK(interval == SIMULATED_INTERVAL);
+}
+
+TEST_CASE_METHOD(simulated_transport, "A script stops at the first message not acknowledged",
+				 "[test/i2c_transport]")
+{
+	fault({false, false, SPS30_OPCODE_GET_FIRMWARE_VERSION, 0, 0, 0});
+
+	char serial[32] = {};
+	uint8_t version[2] = {0xaa, 0xaa};
+	uint8_t interval[4] = {};
+	sps30::transport::script<3> s;
+	s.read(command_t::SPS30_CMD_GET_SERIAL, reinterpret_cast<uint8_t*>(serial), sizeof(serial))
+		.read(command_t::SPS30_CMD_GET_FIRMWARE_VERSION, version, sizeof(version))
+		.read(command_t::SPS30_CMD_AUTOCLEAN_INTERVAL, interval, sizeof(interval));
+
+	CHECK(t.run(s) == status_t::BUS_ERROR);
+	// The serial number's request and response, then the request that was not acknowledged
+	CHECK(counters().messages == 3);
+	CHECK(version[0] == 0xaa);
+	CHECK(version[1] == 0xaa);
+}
+
+TEST_CASE_METHOD(simulated_transport, "A response with a wrong CRC is not stored",
+				 "[test/i2c_transport]")
+{
+	fault({false, false, 0, 0, 0, SPS30_OPCODE_GET_FIRMWARE_VERSION});
+
+	uint8_t version[2] = {0xaa, 0xaa};
+
+	SECTION("read()")
+	{
+		CHECK(t.read(command_t::SPS30_CMD_GET_FIRMWARE_VERSION, version, sizeof(version)) ==
+			  status_t::BUS_ERROR);
+	}
+
+	SECTION("run()")
+	{
+		char serial[32] = {};
+		sps30::transport::script<2> s;
+		s.read(command_t::SPS30_CMD_GET_SERIAL, reinterpret_cast<uint8_t*>(serial),
+			   sizeof(serial))
+			.read(command_t::SPS30_CMD_GET_FIRMWARE_VERSION, version, sizeof(version));
+
+		CHECK(t.run(s) == status_t::BUS_ERROR);
+		CHECK(counters().transfers == 1);
+		CHECK(std::string(serial) == sps30_serial_number_response_string);
+	}
+
+	CHECK(version[0] == 0xaa);
+	CHECK(version[1] == 0xaa);
+}
+
+TEST_CASE_METHOD(simulated_transport, "The driver probes a sensor over I2C",
+				 "[test/i2c_transport]")
+{
+	sps30::sensor s(t);
+
+	REQUIRE(s.probe());
+	CHECK(std::string(s.probeInfo().serial) == sps30_serial_number_response_string);
+	CHECK(s.firmwareVersion().major == 2);
+	CHECK(s.firmwareVersion().minor == 2);
+
+	// The serial number, firmware version and interval are read with one transfer
+	CHECK(counters().transfers == 1);
+}
+
+TEST_CASE_METHOD(simulated_transport, "The driver decodes the values it reads over I2C",
+				 "[test/i2c_transport]")
+{
+	// Firmware 2.1, unlike 2.2, reads differently if the bytes of its word are swapped
+	sps30_simulated_i2c_set_firmware(0, 2, 1);
+	sps30::sensor s(t);
+	REQUIRE(s.probe());
+
+	CHECK(s.firmwareVersion().major == 2);
+	CHECK(s.firmwareVersion().minor == 1);
+	CHECK(s.capabilities().sleep);
+	CHECK_FALSE(s.capabilities().device_status);
+	CHECK(s.autoCleanInterval() == std::chrono::seconds(SIMULATED_INTERVAL));
+
+	SECTION("Measurements")
+	{
+		// The first measurement recorded from a device, sps30_measurement_low_particle_response_1
+		s.start();
+		const auto m = s.read();
+		CHECK(m.mc_1p0 == 0.1628956050f);
+		CHECK(m.mc_2p5 == 0.2644746304f);
+		CHECK(m.mc_4p0 == 0.3391090930f);
+		CHECK(m.mc_10p0 == 0.3540358543f);
+		CHECK(m.nc_0p5 == 0.8901749253f);
+		CHECK(m.nc_10p0 == 1.3195588589f);
+		CHECK(m.typical_particle_size == 0.7204053998f);
+		s.stop();
+	}
+
+	SECTION("Auto clean interval")
+	{
+		CHECK(s.autoCleanInterval(std::chrono::seconds(DAILY_INTERVAL)) ==
+			  std::chrono::seconds(DAILY_INTERVAL));
+
+		// The vendor driver decodes what the sensor stored independently of the transport
+		uint32_t stored = 0;
+		REQUIRE(sps30_get_fan_auto_cleaning_interval(&stored) == 0);
+		CHECK(stored == DAILY_INTERVAL);
+
+		// Firmware 2.1 is reset before the interval is read back
+		CHECK(s.refreshAutoCleanInterval() == std::chrono::seconds(DAILY_INTERVAL));
+		CHECK(s.gatingStats().resets_skipped == 0);
+	}
+
+	SECTION("Sleep and wake up, which firmware 2.1 supports")
+	{
+		CHECK(s.sleep() == status_t::OK);
+		CHECK(s.wake() == status_t::OK);
+		CHECK(s.gatingStats().rejected == 0);
+	}
+}
+
+TEST_CASE_METHOD(simulated_transport, "The sensor is waited for once after each write",
+				 "[test/i2c_transport]")
+{
+	// The simulated sensors answer at once, so each wait asked for is counted, not slept
+	constexpr auto flash_delay =
+		sps30::describe(command_t::SPS30_CMD_AUTOCLEAN_INTERVAL).write_delay().count();
+	constexpr auto reset_delay = sps30::RESET_DELAY_USEC.count();
+
+	sps30_simulated_i2c_set_firmware(0, 2, 1);
+	sps30::sensor s(t);
+	REQUIRE(s.probe());
+	// Reads wait for their response, such as the probe's read of the interval
+	const auto probed = counters().delay_usec;
+	const auto waited = [&] { return counters().delay_usec - probed; };
+
+	SECTION("Reset")
+	{
+		// The transport does not wait after the write: the driver waits before its next one
+		s.reset();
+		CHECK(waited() == 0);
+
+		s.start();
+		CHECK(waited() > 0);
+		CHECK(waited() <= reset_delay);
+	}
+
+	SECTION("Auto clean interval, read back after a reset")
+	{
+		s.autoCleanInterval(std::chrono::seconds(DAILY_INTERVAL));
+		CHECK(waited() == 0);
+
+		// The rest of the flash write, then the reset delay the script asks for, then the
+		// read's wait for its response
+		constexpr auto read_delay =
+			sps30::describe(command_t::SPS30_CMD_AUTOCLEAN_INTERVAL).delay.count();
+		CHECK(s.refreshAutoCleanInterval() == std::chrono::seconds(DAILY_INTERVAL));
+		CHECK(waited() >= reset_delay + read_delay);
+		CHECK(waited() <= flash_delay + reset_delay + read_delay);
+	}
+}
+
+TEST_CASE_METHOD(simulated_transport, "A sensor left measuring is adopted over I2C",
+				 "[test/i2c_transport]")
+{
+	sps30::sensor::probe_info_t cached;
+	{
+		sps30::sensor previous(t);
+		REQUIRE(previous.probe());
+		cached = previous.probeInfo();
+	}
+
+	// The sensors restart as a previous run left them: measuring
+	setenv("SPS30_SIMULATED_MEASURING", "1", 1);
+	sensirion_i2c_init();
+	unsetenv("SPS30_SIMULATED_MEASURING");
+
+	sps30::sensor s(t);
+	REQUIRE(s.resume(cached));
+	// The serial number, the data-ready flag, and the status register, with no start
+	CHECK(counters().messages == 6);
+	CHECK(s.read().typical_particle_size == 0.7204053998f);
+	s.stop();
+}
@@ -0,0 +1,207 @@
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sensirion_common.h>
+#include <sps30_frame_batch.h>
+#include <vector>
+
+namespace
+{
+using frame_t = std::array<uint8_t, SPS30_FRAME_SIZE>;
+
+// Random data words, with the CRCs the sensor would send
+std::vector<uint8_t> make_frames(size_t count, uint32_t seed)
+{
+	std::mt19937 generator(seed);
+	std::vector<uint8_t> frames(count * SPS30_FRAME_SIZE);
+
+	for(size_t w = 0; w < count * SPS30_FRAME_WORDS; w++)
+	{
+		uint8_t* word = &frames[w * 3];
+		word[0] = static_cast<uint8_t>(generator());
+		word[1] = static_cast<uint8_t>(generator());
+		word[2] = sensirion_common_generate_crc(word, SENSIRION_WORD_SIZE);
+	}
+
+	return frames;
+}
+
+// What sps30_read_measurement() does with one frame
+bool vendor_decode(const uint8_t* frame, float* values)
+{
+	uint8_t data[SPS30_RECORD_FIELD_COUNT][4];
+	bool valid = true;
+
+	for(unsigned w = 0; w < SPS30_FRAME_WORDS; w++)
+	{
+		const uint8_t* word = &frame[w * 3];
+		valid &= sensirion_common_check_crc(word, SENSIRION_WORD_SIZE, word[2]) == NO_ERROR;
+		data[w / 2][(w % 2) * 2] = word[0];
+		data[w / 2][(w % 2) * 2 + 1] = word[1];
+	}
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		values[f] = sensirion_bytes_to_float(data[f]);
+	}
+
+	return valid;
+}
+
+struct columns_t
+{
+	explicit columns_t(size_t count) : storage(SPS30_RECORD_FIELD_COUNT * count), valid(count)
+	{
+		for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+		{
+			pointers[f] = &storage[f * count];
+		}
+	}
+
+	std::vector<float> storage;
+	std::array<float*, SPS30_RECORD_FIELD_COUNT> pointers{};
+	std::vector<uint8_t> valid;
+};
+
+// Compares bits, so NaN payloads must match too
+void check_against_vendor(const std::vector<uint8_t>& frames, const columns_t& columns)
+{
+	const size_t count = columns.valid.size();
+	for(size_t i = 0; i < count; i++)
+	{
+		float expected[SPS30_RECORD_FIELD_COUNT];
+		const bool valid = vendor_decode(&frames[i * SPS30_FRAME_SIZE], expected);
+
+		CHECK(columns.valid[i] == valid);
+		for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+		{
+			CHECK(memcmp(&columns.pointers[f][i], &expected[f], sizeof(float)) == 0);
+		}
+	}
+}
+} // namespace
+
+TEST_CASE("Batch decoding matches sensirion_bytes_to_float bit for bit",
+		  "[test/sps30_frame_batch]")
+{
+	// Every remainder of the four-frame vector groups
+	for(size_t count = 0; count <= 13; count++)
+	{
+		const auto frames = make_frames(count, static_cast<uint32_t>(count));
+		columns_t vector(count);
+		columns_t scalar(count);
+
+		CHECK(sps30_frame_decode_batch(frames.data(), count, vector.pointers.data(),
+									   vector.valid.data()) == count);
+		CHECK(sps30_frame_decode_batch_scalar(frames.data(), count, scalar.pointers.data(),
+											  scalar.valid.data()) == count);
+		check_against_vendor(frames, vector);
+		check_against_vendor(frames, scalar);
+	}
+}
+
+TEST_CASE("Batch decoding keeps NaN and infinity bit patterns", "[test/sps30_frame_batch]")
+{
+	constexpr size_t COUNT = 5;
+	const uint32_t patterns[] = {0x7fc00001, 0xffbfffff, 0x7f800000, 0xff800000, 0x80000000,
+								 0x00000001, 0x7f7fffff, 0x3f800000, 0xc2c80000, 0x7fa5a5a5};
+	auto frames = make_frames(COUNT, 1);
+
+	for(size_t i = 0; i < COUNT; i++)
+	{
+		for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+		{
+			const uint32_t bits = patterns[(f + i) % SPS30_RECORD_FIELD_COUNT];
+			uint8_t* value = &frames[i * SPS30_FRAME_SIZE + f * 6];
+			value[0] = static_cast<uint8_t>(bits >> 24);
+			value[1] = static_cast<uint8_t>(bits >> 16);
+			value[2] = sensirion_common_generate_crc(&value[0], SENSIRION_WORD_SIZE);
+			value[3] = static_cast<uint8_t>(bits >> 8);
+			value[4] = static_cast<uint8_t>(bits);
+			value[5] = sensirion_common_generate_crc(&value[3], SENSIRION_WORD_SIZE);
+		}
+	}
+
+	columns_t columns(COUNT);
+	CHECK(sps30_frame_decode_batch(frames.data(), COUNT, columns.pointers.data(),
+								   columns.valid.data()) == COUNT);
+	check_against_vendor(frames, columns);
+}
+
+TEST_CASE("Batch decoding flags frames with a bad CRC", "[test/sps30_frame_batch]")
+{
+	constexpr size_t COUNT = 23;
+	auto frames = make_frames(COUNT, 2);
+
+	// A flipped CRC bit, flipped data bits in the first and last word of a frame, and
+	// frames in vector groups and in the scalar tail
+	frames[0 * SPS30_FRAME_SIZE + 2] ^= 0x01;
+	frames[5 * SPS30_FRAME_SIZE + 0] ^= 0x80;
+	frames[6 * SPS30_FRAME_SIZE + SPS30_FRAME_SIZE - 2] ^= 0x10;
+	frames[6 * SPS30_FRAME_SIZE + SPS30_FRAME_SIZE - 3] ^= 0x10;
+	frames[15 * SPS30_FRAME_SIZE + 31] ^= 0xff;
+	frames[22 * SPS30_FRAME_SIZE + 58] ^= 0x04;
+
+	columns_t vector(COUNT);
+	columns_t scalar(COUNT);
+	CHECK(sps30_frame_decode_batch(frames.data(), COUNT, vector.pointers.data(),
+								   vector.valid.data()) == COUNT - 5);
+	CHECK(sps30_frame_decode_batch_scalar(frames.data(), COUNT, scalar.pointers.data(),
+										  scalar.valid.data()) == COUNT - 5);
+	CHECK(vector.valid == scalar.valid);
+	check_against_vendor(frames, vector);
+
+	for(size_t bad : {0, 5, 6, 15, 22})
+	{
+		CHECK(vector.valid[bad] == 0);
+	}
+}
+
+TEST_CASE("Benchmark batch frame decoding", "[.][benchmark][test/sps30_frame_batch]")
+{
+	constexpr size_t TOTAL_FRAMES = 1 << 22;
+
+	for(size_t count = 1; count <= 1024; count *= 4)
+	{
+		const auto frames = make_frames(count, 3);
+		columns_t columns(count);
+		const size_t rounds = TOTAL_FRAMES / count;
+		float per_frame[SPS30_RECORD_FIELD_COUNT];
+		size_t checksum = 0;
+
+		auto start = std::chrono::steady_clock::now();
+		for(size_t r = 0; r < rounds; r++)
+		{
+			for(size_t i = 0; i < count; i++)
+			{
+				checksum += vendor_decode(&frames[i * SPS30_FRAME_SIZE], per_frame);
+			}
+		}
+		const auto vendor = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+		start = std::chrono::steady_clock::now();
+		for(size_t r = 0; r < rounds; r++)
+		{
+			checksum += sps30_frame_decode_batch_scalar(frames.data(), count,
+														columns.pointers.data(),
+														columns.valid.data());
+		}
+		const auto scalar = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+		start = std::chrono::steady_clock::now();
+		for(size_t r = 0; r < rounds; r++)
+		{
+			checksum += sps30_frame_decode_batch(frames.data(), count, columns.pointers.data(),
+												 columns.valid.data());
+		}
+		const auto batch = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+		const double decoded = static_cast<double>(rounds * count);
+		printf("frame batch N=%-4zu: per-frame %6.1f M frames/s, scalar batch %6.1f M frames/s, "
+			   "batch %6.1f M frames/s (%zu)\n",
+			   count, decoded / vendor.count() / 1e6, decoded / scalar.count() / 1e6,
+			   decoded / batch.count() / 1e6, checksum);
+	}
+}
@@ -0,0 +1,253 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sps30_gorilla.h>
+#include <sps30_recorded_data.h>
+#include <vector>
+
+namespace
+{
+struct sample_t
+{
+	uint64_t timestamp_ms;
+	sps30_measurement measurement;
+};
+
+/// Decode a recorded 60-byte measurement frame (10 words + CRC pairs)
+sps30_measurement decode_frame(const uint8_t* frame)
+{
+	float values[10];
+	for(size_t i = 0; i < 10; i++)
+	{
+		const uint8_t bytes[4] = {frame[i * 6], frame[i * 6 + 1], frame[i * 6 + 3],
+								  frame[i * 6 + 4]};
+		values[i] = sensirion_bytes_to_float(bytes);
+	}
+
+	sps30_measurement m;
+	memcpy(&m, values, sizeof(m));
+	return m;
+}
+
+/// The recorded device frames, replayed at 1 Hz with ±20 ms of clock jitter
+std::vector<sample_t> recorded_corpus(size_t count)
+{
+	const uint8_t* frames[] = {
+		sps30_measurement_low_particle_response_1, sps30_measurement_low_particle_response_2,
+		sps30_measurement_low_particle_response_3, sps30_measurement_mid_particle_response_1,
+		sps30_measurement_mid_particle_response_2, sps30_measurement_zero_particle_response,
+	};
+	std::mt19937 rng(3);
+	std::uniform_int_distribution<int> jitter(-20, 20);
+	std::vector<sample_t> corpus;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		// Each recorded frame is held for a while, as PM readings change slowly
+		const auto frame = frames[(i / 8) % (sizeof(frames) / sizeof(frames[0]))];
+		corpus.push_back({1600000000000ull + i * 1000 + static_cast<uint64_t>(jitter(rng) + 20),
+						  decode_frame(frame)});
+	}
+
+	return corpus;
+}
+
+/// A slowly drifting particle concentration with sensor noise, sampled at exactly 1 Hz
+std::vector<sample_t> simulated_corpus(size_t count)
+{
+	std::mt19937 rng(8);
+	std::normal_distribution<float> drift(0.0f, 0.05f);
+	std::normal_distribution<float> noise(0.0f, 0.02f);
+	std::vector<sample_t> corpus;
+	float level = 5.0f;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		level = std::fabs(level + drift(rng));
+		sps30_measurement m;
+		m.mc_1p0 = level * 0.7f + noise(rng);
+		m.mc_2p5 = level + noise(rng);
+		m.mc_4p0 = level * 1.1f + noise(rng);
+		m.mc_10p0 = level * 1.15f + noise(rng);
+		m.nc_0p5 = level * 5.0f + noise(rng);
+		m.nc_1p0 = level * 6.0f + noise(rng);
+		m.nc_2p5 = level * 6.2f + noise(rng);
+		m.nc_4p0 = level * 6.25f + noise(rng);
+		m.nc_10p0 = level * 6.26f + noise(rng);
+		m.typical_particle_size = 0.6f;
+		corpus.push_back({i * 1000, m});
+	}
+
+	return corpus;
+}
+
+/// Compress a corpus into blocks, returning the total compressed size
+size_t compress(const std::vector<sample_t>& corpus, std::vector<uint8_t>& out,
+				std::vector<uint32_t>& block_counts, std::vector<size_t>& block_sizes)
+{
+	constexpr size_t BLOCK_SIZE = 4096;
+	sps30_gorilla_encoder encoder;
+	std::vector<uint8_t> block(BLOCK_SIZE);
+
+	sps30_gorilla_encoder_init(&encoder, block.data(), block.size());
+	auto flush = [&]() {
+		const auto size = sps30_gorilla_encoder_size(&encoder);
+		out.insert(out.end(), block.begin(), block.begin() + static_cast<long>(size));
+		block_counts.push_back(sps30_gorilla_encoder_count(&encoder));
+		block_sizes.push_back(size);
+		sps30_gorilla_encoder_init(&encoder, block.data(), block.size());
+	};
+
+	for(const auto& s : corpus)
+	{
+		if(sps30_gorilla_encode(&encoder, s.timestamp_ms, &s.measurement) ==
+		   SPS30_GORILLA_ERROR_FULL)
+		{
+			flush();
+			REQUIRE(sps30_gorilla_encode(&encoder, s.timestamp_ms, &s.measurement) == 0);
+		}
+	}
+	flush();
+
+	return out.size();
+}
+
+void check_round_trip(const std::vector<sample_t>& corpus)
+{
+	std::vector<uint8_t> compressed;
+	std::vector<uint32_t> counts;
+	std::vector<size_t> sizes;
+	compress(corpus, compressed, counts, sizes);
+
+	size_t offset = 0;
+	size_t index = 0;
+	for(size_t b = 0; b < counts.size(); b++)
+	{
+		sps30_gorilla_decoder decoder;
+		sps30_gorilla_decoder_init(&decoder, &compressed[offset], sizes[b], counts[b]);
+
+		uint64_t timestamp;
+		sps30_measurement m;
+		while(sps30_gorilla_decode(&decoder, &timestamp, &m) == 0)
+		{
+			REQUIRE(index < corpus.size());
+			CHECK(timestamp == corpus[index].timestamp_ms);
+			CHECK(memcmp(&m, &corpus[index].measurement, sizeof(m)) == 0);
+			index++;
+		}
+		offset += sizes[b];
+	}
+
+	CHECK(index == corpus.size());
+}
+} // namespace
+
+TEST_CASE("Gorilla stream round trips the recorded corpus", "[test/sps30_gorilla]")
+{
+	check_round_trip(recorded_corpus(1000));
+}
+
+TEST_CASE("Gorilla stream round trips the simulated corpus", "[test/sps30_gorilla]")
+{
+	check_round_trip(simulated_corpus(1000));
+}
+
+TEST_CASE("Gorilla stream handles irregular timestamps and special values",
+		  "[test/sps30_gorilla]")
+{
+	std::vector<sample_t> corpus = simulated_corpus(16);
+	corpus[3].measurement.mc_2p5 = NAN;
+	corpus[4].measurement.nc_0p5 = INFINITY;
+	corpus[5].measurement.mc_1p0 = -0.0f;
+	uint64_t t = 0;
+	const uint64_t gaps[] = {1000, 1000, 0, 3, 250000, 1000, 86400000, 1, 1000};
+	for(size_t i = 0; i < corpus.size(); i++)
+	{
+		t += gaps[i % (sizeof(gaps) / sizeof(gaps[0]))];
+		corpus[i].timestamp_ms = t;
+	}
+
+	check_round_trip(corpus);
+}
+
+TEST_CASE("Gorilla encoder reports a full buffer", "[test/sps30_gorilla]")
+{
+	uint8_t buffer[SPS30_GORILLA_MAX_SAMPLE_BYTES + 10];
+	sps30_gorilla_encoder encoder;
+	sps30_gorilla_encoder_init(&encoder, buffer, sizeof(buffer));
+	auto corpus = simulated_corpus(2);
+
+	CHECK(sps30_gorilla_encode(&encoder, 0, &corpus[0].measurement) == 0);
+	const auto size = sps30_gorilla_encoder_size(&encoder);
+	CHECK(sps30_gorilla_encode(&encoder, 1000, &corpus[1].measurement) ==
+		  SPS30_GORILLA_ERROR_FULL);
+	CHECK(sps30_gorilla_encoder_size(&encoder) == size);
+	CHECK(sps30_gorilla_encoder_count(&encoder) == 1);
+}
+
+TEST_CASE("Gorilla decoder detects truncated streams", "[test/sps30_gorilla]")
+{
+	auto corpus = simulated_corpus(10);
+	std::vector<uint8_t> compressed;
+	std::vector<uint32_t> counts;
+	std::vector<size_t> sizes;
+	compress(corpus, compressed, counts, sizes);
+
+	sps30_gorilla_decoder decoder;
+	sps30_gorilla_decoder_init(&decoder, compressed.data(), compressed.size() / 2, counts[0]);
+
+	uint64_t timestamp;
+	sps30_measurement m;
+	int16_t r;
+	while((r = sps30_gorilla_decode(&decoder, &timestamp, &m)) == 0)
+	{
+	}
+	CHECK(r == SPS30_GORILLA_ERROR_CORRUPT);
+}
+
+TEST_CASE("Benchmark Gorilla compression", "[.][benchmark][test/sps30_gorilla]")
+{
+	constexpr size_t COUNT = 86400; // One day at 1 Hz
+
+	for(const auto& corpus_info :
+		{std::make_pair("recorded", recorded_corpus(COUNT)),
+		 std::make_pair("simulated", simulated_corpus(COUNT))})
+	{
+		const auto& corpus = corpus_info.second;
+		std::vector<uint8_t> compressed;
+		std::vector<uint32_t> counts;
+		std::vector<size_t> sizes;
+
+		auto start = std::chrono::steady_clock::now();
+		compress(corpus, compressed, counts, sizes);
+		auto encode = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+		start = std::chrono::steady_clock::now();
+		size_t offset = 0;
+		float checksum = 0;
+		for(size_t b = 0; b < counts.size(); b++)
+		{
+			sps30_gorilla_decoder decoder;
+			sps30_gorilla_decoder_init(&decoder, &compressed[offset], sizes[b], counts[b]);
+			uint64_t timestamp;
+			sps30_measurement m;
+			while(sps30_gorilla_decode(&decoder, &timestamp, &m) == 0)
+			{
+				checksum += m.mc_2p5;
+			}
+			offset += sizes[b];
+		}
+		auto decode = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+		// Raw size: 8-byte timestamp + 40-byte measurement per sample
+		const double raw = static_cast<double>(COUNT * (8 + sizeof(sps30_measurement)));
+		printf("gorilla %-9s: %.2fx (%.1f bytes/sample), encode %.1f MB/s, decode %.1f MB/s "
+			   "(%f)\n",
+			   corpus_info.first, raw / static_cast<double>(compressed.size()),
+			   static_cast<double>(compressed.size()) / COUNT, raw / encode.count() / 1e6,
+			   raw / decode.count() / 1e6, static_cast<double>(checksum));
+	}
+}
@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sps30_log_aggregate.h>
+#include <sps30_record_log.h>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace
+{
+/// A scratch directory that is removed with its contents when the test ends
+class scratch_directory
+{
+  public:
+	scratch_directory()
+	{
+		char path[] = "/tmp/sps30_log_aggregate_XXXXXX";
+		REQUIRE(mkdtemp(path) != nullptr);
+		path_ = path;
+	}
+
+	~scratch_directory()
+	{
+		for(const auto& name : names_)
+		{
+			unlink(file(name.c_str()).c_str());
+		}
+		rmdir(path_.c_str());
+	}
+
+	std::string file(const char* name)
+	{
+		if(std::find(names_.begin(), names_.end(), name) == names_.end())
+		{
+			names_.emplace_back(name);
+		}
+		return path_ + "/" + name;
+	}
+
+  private:
+	std::string path_;
+	std::vector<std::string> names_;
+};
+
+constexpr uint64_t START_MS = 1600000000000;
+
+/// A reproducible record. Values span the histogram, including zero.
+sps30_record make_record(uint64_t sensor_id, uint16_t channel, uint32_t i)
+{
+	sps30_measurement m;
+	float* values = &m.mc_1p0;
+	uint32_t state = static_cast<uint32_t>(sensor_id) * 2654435761u + i * 40503u;
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		state = state * 1664525u + 1013904223u;
+		// Mostly small readings, with occasional spikes
+		const float base = static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+		values[f] = (state & 0x7) ? base * 50.0f : base * 3000.0f;
+		if((state & 0xf0) == 0)
+		{
+			values[f] = 0.0f;
+		}
+	}
+
+	sps30_record record;
+	sps30_record_init(&record, sensor_id, channel, 0, START_MS + i * 1000ull, &m);
+	return record;
+}
+
+/// Write count records per sensor, interleaved, through the record log
+void write_log(const std::string& path, const std::vector<uint64_t>& sensors, uint32_t count)
+{
+	static uint8_t buffer[256 * 1024];
+	sps30_record_log log;
+	const sps30_record_log_config config = {path.c_str(), buffer, sizeof(buffer), 0, 0, 0, 0,
+											SPS30_LOG_WRITER_SYNC, 0};
+
+	REQUIRE(sps30_record_log_open(&log, &config) == 0);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		for(size_t s = 0; s < sensors.size(); s++)
+		{
+			uint8_t payload[SPS30_RECORD_SIZE];
+			const auto record = make_record(sensors[s], static_cast<uint16_t>(s), i);
+			sps30_record_encode(&record, payload);
+			REQUIRE(sps30_record_log_append(&log, payload, sizeof(payload), 0) == 0);
+		}
+	}
+	REQUIRE(sps30_record_log_close(&log) == 0);
+}
+
+using sensor_key = std::pair<uint64_t, uint16_t>;
+
+struct naive_result
+{
+	std::map<sensor_key, sps30_log_aggregate_stats> sensors;
+	std::map<sensor_key, std::vector<std::vector<float>>> values;
+	uint64_t skipped = 0;
+};
+
+/// Read every file front to back on one thread, one record at a time
+void naive_scan(const sps30_log_aggregate_config& config, naive_result& result,
+				bool keep_values)
+{
+	for(size_t p = 0; p < config.path_count; p++)
+	{
+		std::vector<uint8_t> contents;
+		FILE* file = fopen(config.paths[p], "rb");
+		REQUIRE(file != nullptr);
+		uint8_t chunk[65536];
+		size_t n;
+		while((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		{
+			contents.insert(contents.end(), chunk, chunk + n);
+		}
+		fclose(file);
+
+		bool resynchronizing = false;
+		for(size_t position = 0; position < contents.size();)
+		{
+			const uint8_t* payload;
+			uint16_t length;
+			const int32_t r = sps30_record_log_frame_decode(
+				&contents[position], contents.size() - position, &payload, &length);
+			if(r == SPS30_RECORD_LOG_ERROR_TRUNCATED)
+			{
+				break;
+			}
+			if(r < 0)
+			{
+				result.skipped += !resynchronizing;
+				resynchronizing = true;
+				position++;
+				continue;
+			}
+			resynchronizing = false;
+			position += static_cast<size_t>(r);
+
+			sps30_record record;
+			if(length != SPS30_RECORD_SIZE || sps30_record_decode(payload, &record) != 0)
+			{
+				result.skipped++;
+				continue;
+			}
+			if(record.timestamp_ms < config.start_ms || record.timestamp_ms > config.end_ms)
+			{
+				continue;
+			}
+
+			const sensor_key key{record.sensor_id, record.channel};
+			auto found = result.sensors.find(key);
+			if(found == result.sensors.end())
+			{
+				found = result.sensors.emplace(key, sps30_log_aggregate_stats()).first;
+				sps30_log_aggregate_stats_init(&found->second, key.first, key.second);
+				if(keep_values)
+				{
+					result.values[key].resize(SPS30_RECORD_FIELD_COUNT);
+				}
+			}
+			sps30_log_aggregate_stats_add(&found->second, &record, config.thresholds);
+			if(keep_values)
+			{
+				for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+				{
+					result.values[key][f].push_back(record.values[f]);
+				}
+			}
+		}
+	}
+}
+
+void check_stats(const sps30_log_aggregate_stats& actual, const sps30_log_aggregate_stats& expected)
+{
+	REQUIRE(actual.count == expected.count);
+	CHECK(actual.first_timestamp_ms == expected.first_timestamp_ms);
+	CHECK(actual.last_timestamp_ms == expected.last_timestamp_ms);
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		CHECK(actual.min[f] == expected.min[f]);
+		CHECK(actual.max[f] == expected.max[f]);
+		CHECK(actual.exceedances[f] == expected.exceedances[f]);
+		// Columns are summed in single precision before being added to the total
+		CHECK_THAT(actual.sum[f], Catch::Matchers::WithinRel(expected.sum[f], 1e-6));
+		CHECK(memcmp(actual.histogram[f], expected.histogram[f], sizeof(actual.histogram[f])) ==
+			  0);
+	}
+}
+
+/// Three files of uneven size, one with several sensors and a damaged region
+std::vector<std::string> make_fleet(scratch_directory& dir)
+{
+	std::vector<std::string> paths = {dir.file("a"), dir.file("b"), dir.file("c")};
+	write_log(paths[0], {0x1001, 0x1002, 0x1003, 0x1004, 0x1005}, 1200);
+	write_log(paths[1], {0x2001}, 3001);
+	write_log(paths[2], {0x3001, 0x1001}, 200);
+
+	// Damage a few frames in the middle of the first file
+	FILE* file = fopen(paths[0].c_str(), "r+b");
+	REQUIRE(file != nullptr);
+	REQUIRE(fseek(file, 100000, SEEK_SET) == 0);
+	const uint8_t garbage[150] = {0x53, 0x50, 0x53, 0x50};
+	REQUIRE(fwrite(garbage, 1, sizeof(garbage), file) == sizeof(garbage));
+	fclose(file);
+
+	return paths;
+}
+} // namespace
+
+TEST_CASE("Aggregate histogram bins", "[test/sps30_log_aggregate]")
+{
+	CHECK(sps30_log_aggregate_bin(0.0f) == 0);
+	CHECK(sps30_log_aggregate_bin(-5.0f) == 0);
+	CHECK(sps30_log_aggregate_bin(NAN) == SPS30_LOG_AGGREGATE_BINS - 1);
+	CHECK(sps30_log_aggregate_bin(0.0624f) == 0);
+	CHECK(sps30_log_aggregate_bin(0.0625f) == 1);
+	CHECK(sps30_log_aggregate_bin(8191.9f) == SPS30_LOG_AGGREGATE_BINS - 2);
+	CHECK(sps30_log_aggregate_bin(8192.0f) == SPS30_LOG_AGGREGATE_BINS - 1);
+	CHECK(sps30_log_aggregate_bin(INFINITY) == SPS30_LOG_AGGREGATE_BINS - 1);
+
+	// Bins are ordered, and each one is at most 1/32 of its lower bound wide
+	unsigned previous = 0;
+	for(float value = 0.0625f; value < 8192.0f; value *= 1.01f)
+	{
+		const unsigned bin = sps30_log_aggregate_bin(value);
+		CHECK(bin >= previous);
+		CHECK(bin <= previous + 1);
+		previous = bin;
+	}
+
+	// A single value is reported exactly, since percentiles are clamped to the range
+	sps30_log_aggregate_stats stats;
+	sps30_log_aggregate_stats_init(&stats, 1, 0);
+	const auto record = make_record(1, 0, 0);
+	const float thresholds[SPS30_RECORD_FIELD_COUNT] = {};
+	sps30_log_aggregate_stats_add(&stats, &record, thresholds);
+	CHECK(sps30_log_aggregate_percentile(&stats, 3, 0.5) == record.values[3]);
+	CHECK(sps30_log_aggregate_mean(&stats, 3) == record.values[3]);
+}
+
+TEST_CASE("Aggregation matches a naive scan", "[test/sps30_log_aggregate]")
+{
+	scratch_directory dir;
+	const auto paths = make_fleet(dir);
+	std::vector<const char*> path_list;
+	for(const auto& path : paths)
+	{
+		path_list.push_back(path.c_str());
+	}
+
+	sps30_log_aggregate_config config;
+	sps30_log_aggregate_config_init(&config, path_list.data(), path_list.size());
+	// Small chunks, so most chunks start mid-frame
+	config.chunk_bytes = 4000;
+	config.thresholds[1] = 35.0f;  // mc_2p5
+	config.thresholds[3] = 150.0f; // mc_10p0
+
+	SECTION("Every record")
+	{
+	}
+
+	SECTION("A time range")
+	{
+		config.start_ms = START_MS + 100'500;
+		config.end_ms = START_MS + 1'000'000;
+	}
+
+	naive_result expected;
+	naive_scan(config, expected, true);
+	CHECK(expected.sensors.size() == 8);
+
+	for(const unsigned threads : {1u, 3u, 8u})
+	{
+		config.threads = threads;
+		sps30_log_aggregate_result result;
+		REQUIRE(sps30_log_aggregate_run(&config, &result) == 0);
+
+		CHECK(result.threads == threads);
+		CHECK(result.skipped == expected.skipped);
+		REQUIRE(result.sensor_count == expected.sensors.size());
+
+		sps30_log_aggregate_stats fleet;
+		sps30_log_aggregate_stats_init(&fleet, 0, 0);
+		size_t i = 0;
+		for(const auto& [key, stats] : expected.sensors)
+		{
+			CHECK(result.sensors[i].sensor_id == key.first);
+			CHECK(result.sensors[i].channel == key.second);
+			check_stats(result.sensors[i], stats);
+			sps30_log_aggregate_stats_merge(&fleet, &stats);
+
+			// Percentiles are within half a bin of the exact value
+			for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+			{
+				auto values = expected.values[key][f];
+				std::sort(values.begin(), values.end());
+				for(const double q : {0.5, 0.95, 0.99})
+				{
+					const size_t rank = std::max<size_t>(
+						1, static_cast<size_t>(std::ceil(q * static_cast<double>(values.size()))));
+					const float exact = values[rank - 1];
+					const float estimate =
+						sps30_log_aggregate_percentile(&result.sensors[i], f, q);
+					CHECK(std::fabs(estimate - exact) <= std::max(exact / 64.0f, 0.0625f));
+				}
+			}
+			i++;
+		}
+		check_stats(result.fleet, fleet);
+
+		sps30_log_aggregate_free(&result);
+	}
+}
+
+TEST_CASE("Aggregation reports unreadable files", "[test/sps30_log_aggregate]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("missing");
+	const char* paths[] = {path.c_str()};
+	sps30_log_aggregate_config config;
+	sps30_log_aggregate_result result;
+
+	sps30_log_aggregate_config_init(&config, paths, 1);
+	CHECK(sps30_log_aggregate_run(&config, &result) == SPS30_LOG_AGGREGATE_ERROR_IO);
+	sps30_log_aggregate_free(&result);
+
+	// An empty file has no records
+	FILE* file = fopen(path.c_str(), "wb");
+	REQUIRE(file != nullptr);
+	fclose(file);
+	REQUIRE(sps30_log_aggregate_run(&config, &result) == 0);
+	CHECK(result.sensor_count == 0);
+	CHECK(result.fleet.count == 0);
+	CHECK(sps30_log_aggregate_percentile(&result.fleet, 1, 0.5) == 0.0f);
+	sps30_log_aggregate_free(&result);
+}
+
+TEST_CASE("Benchmark: parallel aggregation over a fleet of logs",
+		  "[.][benchmark][test/sps30_log_aggregate]")
+{
+	// 200 sensors, one file each, holding 30 days of one-minute samples
+	constexpr unsigned SENSORS = 200;
+	constexpr uint32_t RECORDS = 30 * 24 * 60;
+
+	scratch_directory dir;
+	std::vector<std::string> paths;
+	std::vector<const char*> path_list;
+	for(unsigned s = 0; s < SENSORS; s++)
+	{
+		const std::string name = "sensor" + std::to_string(s);
+		paths.push_back(dir.file(name.c_str()));
+		write_log(paths.back(), {0x10000u + s}, RECORDS);
+	}
+	for(const auto& path : paths)
+	{
+		path_list.push_back(path.c_str());
+	}
+
+	sps30_log_aggregate_config config;
+	sps30_log_aggregate_config_init(&config, path_list.data(), path_list.size());
+	config.thresholds[1] = 35.0f;
+
+	using clock = std::chrono::steady_clock;
+	const auto seconds = [](clock::duration d) {
+		return std::chrono::duration<double>(d).count();
+	};
+
+	// Warm the page cache, so both scans read from memory
+	naive_result warm;
+	naive_scan(config, warm, false);
+
+	auto start = clock::now();
+	naive_result naive;
+	naive_scan(config, naive, false);
+	const double naive_s = seconds(clock::now() - start);
+	const uint64_t records = uint64_t(SENSORS) * RECORDS;
+	printf("%llu records in %u files, %.0f MB\n", (unsigned long long)records, SENSORS,
+		   double(records) * (SPS30_RECORD_SIZE + SPS30_RECORD_LOG_FRAME_OVERHEAD) / 1e6);
+	printf("naive scan, 1 thread:  %7.1f ms, %6.1f M records/s\n", naive_s * 1e3,
+		   double(records) / naive_s / 1e6);
+
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	for(unsigned threads = 1; threads <= static_cast<unsigned>(std::max(cpus, 4L));
+		threads *= 2)
+	{
+		config.threads = threads;
+		sps30_log_aggregate_result result;
+		start = clock::now();
+		REQUIRE(sps30_log_aggregate_run(&config, &result) == 0);
+		const double s = seconds(clock::now() - start);
+		CHECK(result.fleet.count == records);
+		printf("engine, %2u threads:    %7.1f ms, %6.1f M records/s, %.1fx naive, %llu steals\n",
+			   threads, s * 1e3, double(records) / s / 1e6, naive_s / s,
+			   (unsigned long long)result.steals);
+		sps30_log_aggregate_free(&result);
+	}
+	printf("(%ld CPUs online)\n", cpus);
+}
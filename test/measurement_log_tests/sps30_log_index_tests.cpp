@@ -0,0 +1,539 @@
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sps30_log_index.h>
+#include <sps30_record_log.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+/// A scratch directory that is removed with its contents when the test ends
+class scratch_directory
+{
+  public:
+	scratch_directory()
+	{
+		char path[] = "/tmp/sps30_log_index_XXXXXX";
+		REQUIRE(mkdtemp(path) != nullptr);
+		path_ = path;
+	}
+
+	~scratch_directory()
+	{
+		for(const auto& name : {"log", "log.1", "log.2", "log.3", "log.idx", "log.1.idx",
+								"log.2.idx", "log.3.idx"})
+		{
+			unlink(file(name).c_str());
+		}
+		rmdir(path_.c_str());
+	}
+
+	std::string file(const char* name) const
+	{
+		return path_ + "/" + name;
+	}
+
+  private:
+	std::string path_;
+};
+
+std::vector<uint8_t> read_file(const std::string& path)
+{
+	std::vector<uint8_t> contents;
+	FILE* file = fopen(path.c_str(), "rb");
+	if(file)
+	{
+		uint8_t chunk[4096];
+		size_t n;
+		while((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		{
+			contents.insert(contents.end(), chunk, chunk + n);
+		}
+		fclose(file);
+	}
+	return contents;
+}
+
+bool file_exists(const std::string& path)
+{
+	return access(path.c_str(), F_OK) == 0;
+}
+
+constexpr uint64_t START_MS = 1600000000000;
+constexpr uint64_t SENSOR_IDS[] = {0x1111, 0x2222, 0x3333};
+
+/// Record i of a stream that samples three sensors in turn, one sensor per second
+sps30_record make_record(uint32_t i)
+{
+	sps30_measurement m;
+	float* values = &m.mc_1p0;
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		values[f] = static_cast<float>((i * 37 + f * 11) % 101) / 4.0f;
+	}
+
+	sps30_record record;
+	sps30_record_init(&record, SENSOR_IDS[i % 3], static_cast<uint16_t>(i % 3), 0,
+					  START_MS + i * 1000, &m);
+	return record;
+}
+
+/// Log records first..last-1, indexing them as they are committed unless index is null
+void log_records(const std::string& path, uint32_t first, uint32_t last,
+				 sps30_log_index_writer* index, uint64_t max_file_bytes = 0)
+{
+	uint8_t buffer[8192];
+	sps30_record_log log;
+	// Commits of 50 records, which do not line up with index blocks
+	const sps30_record_log_config config = {path.c_str(), buffer, sizeof(buffer), 50, 0,
+											max_file_bytes, 2, SPS30_LOG_WRITER_SYNC, 0};
+
+	REQUIRE(sps30_record_log_open(&log, &config) == 0);
+	if(index)
+	{
+		sps30_record_log_set_commit_hook(&log, sps30_log_index_writer_add, index);
+	}
+
+	for(uint32_t i = first; i < last; i++)
+	{
+		uint8_t payload[SPS30_RECORD_SIZE];
+		const auto record = make_record(i);
+		sps30_record_encode(&record, payload);
+		REQUIRE(sps30_record_log_append(&log, payload, sizeof(payload), 0) == 0);
+	}
+	REQUIRE(sps30_record_log_close(&log) == 0);
+}
+
+/// Summarize records first..last-1 the slow way
+sps30_log_index_summary naive_summary(uint32_t first, uint32_t last, uint64_t sensor_id,
+									  int32_t channel, uint64_t start_ms, uint64_t end_ms)
+{
+	sps30_log_index_summary summary;
+	sps30_log_index_summary_init(&summary);
+
+	for(uint32_t i = first; i < last; i++)
+	{
+		const auto r = make_record(i);
+		if((sensor_id != SPS30_LOG_INDEX_ANY_SENSOR && r.sensor_id != sensor_id) ||
+		   (channel != SPS30_LOG_INDEX_ANY_CHANNEL && r.channel != channel) ||
+		   r.timestamp_ms < start_ms || r.timestamp_ms > end_ms)
+		{
+			continue;
+		}
+
+		summary.count++;
+		summary.first_timestamp_ms = std::min(summary.first_timestamp_ms, r.timestamp_ms);
+		summary.last_timestamp_ms = std::max(summary.last_timestamp_ms, r.timestamp_ms);
+		for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+		{
+			summary.min[f] = std::min(summary.min[f], r.values[f]);
+			summary.max[f] = std::max(summary.max[f], r.values[f]);
+			summary.sum[f] += r.values[f];
+		}
+	}
+
+	return summary;
+}
+
+void check_summary(const sps30_log_index_summary& actual, const sps30_log_index_summary& expected)
+{
+	REQUIRE(actual.count == expected.count);
+	if(expected.count == 0)
+	{
+		return;
+	}
+
+	CHECK(actual.first_timestamp_ms == expected.first_timestamp_ms);
+	CHECK(actual.last_timestamp_ms == expected.last_timestamp_ms);
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		CHECK(actual.min[f] == expected.min[f]);
+		CHECK(actual.max[f] == expected.max[f]);
+		// Block sums are stored in full, and the test values are exact in binary
+		CHECK(actual.sum[f] == expected.sum[f]);
+	}
+}
+
+constexpr uint32_t RECORDS = 3000;
+constexpr uint32_t BLOCK_RECORDS = 256;
+} // namespace
+
+TEST_CASE("Index aggregates match a scan of the log", "[test/sps30_log_index]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("log");
+	sps30_log_index_writer writer;
+
+	REQUIRE(sps30_log_index_writer_open(&writer, path.c_str(), BLOCK_RECORDS, 2) == 0);
+	log_records(path, 0, RECORDS, &writer);
+	REQUIRE(sps30_log_index_writer_close(&writer) == 0);
+	CHECK(writer.stats.blocks == (RECORDS + BLOCK_RECORDS - 1) / BLOCK_RECORDS);
+	CHECK(writer.stats.entries == 3 * writer.stats.blocks);
+	CHECK(writer.stats.skipped == 0);
+
+	sps30_log_index index;
+	REQUIRE(sps30_log_index_load(&index, path.c_str()) == 0);
+	CHECK(index.count == writer.stats.entries);
+
+	const struct
+	{
+		uint64_t sensor_id;
+		int32_t channel;
+		uint64_t start_ms;
+		uint64_t end_ms;
+	} queries[] = {
+		{SPS30_LOG_INDEX_ANY_SENSOR, SPS30_LOG_INDEX_ANY_CHANNEL, 0, UINT64_MAX},
+		{SPS30_LOG_INDEX_ANY_SENSOR, SPS30_LOG_INDEX_ANY_CHANNEL, START_MS + 500'500,
+		 START_MS + 2'200'000},
+		{0x2222, SPS30_LOG_INDEX_ANY_CHANNEL, START_MS + 100'000, START_MS + 2'900'000},
+		{SPS30_LOG_INDEX_ANY_SENSOR, 2, START_MS + 1'000'000, START_MS + 1'000'000},
+		{0x3333, 2, START_MS + 2'000'000, START_MS + 2'000'000},
+		{0x3333, 1, 0, UINT64_MAX},
+		{SPS30_LOG_INDEX_ANY_SENSOR, SPS30_LOG_INDEX_ANY_CHANNEL, 0, START_MS - 1},
+		{SPS30_LOG_INDEX_ANY_SENSOR, SPS30_LOG_INDEX_ANY_CHANNEL, START_MS + RECORDS * 1000,
+		 UINT64_MAX},
+	};
+
+	for(const auto& q : queries)
+	{
+		sps30_log_index_summary summary;
+		sps30_log_index_summary_init(&summary);
+		sps30_log_index_aggregate(&index, q.sensor_id, q.channel, q.start_ms, q.end_ms,
+								  &summary);
+		check_summary(summary,
+					  naive_summary(0, RECORDS, q.sensor_id, q.channel, q.start_ms, q.end_ms));
+		// Only the blocks at the edges of the range are read
+		CHECK(summary.blocks_scanned <= 2);
+	}
+
+	// A range inside one block is answered by reading that block alone
+	sps30_log_index_summary summary;
+	sps30_log_index_summary_init(&summary);
+	sps30_log_index_aggregate(&index, SPS30_LOG_INDEX_ANY_SENSOR, SPS30_LOG_INDEX_ANY_CHANNEL,
+							  START_MS + 10'000, START_MS + 20'000, &summary);
+	CHECK(summary.count == 11);
+	CHECK(summary.blocks_scanned == 1);
+	CHECK(summary.blocks_summarized == 0);
+
+	sps30_log_index_unload(&index);
+}
+
+TEST_CASE("Index finds the latest record at a time", "[test/sps30_log_index]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("log");
+	sps30_log_index_writer writer;
+	sps30_log_index index;
+	sps30_record record;
+
+	REQUIRE(sps30_log_index_writer_open(&writer, path.c_str(), BLOCK_RECORDS, 2) == 0);
+	log_records(path, 0, 1000, &writer);
+	REQUIRE(sps30_log_index_writer_close(&writer) == 0);
+	// Records appended without the index are found by scanning the tail of the log
+	log_records(path, 1000, 1100, nullptr);
+
+	REQUIRE(sps30_log_index_load(&index, path.c_str()) == 0);
+
+	CHECK(sps30_log_index_find(&index, SPS30_LOG_INDEX_ANY_SENSOR, SPS30_LOG_INDEX_ANY_CHANNEL,
+							   START_MS - 1, &record) == SPS30_LOG_INDEX_ERROR_NOT_FOUND);
+
+	REQUIRE(sps30_log_index_find(&index, SPS30_LOG_INDEX_ANY_SENSOR,
+								 SPS30_LOG_INDEX_ANY_CHANNEL, START_MS + 500'000, &record) == 0);
+	CHECK(record.timestamp_ms == START_MS + 500'000);
+
+	// Sensor 0x1111 last reported at record 498 before record 500
+	REQUIRE(sps30_log_index_find(&index, 0x1111, SPS30_LOG_INDEX_ANY_CHANNEL,
+								 START_MS + 500'999, &record) == 0);
+	CHECK(record.timestamp_ms == START_MS + 498'000);
+	CHECK(record.sensor_id == 0x1111);
+	CHECK(record.values[0] == make_record(498).values[0]);
+
+	REQUIRE(sps30_log_index_find(&index, SPS30_LOG_INDEX_ANY_SENSOR, 1, UINT64_MAX, &record) ==
+			0);
+	CHECK(record.timestamp_ms == START_MS + 1099'000);
+
+	CHECK(sps30_log_index_find(&index, 0x1111, 1, UINT64_MAX, &record) ==
+		  SPS30_LOG_INDEX_ERROR_NOT_FOUND);
+
+	sps30_log_index_summary summary;
+	sps30_log_index_summary_init(&summary);
+	sps30_log_index_aggregate(&index, SPS30_LOG_INDEX_ANY_SENSOR, SPS30_LOG_INDEX_ANY_CHANNEL, 0,
+							  UINT64_MAX, &summary);
+	check_summary(summary, naive_summary(0, 1100, SPS30_LOG_INDEX_ANY_SENSOR,
+										 SPS30_LOG_INDEX_ANY_CHANNEL, 0, UINT64_MAX));
+
+	sps30_log_index_unload(&index);
+}
+
+TEST_CASE("Index built from a log matches the index built while logging",
+		  "[test/sps30_log_index]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("log");
+	sps30_log_index_writer writer;
+
+	REQUIRE(sps30_log_index_writer_open(&writer, path.c_str(), BLOCK_RECORDS, 2) == 0);
+	log_records(path, 0, 1000, &writer);
+	REQUIRE(sps30_log_index_writer_close(&writer) == 0);
+	const auto logged = read_file(path + SPS30_LOG_INDEX_SUFFIX);
+	CHECK(logged.size() ==
+		  sizeof(sps30_log_index_header) + writer.stats.entries * sizeof(sps30_log_index_entry));
+
+	REQUIRE(sps30_log_index_build(path.c_str(), BLOCK_RECORDS) == 0);
+	CHECK(read_file(path + SPS30_LOG_INDEX_SUFFIX) == logged);
+
+	// A log without an index is still queried, by scanning it
+	unlink((path + SPS30_LOG_INDEX_SUFFIX).c_str());
+	sps30_log_index index;
+	REQUIRE(sps30_log_index_load(&index, path.c_str()) == 0);
+	CHECK(index.count == 0);
+	sps30_log_index_summary summary;
+	sps30_log_index_summary_init(&summary);
+	sps30_log_index_aggregate(&index, SPS30_LOG_INDEX_ANY_SENSOR, SPS30_LOG_INDEX_ANY_CHANNEL, 0,
+							  UINT64_MAX, &summary);
+	CHECK(summary.count == 1000);
+	sps30_log_index_unload(&index);
+}
+
+TEST_CASE("Index catches up with records committed before a crash", "[test/sps30_log_index]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("log");
+	sps30_log_index_writer writer;
+	sps30_log_index index;
+	sps30_record record;
+
+	// One block of 4 is written, and the 2 records after it are lost with the writer
+	REQUIRE(sps30_log_index_writer_open(&writer, path.c_str(), 4, 2) == 0);
+	log_records(path, 0, 6, &writer);
+	CHECK(writer.stats.blocks == 1);
+	close(writer.fd);
+
+	REQUIRE(sps30_log_index_writer_open(&writer, path.c_str(), 4, 2) == 0);
+	log_records(path, 6, 12, &writer);
+	REQUIRE(sps30_log_index_writer_close(&writer) == 0);
+
+	REQUIRE(sps30_log_index_load(&index, path.c_str()) == 0);
+	sps30_log_index_summary summary;
+	sps30_log_index_summary_init(&summary);
+	sps30_log_index_aggregate(&index, SPS30_LOG_INDEX_ANY_SENSOR, SPS30_LOG_INDEX_ANY_CHANNEL, 0,
+							  UINT64_MAX, &summary);
+	check_summary(summary, naive_summary(0, 12, SPS30_LOG_INDEX_ANY_SENSOR,
+										 SPS30_LOG_INDEX_ANY_CHANNEL, 0, UINT64_MAX));
+	CHECK(summary.blocks_scanned == 0);
+
+	REQUIRE(sps30_log_index_find(&index, SPS30_LOG_INDEX_ANY_SENSOR,
+								 SPS30_LOG_INDEX_ANY_CHANNEL, START_MS + 5'000, &record) == 0);
+	CHECK(record.timestamp_ms == START_MS + 5'000);
+	sps30_log_index_unload(&index);
+
+	// The same index is built from the log
+	const auto caught_up = read_file(path + SPS30_LOG_INDEX_SUFFIX);
+	REQUIRE(sps30_log_index_build(path.c_str(), 4) == 0);
+	CHECK(read_file(path + SPS30_LOG_INDEX_SUFFIX) == caught_up);
+}
+
+TEST_CASE("Index of a replaced log is rebuilt", "[test/sps30_log_index]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("log");
+	sps30_log_index_writer writer;
+
+	log_records(path, 0, 100, nullptr);
+	REQUIRE(sps30_log_index_build(path.c_str(), 16) == 0);
+	unlink(path.c_str());
+	log_records(path, 0, 10, nullptr);
+
+	REQUIRE(sps30_log_index_writer_open(&writer, path.c_str(), 16, 2) == 0);
+	REQUIRE(sps30_log_index_writer_close(&writer) == 0);
+
+	sps30_log_index index;
+	REQUIRE(sps30_log_index_load(&index, path.c_str()) == 0);
+	CHECK(index.count == 3);
+	sps30_log_index_summary summary;
+	sps30_log_index_summary_init(&summary);
+	sps30_log_index_aggregate(&index, SPS30_LOG_INDEX_ANY_SENSOR, SPS30_LOG_INDEX_ANY_CHANNEL, 0,
+							  UINT64_MAX, &summary);
+	CHECK(summary.count == 10);
+	sps30_log_index_unload(&index);
+}
+
+TEST_CASE("Index rejects another format", "[test/sps30_log_index]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("log");
+	const auto index_path = path + SPS30_LOG_INDEX_SUFFIX;
+	sps30_log_index_writer writer;
+	sps30_log_index index;
+
+	log_records(path, 0, 100, nullptr);
+	REQUIRE(sps30_log_index_build(path.c_str(), 0) == 0);
+
+	auto contents = read_file(index_path);
+	REQUIRE(contents.size() > sizeof(sps30_log_index_header));
+	contents[0] ^= 0xff;
+	FILE* file = fopen(index_path.c_str(), "wb");
+	REQUIRE(file != nullptr);
+	fwrite(contents.data(), 1, contents.size(), file);
+	fclose(file);
+
+	CHECK(sps30_log_index_load(&index, path.c_str()) == SPS30_LOG_INDEX_ERROR_VERSION);
+	CHECK(sps30_log_index_writer_open(&writer, path.c_str(), 0, 2) ==
+		  SPS30_LOG_INDEX_ERROR_VERSION);
+
+	// Rebuilding replaces it
+	REQUIRE(sps30_log_index_build(path.c_str(), 0) == 0);
+	REQUIRE(sps30_log_index_load(&index, path.c_str()) == 0);
+	CHECK(index.count == 3);
+	sps30_log_index_unload(&index);
+}
+
+TEST_CASE("Index follows log rotation", "[test/sps30_log_index]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("log");
+	sps30_log_index_writer writer;
+	constexpr size_t FRAME_SIZE = SPS30_RECORD_SIZE + SPS30_RECORD_LOG_FRAME_OVERHEAD;
+
+	// Room for 400 records per file, so 1000 records leave files of 200, 400, and 400
+	REQUIRE(sps30_log_index_writer_open(&writer, path.c_str(), 128, 2) == 0);
+	log_records(path, 0, 1000, &writer, 400 * FRAME_SIZE);
+	REQUIRE(sps30_log_index_writer_close(&writer) == 0);
+
+	CHECK(file_exists(dir.file("log.1.idx")));
+	CHECK(file_exists(dir.file("log.2.idx")));
+	CHECK_FALSE(file_exists(dir.file("log.3.idx")));
+
+	const struct
+	{
+		const char* name;
+		uint32_t first;
+		uint32_t last;
+	} files[] = {{"log.2", 0, 400}, {"log.1", 400, 800}, {"log", 800, 1000}};
+
+	for(const auto& f : files)
+	{
+		sps30_log_index index;
+		REQUIRE(sps30_log_index_load(&index, dir.file(f.name).c_str()) == 0);
+		sps30_log_index_summary summary;
+		sps30_log_index_summary_init(&summary);
+		sps30_log_index_aggregate(&index, SPS30_LOG_INDEX_ANY_SENSOR,
+								  SPS30_LOG_INDEX_ANY_CHANNEL, 0, UINT64_MAX, &summary);
+		check_summary(summary, naive_summary(f.first, f.last, SPS30_LOG_INDEX_ANY_SENSOR,
+											 SPS30_LOG_INDEX_ANY_CHANNEL, 0, UINT64_MAX));
+		// Every record is answered from the index
+		CHECK(summary.blocks_scanned == 0);
+		sps30_log_index_unload(&index);
+	}
+}
+
+TEST_CASE("Benchmark: index queries over a year of 1 Hz records",
+		  "[.][benchmark][test/sps30_log_index]")
+{
+	// One sensor, one record per second for a year: about 31.5 million records and 2.3 GB
+	constexpr uint32_t YEAR_S = 365 * 24 * 3600;
+	constexpr uint64_t HOUR_MS = 3600 * 1000;
+
+	char directory[] = "/tmp/sps30_log_index_bench_XXXXXX";
+	REQUIRE(mkdtemp(directory) != nullptr);
+	const std::string path = std::string(directory) + "/log";
+	const std::string index_path = path + SPS30_LOG_INDEX_SUFFIX;
+
+	using clock = std::chrono::steady_clock;
+	const auto seconds = [](clock::duration d) {
+		return std::chrono::duration<double>(d).count();
+	};
+
+	{
+		static uint8_t buffer[1 << 20];
+		sps30_record_log log;
+		const sps30_record_log_config config = {path.c_str(),	  buffer, sizeof(buffer), 0, 0,
+												0, 0, SPS30_LOG_WRITER_SYNC, 0};
+		sps30_log_index_writer writer;
+
+		REQUIRE(sps30_record_log_open(&log, &config) == 0);
+		REQUIRE(sps30_log_index_writer_open(&writer, path.c_str(), 0, 0) == 0);
+		sps30_record_log_set_commit_hook(&log, sps30_log_index_writer_add, &writer);
+
+		const auto start = clock::now();
+		uint32_t errors = 0;
+		for(uint32_t i = 0; i < YEAR_S; i++)
+		{
+			sps30_record record = make_record(i * 3);
+			record.timestamp_ms = START_MS + uint64_t(i) * 1000;
+			uint8_t payload[SPS30_RECORD_SIZE];
+			sps30_record_encode(&record, payload);
+			errors += sps30_record_log_append(&log, payload, sizeof(payload), 0) != 0;
+		}
+		REQUIRE(errors == 0);
+		REQUIRE(sps30_record_log_close(&log) == 0);
+		REQUIRE(sps30_log_index_writer_close(&writer) == 0);
+		printf("Logged %u records with the index attached in %.1f s\n", YEAR_S,
+			   seconds(clock::now() - start));
+	}
+
+	const auto index_start = clock::now();
+	REQUIRE(sps30_log_index_build(path.c_str(), 0) == 0);
+	const double build_s = seconds(clock::now() - index_start);
+
+	sps30_log_index index;
+	REQUIRE(sps30_log_index_load(&index, path.c_str()) == 0);
+	printf("Log: %.1f MB, index: %.2f MB (%zu entries), rebuilt in %.2f s\n",
+		   double(index.log_size) / 1e6, double(read_file(index_path).size()) / 1e6,
+		   index.count, build_s);
+
+	// Ranges start mid-block, so each query reads its edge blocks
+	const struct
+	{
+		const char* name;
+		uint64_t length_ms;
+	} ranges[] = {{"hour", HOUR_MS}, {"day", 24 * HOUR_MS}, {"month", 30 * 24 * HOUR_MS},
+				  {"year", uint64_t(YEAR_S) * 1000}};
+
+	for(const auto& range : ranges)
+	{
+		const uint64_t start_ms = START_MS + 1234567;
+		const uint64_t end_ms = start_ms + range.length_ms - 1;
+
+		auto start = clock::now();
+		sps30_log_index_summary indexed;
+		sps30_log_index_summary_init(&indexed);
+		sps30_log_index_aggregate(&index, SPS30_LOG_INDEX_ANY_SENSOR,
+								  SPS30_LOG_INDEX_ANY_CHANNEL, start_ms, end_ms, &indexed);
+		const double indexed_s = seconds(clock::now() - start);
+
+		// The naive query: an index with no entries scans the whole log
+		sps30_log_index unindexed = index;
+		unindexed.count = 0;
+		start = clock::now();
+		sps30_log_index_summary scanned;
+		sps30_log_index_summary_init(&scanned);
+		sps30_log_index_aggregate(&unindexed, SPS30_LOG_INDEX_ANY_SENSOR,
+								  SPS30_LOG_INDEX_ANY_CHANNEL, start_ms, end_ms, &scanned);
+		const double scanned_s = seconds(clock::now() - start);
+
+		CHECK(indexed.count == scanned.count);
+		printf("%-6s %9llu records: index %9.1f us (%u blocks read), scan %9.1f ms, %.0fx\n",
+			   range.name, (unsigned long long)indexed.count, indexed_s * 1e6,
+			   indexed.blocks_scanned, scanned_s * 1e3, scanned_s / indexed_s);
+	}
+
+	sps30_record record;
+	const uint64_t t = START_MS + 200ull * 24 * HOUR_MS + 500;
+	auto start = clock::now();
+	REQUIRE(sps30_log_index_find(&index, SPS30_LOG_INDEX_ANY_SENSOR,
+								 SPS30_LOG_INDEX_ANY_CHANNEL, t, &record) == 0);
+	const double find_s = seconds(clock::now() - start);
+	CHECK(record.timestamp_ms == t - 500);
+	printf("Point query: %.1f us\n", find_s * 1e6);
+
+	sps30_log_index_unload(&index);
+	unlink(index_path.c_str());
+	unlink(path.c_str());
+	rmdir(directory);
+}
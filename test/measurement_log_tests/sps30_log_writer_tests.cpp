@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <sps30_log_writer.h>
+#include <sps30_record_log.h>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+/// Start a writer, or return false if the backend is not available on this system
+bool start_writer(sps30_log_writer* writer, sps30_log_writer_backend backend, uint8_t* buffer,
+				  size_t segment_size, uint32_t segment_count)
+{
+	if(sps30_log_writer_start(writer, backend, buffer, segment_size, segment_count) == 0)
+	{
+		return true;
+	}
+	REQUIRE(backend == SPS30_LOG_WRITER_IO_URING);
+	WARN("io_uring is not available: " << strerror(errno));
+	return false;
+}
+
+void check_writer(sps30_log_writer_backend backend)
+{
+	char path[] = "/tmp/sps30_log_writer_XXXXXX";
+	const int fd = mkstemp(path);
+	REQUIRE(fd >= 0);
+	unlink(path);
+
+	uint8_t buffer[2 * 64];
+	sps30_log_writer writer;
+	if(!start_writer(&writer, backend, buffer, 64, 2))
+	{
+		close(fd);
+		return;
+	}
+
+	// Both segments are claimed, so a third is refused rather than waited for
+	const int32_t first = sps30_log_writer_acquire(&writer);
+	const int32_t second = sps30_log_writer_acquire(&writer);
+	REQUIRE(first >= 0);
+	REQUIRE(second >= 0);
+	CHECK(first != second);
+	CHECK(sps30_log_writer_acquire(&writer) == SPS30_LOG_WRITER_ERROR_BUSY);
+
+	// Segments may be submitted out of file order
+	memset(sps30_log_writer_segment(&writer, static_cast<uint32_t>(first)), 'a', 64);
+	memset(sps30_log_writer_segment(&writer, static_cast<uint32_t>(second)), 'b', 64);
+	REQUIRE(sps30_log_writer_submit(&writer, fd, static_cast<uint32_t>(second), 64, 64) == 0);
+	REQUIRE(sps30_log_writer_submit(&writer, fd, static_cast<uint32_t>(first), 64, 0) == 0);
+	sps30_log_writer_drain(&writer);
+
+	// Completed segments return to the pool
+	CHECK(sps30_log_writer_acquire(&writer) >= 0);
+	CHECK(sps30_log_writer_acquire(&writer) >= 0);
+	sps30_log_writer_stop(&writer);
+
+	const auto stats = sps30_log_writer_get_stats(&writer);
+	CHECK(stats.submitted == 2);
+	CHECK(stats.completed == 2);
+	CHECK(stats.errors == 0);
+
+	char contents[129] = {};
+	CHECK(pread(fd, contents, sizeof(contents), 0) == 128);
+	CHECK(std::string(contents, 64) == std::string(64, 'a'));
+	CHECK(std::string(contents + 64, 64) == std::string(64, 'b'));
+	close(fd);
+}
+} // namespace
+
+TEST_CASE("Log writer reuses segments and never blocks", "[test/sps30_log_writer]")
+{
+	SECTION("Writer thread")
+	{
+		check_writer(SPS30_LOG_WRITER_THREAD);
+	}
+
+	SECTION("io_uring")
+	{
+		check_writer(SPS30_LOG_WRITER_IO_URING);
+	}
+}
+
+TEST_CASE("Log writer counts failed writes", "[test/sps30_log_writer]")
+{
+	uint8_t buffer[64];
+	sps30_log_writer writer;
+	REQUIRE(start_writer(&writer, SPS30_LOG_WRITER_THREAD, buffer, sizeof(buffer), 1));
+
+	const int32_t segment = sps30_log_writer_acquire(&writer);
+	REQUIRE(segment == 0);
+	// Writing to a read-only descriptor fails in the background
+	const int fd = open("/dev/null", O_RDONLY);
+	REQUIRE(fd >= 0);
+	REQUIRE(sps30_log_writer_submit(&writer, fd, 0, sizeof(buffer), 0) == 0);
+	sps30_log_writer_drain(&writer);
+	REQUIRE(sps30_log_writer_close_fd(&writer, fd) == 0);
+	sps30_log_writer_stop(&writer);
+
+	CHECK(sps30_log_writer_get_stats(&writer).errors == 1);
+	CHECK(sps30_log_writer_get_stats(&writer).completed == 1);
+}
+
+TEST_CASE("Log writer counts short writes", "[test/sps30_log_writer]")
+{
+	// The file size limit cuts the write short, and the rest of the segment then fails
+	// with EFBIG instead of being dropped without a trace
+	constexpr rlim_t LIMIT = 100;
+	struct rlimit original;
+	REQUIRE(getrlimit(RLIMIT_FSIZE, &original) == 0);
+	const auto previous_handler = signal(SIGXFSZ, SIG_IGN);
+
+	for(const auto backend : {SPS30_LOG_WRITER_THREAD, SPS30_LOG_WRITER_IO_URING})
+	{
+		char path[] = "/tmp/sps30_log_writer_XXXXXX";
+		const int fd = mkstemp(path);
+		REQUIRE(fd >= 0);
+		unlink(path);
+
+		uint8_t buffer[128];
+		sps30_log_writer writer;
+		if(!start_writer(&writer, backend, buffer, sizeof(buffer), 1))
+		{
+			close(fd);
+			continue;
+		}
+
+		const struct rlimit limited = {LIMIT, original.rlim_max};
+		REQUIRE(setrlimit(RLIMIT_FSIZE, &limited) == 0);
+		REQUIRE(sps30_log_writer_acquire(&writer) == 0);
+		memset(buffer, 'x', sizeof(buffer));
+		REQUIRE(sps30_log_writer_submit(&writer, fd, 0, sizeof(buffer), 0) == 0);
+		sps30_log_writer_drain(&writer);
+		REQUIRE(setrlimit(RLIMIT_FSIZE, &original) == 0);
+
+		// The segment is released, with the failure counted once
+		CHECK(sps30_log_writer_acquire(&writer) == 0);
+		sps30_log_writer_stop(&writer);
+		const auto stats = sps30_log_writer_get_stats(&writer);
+		CHECK(stats.completed == 1);
+		CHECK(stats.errors == 1);
+		CHECK(lseek(fd, 0, SEEK_END) == static_cast<off_t>(LIMIT));
+		close(fd);
+	}
+
+	signal(SIGXFSZ, previous_handler);
+}
+
+TEST_CASE("Benchmark log acquisition jitter under slow storage",
+		  "[.][benchmark][test/sps30_log_writer]")
+{
+	// A 1 kHz acquisition loop appends 64 records per tick. Another thread saturates the
+	// same file system with large synced writes, so commits stall the way they do on
+	// slow flash. The jitter is how late each tick finishes relative to its schedule.
+	constexpr uint32_t TICKS = 2000;
+	constexpr uint32_t RECORDS_PER_TICK = 64;
+	constexpr auto PERIOD = std::chrono::milliseconds(1);
+
+	char directory[] = "/tmp/sps30_log_jitter_XXXXXX";
+	REQUIRE(mkdtemp(directory) != nullptr);
+	const std::string log_path = std::string(directory) + "/log";
+	const std::string hog_path = std::string(directory) + "/hog";
+
+	for(const auto backend :
+		{SPS30_LOG_WRITER_SYNC, SPS30_LOG_WRITER_THREAD, SPS30_LOG_WRITER_IO_URING})
+	{
+		std::atomic<bool> running{true};
+		std::thread hog([&] {
+			std::vector<uint8_t> chunk(1 << 20, 0x5a);
+			const int fd = open(hog_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			while(fd >= 0 && running)
+			{
+				if(write(fd, chunk.data(), chunk.size()) < 0)
+				{
+					break;
+				}
+				fdatasync(fd);
+				if(lseek(fd, 0, SEEK_CUR) > (64 << 20))
+				{
+					(void)ftruncate(fd, 0);
+					lseek(fd, 0, SEEK_SET);
+				}
+			}
+			close(fd);
+		});
+
+		static uint8_t buffer[256 * 1024];
+		sps30_record_log log;
+		const sps30_record_log_config config = {
+			log_path.c_str(), buffer, sizeof(buffer), 1024, 100, 0, 0, backend, 4};
+		if(sps30_record_log_open(&log, &config) != 0)
+		{
+			running = false;
+			hog.join();
+			WARN("Backend " << backend << " is not available");
+			continue;
+		}
+
+		uint8_t record[52] = {};
+		std::vector<double> late_us;
+		late_us.reserve(TICKS);
+		auto deadline = std::chrono::steady_clock::now();
+
+		for(uint32_t tick = 0; tick < TICKS; tick++)
+		{
+			deadline += PERIOD;
+			const uint64_t now_ms = tick;
+			for(uint32_t i = 0; i < RECORDS_PER_TICK; i++)
+			{
+				memcpy(record, &i, sizeof(i));
+				(void)sps30_record_log_append(&log, record, sizeof(record), now_ms);
+			}
+			(void)sps30_record_log_poll(&log, now_ms);
+
+			const auto finished = std::chrono::steady_clock::now();
+			late_us.push_back(
+				std::max(0.0, std::chrono::duration<double, std::micro>(
+								  finished - (deadline - PERIOD))
+								  .count()));
+			std::this_thread::sleep_until(std::max(deadline, finished));
+		}
+
+		running = false;
+		hog.join();
+		REQUIRE(sps30_record_log_close(&log) == 0);
+		const auto* stats = sps30_record_log_get_stats(&log);
+
+		std::sort(late_us.begin(), late_us.end());
+		static const char* const names[] = {"sync", "thread", "io_uring"};
+		printf("log writer %-8s: tick work p50 %8.1f us, p99 %8.1f us, max %8.1f us, "
+			   "%llu commits, %llu dropped\n",
+			   names[backend], late_us[TICKS / 2], late_us[TICKS * 99 / 100], late_us.back(),
+			   static_cast<unsigned long long>(stats->commits),
+			   static_cast<unsigned long long>(stats->dropped));
+
+		unlink(log_path.c_str());
+		unlink(hog_path.c_str());
+	}
+
+	rmdir(directory);
+}
@@ -0,0 +1,420 @@
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sps30_record_log.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+/// A scratch directory that is removed with its contents when the test ends
+class scratch_directory
+{
+  public:
+	scratch_directory()
+	{
+		char path[] = "/tmp/sps30_record_log_XXXXXX";
+		REQUIRE(mkdtemp(path) != nullptr);
+		path_ = path;
+	}
+
+	~scratch_directory()
+	{
+		for(const auto& name : {"log", "log.1", "log.2", "log.3", "log.moved"})
+		{
+			unlink(file(name).c_str());
+		}
+		rmdir(path_.c_str());
+	}
+
+	std::string file(const char* name) const
+	{
+		return path_ + "/" + name;
+	}
+
+  private:
+	std::string path_;
+};
+
+std::vector<uint8_t> read_file(const std::string& path)
+{
+	std::vector<uint8_t> contents;
+	FILE* file = fopen(path.c_str(), "rb");
+	if(file)
+	{
+		uint8_t chunk[4096];
+		size_t n;
+		while((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		{
+			contents.insert(contents.end(), chunk, chunk + n);
+		}
+		fclose(file);
+	}
+	return contents;
+}
+
+bool file_exists(const std::string& path)
+{
+	return access(path.c_str(), F_OK) == 0;
+}
+
+/// Decode every frame in a file. Fails the test if any frame is damaged.
+std::vector<uint32_t> read_records(const std::string& path)
+{
+	const auto contents = read_file(path);
+	std::vector<uint32_t> records;
+	size_t offset = 0;
+
+	while(offset < contents.size())
+	{
+		const uint8_t* payload;
+		uint16_t length;
+		const int32_t r = sps30_record_log_frame_decode(&contents[offset], contents.size() - offset,
+														&payload, &length);
+		REQUIRE(r > 0);
+		REQUIRE(length == sizeof(uint32_t));
+
+		uint32_t value;
+		memcpy(&value, payload, sizeof(value));
+		records.push_back(value);
+		offset += static_cast<size_t>(r);
+	}
+
+	return records;
+}
+
+constexpr size_t FRAME_SIZE = sizeof(uint32_t) + SPS30_RECORD_LOG_FRAME_OVERHEAD;
+} // namespace
+
+TEST_CASE("Record log CRC matches CRC-32/IEEE", "[test/sps30_record_log]")
+{
+	const char* check = "123456789";
+	CHECK(sps30_record_log_crc32(reinterpret_cast<const uint8_t*>(check), 9) == 0xcbf43926);
+	CHECK(sps30_record_log_crc32(nullptr, 0) == 0);
+}
+
+TEST_CASE("Record log group commits by record count", "[test/sps30_record_log]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("log");
+	uint8_t buffer[4096];
+	sps30_record_log log;
+	const sps30_record_log_config config = {path.c_str(), buffer, sizeof(buffer), 100, 0, 0, 0,
+											SPS30_LOG_WRITER_SYNC, 0};
+
+	REQUIRE(sps30_record_log_open(&log, &config) == 0);
+
+	for(uint32_t i = 0; i < 250; i++)
+	{
+		REQUIRE(sps30_record_log_append(&log, &i, sizeof(i), 0) == 0);
+	}
+
+	// Two batches are on disk, and the remainder is pending
+	CHECK(sps30_record_log_get_stats(&log)->commits == 2);
+	CHECK(read_file(path).size() == 200 * FRAME_SIZE);
+
+	REQUIRE(sps30_record_log_close(&log) == 0);
+	CHECK(sps30_record_log_get_stats(&log)->commits == 3);
+	CHECK(sps30_record_log_get_stats(&log)->records == 250);
+	CHECK(sps30_record_log_get_stats(&log)->bytes == 250 * FRAME_SIZE);
+
+	const auto records = read_records(path);
+	REQUIRE(records.size() == 250);
+	for(uint32_t i = 0; i < 250; i++)
+	{
+		CHECK(records[i] == i);
+	}
+}
+
+TEST_CASE("Record log commits by age and when the buffer is full", "[test/sps30_record_log]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("log");
+	sps30_record_log log;
+
+	SECTION("Age")
+	{
+		uint8_t buffer[4096];
+		const sps30_record_log_config config = {path.c_str(), buffer, sizeof(buffer),
+												0,			  1000,	  0,			  0,
+												SPS30_LOG_WRITER_SYNC,		  0};
+		REQUIRE(sps30_record_log_open(&log, &config) == 0);
+
+		uint32_t value = 1;
+		REQUIRE(sps30_record_log_append(&log, &value, sizeof(value), 5000) == 0);
+		REQUIRE(sps30_record_log_append(&log, &value, sizeof(value), 5999) == 0);
+		CHECK(sps30_record_log_poll(&log, 5999) == 0);
+		CHECK(sps30_record_log_get_stats(&log)->commits == 0);
+
+		CHECK(sps30_record_log_poll(&log, 6000) == 0);
+		CHECK(sps30_record_log_get_stats(&log)->commits == 1);
+		CHECK(read_file(path).size() == 2 * FRAME_SIZE);
+	}
+
+	SECTION("Buffer full")
+	{
+		uint8_t buffer[FRAME_SIZE * 3];
+		const sps30_record_log_config config = {path.c_str(), buffer, sizeof(buffer), 0, 0, 0, 0,
+												SPS30_LOG_WRITER_SYNC, 0};
+		REQUIRE(sps30_record_log_open(&log, &config) == 0);
+
+		for(uint32_t i = 0; i < 4; i++)
+		{
+			REQUIRE(sps30_record_log_append(&log, &i, sizeof(i), 0) == 0);
+		}
+		CHECK(sps30_record_log_get_stats(&log)->commits == 1);
+		CHECK(read_file(path).size() == 3 * FRAME_SIZE);
+
+		uint8_t too_large[FRAME_SIZE * 3] = {};
+		CHECK(sps30_record_log_append(&log, too_large, sizeof(too_large), 0) ==
+			  SPS30_RECORD_LOG_ERROR_TOO_LARGE);
+	}
+
+	REQUIRE(sps30_record_log_close(&log) == 0);
+}
+
+TEST_CASE("Record log rotates by size and keeps whole frames", "[test/sps30_record_log]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("log");
+	uint8_t buffer[4096];
+	sps30_record_log log;
+	// Ten records per commit, and room for twenty records per file
+	const sps30_record_log_config config = {path.c_str(), buffer, sizeof(buffer), 10, 0,
+											20 * FRAME_SIZE, 2, SPS30_LOG_WRITER_SYNC, 0};
+
+	REQUIRE(sps30_record_log_open(&log, &config) == 0);
+	for(uint32_t i = 0; i < 100; i++)
+	{
+		REQUIRE(sps30_record_log_append(&log, &i, sizeof(i), 0) == 0);
+	}
+	REQUIRE(sps30_record_log_close(&log) == 0);
+
+	CHECK(sps30_record_log_get_stats(&log)->rotations == 4);
+	CHECK_FALSE(file_exists(dir.file("log.3")));
+
+	// Only the newest files are kept, and each holds complete commits
+	const auto oldest = read_records(dir.file("log.2"));
+	const auto older = read_records(dir.file("log.1"));
+	const auto newest = read_records(path);
+	REQUIRE(oldest.size() == 20);
+	REQUIRE(older.size() == 20);
+	REQUIRE(newest.size() == 20);
+	CHECK(oldest.front() == 40);
+	CHECK(older.front() == 60);
+	CHECK(newest.front() == 80);
+	CHECK(newest.back() == 99);
+}
+
+TEST_CASE("Record log reports each commit to its hook", "[test/sps30_record_log]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("log");
+	uint8_t buffer[4096];
+	sps30_record_log log;
+	// Ten records per commit, and room for twenty records per file
+	const sps30_record_log_config config = {path.c_str(), buffer, sizeof(buffer), 10, 0,
+											20 * FRAME_SIZE, 2, SPS30_LOG_WRITER_SYNC, 0};
+	struct commit
+	{
+		uint32_t first;
+		size_t length;
+		uint64_t offset;
+	};
+	std::vector<commit> commits;
+
+	REQUIRE(sps30_record_log_open(&log, &config) == 0);
+	sps30_record_log_set_commit_hook(
+		&log,
+		[](void* context, const uint8_t* frames, size_t length, uint64_t offset) {
+			const uint8_t* payload;
+			uint16_t payload_length;
+			REQUIRE(sps30_record_log_frame_decode(frames, length, &payload, &payload_length) > 0);
+			uint32_t first;
+			memcpy(&first, payload, sizeof(first));
+			static_cast<std::vector<commit>*>(context)->push_back({first, length, offset});
+		},
+		&commits);
+
+	for(uint32_t i = 0; i < 50; i++)
+	{
+		REQUIRE(sps30_record_log_append(&log, &i, sizeof(i), 0) == 0);
+	}
+	REQUIRE(sps30_record_log_close(&log) == 0);
+
+	// Offsets are within the current file, so they restart at 0 after each rotation
+	REQUIRE(commits.size() == 5);
+	for(size_t i = 0; i < commits.size(); i++)
+	{
+		CHECK(commits[i].first == i * 10);
+		CHECK(commits[i].length == 10 * FRAME_SIZE);
+		CHECK(commits[i].offset == (i % 2) * 10 * FRAME_SIZE);
+	}
+}
+
+TEST_CASE("Record log rotation on request", "[test/sps30_record_log]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("log");
+	uint8_t buffer[4096];
+	sps30_record_log log;
+	const sps30_record_log_config config = {path.c_str(), buffer, sizeof(buffer), 0, 0, 0, 1,
+											SPS30_LOG_WRITER_SYNC, 0};
+	uint32_t value = 7;
+
+	REQUIRE(sps30_record_log_open(&log, &config) == 0);
+	REQUIRE(sps30_record_log_append(&log, &value, sizeof(value), 0) == 0);
+
+	SECTION("Pending records are committed to the rotated file")
+	{
+		REQUIRE(sps30_record_log_rotate(&log) == 0);
+		CHECK(read_records(dir.file("log.1")) == std::vector<uint32_t>{7});
+		CHECK(read_file(path).empty());
+	}
+
+	SECTION("The active file was already moved by another tool")
+	{
+		REQUIRE(rename(path.c_str(), dir.file("log.moved").c_str()) == 0);
+		REQUIRE(sps30_record_log_rotate(&log) == 0);
+		CHECK(read_records(dir.file("log.moved")) == std::vector<uint32_t>{7});
+		CHECK(file_exists(path));
+		CHECK_FALSE(file_exists(dir.file("log.1")));
+	}
+
+	value = 8;
+	REQUIRE(sps30_record_log_append(&log, &value, sizeof(value), 0) == 0);
+	REQUIRE(sps30_record_log_close(&log) == 0);
+	CHECK(read_records(path) == std::vector<uint32_t>{8});
+
+	// Reopening appends to the existing file
+	REQUIRE(sps30_record_log_open(&log, &config) == 0);
+	value = 9;
+	REQUIRE(sps30_record_log_append(&log, &value, sizeof(value), 0) == 0);
+	REQUIRE(sps30_record_log_close(&log) == 0);
+	CHECK(read_records(path) == std::vector<uint32_t>{8, 9});
+}
+
+TEST_CASE("Record log frames detect damage", "[test/sps30_record_log]")
+{
+	scratch_directory dir;
+	const auto path = dir.file("log");
+	uint8_t buffer[4096];
+	sps30_record_log log;
+	const sps30_record_log_config config = {path.c_str(), buffer, sizeof(buffer), 0, 0, 0, 0,
+											SPS30_LOG_WRITER_SYNC, 0};
+
+	REQUIRE(sps30_record_log_open(&log, &config) == 0);
+	for(uint32_t i = 0; i < 3; i++)
+	{
+		REQUIRE(sps30_record_log_append(&log, &i, sizeof(i), 0) == 0);
+	}
+	REQUIRE(sps30_record_log_close(&log) == 0);
+
+	auto contents = read_file(path);
+	REQUIRE(contents.size() == 3 * FRAME_SIZE);
+	const uint8_t* payload;
+	uint16_t length;
+
+	CHECK(sps30_record_log_frame_decode(contents.data(), FRAME_SIZE - 1, &payload, &length) ==
+		  SPS30_RECORD_LOG_ERROR_TRUNCATED);
+
+	// Damage the middle frame's payload
+	contents[FRAME_SIZE + 5] ^= 0x01;
+	CHECK(sps30_record_log_frame_decode(&contents[FRAME_SIZE], contents.size() - FRAME_SIZE,
+										&payload, &length) == SPS30_RECORD_LOG_ERROR_CORRUPT);
+
+	// A reader scanning forward byte by byte finds the next intact frame
+	size_t offset = FRAME_SIZE + 1;
+	int32_t r;
+	while((r = sps30_record_log_frame_decode(&contents[offset], contents.size() - offset,
+											 &payload, &length)) < 0)
+	{
+		offset++;
+	}
+	CHECK(offset == 2 * FRAME_SIZE);
+	uint32_t value;
+	memcpy(&value, payload, sizeof(value));
+	CHECK(value == 2);
+}
+
+namespace
+{
+/// Log 100 records through an asynchronous writer with size rotation, then check the files
+void check_async_log(const scratch_directory& dir, sps30_log_writer_backend backend)
+{
+	const auto path = dir.file("log");
+	uint8_t buffer[4096];
+	sps30_record_log log;
+	// Ten records per commit, and room for twenty records per file
+	const sps30_record_log_config config = {path.c_str(), buffer, sizeof(buffer), 10, 0,
+											20 * FRAME_SIZE, 2, backend, 4};
+
+	const int16_t r = sps30_record_log_open(&log, &config);
+	if(r != 0 && backend == SPS30_LOG_WRITER_IO_URING)
+	{
+		WARN("io_uring is not available: " << strerror(errno));
+		return;
+	}
+	REQUIRE(r == 0);
+
+	uint32_t appended = 0;
+	for(uint32_t i = 0; i < 100; i++)
+	{
+		const int16_t append = sps30_record_log_append(&log, &i, sizeof(i), 0);
+		REQUIRE((append == 0 || append == SPS30_RECORD_LOG_ERROR_BUSY));
+		appended += (append == 0);
+	}
+	REQUIRE(sps30_record_log_close(&log) == 0);
+
+	const auto* stats = sps30_record_log_get_stats(&log);
+	CHECK(stats->write_errors == 0);
+	CHECK(stats->records == appended);
+	CHECK(stats->records + stats->dropped == 100);
+	CHECK_FALSE(file_exists(dir.file("log.3")));
+
+	// Accepted records are on disk in order, and files hold whole commits
+	std::vector<uint32_t> records;
+	for(const auto& name : {"log.2", "log.1", "log"})
+	{
+		const auto file_records = read_records(dir.file(name));
+		CHECK(file_records.size() <= 20);
+		records.insert(records.end(), file_records.begin(), file_records.end());
+	}
+	CHECK(records.size() == std::min<size_t>(appended, 60));
+	for(size_t i = 1; i < records.size(); i++)
+	{
+		CHECK(records[i] > records[i - 1]);
+	}
+
+	// Storage normally keeps up with this rate, and nothing is dropped
+	if(stats->dropped == 0)
+	{
+		CHECK(stats->rotations == 4);
+		CHECK(records.back() == 99);
+	}
+}
+} // namespace
+
+TEST_CASE("Record log with an asynchronous writer", "[test/sps30_record_log]")
+{
+	scratch_directory dir;
+
+	SECTION("Writer thread")
+	{
+		check_async_log(dir, SPS30_LOG_WRITER_THREAD);
+	}
+
+	SECTION("io_uring")
+	{
+		check_async_log(dir, SPS30_LOG_WRITER_IO_URING);
+	}
+
+	SECTION("Best available")
+	{
+		check_async_log(dir, SPS30_LOG_WRITER_ASYNC);
+	}
+}
@@ -0,0 +1,202 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <sps30_record.h>
+#include <sps30_record.hpp>
+#include <vector>
+
+namespace
+{
+constexpr sps30_measurement SAMPLE = {1.5f,  2.5f,	3.5f,  4.5f,  10.25f,
+									  11.0f, 12.0f, 13.0f, 14.0f, 0.625f};
+
+sps30_record make_record(uint32_t i)
+{
+	sps30_measurement m = SAMPLE;
+	m.mc_2p5 += static_cast<float>(i);
+	sps30_record record;
+	sps30_record_init(&record, 0x1122334455667788 + i, static_cast<uint16_t>(i % 8), i << 8,
+					  1600000000000 + i * 1000, &m);
+	return record;
+}
+
+bool same_record(const sps30_record& a, const sps30_record& b)
+{
+	return a.version == b.version && a.channel == b.channel && a.status == b.status &&
+		   a.timestamp_ms == b.timestamp_ms && a.sensor_id == b.sensor_id &&
+		   memcmp(a.values, b.values, sizeof(a.values)) == 0;
+}
+} // namespace
+
+TEST_CASE("Record sensor IDs are FNV-1a hashes of the serial", "[test/sps30_record]")
+{
+	CHECK(sps30_record_sensor_id("") == 0xcbf29ce484222325);
+	CHECK(sps30_record_sensor_id("a") == 0xaf63dc4c8601ec8c);
+	CHECK(sps30_record_sensor_id("3E2B5A7C1F0D9E84") != sps30_record_sensor_id("3E2B5A7C1F0D9E85"));
+}
+
+TEST_CASE("Record fields are named after sps30_measurement members", "[test/sps30_record]")
+{
+	CHECK(strcmp(sps30_record_field_name(0), "mc_1p0") == 0);
+	CHECK(strcmp(sps30_record_field_name(SPS30_RECORD_FIELD_COUNT - 1),
+				 "typical_particle_size") == 0);
+	CHECK(sps30_record_field_name(SPS30_RECORD_FIELD_COUNT) == nullptr);
+
+	for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+	{
+		const char* name = sps30_record_field_name(f);
+		CHECK(sps30_record_field_index(name, strlen(name)) == static_cast<int>(f));
+	}
+	CHECK(sps30_record_field_index("mc_2p5=35", 6) == 1);
+	CHECK(sps30_record_field_index("mc_2p", 5) == -1);
+	CHECK(sps30_record_field_index("", 0) == -1);
+}
+
+TEST_CASE("Stored records are little-endian at fixed offsets", "[test/sps30_record]")
+{
+	const sps30_record record = make_record(1);
+	uint8_t stored[SPS30_RECORD_SIZE + 1];
+
+	// The stored form has no alignment requirement
+	sps30_record_encode(&record, &stored[1]);
+	const uint8_t* p = &stored[1];
+
+	CHECK(p[0] == SPS30_RECORD_VERSION);
+	CHECK(p[1] == 0);
+	CHECK(p[2] == 1); // channel
+	CHECK(p[5] == 1); // status 0x100
+	CHECK(p[8] == ((1600000001000 >> 0) & 0xff));
+	CHECK(p[15] == 0);
+	CHECK(p[16] == 0x89);
+	CHECK(p[23] == 0x11);
+	// mc_1p0 = 1.5f = 0x3fc00000
+	CHECK(p[24] == 0x00);
+	CHECK(p[26] == 0xc0);
+	CHECK(p[27] == 0x3f);
+
+	sps30_record decoded;
+	REQUIRE(sps30_record_decode(p, &decoded) == 0);
+	CHECK(same_record(decoded, record));
+
+	sps30_measurement m;
+	sps30_record_measurement(&decoded, &m);
+	CHECK(m.mc_2p5 == SAMPLE.mc_2p5 + 1);
+	CHECK(m.typical_particle_size == SAMPLE.typical_particle_size);
+
+	stored[1] = SPS30_RECORD_VERSION + 1;
+	CHECK(sps30_record_decode(p, &decoded) == SPS30_RECORD_ERROR_VERSION);
+}
+
+TEST_CASE("Stored records are used in place when aligned", "[test/sps30_record]")
+{
+	alignas(SPS30_RECORD_SIZE) uint8_t storage[4 * SPS30_RECORD_SIZE + 8];
+	sps30::record_writer writer(storage, sizeof(storage));
+
+	for(uint32_t i = 0; i < 4; i++)
+	{
+		REQUIRE(writer.append(make_record(i)));
+	}
+	CHECK_FALSE(writer.append(make_record(4)));
+	CHECK(writer.bytes() == 4 * SPS30_RECORD_SIZE);
+
+	sps30::record_reader reader(storage, sizeof(storage));
+	REQUIRE(reader.size() == 4);
+	if(SPS30_RECORD_NATIVE_LAYOUT)
+	{
+		REQUIRE(reader.data() == reinterpret_cast<const sps30_record*>(storage));
+		uint32_t i = 0;
+		for(const auto& record : reader)
+		{
+			CHECK(same_record(record, make_record(i++)));
+		}
+		CHECK(i == 4);
+	}
+
+	sps30_record record;
+	CHECK(reader.get(3, record));
+	CHECK(same_record(record, make_record(3)));
+	CHECK_FALSE(reader.get(4, record));
+
+	// Misaligned storage is still readable, by copying
+	std::vector<uint8_t> copy(storage, storage + writer.bytes() + 1);
+	memmove(&copy[1], &copy[0], writer.bytes());
+	sps30::record_reader misaligned(&copy[1], writer.bytes());
+	if(reinterpret_cast<uintptr_t>(&copy[1]) % SPS30_RECORD_SIZE != 0)
+	{
+		CHECK(misaligned.data() == nullptr);
+		CHECK(misaligned.begin() == misaligned.end());
+	}
+	CHECK(misaligned.get(2, record));
+	CHECK(same_record(record, make_record(2)));
+}
+
+TEST_CASE("Column blocks hold the same records as rows", "[test/sps30_record]")
+{
+	sps30_record_block block;
+	sps30_record_block_init(&block);
+	sps30_record record;
+
+	CHECK(sps30_record_block_get(&block, 0, &record) == SPS30_RECORD_ERROR_RANGE);
+	for(uint32_t i = 0; i < SPS30_RECORD_BLOCK_RECORDS; i++)
+	{
+		const auto row = make_record(i);
+		REQUIRE(sps30_record_block_append(&block, &row) == 0);
+	}
+	const auto extra = make_record(99);
+	CHECK(sps30_record_block_append(&block, &extra) == SPS30_RECORD_ERROR_FULL);
+
+	CHECK(block.first_timestamp_ms == make_record(0).timestamp_ms);
+	CHECK(block.last_timestamp_ms == make_record(15).timestamp_ms);
+	// A field is contiguous across records
+	CHECK(block.values[1][5] == SAMPLE.mc_2p5 + 5);
+
+	uint8_t stored[SPS30_RECORD_BLOCK_SIZE];
+	sps30_record_block_encode(&block, stored);
+	CHECK(memcmp(stored, "S30B", 4) == 0);
+
+	sps30_record_block decoded;
+	REQUIRE(sps30_record_block_decode(stored, &decoded) == 0);
+	for(uint16_t i = 0; i < SPS30_RECORD_BLOCK_RECORDS; i++)
+	{
+		REQUIRE(sps30_record_block_get(&decoded, i, &record) == 0);
+		CHECK(same_record(record, make_record(i)));
+	}
+
+	stored[0] ^= 1;
+	CHECK(sps30_record_block_decode(stored, &decoded) == SPS30_RECORD_ERROR_VERSION);
+}
+
+TEST_CASE("Block builder transposes a record stream", "[test/sps30_record]")
+{
+	alignas(SPS30_RECORD_SIZE) static uint8_t storage[3 * SPS30_RECORD_BLOCK_SIZE];
+	sps30::block_writer writer(storage, sizeof(storage));
+	sps30::block_builder builder(writer);
+
+	for(uint32_t i = 0; i < 40; i++)
+	{
+		REQUIRE(builder.append(make_record(i)));
+	}
+	REQUIRE(builder.flush());
+	CHECK(writer.size() == 3);
+
+	sps30::block_reader reader(storage, writer.bytes());
+	uint32_t i = 0;
+	for(size_t b = 0; b < reader.size(); b++)
+	{
+		sps30_record_block block;
+		REQUIRE(reader.get(b, block));
+		for(uint16_t row = 0; row < block.count; row++)
+		{
+			sps30_record record;
+			REQUIRE(sps30_record_block_get(&block, row, &record) == 0);
+			CHECK(same_record(record, make_record(i++)));
+		}
+	}
+	CHECK(i == 40);
+
+	// The writer is full, so another full block cannot be stored
+	for(uint32_t j = 0; j < SPS30_RECORD_BLOCK_RECORDS; j++)
+	{
+		REQUIRE(builder.append(make_record(j)));
+	}
+	CHECK_FALSE(builder.append(make_record(16)));
+}
@@ -0,0 +1,197 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sps30_record.h>
+#include <sps30_record_log.h>
+#include <sps30_sensor_table.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+/// A scratch directory that is removed with its contents when the test ends
+class scratch_directory
+{
+  public:
+	scratch_directory()
+	{
+		char path[] = "/tmp/sps30_sensor_table_XXXXXX";
+		REQUIRE(mkdtemp(path) != nullptr);
+		path_ = path;
+	}
+
+	~scratch_directory()
+	{
+		for(const auto& name : {"log.sensors", "log.sensors.tmp"})
+		{
+			unlink(file(name).c_str());
+		}
+		rmdir(path_.c_str());
+	}
+
+	std::string file(const char* name) const
+	{
+		return path_ + "/" + name;
+	}
+
+  private:
+	std::string path_;
+};
+
+std::vector<uint8_t> read_file(const std::string& path)
+{
+	std::vector<uint8_t> data;
+	FILE* f = fopen(path.c_str(), "rb");
+	REQUIRE(f);
+	int c;
+	while((c = fgetc(f)) != EOF)
+	{
+		data.push_back(static_cast<uint8_t>(c));
+	}
+	fclose(f);
+	return data;
+}
+
+void write_file(const std::string& path, const std::vector<uint8_t>& data)
+{
+	FILE* f = fopen(path.c_str(), "wb");
+	REQUIRE(f);
+	REQUIRE(fwrite(data.data(), 1, data.size(), f) == data.size());
+	fclose(f);
+}
+} // namespace
+
+TEST_CASE("A missing sensor table loads empty", "[test/sps30_sensor_table]")
+{
+	scratch_directory dir;
+	sps30_sensor_table table;
+
+	errno = 0;
+	CHECK(sps30_sensor_table_load(&table, dir.file("log").c_str()) ==
+		  SPS30_SENSOR_TABLE_ERROR_IO);
+	CHECK(errno == ENOENT);
+	for(unsigned c = 0; c < SPS30_SENSOR_TABLE_CHANNELS; c++)
+	{
+		CHECK(table.entries[c].flags == 0);
+		CHECK(table.entries[c].channel == c);
+	}
+}
+
+TEST_CASE("Sensor tables round-trip", "[test/sps30_sensor_table]")
+{
+	scratch_directory dir;
+	const std::string log = dir.file("log");
+	sps30_sensor_table table;
+	sps30_sensor_table_init(&table);
+
+	auto* entry = sps30_sensor_table_set(&table, 3, "A1B2C3D4E5F6", SPS30_SENSOR_TABLE_MEASURING);
+	entry->started_ms = 1634567890123;
+	entry->firmware_major = 2;
+	entry->firmware_minor = 2;
+	entry->autoclean_interval_s = 604800;
+	sps30_sensor_table_set(&table, 255, "FFFF", 0);
+	CHECK(entry->sensor_id == sps30_record_sensor_id("A1B2C3D4E5F6"));
+
+	REQUIRE(sps30_sensor_table_save(&table, log.c_str()) == 0);
+	// Only present entries are stored
+	CHECK(read_file(dir.file("log.sensors")).size() ==
+		  sizeof(sps30_sensor_table_header) + 2 * sizeof(sps30_sensor_table_entry));
+	CHECK(access(dir.file("log.sensors.tmp").c_str(), F_OK) != 0);
+
+	sps30_sensor_table loaded;
+	REQUIRE(sps30_sensor_table_load(&loaded, log.c_str()) == 0);
+	CHECK(memcmp(&loaded, &table, sizeof(table)) == 0);
+	CHECK(loaded.entries[3].flags == (SPS30_SENSOR_TABLE_PRESENT | SPS30_SENSOR_TABLE_MEASURING));
+	CHECK(std::string(loaded.entries[3].serial) == "A1B2C3D4E5F6");
+	CHECK(loaded.entries[255].flags == SPS30_SENSOR_TABLE_PRESENT);
+	CHECK(loaded.entries[4].flags == 0);
+
+	// Saving again replaces the table
+	loaded.entries[3].flags &= ~SPS30_SENSOR_TABLE_MEASURING;
+	REQUIRE(sps30_sensor_table_save(&loaded, log.c_str()) == 0);
+	REQUIRE(sps30_sensor_table_load(&table, log.c_str()) == 0);
+	CHECK(table.entries[3].flags == SPS30_SENSOR_TABLE_PRESENT);
+}
+
+TEST_CASE("Damaged sensor tables are rejected", "[test/sps30_sensor_table]")
+{
+	scratch_directory dir;
+	const std::string log = dir.file("log");
+	const std::string path = dir.file("log.sensors");
+	sps30_sensor_table table;
+	sps30_sensor_table_init(&table);
+	sps30_sensor_table_set(&table, 7, "0123456789", SPS30_SENSOR_TABLE_MEASURING);
+	REQUIRE(sps30_sensor_table_save(&table, log.c_str()) == 0);
+	const std::vector<uint8_t> good = read_file(path);
+
+	std::vector<uint8_t> damaged = good;
+	damaged[0] ^= 1;
+	write_file(path, damaged);
+	CHECK(sps30_sensor_table_load(&table, log.c_str()) == SPS30_SENSOR_TABLE_ERROR_VERSION);
+
+	damaged = good;
+	damaged[sizeof(sps30_sensor_table_header) + 40] ^= 1;
+	write_file(path, damaged);
+	CHECK(sps30_sensor_table_load(&table, log.c_str()) == SPS30_SENSOR_TABLE_ERROR_CORRUPT);
+	// Nothing from a damaged table is used
+	CHECK(table.entries[7].flags == 0);
+
+	damaged.assign(good.begin(), good.end() - 1);
+	write_file(path, damaged);
+	CHECK(sps30_sensor_table_load(&table, log.c_str()) == SPS30_SENSOR_TABLE_ERROR_CORRUPT);
+
+	damaged.assign(good.begin(), good.begin() + 10);
+	write_file(path, damaged);
+	CHECK(sps30_sensor_table_load(&table, log.c_str()) == SPS30_SENSOR_TABLE_ERROR_CORRUPT);
+
+	write_file(path, good);
+	CHECK(sps30_sensor_table_load(&table, log.c_str()) == 0);
+	CHECK(table.entries[7].flags & SPS30_SENSOR_TABLE_MEASURING);
+}
+
+TEST_CASE("Version 1 sensor tables load without calibrated delays", "[test/sps30_sensor_table]")
+{
+	scratch_directory dir;
+	const std::string log = dir.file("log");
+	sps30_sensor_table table;
+	sps30_sensor_table_init(&table);
+	const uint32_t flags = SPS30_SENSOR_TABLE_MEASURING | SPS30_SENSOR_TABLE_CALIBRATED;
+	auto* entry = sps30_sensor_table_set(&table, 5, "0123456789", flags);
+	entry->firmware_major = 2;
+	entry->delays_us[SPS30_DELAY_RESET] = 40000;
+
+	// The same entry, as written before delays were added
+	sps30_sensor_table_header header = {};
+	header.magic = SPS30_SENSOR_TABLE_MAGIC;
+	header.version = 1;
+	header.entry_size = SPS30_SENSOR_TABLE_V1_ENTRY_SIZE;
+	header.count = 1;
+	header.crc = sps30_record_log_crc32(reinterpret_cast<const uint8_t*>(entry),
+										SPS30_SENSOR_TABLE_V1_ENTRY_SIZE);
+	std::vector<uint8_t> v1(sizeof(header) + SPS30_SENSOR_TABLE_V1_ENTRY_SIZE);
+	memcpy(v1.data(), &header, sizeof(header));
+	memcpy(v1.data() + sizeof(header), entry, SPS30_SENSOR_TABLE_V1_ENTRY_SIZE);
+	write_file(dir.file("log.sensors"), v1);
+
+	sps30_sensor_table loaded;
+	REQUIRE(sps30_sensor_table_load(&loaded, log.c_str()) == 0);
+	CHECK(std::string(loaded.entries[5].serial) == "0123456789");
+	CHECK(loaded.entries[5].firmware_major == 2);
+	CHECK(loaded.entries[5].flags == (SPS30_SENSOR_TABLE_PRESENT | SPS30_SENSOR_TABLE_MEASURING));
+	CHECK(loaded.entries[5].delays_us[SPS30_DELAY_RESET] == 0);
+
+	// Calibrated delays round-trip in the current version
+	REQUIRE(sps30_sensor_table_save(&table, log.c_str()) == 0);
+	REQUIRE(sps30_sensor_table_load(&loaded, log.c_str()) == 0);
+	CHECK(loaded.entries[5].flags & SPS30_SENSOR_TABLE_CALIBRATED);
+	CHECK(loaded.entries[5].delays_us[SPS30_DELAY_RESET] == 40000);
+
+	// A newer version is rejected
+	header.version = SPS30_SENSOR_TABLE_VERSION + 1;
+	memcpy(v1.data(), &header, sizeof(header));
+	write_file(dir.file("log.sensors"), v1);
+	CHECK(sps30_sensor_table_load(&loaded, log.c_str()) == SPS30_SENSOR_TABLE_ERROR_VERSION);
+}
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <sps30_sketch.h>
+#include <vector>
+
+namespace
+{
+constexpr std::array<double, 10> QUANTILES = {0,	0.01, 0.1,	0.25,  0.5,
+											   0.75, 0.9, 0.95, 0.99, 1};
+
+// Weeks of a sensor at 1 Hz, compressed: a lognormal background with slow drift and
+// occasional smoke events, roughly what PM2.5 looks like
+std::vector<float> simulated_pm(size_t count, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::lognormal_distribution<double> noise(0, 0.15);
+	std::normal_distribution<double> drift(0, 0.02);
+	std::bernoulli_distribution event(0.0002);
+	std::vector<float> values(count);
+	double level = 8;
+	double plume = 0;
+
+	for(auto& v : values)
+	{
+		level = std::min(60.0, std::max(0.5, level + drift(rng)));
+		plume = event(rng) ? 400 : plume * 0.995;
+		v = static_cast<float>((level + plume) * noise(rng));
+	}
+
+	return values;
+}
+
+// The exact value of rank floor(q * (n - 1))
+float exact_quantile(std::vector<float> values, double q)
+{
+	const auto rank = static_cast<size_t>(q * static_cast<double>(values.size() - 1));
+	std::nth_element(values.begin(), values.begin() + static_cast<ptrdiff_t>(rank), values.end());
+	return values[rank];
+}
+
+bool within_accuracy(float estimate, float exact)
+{
+	// The last factor allows for rounding in log() and exp()
+	return std::fabs(estimate - exact) <= exact * SPS30_SKETCH_RELATIVE_ACCURACY * (1 + 1e-6);
+}
+} // namespace
+
+TEST_CASE("An empty sketch has no quantiles", "[test/sps30_sketch]")
+{
+	sps30_sketch sketch;
+	sps30_sketch_init(&sketch);
+
+	CHECK(sketch.count == 0);
+	CHECK(std::isnan(sps30_sketch_quantile(&sketch, 0.5)));
+	CHECK(sps30_sketch_encode(&sketch, nullptr, 0) == SPS30_SKETCH_HEADER_SIZE);
+
+	sps30_sketch_add(&sketch, NAN);
+	CHECK(sketch.count == 0);
+}
+
+TEST_CASE("Sketch quantiles are within the relative accuracy", "[test/sps30_sketch]")
+{
+	for(uint32_t seed : {1, 2, 3})
+	{
+		const std::vector<float> values = simulated_pm(200000, seed);
+		sps30_sketch sketch;
+		sps30_sketch_init(&sketch);
+		for(float v : values)
+		{
+			sps30_sketch_add(&sketch, v);
+		}
+
+		CHECK(sketch.count == values.size());
+		for(double q : QUANTILES)
+		{
+			const float exact = exact_quantile(values, q);
+			const float estimate = sps30_sketch_quantile(&sketch, q);
+			INFO("seed " << seed << " q " << q << ": " << estimate << " vs " << exact);
+			CHECK(within_accuracy(estimate, exact));
+		}
+
+		CHECK(sps30_sketch_quantile(&sketch, 0) == *std::min_element(values.begin(), values.end()));
+		CHECK(sps30_sketch_quantile(&sketch, 1) == *std::max_element(values.begin(), values.end()));
+		CHECK(std::isnan(sps30_sketch_quantile(&sketch, 1.5)));
+	}
+}
+
+TEST_CASE("Sketches cover the sensor's full range", "[test/sps30_sketch]")
+{
+	// Log-uniform across the whole layout, plus values outside it
+	std::mt19937 rng(39);
+	std::uniform_real_distribution<double> exponent(std::log(SPS30_SKETCH_MIN_VALUE),
+													std::log(SPS30_SKETCH_MAX_VALUE));
+	std::vector<float> values(100000);
+	for(auto& v : values)
+	{
+		v = static_cast<float>(std::exp(exponent(rng)));
+	}
+
+	sps30_sketch sketch;
+	sps30_sketch_init(&sketch);
+	for(float v : values)
+	{
+		sps30_sketch_add(&sketch, v);
+	}
+	CHECK(sketch.low == 0);
+	CHECK(sketch.high == SPS30_SKETCH_BUCKETS - 1);
+	for(double q : QUANTILES)
+	{
+		CHECK(within_accuracy(sps30_sketch_quantile(&sketch, q), exact_quantile(values, q)));
+	}
+
+	sps30_sketch_init(&sketch);
+	for(float v : {0.0f, -1.0f, 0.005f, 20.0f, 50000.0f})
+	{
+		sps30_sketch_add(&sketch, v);
+	}
+	CHECK(sketch.zero_count == 3);
+	CHECK(sps30_sketch_quantile(&sketch, 0) == -1.0f);
+	CHECK(sps30_sketch_quantile(&sketch, 0.25f) == 0.0f);
+	CHECK(within_accuracy(sps30_sketch_quantile(&sketch, 0.75), 20.0f));
+	CHECK(sps30_sketch_quantile(&sketch, 1) == 50000.0f);
+}
+
+TEST_CASE("Merged sketches equal the sketch of all values", "[test/sps30_sketch]")
+{
+	constexpr size_t SENSORS = 8;
+	sps30_sketch fleet;
+	sps30_sketch merged;
+	std::vector<float> all;
+	sps30_sketch_init(&fleet);
+	sps30_sketch_init(&merged);
+
+	for(size_t s = 0; s < SENSORS; s++)
+	{
+		// Sensors in different places see different levels
+		std::vector<float> values = simulated_pm(20000, static_cast<uint32_t>(100 + s));
+		for(auto& v : values)
+		{
+			v *= static_cast<float>(s + 1);
+		}
+
+		sps30_sketch sensor;
+		sps30_sketch_init(&sensor);
+		for(float v : values)
+		{
+			sps30_sketch_add(&sensor, v);
+			sps30_sketch_add(&fleet, v);
+		}
+		sps30_sketch_merge(&merged, &sensor);
+		all.insert(all.end(), values.begin(), values.end());
+	}
+
+	CHECK(merged.count == fleet.count);
+	CHECK(merged.zero_count == fleet.zero_count);
+	CHECK(merged.min == fleet.min);
+	CHECK(merged.max == fleet.max);
+	CHECK(merged.low == fleet.low);
+	CHECK(merged.high == fleet.high);
+	CHECK(std::equal(std::begin(merged.buckets), std::end(merged.buckets),
+					 std::begin(fleet.buckets)));
+	for(double q : QUANTILES)
+	{
+		CHECK(within_accuracy(sps30_sketch_quantile(&merged, q), exact_quantile(all, q)));
+	}
+
+	// Merging a sketch into itself doubles every count
+	sps30_sketch_merge(&merged, &merged);
+	CHECK(merged.count == 2 * fleet.count);
+	CHECK(merged.buckets[fleet.high] == 2 * fleet.buckets[fleet.high]);
+	CHECK(sps30_sketch_quantile(&merged, 0.5) == sps30_sketch_quantile(&fleet, 0.5));
+}
+
+TEST_CASE("Sketches round-trip through their encoding", "[test/sps30_sketch]")
+{
+	std::array<sps30_sketch, SPS30_RECORD_FIELD_COUNT> sketches;
+	for(auto& s : sketches)
+	{
+		sps30_sketch_init(&s);
+	}
+	const std::vector<float> values = simulated_pm(5000, 9);
+	for(float v : values)
+	{
+		std::array<float, SPS30_RECORD_FIELD_COUNT> fields;
+		for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+		{
+			fields[f] = v * static_cast<float>(f + 1);
+		}
+		sps30_sketch_add_fields(sketches.data(), fields.data());
+	}
+
+	// Every field back to back, as a gateway would receive them from one sensor
+	std::vector<uint8_t> encoded;
+	for(const auto& s : sketches)
+	{
+		const size_t size = sps30_sketch_encode(&s, nullptr, 0);
+		CHECK(size <= SPS30_SKETCH_MAX_ENCODED_SIZE);
+		encoded.resize(encoded.size() + size);
+		CHECK(sps30_sketch_encode(&s, &encoded[encoded.size() - size], size) == size);
+	}
+	CHECK(encoded.size() < SPS30_RECORD_FIELD_COUNT * sizeof(sps30_sketch) / 2);
+
+	size_t offset = 0;
+	for(const auto& expected : sketches)
+	{
+		sps30_sketch decoded;
+		size_t used = 0;
+		REQUIRE(sps30_sketch_decode(&encoded[offset], encoded.size() - offset, &decoded, &used) ==
+				0);
+		CHECK(decoded.count == expected.count);
+		CHECK(decoded.min == expected.min);
+		CHECK(decoded.max == expected.max);
+		CHECK(decoded.low == expected.low);
+		CHECK(decoded.high == expected.high);
+		CHECK(std::equal(std::begin(decoded.buckets), std::end(decoded.buckets),
+						 std::begin(expected.buckets)));
+		offset += used;
+	}
+	CHECK(offset == encoded.size());
+
+	sps30_sketch decoded;
+	const size_t first = sps30_sketch_encode(&sketches[0], nullptr, 0);
+	CHECK(sps30_sketch_decode(encoded.data(), first - 1, &decoded, nullptr) ==
+		  SPS30_SKETCH_ERROR_TRUNCATED);
+	CHECK(sps30_sketch_decode(encoded.data(), 10, &decoded, nullptr) ==
+		  SPS30_SKETCH_ERROR_TRUNCATED);
+
+	std::vector<uint8_t> damaged(encoded.begin(), encoded.begin() + static_cast<ptrdiff_t>(first));
+	damaged[28] = 0xff;
+	damaged[29] = 0x02;
+	CHECK(sps30_sketch_decode(damaged.data(), damaged.size(), &decoded, nullptr) ==
+		  SPS30_SKETCH_ERROR_CORRUPT);
+	damaged[0] ^= 1;
+	CHECK(sps30_sketch_decode(damaged.data(), damaged.size(), &decoded, nullptr) ==
+		  SPS30_SKETCH_ERROR_VERSION);
+}
+
+TEST_CASE("Benchmark sketches", "[.][benchmark][test/sps30_sketch]")
+{
+	constexpr size_t COUNT = 4000000;
+	const std::vector<float> values = simulated_pm(COUNT, 5);
+	sps30_sketch sketch;
+	sps30_sketch_init(&sketch);
+
+	auto start = std::chrono::steady_clock::now();
+	for(float v : values)
+	{
+		sps30_sketch_add(&sketch, v);
+	}
+	std::array<float, 3> estimates;
+	for(size_t i = 0; i < estimates.size(); i++)
+	{
+		estimates[i] = sps30_sketch_quantile(&sketch, std::array<double, 3>{0.5, 0.95, 0.99}[i]);
+	}
+	const auto sketched = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+	start = std::chrono::steady_clock::now();
+	std::vector<float> sorted(values);
+	std::sort(sorted.begin(), sorted.end());
+	const auto exact = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+	printf("sketch: %.1f M values/s, %zu bytes; exact sort: %.1f M values/s, %zu bytes\n",
+		   COUNT / sketched.count() / 1e6, sizeof(sketch), COUNT / exact.count() / 1e6,
+		   COUNT * sizeof(float));
+	const char* names[] = {"p50", "p95", "p99"};
+	const double qs[] = {0.5, 0.95, 0.99};
+	for(size_t i = 0; i < estimates.size(); i++)
+	{
+		const float truth = sorted[static_cast<size_t>(qs[i] * (COUNT - 1))];
+		printf("\t%s: sketch %8.3f, exact %8.3f, error %.3f%%\n", names[i],
+			   static_cast<double>(estimates[i]), static_cast<double>(truth),
+			   std::fabs(estimates[i] - truth) / truth * 100);
+	}
+
+	// A gateway merging a fleet's sketches
+	std::vector<sps30_sketch> fleet(1000, sketch);
+	sps30_sketch merged;
+	sps30_sketch_init(&merged);
+	start = std::chrono::steady_clock::now();
+	for(const auto& s : fleet)
+	{
+		sps30_sketch_merge(&merged, &s);
+	}
+	const auto merging = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+	printf("merge: %.2f us per sketch (p99 %.3f)\n", merging.count() / fleet.size() * 1e6,
+		   static_cast<double>(sps30_sketch_quantile(&merged, 0.99)));
+}
@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <sps30_tick_stats.h>
+#include <vector>
+
+using Catch::Matchers::WithinAbs;
+using Catch::Matchers::WithinRel;
+
+namespace
+{
+struct tick_t
+{
+	explicit tick_t(size_t count) : storage(SPS30_RECORD_FIELD_COUNT * count), valid(count)
+	{
+		for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+		{
+			columns[f] = &storage[f * count];
+		}
+	}
+
+	std::vector<float> storage;
+	std::array<float*, SPS30_RECORD_FIELD_COUNT> columns{};
+	std::vector<uint8_t> valid;
+};
+
+// Sensor-like values: mass concentrations near 10-30, the number concentrations larger
+tick_t make_tick(size_t count, uint32_t seed, double invalid_fraction)
+{
+	std::mt19937 generator(seed);
+	std::lognormal_distribution<float> value(2.5f, 0.6f);
+	std::bernoulli_distribution invalid(invalid_fraction);
+	tick_t tick(count);
+
+	for(size_t i = 0; i < count; i++)
+	{
+		for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+		{
+			tick.columns[f][i] = value(generator) * static_cast<float>(f < 4 ? 1 : 4);
+		}
+		tick.valid[i] = invalid(generator) ? 0 : 1;
+	}
+
+	return tick;
+}
+
+struct reference_t
+{
+	sps30_tick_field_stats stats{};
+	std::vector<uint64_t> mask;
+};
+
+// Long-hand, in double precision
+reference_t reference(const float* column, const uint8_t* valid, size_t count, float threshold)
+{
+	reference_t r;
+	double sum = 0;
+	r.mask.assign(SPS30_TICK_MASK_WORDS(count), 0);
+	r.stats.min = INFINITY;
+	r.stats.max = -INFINITY;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		if(valid && !valid[i])
+		{
+			continue;
+		}
+		r.stats.count++;
+		r.stats.min = std::min(r.stats.min, column[i]);
+		r.stats.max = std::max(r.stats.max, column[i]);
+		sum += column[i];
+		if(column[i] > threshold)
+		{
+			r.stats.exceedances++;
+			r.mask[i / 64] |= 1ull << (i % 64);
+		}
+	}
+
+	if(r.stats.count == 0)
+	{
+		r.stats = sps30_tick_field_stats{};
+		return r;
+	}
+
+	r.stats.mean = sum / r.stats.count;
+	for(size_t i = 0; i < count; i++)
+	{
+		if(!valid || valid[i])
+		{
+			r.stats.variance += (column[i] - r.stats.mean) * (column[i] - r.stats.mean);
+		}
+	}
+	r.stats.variance /= r.stats.count;
+
+	return r;
+}
+
+void check_stats(const sps30_tick_field_stats& actual, const reference_t& expected)
+{
+	CHECK(actual.count == expected.stats.count);
+	CHECK(actual.exceedances == expected.stats.exceedances);
+	CHECK(actual.min == expected.stats.min);
+	CHECK(actual.max == expected.stats.max);
+	CHECK_THAT(actual.mean, WithinRel(expected.stats.mean, 1e-12));
+	CHECK_THAT(actual.variance, WithinRel(expected.stats.variance, 1e-9));
+}
+} // namespace
+
+TEST_CASE("Tick statistics match a long-hand computation", "[test/sps30_tick_stats]")
+{
+	// Every remainder of the vector width, and a dashboard-sized fleet
+	for(size_t count : {0, 1, 3, 7, 8, 9, 17, 63, 64, 65, 130, 1000})
+	{
+		const tick_t tick = make_tick(count, static_cast<uint32_t>(count), 0.1);
+		const std::array<float, SPS30_RECORD_FIELD_COUNT> thresholds = {
+			12, 25, 30, INFINITY, 50, 60, -1, 70, 80, 20};
+
+		for(const uint8_t* valid : {static_cast<const uint8_t*>(nullptr), tick.valid.data()})
+		{
+			std::vector<uint64_t> masks(SPS30_RECORD_FIELD_COUNT * SPS30_TICK_MASK_WORDS(count),
+										~0ull);
+			std::array<sps30_tick_field_stats, SPS30_RECORD_FIELD_COUNT> stats;
+			sps30_tick_stats(tick.columns.data(), valid, count, thresholds.data(), masks.data(),
+							 stats.data());
+
+			for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+			{
+				const reference_t expected =
+					reference(tick.columns[f], valid, count, thresholds[f]);
+				check_stats(stats[f], expected);
+				CHECK(std::equal(expected.mask.begin(), expected.mask.end(),
+								 masks.begin() + f * SPS30_TICK_MASK_WORDS(count)));
+
+				sps30_tick_field_stats scalar;
+				std::vector<uint64_t> scalar_mask(SPS30_TICK_MASK_WORDS(count));
+				sps30_tick_column_stats_scalar(tick.columns[f], valid, count, thresholds[f],
+											   scalar_mask.data(), &scalar);
+				check_stats(scalar, expected);
+				CHECK(scalar_mask == expected.mask);
+			}
+		}
+	}
+}
+
+TEST_CASE("Tick statistics are zero without valid values", "[test/sps30_tick_stats]")
+{
+	tick_t tick = make_tick(20, 1, 0);
+	std::fill(tick.valid.begin(), tick.valid.end(), 0);
+	sps30_tick_field_stats stats;
+	uint64_t mask = ~0ull;
+
+	sps30_tick_column_stats(tick.columns[0], tick.valid.data(), 20, 0, &mask, &stats);
+	CHECK(stats.count == 0);
+	CHECK(stats.exceedances == 0);
+	CHECK(stats.min == 0);
+	CHECK(stats.max == 0);
+	CHECK(stats.mean == 0);
+	CHECK(stats.variance == 0);
+	CHECK(mask == 0);
+}
+
+TEST_CASE("Tick variance does not lose precision to large offsets", "[test/sps30_tick_stats]")
+{
+	// A one-pass sum of squares in single precision cancels catastrophically here
+	std::vector<float> column(1000);
+	for(size_t i = 0; i < column.size(); i++)
+	{
+		column[i] = 3000.0f + ((i % 2) ? 0.5f : -0.5f);
+	}
+
+	sps30_tick_field_stats stats;
+	sps30_tick_column_stats(column.data(), nullptr, column.size(), INFINITY, nullptr, &stats);
+	CHECK_THAT(stats.mean, WithinAbs(3000.0, 1e-9));
+	CHECK_THAT(stats.variance, WithinAbs(0.25, 1e-9));
+}
+
+TEST_CASE("Benchmark tick statistics", "[.][benchmark][test/sps30_tick_stats]")
+{
+	constexpr size_t TOTAL_VALUES = 1 << 26;
+	const std::array<float, SPS30_RECORD_FIELD_COUNT> thresholds = {
+		12, 25, 30, 45, 50, 60, 70, 70, 80, 20};
+
+	for(size_t count : {16, 64, 256, 1000, 4096})
+	{
+		const tick_t tick = make_tick(count, 7, 0.01);
+		std::vector<uint64_t> masks(SPS30_RECORD_FIELD_COUNT * SPS30_TICK_MASK_WORDS(count));
+		std::array<sps30_tick_field_stats, SPS30_RECORD_FIELD_COUNT> stats;
+		const size_t rounds = TOTAL_VALUES / (count * SPS30_RECORD_FIELD_COUNT);
+		double checksum = 0;
+
+		auto start = std::chrono::steady_clock::now();
+		for(size_t r = 0; r < rounds; r++)
+		{
+			for(unsigned f = 0; f < SPS30_RECORD_FIELD_COUNT; f++)
+			{
+				sps30_tick_column_stats_scalar(tick.columns[f], tick.valid.data(), count,
+											   thresholds[f],
+											   &masks[f * SPS30_TICK_MASK_WORDS(count)],
+											   &stats[f]);
+			}
+			checksum += stats[1].mean;
+		}
+		const auto scalar = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+		start = std::chrono::steady_clock::now();
+		for(size_t r = 0; r < rounds; r++)
+		{
+			sps30_tick_stats(tick.columns.data(), tick.valid.data(), count, thresholds.data(),
+							 masks.data(), stats.data());
+			checksum += stats[1].mean;
+		}
+		const auto vector = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+		printf("tick stats %4zu sensors: scalar %7.2f us/tick, vector %7.2f us/tick (%.1f)\n",
+			   count, scalar.count() / static_cast<double>(rounds) * 1e6,
+			   vector.count() / static_cast<double>(rounds) * 1e6, checksum);
+	}
+}
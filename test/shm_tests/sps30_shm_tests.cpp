@@ -0,0 +1,94 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdio>
+#include <sps30_shm_client.hpp>
+#include <sps30_shm_publisher.hpp>
+#include <string>
+#include <unistd.h>
+
+namespace
+{
+std::string segment_name(const char* test)
+{
+	return std::string("/sps30_test_") + test + "_" + std::to_string(getpid());
+}
+
+sps30::sensor::sample_t make_sample(float value)
+{
+	sps30::sensor::sample_t sample = {};
+	sample.measurement.mc_2p5 = value;
+	sample.measurement.nc_10p0 = value * 10;
+	sample.timestamp = std::chrono::steady_clock::now();
+	return sample;
+}
+} // namespace
+
+TEST_CASE("Client cannot attach without a publisher", "[test/sps30_shm]")
+{
+	auto name = segment_name("missing");
+	sps30::shm::client c(name.c_str());
+
+	CHECK_FALSE(c.attach());
+}
+
+TEST_CASE("Client reads records published by another mapping", "[test/sps30_shm]")
+{
+	auto name = segment_name("publish");
+	sps30::shm::publisher p(name.c_str(), 4);
+	REQUIRE(p.open());
+
+	sps30::shm::client c(name.c_str());
+	REQUIRE(c.attach());
+	CHECK(c.slotCount() == 4);
+
+	// Nothing published yet
+	CHECK(c.read(0).sequence == 0);
+	CHECK(c.sequence(3) == 0);
+
+	auto sample = make_sample(12.5f);
+	p.publish(2, sample, 0x10);
+
+	auto record = c.read(2);
+	CHECK(record.sequence == 1);
+	CHECK(record.measurement.mc_2p5 == 12.5f);
+	CHECK(record.measurement.nc_10p0 == 125.0f);
+	CHECK(record.status_flags == 0x10);
+	CHECK(record.timestamp_ns == std::chrono::duration_cast<std::chrono::nanoseconds>(
+									 sample.timestamp.time_since_epoch())
+									 .count());
+
+	p.publish(2, make_sample(13.0f));
+	CHECK(c.sequence(2) == 2);
+	CHECK(c.read(2).measurement.mc_2p5 == 13.0f);
+
+	// Other slots are untouched
+	CHECK(c.read(1).sequence == 0);
+}
+
+TEST_CASE("Benchmark shared-memory client reads", "[.][benchmark][test/sps30_shm]")
+{
+	constexpr size_t SLOTS = 64;
+	constexpr size_t ITERATIONS = 10000000;
+
+	auto name = segment_name("bench");
+	sps30::shm::publisher p(name.c_str(), SLOTS);
+	REQUIRE(p.open());
+	sps30::shm::client c(name.c_str());
+	REQUIRE(c.attach());
+
+	for(size_t i = 0; i < SLOTS; i++)
+	{
+		p.publish(i, make_sample(static_cast<float>(i)));
+	}
+
+	float sum = 0;
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < ITERATIONS; i++)
+	{
+		sum += c.read(i % SLOTS).measurement.mc_2p5;
+	}
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+	printf("shm client: %.1f ns/read (checksum %f)\n", elapsed.count() * 1e9 / ITERATIONS,
+		   static_cast<double>(sum));
+}
@@ -256,3 +256,9 @@ void sensirion_sleep_usec(uint32_t useconds)
 	// For the test code, we're just going to use the OS's functionality.
 	usleep(useconds);
 }
+
+// Each message is checked against the queued expectations like a separate transfer
+int16_t sensirion_i2c_transfer(const struct sensirion_i2c_msg* msgs, uint16_t count)
+{
+	return sensirion_i2c_transfer_sequential(msgs, count);
+}
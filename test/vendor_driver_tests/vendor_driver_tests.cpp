@@ -1,9 +1,11 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 #include <sps30.h>
+#include <sps30_commands.h>
 #include <sps30_recorded_data.h>
 #include "vendor_driver_mock.hpp"
 #include <cstdio>
+#include <cstring>
 
 TEST_CASE("SPS-30 I2C Setup/Teardown", "[test/vendor_sps30]")
 {
@@ -133,6 +135,50 @@ TEST_CASE("SPS-30 I2C Interactions", "[test/vendor_sps30]")
 						   sizeof(sps30_serial_number_response_string)));
 	}
 
+	SECTION("SPS-30 Read Device Info")
+	{
+		struct sps30_device_info info;
+
+		// The whole sequence is submitted as one transfer, in this order
+		sps30_mock_set_i2c_write_data(sps30_wakeup_command, sizeof(sps30_wakeup_command));
+		sps30_mock_set_i2c_write_data(sps30_wakeup_command, sizeof(sps30_wakeup_command));
+		sps30_mock_set_i2c_write_data(sps30_request_serial_number,
+									  sizeof(sps30_request_serial_number));
+		sps30_mock_set_i2c_read_data(sps30_serial_number_response,
+									 sizeof(sps30_serial_number_response));
+		sps30_mock_set_i2c_write_data(sps30_request_fw_ver, sizeof(sps30_request_fw_ver));
+		sps30_mock_set_i2c_read_data(sps30_fw_ver_response, sizeof(sps30_fw_ver_response));
+		sps30_mock_set_i2c_write_data(sps30_request_fan_auto_cleaning_interval,
+									  sizeof(sps30_request_fan_auto_cleaning_interval));
+		sps30_mock_set_i2c_read_data(sps30_fan_auto_cleaning_interval_response_1,
+									 sizeof(sps30_fan_auto_cleaning_interval_response_1));
+
+		auto r = sps30_read_device_info(&info);
+		CHECK(r == 0);
+		CHECK(0 == strncmp(info.serial, sps30_serial_number_response_string,
+						   sizeof(sps30_serial_number_response_string)));
+		CHECK(info.firmware_major == SPS30_FW_VER_RESPONSE_MAJOR);
+		CHECK(info.firmware_minor == SPS30_FW_VER_RESPONSE_MINOR);
+		CHECK(info.autoclean_interval_seconds == 172800);
+	}
+
+	SECTION("SPS-30 Reconfigure Fan Auto-Cleaning Interval")
+	{
+		uint32_t reported = 0;
+
+		sps30_mock_set_i2c_write_data(sps30_set_fan_auto_cleaning_interval_2,
+									  sizeof(sps30_set_fan_auto_cleaning_interval_2));
+		sps30_mock_set_i2c_write_data(sps30_reset_command, sizeof(sps30_reset_command));
+		sps30_mock_set_i2c_write_data(sps30_request_fan_auto_cleaning_interval,
+									  sizeof(sps30_request_fan_auto_cleaning_interval));
+		sps30_mock_set_i2c_read_data(sps30_fan_auto_cleaning_interval_response_1,
+									 sizeof(sps30_fan_auto_cleaning_interval_response_1));
+
+		auto r = sps30_reconfigure_fan_auto_cleaning_interval(172800, &reported);
+		CHECK(r == 0);
+		CHECK(reported == 172800);
+	}
+
 	SECTION("SPS-30 Set Fan Auto-Cleaning Interval")
 	{
 		// We set the expected TX data that the driver should send over
@@ -379,3 +425,31 @@ TEST_CASE("SPS-30 I2C Interactions", "[test/vendor_sps30]")
 				   Catch::Matchers::WithinULP(1.6299999952316284f, 0));
 	}
 }
+
+TEST_CASE("SPS-30 constant command frames", "[test/vendor_sps30]")
+{
+	for(uint32_t word = 0; word <= 0xffff; word++)
+	{
+		const uint8_t bytes[2] = {static_cast<uint8_t>(word >> 8), static_cast<uint8_t>(word)};
+		if(SPS30_CRC8(word) != sensirion_common_generate_crc(bytes, 2))
+		{
+			FAIL("SPS30_CRC8() differs from the CRC for word " << word);
+		}
+	}
+
+	CHECK(memcmp(sps30_frame_start_measurement, sps30_request_start_measurement,
+				 sizeof(sps30_request_start_measurement)) == 0);
+	CHECK(memcmp(sps30_frame_stop_measurement, sps30_request_stop_measurement,
+				 sizeof(sps30_request_stop_measurement)) == 0);
+	CHECK(memcmp(sps30_frame_read_measurement, sps30_read_measurement_command,
+				 sizeof(sps30_read_measurement_command)) == 0);
+	CHECK(memcmp(sps30_frame_get_data_ready, sps30_request_data_ready,
+				 sizeof(sps30_request_data_ready)) == 0);
+	CHECK(memcmp(sps30_frame_reset, sps30_reset_command, sizeof(sps30_reset_command)) == 0);
+	CHECK(memcmp(sps30_frame_sleep, sps30_sleep_command, sizeof(sps30_sleep_command)) == 0);
+	CHECK(memcmp(sps30_frame_wake_up, sps30_wakeup_command, sizeof(sps30_wakeup_command)) == 0);
+	CHECK(memcmp(sps30_frame_read_device_status_reg, sps30_request_device_status,
+				 sizeof(sps30_request_device_status)) == 0);
+	CHECK(sps30_frame_start_measurement_uint16[2] == 0x05);
+	CHECK(sps30_frame_start_measurement_uint16[4] == 0xf6);
+}